@@ -19,20 +19,127 @@
 
 using namespace std;
 
-static std::string _GameMap_errStr;
-
 /*
 Private functions
 */
-static std::string _getDir(const char* path); //Extract file dir from path
 static std::vector<json11::Json> _getLayers(const json11::Json* map);
-static int _loadMapLayers(const json11::Json* jsonMap, GameMap_t* map);
+static int _loadMapLayers(const std::vector<json11::Json>& jsonLayers, GameMap_t* map);
+static int _loadLayerChunks(const json11::Json& jsonLayer, GMapTilelayer_t* layer, std::string& err);
+static void _decodeTask(void* arg, int index);
+static void _packTask(void* arg, int index);
 static void _freeMapLayers(GameMap_t *map);
-static int _loadMapTilesets(const json11::Json* jsonMap, GameMap_t* map , const char* baseDir);
 static void _freeMapTilesets(GameMap_t* map);
 static void _printTilemapData(const unsigned int* data, int w, int h);
 static int _findLayer(const GameMap_t* map, const char* layerName); //return -1 if layer not found
 
+#define _DECODE_BLOCK_TILES (1 << 16)   //Tiles of CSV layers converted by one task
+#define _DECODE_PARALLEL_MIN (1 << 15)  //Maps with fewer tiles are decoded on the loading thread
+
+//Decoding of the tile data of all layers, on the worker threads: one task
+//per base64 or infinite layer, one per block of tiles of CSV layers, then
+//one per layer to pack it
+typedef struct {
+  int layer;
+  size_t first;     //CSV layers: first tile of the block
+  size_t num;       //CSV layers: tiles of the block, 0: whole layer
+} _DecodeTask_t;
+
+typedef struct {
+  const std::vector<json11::Json>* jsonLayers;
+  GameMap_t* map;
+  std::vector<_DecodeTask_t> tasks;
+  std::vector<int> packs;         //Layers packed once decoded
+  std::vector<std::string> errs;  //Decoding error of each layer, "": none
+} _DecodeJob_t;
+
+/*
+Pre-hashed JSON keys, for lookups repeated per layer and per tileset
+*/
+static const json11::Json::Key _KEY_CHUNKS("chunks");
+static const json11::Json::Key _KEY_COMPRESSION("compression");
+static const json11::Json::Key _KEY_DATA("data");
+static const json11::Json::Key _KEY_ENCODING("encoding");
+static const json11::Json::Key _KEY_FIRSTGID("firstgid");
+static const json11::Json::Key _KEY_HEIGHT("height");
+static const json11::Json::Key _KEY_IMAGE("image");
+static const json11::Json::Key _KEY_IMAGEHEIGHT("imageheight");
+static const json11::Json::Key _KEY_IMAGEWIDTH("imagewidth");
+static const json11::Json::Key _KEY_LAYERS("layers");
+static const json11::Json::Key _KEY_NAME("name");
+static const json11::Json::Key _KEY_OFFSETX("offsetx");
+static const json11::Json::Key _KEY_OFFSETY("offsety");
+static const json11::Json::Key _KEY_OPACITY("opacity");
+static const json11::Json::Key _KEY_SOURCE("source");
+static const json11::Json::Key _KEY_STARTX("startx");
+static const json11::Json::Key _KEY_STARTY("starty");
+static const json11::Json::Key _KEY_TILECOUNT("tilecount");
+static const json11::Json::Key _KEY_TILEHEIGHT("tileheight");
+static const json11::Json::Key _KEY_TILESETS("tilesets");
+static const json11::Json::Key _KEY_TILEWIDTH("tilewidth");
+static const json11::Json::Key _KEY_TYPE("type");
+static const json11::Json::Key _KEY_VISIBLE("visible");
+static const json11::Json::Key _KEY_WIDTH("width");
+static const json11::Json::Key _KEY_X("x");
+static const json11::Json::Key _KEY_Y("y");
+
+/*
+JSON shape checks, compiled once
+*/
+static const int _MAP_SIZE_MAX = 1 << 15; //Max map width or height in tiles
+static const json11::JsonSchema _mapSchema = json11::JsonSchema()
+  .field("width", json11::Json::NUMBER).range(0, _MAP_SIZE_MAX)
+  .field("height", json11::Json::NUMBER).range(0, _MAP_SIZE_MAX)
+  .field("tilewidth", json11::Json::NUMBER).range(1, _MAP_SIZE_MAX)
+  .field("tileheight", json11::Json::NUMBER).range(1, _MAP_SIZE_MAX)
+  .field("layers", json11::Json::ARRAY)
+  .field("tilesets", json11::Json::ARRAY, false);
+static const int _CHUNK_COORD_MAX = 1 << 28; //Max infinite layer tile coordinate (either sign)
+static const json11::JsonSchema _layerSchema = json11::JsonSchema()
+  .field("name", json11::Json::STRING)
+  .field("offsetx", json11::Json::NUMBER, false)
+  .field("offsety", json11::Json::NUMBER, false)
+  .field("opacity", json11::Json::NUMBER, false).range(0, 1)
+  .field("visible", json11::Json::BOOL, false)
+  .field("encoding", json11::Json::STRING, false)
+  .field("compression", json11::Json::STRING, false);
+const json11::JsonSchema _GameMap_tileLayerHeaderSchema = json11::JsonSchema(_layerSchema)
+  .field("width", json11::Json::NUMBER).range(0, _MAP_SIZE_MAX)
+  .field("height", json11::Json::NUMBER).range(0, _MAP_SIZE_MAX);
+static const json11::JsonSchema _tileLayerSchema = json11::JsonSchema(_GameMap_tileLayerHeaderSchema)
+  .field("data", json11::Json::ARRAY)
+  .size_product("data", "width", "height");
+static const json11::JsonSchema _base64LayerSchema = json11::JsonSchema(_GameMap_tileLayerHeaderSchema)
+  .field("data", json11::Json::STRING);
+const json11::JsonSchema _GameMap_chunkedLayerSchema = json11::JsonSchema(_layerSchema)
+  .field("width", json11::Json::NUMBER).range(0, _CHUNK_COORD_MAX)
+  .field("height", json11::Json::NUMBER).range(0, _CHUNK_COORD_MAX)
+  .field("startx", json11::Json::NUMBER, false).range(-_CHUNK_COORD_MAX, _CHUNK_COORD_MAX)
+  .field("starty", json11::Json::NUMBER, false).range(-_CHUNK_COORD_MAX, _CHUNK_COORD_MAX)
+  .field("chunks", json11::Json::ARRAY);
+const json11::JsonSchema _GameMap_chunkHeaderSchema = json11::JsonSchema()
+  .field("x", json11::Json::NUMBER).range(-_CHUNK_COORD_MAX, _CHUNK_COORD_MAX)
+  .field("y", json11::Json::NUMBER).range(-_CHUNK_COORD_MAX, _CHUNK_COORD_MAX)
+  .field("width", json11::Json::NUMBER).range(0, _MAP_SIZE_MAX)
+  .field("height", json11::Json::NUMBER).range(0, _MAP_SIZE_MAX);
+static const json11::JsonSchema _chunkSchema = json11::JsonSchema(_GameMap_chunkHeaderSchema)
+  .field("data", json11::Json::ARRAY)
+  .size_product("data", "width", "height");
+static const json11::JsonSchema _base64ChunkSchema = json11::JsonSchema(_GameMap_chunkHeaderSchema)
+  .field("data", json11::Json::STRING);
+static const json11::JsonSchema _tilesetFileSchema = json11::JsonSchema()
+  .field("name", json11::Json::STRING)
+  .field("image", json11::Json::STRING)
+  .field("tilecount", json11::Json::NUMBER).range(0, 0x1FFFFFFF)
+  .field("tilewidth", json11::Json::NUMBER).range(1, _MAP_SIZE_MAX)
+  .field("tileheight", json11::Json::NUMBER).range(1, _MAP_SIZE_MAX)
+  .field("imagewidth", json11::Json::NUMBER).range(1, _MAP_SIZE_MAX)
+  .field("imageheight", json11::Json::NUMBER).range(1, _MAP_SIZE_MAX);
+static const json11::JsonSchema _tilesetSchema = json11::JsonSchema(_tilesetFileSchema)
+  .field("firstgid", json11::Json::NUMBER).range(1, 0x1FFFFFFF);
+static const json11::JsonSchema _externalTilesetSchema = json11::JsonSchema()
+  .field("firstgid", json11::Json::NUMBER).range(1, 0x1FFFFFFF)
+  .field("source", json11::Json::STRING);
+
 /*******************************************************************************/
 /**
  * Load game map from Tiled JSON file
@@ -59,11 +166,13 @@ GameMap_t *GameMap_loadFromTiledJSON(const char *path)
     _GameMap_appendToErrStr("\"\n");
     return nullptr;
   }
+  _GameMap_addFileBytes(ss.str().size());
 
   //parse json string
   std::string errmsg;
   json11::Json jsonMap;
-  jsonMap = json11::Json::parse(  ss.str() , errmsg );
+  //(tile GIDs are parsed straight to integers, without strtod)
+  jsonMap = json11::Json::parse(  ss.str() , errmsg , json11::JsonParse::RAW_NUMBERS );
 
   //check parsing errors
   if( errmsg.size() != 0){
@@ -72,22 +181,18 @@ GameMap_t *GameMap_loadFromTiledJSON(const char *path)
   }
 
   //allocate map
-  map = (GameMap_t*)calloc(1, sizeof(GameMap_t));
-  if (map == nullptr || path == nullptr) {
+  map = _GameMap_newFromJSON(jsonMap, path);
+  if (map == nullptr) {
     return nullptr;
   }
-  map->byteSize += sizeof(GameMap_t);
-
-  //fill struct with jsonMap data
-  map->width = jsonMap["width"].int_value();
-  map->height = jsonMap["height"].int_value();
-  map->tileheight = jsonMap["tileheight"].int_value();
-  map->tilewidth = jsonMap["tilewidth"].int_value();
 
-  std::string mapDir = _getDir(path);
+  std::string mapDir = _GameMap_getDir(path);
+  std::vector<json11::Json> _jsonLayers = _getLayers(&jsonMap);
+  std::vector<json11::Json> _jsonTilesets;
   int rc = 0; //return code
-  if (rc == 0) rc = _loadMapLayers(&jsonMap, map);
-  if (rc == 0) rc = _loadMapTilesets(&jsonMap, map , mapDir.c_str());
+  if (rc == 0) rc = _loadMapLayers(_jsonLayers, map);
+  if (rc == 0) rc = _GameMap_loadMapTilesets(&jsonMap, map , mapDir.c_str(), &_jsonTilesets);
+  if (rc == 0) rc = _GameMap_loadProperties(map, jsonMap, _jsonLayers, _jsonTilesets);
   if (rc == 0) rc = ReloadGameMapGraphs(map);
 
   if (rc != 0) {
@@ -98,6 +203,37 @@ GameMap_t *GameMap_loadFromTiledJSON(const char *path)
   return map;
 }
 
+/*******************************************************************************/
+/**
+ * Check map fields and allocate a new map with them
+ * (layers and tilesets are loaded by the caller)
+ *
+ * @return nullptr : map error
+ */
+GameMap_t* _GameMap_newFromJSON(const json11::Json& jsonMap, const char* path)
+{
+  //check map shape
+  std::string errmsg;
+  if (false == _mapSchema.validate(jsonMap, errmsg)) {
+    _GameMap_appendToErrStr(path + (std::string)"\nMap Error:" + errmsg + "\n");
+    return nullptr;
+  }
+
+  //allocate map
+  GameMap_t* map = (GameMap_t*)calloc(1, sizeof(GameMap_t));
+  if (map == nullptr) {
+    return nullptr;
+  }
+  map->byteSize += sizeof(GameMap_t);
+
+  //fill struct with jsonMap data
+  map->width = jsonMap[_KEY_WIDTH].int_value();
+  map->height = jsonMap[_KEY_HEIGHT].int_value();
+  map->tileheight = jsonMap[_KEY_TILEHEIGHT].int_value();
+  map->tilewidth = jsonMap[_KEY_TILEWIDTH].int_value();
+  return map;
+}
+
 /*******************************************************************************/
 void GameMap_free(GameMap_t *map)
 {
@@ -106,6 +242,9 @@ void GameMap_free(GameMap_t *map)
   DeleteGameMapGraphs(map);
   _freeMapLayers(map);
   _freeMapTilesets(map);
+  _GameMap_freeObjects(map->objects);
+  _GameMap_freeProperties(map->properties);
+  _GameMap_closeMapping(map->mapping);
   free(map);
   return;
 }
@@ -122,11 +261,22 @@ unsigned int GameMap_getTileId(const GameMap_t* map, int layerId, int tx, int ty
   int l = layerId;
   if (l < 0 || l >= map->layersNum) return 0;
 
+  //Infinite map layer, tiles can be anywhere
+  if (map->layers[l].chunks != nullptr)
+    return _GID_MASK & _GameMap_getChunkTile(map->layers[l].chunks, tx, ty);
   //Check for tx,ty out of map
   if (tx < 0 || ty < 0 || tx >= map->layers[l].width || ty >= map->layers[l].height)
     return 0;
   //Return tile GID
-  return _GID_MASK & map->layers[l].data[ty * map->layers[l].width + tx];
+  return _GID_MASK & _GameMap_denseTile(&map->layers[l], tx, ty);
+}
+
+/*******************************************************************************/
+int GameMap_getLayerId(const GameMap_t* map, const char* layerName)
+{
+  if (map == nullptr || layerName == nullptr)
+    return -1;
+  return _findLayer(map, layerName);
 }
 
 /*******************************************************************************/
@@ -140,7 +290,7 @@ static int _findLayer(const GameMap_t* map, const char* layerName)
   //Search layer
   int l = 0;
   for (l = 0; l < map->layersNum; l++)
-    if (_nameHash = map->layers[l].nameHash) break;
+    if (_nameHash == map->layers[l].nameHash) break;
   if (l == map->layersNum) l = -1; //Layer not found
   return l;
 }
@@ -148,9 +298,9 @@ static int _findLayer(const GameMap_t* map, const char* layerName)
 
 /*******************************************************************************/
 /**
-*
+* Extract file dir from path
 */
-static std::string _getDir(const char* path)
+std::string _GameMap_getDir(const char* path)
 {
   std::string dir = path;
   std::size_t last = dir.find_last_of("\\/");
@@ -175,8 +325,8 @@ static void _getLayers(const json11::Json * layer,
 {
   /*Recursion base case:*/
   /*layer is NOT a group, ADD layer pointer to list and RETURN*/
-  if (true == (*layer)["layers"].is_null()
-    && "group" != (*layer)["type"].string_value()) {
+  if (true == (*layer)[_KEY_LAYERS].is_null()
+    && "group" != (*layer)[_KEY_TYPE].string_value()) {
     layerList->push_back(*layer);
     return;
   }
@@ -188,7 +338,7 @@ static void _getLayers(const json11::Json * layer,
   /*Recursion General case:*/
   /*layer is a group, go down a level*/
   json11::Json::array _layersArray;
-  _layersArray = (*layer)["layers"].array_items();
+  _layersArray = (*layer)[_KEY_LAYERS].array_items();
   for (int i = 0; i != _layersArray.size(); i++)
     _getLayers(&_layersArray[i], layerList, depth + 1);
 
@@ -209,81 +359,267 @@ static std::vector<json11::Json> _getLayers(const json11::Json* map)
 /*******************************************************************************/
 /**
  * Load layers data from json11::Json to GameMap_t
+ * Layers are checked in order and their tile buffers allocated, then their
+ * tile data is decoded in parallel
+ * (errors are the ones of the first layer that fails, as if loaded in order)
  *
  * @return != 0 : error loading layers
  * @return 0 : layers loaded succesfully
  */
-static int _loadMapLayers(const json11::Json* jsonMap, GameMap_t* map)
+static int _loadMapLayers(const std::vector<json11::Json>& jsonLayers, GameMap_t* map)
 {
-  std::vector<json11::Json> _layers;
-  _layers = _getLayers(jsonMap);
+  const std::vector<json11::Json>& _layers = jsonLayers;
 
-  hash<string> hasher;
+  std::string _err;
 
   //allocate memory for layers
   map->layersNum = _layers.size();
   map->layers = (GMapTilelayer_t*)calloc(_layers.size(), sizeof(GMapTilelayer_t));
+  if (map->layers == nullptr && false == _layers.empty()) {
+    map->layersNum = 0;
+    _GameMap_appendToErrStr("Layers: out of memory\n");
+    return -1;
+  }
   map->byteSize += (sizeof(GMapTilelayer_t) * _layers.size());
-  //Fill layers with data
-  for (int i = 0; i < _layers.size(); i++) {
+  _DecodeJob_t _job;
+  _job.jsonLayers = &_layers;
+  _job.map = map;
+  _job.errs.resize(_layers.size());
+  int _failed = (int)_layers.size(); //First layer failing its checks
+  int rc = 0; //return code of its check
+  std::string _failedErr;
+  size_t _tilesNum = 0;
+  //Check layers, allocate data of CSV layers
+  for (int i = 0; i < (int)_layers.size(); i++) {
 
     GMapTilelayer_t* _layer = &map->layers[i];
     //Check for unsupported encodings
-    std::string _encoding = _layers[i]["encoding"].string_value();
-    if (_encoding != "" && _encoding != "csv")
+    if (0 != _GameMap_checkLayerEncoding(_layers[i], _failedErr)) {
+      _failed = i;
+      rc = 1;
+      break;
+    }
+    //Infinite map layer
+    if (false == _layers[i][_KEY_CHUNKS].is_null()) {
+      if (false == _GameMap_chunkedLayerSchema.validate(_layers[i], _err)) {
+        _failedErr = "Layer \"" + _layers[i][_KEY_NAME].string_value() + "\": " + _err + "\n";
+        _failed = i;
+        rc = -1;
+        break;
+      }
+      _job.tasks.push_back({ i, 0, 0 });
+      _tilesNum += _layers[i][_KEY_CHUNKS].array_items().size() * _CHUNK_TILES;
+      continue;
+    }
+    //Check layer shape, layers without tile data (objectgroup, imagelayer) are loaded empty
+    bool _hasData = "tilelayer" == _layers[i][_KEY_TYPE].string_value()
+                  || false == _layers[i][_KEY_DATA].is_null();
+    bool _isBase64 = "base64" == _layers[i][_KEY_ENCODING].string_value();
+    const json11::JsonSchema& _schema = _isBase64 ? _base64LayerSchema : _tileLayerSchema;
+    if (_hasData && false == _schema.validate(_layers[i], _err))
     {
-      _GameMap_appendToErrStr("Layer \"" + _encoding + " " + _layers[i]["compression"].string_value() + "\" not supported\n");
-      _GameMap_appendToErrStr("Save map as \"CSV\" and try again\n");
-      return 1;
+      _failedErr = "Layer \"" + _layers[i][_KEY_NAME].string_value() + "\": " + _err + "\n";
+      _failed = i;
+      rc = -1;
+      break;
     }
-    //layer name
-    std::string _name = _layers[i]["name"].string_value();
-    strncpy_s(_layer->name, _name.c_str(), _LAYER_NAME_MAXLEN);
-    _layer->name[_LAYER_NAME_MAXLEN - 1] = '\0';
-    //Name hash
-    std::string _nameString(_layer->name);
-    _layer->nameHash = hasher(_nameString);
-    //
-    _layer->width = _layers[i]["width"].int_value();
-    _layer->height = _layers[i]["height"].int_value();
-    _layer->offsetx = _layers[i]["offsetx"].int_value();
-    _layer->offsety = _layers[i]["offsety"].int_value();
-    _layer->opacity = _layers[i]["opacity"].number_value();
-    _layer->visible = _layers[i]["visible"].bool_value() ? 1 : 0;
+    _GameMap_setLayerFields(_layers[i], _hasData, _layer);
     //layer data
     size_t _dataLen = _layer->width * _layer->height;
-    json11::Json::array _data = _layers[i]["data"].array_items();
-    if (_dataLen != _data.size())
-    {
-      //ERROR expected size and data size does not match!
-      _GameMap_appendToErrStr(
-        "Map size is " + std::to_string(_layer->width)
-        + "x" + std::to_string(_layer->height)
-        + " = " + std::to_string(_dataLen)
-        + " But layer data size is " + std::to_string(_data.size()) + " !!");
+    _tilesNum += _dataLen;
+    _job.packs.push_back(i);
+    //Allocated before any layer is decoded: out of memory fails the load at once
+    _layer->data = (unsigned int*)malloc(_dataLen > 0 ? _dataLen * sizeof(unsigned int) : 1);
+    if (_layer->data == nullptr) {
+      _GameMap_appendToErrStr("Layer \"" + _layers[i][_KEY_NAME].string_value() + "\": out of memory\n");
       return -1;
     }
-    _layer->data = (unsigned int*)malloc(_dataLen * sizeof(unsigned int));
-    map->byteSize += _dataLen * sizeof(unsigned int);
-    for (int j = 0; j < _dataLen; j++)
-    {//This is slow! there has to be another way to do this
-      _layer->data[j] = _data[j].number_value();
+    if (_isBase64 && _hasData) {
+      _job.tasks.push_back({ i, 0, 0 });
+      continue;
+    }
+    for (size_t j = 0; j < _dataLen; j += _DECODE_BLOCK_TILES)
+      _job.tasks.push_back({ i, j, _dataLen - j < _DECODE_BLOCK_TILES ? _dataLen - j : _DECODE_BLOCK_TILES });
+  }
+
+  //Decode layers before the first failing one
+  if (_tilesNum < _DECODE_PARALLEL_MIN) {
+    for (int t = 0; t < (int)_job.tasks.size(); t++)
+      _decodeTask(&_job, t);
+  }
+  else
+    _GameMap_runTasks((int)_job.tasks.size(), _decodeTask, &_job);
+  for (int i = 0; i < _failed; i++) {
+    if (false == _job.errs[i].empty()) {
+      _GameMap_appendToErrStr("Layer \"" + _layers[i][_KEY_NAME].string_value() + "\": " + _job.errs[i] + "\n");
+      return -1;
+    }
+  }
+  if (rc != 0) {
+    _GameMap_appendToErrStr(_failedErr);
+    return rc;
+  }
+  if (_tilesNum < _DECODE_PARALLEL_MIN) {
+    for (int t = 0; t < (int)_job.packs.size(); t++)
+      _packTask(&_job, t);
+  }
+  else
+    _GameMap_runTasks((int)_job.packs.size(), _packTask, &_job);
+  for (int i = 0; i < map->layersNum; i++) {
+    if (map->layers[i].chunks != nullptr)
+      map->byteSize += _GameMap_chunksByteSize(map->layers[i].chunks);
+    else
+      map->byteSize += _GameMap_layerDataBytes(&map->layers[i]);
+  }
+  //Objects of the object layers
+  return _GameMap_loadObjects(map, _layers);
+}
+
+/*******************************************************************************/
+//Decode tile data of a layer, or convert a block of tiles of a CSV layer
+static void _decodeTask(void* arg, int index)
+{
+  _DecodeJob_t* job = (_DecodeJob_t*)arg;
+  const _DecodeTask_t* _task = &job->tasks[index];
+  const json11::Json& _jsonLayer = (*job->jsonLayers)[_task->layer];
+  GMapTilelayer_t* _layer = &job->map->layers[_task->layer];
+  std::string& _err = job->errs[_task->layer];
+  if (_task->num > 0) {
+    const json11::Json::array& _data = _jsonLayer[_KEY_DATA].array_items();
+    for (size_t j = _task->first; j < _task->first + _task->num; j++)
+      _layer->data[j] = _data[j].uint32_value();
+    return;
+  }
+  if (false == _jsonLayer[_KEY_CHUNKS].is_null()) {
+    _loadLayerChunks(_jsonLayer, _layer, _err);
+    return;
+  }
+  const std::string& _text = _jsonLayer[_KEY_DATA].string_value();
+  _GameMap_decodeLayerInto(_text.data(), _text.size(), _jsonLayer[_KEY_COMPRESSION].string_value(), _layer->data,
+                           (size_t)_layer->width * _layer->height, _err);
+}
+
+static void _packTask(void* arg, int index)
+{
+  _DecodeJob_t* job = (_DecodeJob_t*)arg;
+  _GameMap_packLayer(&job->map->layers[job->packs[index]]);
+}
+
+/*******************************************************************************/
+/**
+ * Load the chunks of an infinite map layer into its chunk table
+ *
+ * @return != 0 : chunk error, described in err
+ */
+static int _loadLayerChunks(const json11::Json& jsonLayer, GMapTilelayer_t* layer, std::string& err)
+{
+  _GameMap_setLayerFields(jsonLayer, true, layer);
+  //(an empty table, layers without chunks are still infinite)
+  if (0 != _GameMap_putChunk(layer, 0, 0, 0, 0, nullptr)) {
+    err = "out of memory";
+    return -1;
+  }
+  bool _isBase64 = "base64" == jsonLayer[_KEY_ENCODING].string_value();
+  const json11::JsonSchema& _schema = _isBase64 ? _base64ChunkSchema : _chunkSchema;
+  const json11::Json::array& _chunks = jsonLayer[_KEY_CHUNKS].array_items();
+  std::vector<unsigned int> _tiles;
+  for (size_t c = 0; c < _chunks.size(); c++) {
+    const json11::Json& _chunk = _chunks[c];
+    if (false == _schema.validate(_chunk, err)) {
+      err = "chunk " + std::to_string(c) + ": " + err;
+      return -1;
+    }
+    int _w = _chunk[_KEY_WIDTH].int_value();
+    int _h = _chunk[_KEY_HEIGHT].int_value();
+    size_t _dataLen = (size_t)_w * _h;
+    int rc = 0;
+    if (_isBase64) {
+      const std::string& _text = _chunk[_KEY_DATA].string_value();
+      unsigned int* _data = _GameMap_decodeLayerData(_text.data(), _text.size(),
+                                                     jsonLayer[_KEY_COMPRESSION].string_value(), _dataLen, err);
+      if (_data == nullptr) {
+        err = "chunk " + std::to_string(c) + ": " + err;
+        return -1;
+      }
+      rc = _GameMap_putChunk(layer, _chunk[_KEY_X].int_value(), _chunk[_KEY_Y].int_value(), _w, _h, _data);
+      free(_data);
+    }
+    else {
+      const json11::Json::array& _data = _chunk[_KEY_DATA].array_items();
+      _tiles.resize(_dataLen);
+      for (size_t j = 0; j < _dataLen; j++)
+        _tiles[j] = _data[j].uint32_value();
+      rc = _GameMap_putChunk(layer, _chunk[_KEY_X].int_value(), _chunk[_KEY_Y].int_value(), _w, _h, _tiles.data());
+    }
+    if (rc != 0) {
+      err = "chunk " + std::to_string(c) + ": out of memory";
+      return -1;
     }
-    //
   }
   return 0;
 }
 
+/*******************************************************************************/
+/**
+ * Check for unsupported layer data encodings
+ *
+ * @return != 0 : encoding not supported, err says why
+ */
+int _GameMap_checkLayerEncoding(const json11::Json& jsonLayer, std::string& err)
+{
+  const std::string& _encoding = jsonLayer[_KEY_ENCODING].string_value();
+  const std::string& _compression = jsonLayer[_KEY_COMPRESSION].string_value();
+  bool _supported = (_encoding == "" || _encoding == "csv") ? _compression == ""
+                  : _encoding == "base64" && _GameMap_isCompressionSupported(_compression);
+  if (false == _supported)
+  {
+    err = "Layer \"" + _encoding + " " + _compression + "\" not supported\n";
+    if (_compression == "zstd")
+      err += "Build GameMap with GAMEMAP_USE_ZSTD defined to load zstd layers\n";
+    else
+      err += "Save map as \"CSV\" or \"Base64\" (uncompressed, zlib or gzip) and try again\n";
+    return 1;
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Fill layer fields (all but data) from its json object
+ * Layers without tile data get size 0x0
+ */
+void _GameMap_setLayerFields(const json11::Json& jsonLayer, bool hasData, GMapTilelayer_t* layer)
+{
+  hash<string> hasher;
+  //layer name
+  std::string _name = jsonLayer[_KEY_NAME].string_value();
+  strncpy_s(layer->name, _name.c_str(), _LAYER_NAME_MAXLEN);
+  layer->name[_LAYER_NAME_MAXLEN - 1] = '\0';
+  //Name hash
+  std::string _nameString(layer->name);
+  layer->nameHash = hasher(_nameString);
+  //
+  layer->width = hasData ? jsonLayer[_KEY_WIDTH].int_value() : 0;
+  layer->height = hasData ? jsonLayer[_KEY_HEIGHT].int_value() : 0;
+  layer->offsetx = jsonLayer[_KEY_OFFSETX].int_value();
+  layer->offsety = jsonLayer[_KEY_OFFSETY].int_value();
+  layer->opacity = jsonLayer[_KEY_OPACITY].number_value();
+  layer->visible = jsonLayer[_KEY_VISIBLE].bool_value() ? 1 : 0;
+  layer->startx = jsonLayer[_KEY_STARTX].int_value();
+  layer->starty = jsonLayer[_KEY_STARTY].int_value();
+}
+
 /*******************************************************************************/
 static void _freeMapLayers(GameMap_t* map)
 {
   if (map->layersNum == 0 || map->layers == nullptr)
     return;
 
-  for (int i = 0; i < map->layersNum; i++) {
-    GMapTilelayer_t* _layer = &map->layers[i];
-    if(_layer->data != nullptr) free(_layer->data);
+  for (int i = 0; i < map->layersNum && map->mapping == nullptr; i++) {
+    _GameMap_freeLayerData(&map->layers[i]);
   }
+  for (int i = 0; i < map->layersNum; i++)
+    _GameMap_freeChunks(map->layers[i].chunks);
   free(map->layers);
   map->layers = nullptr;
 }
@@ -291,17 +627,19 @@ static void _freeMapLayers(GameMap_t* map)
 /*******************************************************************************/
 /**
  * Load tilesets data from json11::Json to GameMap_t
+ * Their JSON (external ones as read from their file) goes to *jsonTilesets
  *
  * @return != 0 : error loading layers
  * @return 0 : layers loaded succesfully
  */
-static int _loadMapTilesets(const json11::Json* jsonMap, GameMap_t* map, const char* baseDir)
+int _GameMap_loadMapTilesets(const json11::Json* jsonMap, GameMap_t* map, const char* baseDir,
+                             std::vector<json11::Json>* jsonTilesets)
 {
   //allocate memory for tilesets
-  if (true == (*jsonMap)["tilesets"].is_null())
+  if (true == (*jsonMap)[_KEY_TILESETS].is_null())
     return 0;
   std::vector<json11::Json> _tilesets;
-  _tilesets = (*jsonMap)["tilesets"].array_items();
+  _tilesets = (*jsonMap)[_KEY_TILESETS].array_items();
   if (0 == _tilesets.size())
     return 0;
 
@@ -312,29 +650,49 @@ static int _loadMapTilesets(const json11::Json* jsonMap, GameMap_t* map, const c
   for (int i = 0; i < _tilesets.size(); i++) {
     //
     GMapTileset_t* _tileset = &map->tilesets[i];
-    //Check for external tilesets
-    if (false == _tilesets[i]["source"].is_null()) {
-      _GameMap_appendToErrStr(_tilesets[i]["source"].string_value());
-      _GameMap_appendToErrStr(" External tilesets not supported\n");
-      _GameMap_appendToErrStr("Fix:Open map with \"Tiled\" and set tileset as internal");
+    const json11::Json* _jsonTileset = &_tilesets[i];
+    std::string _tilesetDir = baseDir;
+    std::string _err;
+    //External tilesets: fields from their file (parsed once for all maps),
+    //image path relative to it
+    json11::Json _fileTileset;
+    if (false == _tilesets[i][_KEY_SOURCE].is_null()) {
+      if (false == _externalTilesetSchema.validate(_tilesets[i], _err)) {
+        _GameMap_appendToErrStr("External tileset: " + _err + "\n");
+        return 1;
+      }
+      std::string _source = baseDir + _tilesets[i][_KEY_SOURCE].string_value();
+      if (0 != _GameMap_loadTilesetFile(_source, &_fileTileset, _err)) {
+        _GameMap_appendToErrStr(_err + "\n");
+        return 1;
+      }
+      strncpy_s(_tileset->source, _source.c_str(), sizeof(_tileset->source) - 1);
+      _jsonTileset = &_fileTileset;
+      _tilesetDir = _GameMap_getDir(_source.c_str());
+    }
+    //Check tileset shape
+    const json11::JsonSchema* _schema = _jsonTileset == &_fileTileset ? &_tilesetFileSchema : &_tilesetSchema;
+    if (false == _schema->validate(*_jsonTileset, _err)) {
+      _GameMap_appendToErrStr("Tileset \"" + (*_jsonTileset)[_KEY_NAME].string_value() + "\": " + _err + "\n");
       return 1;
     }
     //tileset name
-    std::string _name = _tilesets[i]["name"].string_value();
+    std::string _name = (*_jsonTileset)[_KEY_NAME].string_value();
     strncpy_s(_tileset->name, _name.c_str(), _LAYER_NAME_MAXLEN);
     _tileset->name[_LAYER_NAME_MAXLEN - 1] = '\0';
     //tileset file path
-    std::string _path = _tilesets[i]["image"].string_value();
-    _path = baseDir + _path;
+    std::string _path = (*_jsonTileset)[_KEY_IMAGE].string_value();
+    _path = _tilesetDir + _path;
     strncpy_s(_tileset->imgPath, _path.c_str(), _LAYER_NAME_MAXLEN);
     _tileset->imgPath[_LAYER_NAME_MAXLEN - 1] = '\0';
     //
-    _tileset->tilewidth = _tilesets[i]["tilewidth"].int_value();
-    _tileset->tileheight = _tilesets[i]["tileheight"].int_value();
-    _tileset->imagewidth = _tilesets[i]["imagewidth"].int_value();
-    _tileset->imageheight = _tilesets[i]["imageheight"].int_value();
-    _tileset->firstgid = _tilesets[i]["firstgid"].int_value();
-    _tileset->tilecount = _tilesets[i]["tilecount"].int_value();
+    _tileset->tilewidth = (*_jsonTileset)[_KEY_TILEWIDTH].int_value();
+    _tileset->tileheight = (*_jsonTileset)[_KEY_TILEHEIGHT].int_value();
+    _tileset->imagewidth = (*_jsonTileset)[_KEY_IMAGEWIDTH].int_value();
+    _tileset->imageheight = (*_jsonTileset)[_KEY_IMAGEHEIGHT].int_value();
+    _tileset->firstgid = _tilesets[i][_KEY_FIRSTGID].int_value();
+    _tileset->tilecount = (*_jsonTileset)[_KEY_TILECOUNT].int_value();
+    jsonTilesets->push_back(*_jsonTileset);
     //
   }
   return 0;
@@ -349,23 +707,6 @@ static void _freeMapTilesets(GameMap_t* map)
   map->tilesets = nullptr;
 }
 
-/*******************************************************************************/
-void _GameMap_clearErrStr()
-{
-  _GameMap_errStr = "";
-}
-
-void _GameMap_appendToErrStr(const char* str)
-{ _GameMap_errStr += str; }
-
-void _GameMap_appendToErrStr(std::string str)
-{ _GameMap_errStr += str; }
-
-const char* GameMap_getErrStr()
-{
-  return _GameMap_errStr.c_str();
-}
-
 /*******************************************************************************/
 static void _printTilemapData(const unsigned int *data, int w, int h)
 {
@@ -400,6 +741,7 @@ void GameMap_print(const GameMap_t *map)
     map->layers[i].width,map->layers[i].height);
     //_printTilemapData(map->layers[i].data,map->layers[i].width,map->layers[i].height);
   }
+  printf("\tobjects: %d\n", map->objectsNum);
   for (int i = 0; i != map->tilesetsNum; i++) {
     printf("\ttileset %d \"%s\"\n", i, map->tilesets[i].name);
     printf("\t\tfile:\"%s\"\n\t\tWidth: %d\n\t\tHeight: %d\n"
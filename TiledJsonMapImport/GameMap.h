@@ -6,6 +6,8 @@
 #ifndef _GAME_MAP_H
 #define _GAME_MAP_H
 
+#include <stddef.h>
+
 typedef struct GameMap_t GameMap_t;
 
 /**
@@ -16,30 +18,491 @@ typedef struct GameMap_t GameMap_t;
  */
 GameMap_t *GameMap_loadFromTiledJSON(const char *path);
 
+/**
+ * Same as GameMap_loadFromTiledJSON(), but tokenizes the file once and writes
+ * tile data straight into the map without building a json11 tree of the
+ * whole file. Faster and uses less memory on big maps.
+ *
+ * @return nullptr : error loading file
+ * @return != nullptr : pointer to new  map
+ */
+GameMap_t *GameMap_loadFromTiledJSONStreaming(const char *path);
+
+/**
+ * Load map from Tiled JSON file through a binary cache next to it
+ * ("map.json" -> "map.gmapbin"). The cache is used while it matches the JSON
+ * file (same size and time, or same contents), else the JSON file is loaded
+ * and the cache written again. Without the JSON file the cache alone is used.
+ *
+ * @return nullptr : error loading file
+ * @return != nullptr : pointer to new  map
+ */
+GameMap_t *GameMap_loadCached(const char *jsonPath);
+
+/**
+ * Load map from a .gmapbin file (see GameMap_saveBinary())
+ * The file is memory mapped and layer data points into it, no copy is made
+ *
+ * @return nullptr : error loading file
+ * @return != nullptr : pointer to new  map
+ */
+GameMap_t *GameMap_loadBinary(const char *path);
+
+/**
+ * Save map as a .gmapbin file
+ * sourcePath: Tiled JSON file the map was loaded from, its size, time and
+ * contents hash are kept to know when the binary file is out of date
+ * Tileset images are stored relative to the map, keep both files together
+ *
+ * @return != 0 : error writing file
+ */
+int GameMap_saveBinary(const GameMap_t *map, const char *path, const char *sourcePath);
+
+/**
+ * Save map as a Tiled JSON file, for maps edited or made at runtime
+ * Layer data is written as CSV, one row of tiles per line, or uncompressed
+ * base64 (base64 == true). Tileset images and tileset files are written
+ * relative to the directory of path, whichever directory the map came from.
+ * Not saved: text object contents and image layers (empty object layers)
+ *
+ * @return != 0 : error writing file
+ */
+int GameMap_saveToTiledJSON(const GameMap_t *map, const char *path, bool base64 = false);
+
+typedef struct GameMap_LoadContext_t GameMap_LoadContext_t;
+
+/**
+ * Totals over the loads made with a context
+ */
+typedef struct {
+  int loadsNum;
+  int failsNum;
+  double loadMs;      //Time spent loading
+  size_t fileBytes;   //Bytes of map files read
+  size_t mapBytes;    //byteSize of the loaded maps
+} GameMap_LoadStats_t;
+
+/**
+ * Load context: errors, stats and reused file buffer of the loads made with
+ * it. Give each thread loading maps its own context, and any number of maps
+ * can be loaded at once (a context is used by one thread at a time).
+ */
+GameMap_LoadContext_t *GameMap_newLoadContext();
+void GameMap_freeLoadContext(GameMap_LoadContext_t *ctx);
+
+/**
+ * Load map like GameMap_loadCached(), errors and stats going to ctx instead
+ * of GameMap_getErrStr(). Only the DxLib thread may load graphics: on other
+ * threads pass loadGraphs = false and call GameMap_loadGraphs() later.
+ *
+ * @return nullptr : error loading file (see GameMap_getLoadContextErr())
+ */
+GameMap_t *GameMap_loadWithContext(GameMap_LoadContext_t *ctx, const char *jsonPath, bool loadGraphs = true);
+
+/**
+ * Errors of the last load made with ctx, "" if it did not fail
+ */
+const char *GameMap_getLoadContextErr(const GameMap_LoadContext_t *ctx);
+const GameMap_LoadStats_t *GameMap_getLoadStats(const GameMap_LoadContext_t *ctx);
+
+/**
+ * Load tileset graphics of a map loaded without them, from the DxLib thread
+ *
+ * @return != 0 : error loading graphics
+ */
+int GameMap_loadGraphs(GameMap_t *map);
+
+/**
+ * Called with a map loaded by GameMap_loadAsync(), nullptr on load error
+ * (GameMap_getErrStr() has the error). The map is owned by the callback.
+ */
+typedef void (*GameMap_LoadCallback_t)(GameMap_t *map, const char *path, void *userData);
+
+/**
+ * Load map like GameMap_loadCached() on a background thread.
+ * Graphics are loaded and callback is called by GameMap_pollAsync(), on the
+ * thread calling it, so the new map can be swapped in between frames.
+ *
+ * @return != 0 : load not started
+ */
+int GameMap_loadAsync(const char *jsonPath, GameMap_LoadCallback_t callback, void *userData);
+
+/**
+ * Finish background loads that are done: load their graphics and call their
+ * callbacks. Call once per frame from the thread using DxLib.
+ *
+ * @return number of loads still running
+ */
+int GameMap_pollAsync();
+
+typedef struct GameMap_Watch_t GameMap_Watch_t;
+
+/**
+ * Watch a map JSON file (and the tileset images of the map) for changes
+ */
+GameMap_Watch_t *GameMap_watch(const char *jsonPath);
+
+/**
+ * Update map in place when watched files changed since the last call
+ * (checked every 250 ms at most, call it every frame from the DxLib thread).
+ * The changed map is loaded in the background by GameMap_pollAsync() (call
+ * it every frame too), a later call swaps it in: only layers that changed
+ * are replaced, only tilesets that changed get their graphics loaded again.
+ * With map == nullptr files are only checked.
+ *
+ * @return 1 : map updated (or files changed, when map == nullptr)
+ * @return 0 : no change, or changes still loading
+ * @return -1 : files changed but did not load, map unchanged (see GameMap_getErrStr())
+ */
+int GameMap_pollWatch(GameMap_Watch_t *watch, GameMap_t *map);
+
+/**
+ * Stop watching, free watch
+ */
+void GameMap_unwatch(GameMap_Watch_t *watch);
+
+typedef struct GameMap_World_t GameMap_World_t;
+
+/**
+ * Load a Tiled .world file (maps placed in world pixels, "maps" and "patterns")
+ * Its maps are loaded with GameMap_loadAsync() when the camera comes within
+ * prefetchDistance pixels of them, and kept while their byteSize total fits in
+ * byteBudget. Over it, maps away from the camera are freed, the least recently
+ * near first (maps near the camera are kept over the budget).
+ *
+ * @return nullptr : error loading file (see GameMap_getErrStr())
+ */
+GameMap_World_t *GameMap_loadWorld(const char *worldPath, size_t byteBudget, int prefetchDistance = 512);
+
+/**
+ * Free world and its loaded maps
+ */
+void GameMap_freeWorld(GameMap_World_t *world);
+
+/**
+ * Move the camera (or player) to world pixel (x,y): start loading maps near
+ * it, free maps over the budget. Loaded maps are handed to the world by
+ * GameMap_pollAsync(), call both every frame from the DxLib thread.
+ *
+ * @return number of maps loading
+ */
+int GameMap_updateWorld(GameMap_World_t *world, double x, double y);
+
+/**
+ * Maps of the world, .world file order
+ * GameMap_getWorldMap(): map index, nullptr while not loaded, and its place
+ * (x,y,w,h) in world pixels (pointers may be nullptr)
+ * GameMap_findWorldMap(): index of the map at world pixel (x,y), -1: none
+ * GameMap_getWorldMapErr(): load error of map index, "" if it did not fail
+ * (maps that failed to load are not loaded again)
+ */
+int GameMap_getWorldMapsNum(const GameMap_World_t *world);
+GameMap_t *GameMap_getWorldMap(const GameMap_World_t *world, int index, int *x, int *y, int *w, int *h);
+int GameMap_findWorldMap(const GameMap_World_t *world, double x, double y);
+const char *GameMap_getWorldMapErr(const GameMap_World_t *world, int index);
+
 /**
 * delete game map
 * free game map memory
 */
 void GameMap_free(GameMap_t* map);
 
+/**
+* Tileset graphics are shared by all maps using the same image, and kept for
+* a while once no map uses them. Delete the ones no map uses now
+*/
+void GameMap_freeUnusedTilesets();
+
+/**
+* Forget the tileset graphics after a video mode change deleted them (DxLib
+* ChangeWindowMode(), SetGraphMode()...), call it right after: maps loaded
+* next load their tilesets again, maps loaded before need a reload
+*/
+void GameMap_invalidateGraphs();
+
 /**
 * Draw GameMap with camera position at tile (x,y)
 */
 void DrawGameMap(const GameMap_t* map, double x, double y);
 
+/**
+* Draw loaded maps of world with the screen top left at world pixel (x,y)
+*/
+void DrawGameWorld(const GameMap_World_t* world, double x, double y);
+
 /**
 * Get tile ID of tile (x,y) in layer "layername"
 * Example: GameMap_getLayerTileID("collision_map",140,300);
 * @return ID of tile
 * @return 0 if wrong layerName or (tx,ty)
+* Infinite map layers take any (tx,ty), also negative ones
 */
 unsigned int GameMap_getTileId(const GameMap_t* map, const char* layerName, int tx, int ty);
 unsigned int GameMap_getTileId(const GameMap_t* map, int layerId, int tx, int ty);
 
+/**
+* Get layer ID of layer "layerName", for the functions taking layer IDs
+* (layer name lookups are done once instead of per call)
+* @return -1 if layer not found
+*/
+int GameMap_getLayerId(const GameMap_t* map, const char* layerName);
+
+/**
+* Copy tile IDs of the w x h tiles at (x0,y0) of a layer into out, rows
+* stride tiles apart. Tiles outside the layer are 0, flip flags are stripped
+* like GameMap_getTileId() does unless keepFlags is true.
+* Example: unsigned int area[8 * 8];
+*          GameMap_getTileRegion(map, "collision_map", tx - 4, ty - 4, 8, 8, area, 8);
+* @return != 0 : wrong layer or region
+*/
+int GameMap_getTileRegion(const GameMap_t* map, int layerId, int x0, int y0, int w, int h,
+                          unsigned int* out, int stride, bool keepFlags = false);
+int GameMap_getTileRegion(const GameMap_t* map, const char* layerName, int x0, int y0, int w, int h,
+                          unsigned int* out, int stride, bool keepFlags = false);
+
+/**
+* Same region of several layers, layerIds[i] is copied to out + i * layerStride
+* @return != 0 : wrong layer or region
+*/
+int GameMap_getTileRegion(const GameMap_t* map, const int* layerIds, int layersNum, int x0, int y0, int w, int h,
+                          unsigned int* out, int stride, size_t layerStride, bool keepFlags = false);
+
+typedef enum {
+  GAMEMAP_OBJECT_RECT,
+  GAMEMAP_OBJECT_ELLIPSE,
+  GAMEMAP_OBJECT_POINT,
+  GAMEMAP_OBJECT_POLYGON,
+  GAMEMAP_OBJECT_POLYLINE,
+  GAMEMAP_OBJECT_TILE,
+  GAMEMAP_OBJECT_TEXT
+} GameMap_ObjectShape_t;
+
+/**
+* Object of an object layer, coordinates in pixels like Tiled saves them
+*/
+typedef struct {
+  int id;
+  const char* name;
+  const char* type;         //"type", or "class" since Tiled 1.9
+  int layerId;              //Object layer
+  GameMap_ObjectShape_t shape;
+  float x, y;               //Tile objects: bottom left corner
+  float width, height;
+  float rotation;           //Degrees, clockwise around (x,y)
+  unsigned int gid;         //Tile objects: tile GID with flip flags, else 0
+  int pointsNum;            //Polygons and polylines: x,y pairs relative to (x,y)
+  const float* points;
+} GameMap_Object_t;
+
+/**
+* Objects of all object layers, index 0 .. GameMap_getObjectsNum() - 1
+* Strings and points stay valid until the map is freed (or reloaded by
+* GameMap_pollWatch())
+* @return != 0 : wrong index
+*/
+int GameMap_getObjectsNum(const GameMap_t* map);
+int GameMap_getObject(const GameMap_t* map, int index, GameMap_Object_t* object);
+
+/**
+* Find objects whose bounds overlap rectangle (x,y,w,h), in pixels
+* Example: int found[64];
+*          int n = GameMap_queryObjects(map, camx, camy, screenw, screenh, found, 64);
+* @return number of objects found, only the first outMax are written to out
+*/
+int GameMap_queryObjects(const GameMap_t* map, float x, float y, float w, float h, int* out, int outMax);
+
+/**
+* Find objects whose shape contains point (x,y), in pixels
+* (points and polylines have no area, find them with GameMap_queryObjects())
+* @return number of objects found, only the first outMax are written to out
+*/
+int GameMap_queryObjectsAt(const GameMap_t* map, float x, float y, int* out, int outMax);
+
+typedef enum {
+  GAMEMAP_PROPERTY_NONE,    //Not set
+  GAMEMAP_PROPERTY_BOOL,
+  GAMEMAP_PROPERTY_INT,     //Also object properties (object id)
+  GAMEMAP_PROPERTY_FLOAT,
+  GAMEMAP_PROPERTY_STRING,
+  GAMEMAP_PROPERTY_COLOR,
+  GAMEMAP_PROPERTY_FILE
+} GameMap_PropertyType_t;
+
+/**
+* Custom property set in Tiled. Numbers are in both i and f whatever their
+* type (bool: 0 or 1, color: 0xAARRGGBB, also in color), texts in s
+* (strings, colors, files as saved in Tiled). Class properties are not read.
+*/
+typedef struct {
+  int nameId;               //See GameMap_getPropertyId()
+  GameMap_PropertyType_t type;
+  int i;
+  float f;
+  unsigned int color;
+  const char* name;
+  const char* s;
+} GameMap_Property_t;
+
+/**
+* Id of a property name, the same for every map: get the ids once, then use
+* them in the lookups below
+*/
+int GameMap_getPropertyId(const char* name);
+
+/**
+* Property nameId of the map, of layer layerId, of tileset tilesetId (map
+* tilesets order) or of tile gid (flip flags are ignored). Tile lookups index
+* a table by GID, they are cheap enough for per frame loops.
+* Never nullptr: properties not set are GAMEMAP_PROPERTY_NONE, with i = 0,
+* f = 0 and s = "", so GameMap_getTileProperty(map, gid, solidId)->i can be
+* tested as is. Valid until the map is freed (or reloaded by GameMap_pollWatch())
+*/
+const GameMap_Property_t* GameMap_getMapProperty(const GameMap_t* map, int nameId);
+const GameMap_Property_t* GameMap_getLayerProperty(const GameMap_t* map, int layerId, int nameId);
+const GameMap_Property_t* GameMap_getTilesetProperty(const GameMap_t* map, int tilesetId, int nameId);
+const GameMap_Property_t* GameMap_getTileProperty(const GameMap_t* map, unsigned int gid, int nameId);
+
+/**
+* All properties of tile gid, *props is set to the first
+* @return number of properties
+*/
+int GameMap_getTileProperties(const GameMap_t* map, unsigned int gid, const GameMap_Property_t** props);
+
+typedef struct GameMap_Collision_t GameMap_Collision_t;
+
+/**
+* Make a collision bitset of layer "layerName" for the box queries below
+* Tiles with a GID in solidGids are solid, or every non zero tile when
+* solidGids is nullptr. The bitset is a copy of the layer: make a new one
+* after the layer changes (GameMap_pollWatch()).
+* @return nullptr : wrong layer (see GameMap_getErrStr())
+*/
+GameMap_Collision_t* GameMap_newCollision(const GameMap_t* map, const char* layerName,
+                                          const unsigned int* solidGids = nullptr, int solidGidsNum = 0);
+void GameMap_freeCollision(GameMap_Collision_t* col);
+
+/**
+* Boxes are passed as arrays, box i is x[i], y[i], w[i], h[i]: top left
+* corner and size in tiles. A box touching a tile does not overlap it.
+*
+* Test boxes against solid tiles, hit[i] = 1 when box i overlaps one
+* @return number of boxes overlapping solid tiles, -1 on wrong arguments
+*/
+int GameMap_overlapBoxes(const GameMap_Collision_t* col, int boxesNum,
+                         const float* x, const float* y, const float* w, const float* h,
+                         unsigned char* hit);
+
+/**
+* Sweep boxes by (vx[i],vy[i]) tiles against solid tiles
+* toi[i]: fraction of the move done before box i hits a solid tile (1: no hit)
+* (nx[i],ny[i]): normal of the tile side hit, both set for a corner, (0,0): no hit
+* Tiles a box overlaps before moving are not hit (it can move out of them)
+* Example: move box i by toi[i] * v, then keep the part of v along the hit side
+* @return number of boxes hitting solid tiles, -1 on wrong arguments
+*/
+int GameMap_sweepBoxes(const GameMap_Collision_t* col, int boxesNum,
+                       const float* x, const float* y, const float* w, const float* h,
+                       const float* vx, const float* vy,
+                       float* toi, float* nx, float* ny);
+
+typedef struct GameMap_Nav_t GameMap_Nav_t;
+
+/**
+* Make a navigation grid of layer "layerName" for the path queries below
+* Tiles with a GID in solidGids are not walkable, or every non zero tile when
+* solidGids is nullptr (same as GameMap_newCollision()). Clusters of 16x16
+* tiles and the entrances between them are found here, so path queries only
+* search inside the start and goal clusters and over the entrances.
+* A nav is used by one thread at a time (queries reuse its search buffers).
+* @return nullptr : wrong layer (see GameMap_getErrStr())
+*/
+GameMap_Nav_t* GameMap_newNav(const GameMap_t* map, const char* layerName,
+                              const unsigned int* solidGids = nullptr, int solidGidsNum = 0);
+void GameMap_freeNav(GameMap_Nav_t* nav);
+
+/**
+* Find a path from tile (sx,sy) to tile (gx,gy), 8 way moves without
+* cutting corners. The path is close to the shortest, not always the shortest.
+* path gets x,y pairs of the tiles, start and goal included, one step apart
+* Example: int path[2 * 256];
+*          int n = GameMap_findPath(nav, sx, sy, gx, gy, path, 256);
+* @return number of tiles of the path (only the first pathMax are written), -1: no path
+*/
+int GameMap_findPath(GameMap_Nav_t* nav, int sx, int sy, int gx, int gy, int* path, int pathMax);
+
+/**
+* Change tiles of the navigation grid, only the clusters around them are
+* found again (on the next GameMap_findPath())
+* GameMap_setNavTile(): set one tile walkable or not
+* GameMap_updateNav(): read tiles (x0,y0,w,h) from the layer again, after
+* GameMap_pollWatch() or game code changed them
+* @return != 0 : tile outside the grid / layer not found
+*/
+int GameMap_setNavTile(GameMap_Nav_t* nav, int tx, int ty, bool walkable);
+int GameMap_updateNav(GameMap_Nav_t* nav, const GameMap_t* map, int x0, int y0, int w, int h);
+
+/**
+* Check a path found before against the tiles now
+* @return index of the first tile of path that is blocked, -1: path still good
+*/
+int GameMap_checkPath(const GameMap_Nav_t* nav, const int* path, int pathNum);
+
+typedef struct GameMap_Flows_t GameMap_Flows_t;
+
+/**
+* Make flow fields of layer "layerName", for many units going to the same goals
+* gidCosts[gid]: cost of entering a tile with that GID (1 ~ 255), 0 and GIDs
+* past the table are blocked. With gidCosts == nullptr, empty tiles cost 1
+* and the others are blocked. Fields of the last fieldsMax goal sets are kept.
+* Layers up to 1M tiles (1024x1024).
+* @return nullptr : wrong layer (see GameMap_getErrStr())
+*/
+GameMap_Flows_t* GameMap_newFlows(const GameMap_t* map, const char* layerName,
+                                  const unsigned char* gidCosts = nullptr, int gidCostsNum = 0, int fieldsMax = 8);
+void GameMap_freeFlows(GameMap_Flows_t* flows);
+
+/**
+* Read tiles (x0,y0,w,h) from the layer again, after it changed
+* Kept fields are dropped.
+* @return != 0 : layer not found
+*/
+int GameMap_updateFlows(GameMap_Flows_t* flows, const GameMap_t* map, int x0, int y0, int w, int h);
+
+/**
+* Get flow field to goal tiles (goalsNum x,y pairs), the kept one or a new one
+* computed on worker threads (the least recently used field is replaced)
+* Example: int field = GameMap_getFlowField(flows, goals, 2);
+*          GameMap_sampleFlow(flows, field, unitsNum, ux, uy, dx, dy);
+* @return field id, valid until a GameMap_getFlowField() call makes a new one; -1: wrong arguments
+*/
+int GameMap_getFlowField(GameMap_Flows_t* flows, const int* goals, int goalsNum);
+
+/**
+* Step (dx,dy) from tile (tx,ty) toward the nearest goal, (0,0) on a goal
+* @return != 0 : no path from this tile
+*/
+int GameMap_getFlowDir(const GameMap_Flows_t* flows, int field, int tx, int ty, int* dx, int* dy);
+
+/**
+* Directions of units at (x[i],y[i]) in tiles, (dx[i],dy[i]) has length 1,
+* (0,0) on a goal or without path
+* @return number of units with a direction, -1 on wrong arguments
+*/
+int GameMap_sampleFlow(const GameMap_Flows_t* flows, int field, int unitsNum,
+                       const float* x, const float* y, float* dx, float* dy);
+
+/**
+* Cost from tile (tx,ty) to the nearest goal, a straight step into a tile
+* of cost 1 is 1.0
+* @return < 0 : no path
+*/
+float GameMap_getFlowCost(const GameMap_Flows_t* flows, int field, int tx, int ty);
+
 /**
 * Get error string
 * When GameMap_loadFromTiledJSON(), LoadGameMapGraphs() or similar fails
 * Descriptive error messages will appear in this string
+* (each thread has its own, see GameMap_loadAsync() for background loads)
 */
 const char* GameMap_getErrStr();
 
@@ -17,6 +17,7 @@
 #define MSPF (1000.0/60.0)
 void static computeFrameRate(int now);
 float getRuntimeFPS();
+void static onMapLoaded(GameMap_t* newMap, const char* path, void* userData);
 
 /******************************************************************************/
 /******************************************************************************/
@@ -42,11 +43,13 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR args, int) {
   int uiFontHandle = CreateFontToHandle(NULL, 16, -1, DX_FONTTYPE_ANTIALIASING_EDGE);
   int errFontHandle = CreateFontToHandle(NULL, 12, -1, DX_FONTTYPE_ANTIALIASING_EDGE);
 
-  /*load json*/
-  GameMap_t* map = GameMap_loadFromTiledJSON(mapPath);
+  /*load json (through its .gmapbin cache)*/
+  GameMap_t* map = GameMap_loadCached(mapPath);
   GameMap_print(map);
+  GameMap_Watch_t* watch = GameMap_watch(mapPath); //hot reload when map files are saved
 
   double mx = 0, my = 0; //Position on map (mx,my)
+  bool mapLoading = false; //Reload running in background
 
   /***********Main Loop****************/
   while (1) {
@@ -54,6 +57,9 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR args, int) {
     int startTime = GetNowCount();
     computeFrameRate(startTime);
 
+    /*Swap in reloaded map, between frames*/
+    mapLoading = GameMap_pollAsync() > 0;
+
     /** Input **/
 
     /*Exit*/
@@ -64,18 +70,22 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR args, int) {
     if (CheckHitKey(KEY_INPUT_RETURN) == 1) {
       windowMode = windowMode == TRUE ? FALSE : TRUE;
       ChangeWindowMode(windowMode);
+      GameMap_invalidateGraphs();
       uiFontHandle = CreateFontToHandle(NULL, 16, -1, DX_FONTTYPE_ANTIALIASING_EDGE);
       errFontHandle = CreateFontToHandle(NULL, 12, -1, DX_FONTTYPE_ANTIALIASING_EDGE);
-      GameMap_free(map);
-      map = GameMap_loadFromTiledJSON(mapPath);
-      GameMap_print(map);
+      //(video mode change deletes graphics, a load running now loads them after it)
+      if (!mapLoading) mapLoading = 0 == GameMap_loadAsync(mapPath, onMapLoaded, &map);
     }
 
     /*Reload map*/
-    if (CheckHitKey(KEY_INPUT_R) == 1){
-      GameMap_free(map);
-      map = GameMap_loadFromTiledJSON(mapPath);
-      GameMap_print(map);
+    if (CheckHitKey(KEY_INPUT_R) == 1 && !mapLoading){
+      mapLoading = 0 == GameMap_loadAsync(mapPath, onMapLoaded, &map);
+    }
+    /*Hot reload, changed layers and tilesets only*/
+    if (!mapLoading) {
+      int changed = GameMap_pollWatch(watch, map);
+      if (changed == 1 && map == nullptr) mapLoading = 0 == GameMap_loadAsync(mapPath, onMapLoaded, &map);
+      if (changed == -1) printf("%s", GameMap_getErrStr());
     }
     /*Movement*/
     if (CheckHitKey(KEY_INPUT_DOWN) == 1) my += 0.2;
@@ -89,6 +99,7 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR args, int) {
 
     DrawStringToHandle(0, 400, "* Key [R]: Reload map\n* Use Arrow keys to move", 0xFFFFFF, uiFontHandle, 0x00);
     DrawFormatStringToHandle(440, 10, 0xFFFFFF, uiFontHandle, "%.2f FPS\nPos(x %.1f y %.1f)",getRuntimeFPS(), mx, my);
+    if (mapLoading) DrawStringToHandle(440, 50, "Loading map...", 0xFFFFFF, uiFontHandle, 0x00);
     if (map == nullptr) DrawFormatStringToHandle(32, 64, 0xFFFFFF, errFontHandle, "%s", GameMap_getErrStr());
 
     /*Timming and sync*/
@@ -99,11 +110,24 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR args, int) {
   }
   /************************************/
 
+  while (GameMap_pollAsync() > 0) //let background loads end before DxLib
+    WaitTimer(1);
+  GameMap_unwatch(watch);
+  GameMap_free(map);
   DxLib_End();   // DXライブラリ終了処理
   return 0;
 }
 
 /******************************************************************************/
+/* reloaded map, called by GameMap_pollAsync() at the start of a frame */
+void static onMapLoaded(GameMap_t* newMap, const char* path, void* userData)
+{
+  GameMap_t** map = (GameMap_t**)userData;
+  GameMap_free(*map);
+  *map = newMap;
+  GameMap_print(*map);
+}
+
 /*****************************************************************************/
 /* compute framerate*/
 static float _runtimeFPS = 0.0f;
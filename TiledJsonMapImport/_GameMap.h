@@ -6,7 +6,12 @@
 #ifndef __GAME_MAP_H
 #define __GAME_MAP_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
+#include <bitset>
+#include "json11.hpp"
 
 /*******************************************************************************/
 //Bit masks for tile values
@@ -17,10 +22,17 @@ static const unsigned _LEFT_ROTA_FLAG = _FLIPPED_D_FLAG | _FLIPPED_V_FLAG;
 static const unsigned _RIGHT_ROTA_FLAG = _FLIPPED_D_FLAG | _FLIPPED_H_FLAG;
 static const unsigned _FLAGS_MASK = _FLIPPED_H_FLAG | _FLIPPED_V_FLAG | _FLIPPED_D_FLAG;
 static const unsigned _GID_MASK = ~_FLAGS_MASK;
+static const unsigned _FLAGS_SHIFT = 29;     //Flags as a number: tile >> _FLAGS_SHIFT
+static const unsigned _FLAGS_NIBBLE = 0x7;
 
 /*******************************************************************************/
 typedef struct GMapTileset_t GMapTileset_t;
+typedef struct GMapTileGraphs_t GMapTileGraphs_t;
 typedef struct GMapTilelayer_t GMapTilelayer_t;
+typedef struct GMapChunks_t GMapChunks_t;
+typedef struct GMapObjects_t GMapObjects_t;
+typedef struct GMapProperties_t GMapProperties_t;
+typedef struct _GameMap_Mapping_t _GameMap_Mapping_t;
 
 /**
  Load map graphics data
@@ -32,9 +44,110 @@ int ReloadGameMapGraphs(GameMap_t* map);
 */
 void DeleteGameMapGraphs(GameMap_t* map);
 
+/*
+  Current load context (context_GameMap.cpp): errors, stats and file buffer
+  of the load running on this thread
+*/
 void _GameMap_appendToErrStr(const char* str);
 void _GameMap_appendToErrStr(std::string str);
 void _GameMap_clearErrStr();
+void _GameMap_addFileBytes(size_t bytes);
+char* _GameMap_scratchAlloc(size_t size);
+void _GameMap_scratchFree(char* scratch);
+
+/*
+  Shared by the json11 loader (GameMap.cpp) and the streaming loader (stream_GameMap.cpp)
+*/
+extern const json11::JsonSchema _GameMap_tileLayerHeaderSchema; //Tile layer fields but data
+extern const json11::JsonSchema _GameMap_chunkedLayerSchema;    //Infinite map layer fields but chunks data
+extern const json11::JsonSchema _GameMap_chunkHeaderSchema;     //Chunk fields but data
+std::string _GameMap_getDir(const char* path);
+GameMap_t* _GameMap_newFromJSON(const json11::Json& jsonMap, const char* path);
+int _GameMap_checkLayerEncoding(const json11::Json& jsonLayer, std::string& err);
+void _GameMap_setLayerFields(const json11::Json& jsonLayer, bool hasData, GMapTilelayer_t* layer);
+int _GameMap_loadMapTilesets(const json11::Json* jsonMap, GameMap_t* map, const char* baseDir,
+                             std::vector<json11::Json>* jsonTilesets);
+
+/*
+  External tileset files (tileset_GameMap.cpp)
+*/
+int _GameMap_loadTilesetFile(const std::string& path, json11::Json* tileset, std::string& err);
+std::string _GameMap_normPath(const std::string& path); //Same path for the same file from other directories
+std::string _GameMap_relativePath(const std::string& path, const std::string& dir); //Path from dir to path
+
+/*
+  Layer data codecs (codec_GameMap.cpp)
+*/
+bool _GameMap_isCompressionSupported(const std::string& compression);
+unsigned int* _GameMap_decodeLayerData(const char* text, size_t textLen, const std::string& compression, size_t tilesNum, std::string& err);
+int _GameMap_decodeLayerInto(const char* text, size_t textLen, const std::string& compression, unsigned int* data,
+                             size_t tilesNum, std::string& err);
+
+/*
+  Loaders without graphics (loadGraphs == false), for loading threads
+*/
+GameMap_t* _GameMap_loadStreaming(const char* path, bool loadGraphs);
+GameMap_t* _GameMap_loadBinary(const char* path, bool loadGraphs);
+GameMap_t* _GameMap_loadCached(const char* jsonPath, bool loadGraphs);
+int _GameMap_loadAsync(const char* jsonPath, GameMap_LoadCallback_t callback, void* userData, bool loadGraphs);
+
+/*
+  Binary cache (binary_GameMap.cpp)
+*/
+void _GameMap_closeMapping(_GameMap_Mapping_t* mapping);
+int _GameMap_fileStat(const char* path, uint64_t* size, int64_t* mtime); //mtime in ns, != 0: no file
+
+/*
+  Graphics (video_GameMap.cpp)
+*/
+int _GameMap_reuseGraphs(GameMap_t* map, GameMap_t* old, const unsigned char* imageChanged);
+
+/*
+  Infinite map layers (chunk_GameMap.cpp)
+*/
+int _GameMap_putChunk(GMapTilelayer_t* layer, int x, int y, int w, int h, const unsigned int* data);
+GMapChunks_t* _GameMap_newChunks(int blocksNum, const int* coords, unsigned int* tiles);
+const unsigned int* _GameMap_findChunk(const GMapChunks_t* chunks, int cx, int cy);
+unsigned int _GameMap_getChunkTile(const GMapChunks_t* chunks, int tx, int ty);
+size_t _GameMap_chunksByteSize(const GMapChunks_t* chunks);
+void _GameMap_freeChunks(GMapChunks_t* chunks);
+
+/*
+  Object layers (objects_GameMap.cpp)
+*/
+int _GameMap_loadObjects(GameMap_t* map, const std::vector<json11::Json>& jsonLayers);
+void _GameMap_freeObjects(GMapObjects_t* objects);
+size_t _GameMap_objectsFileBytes(const GMapObjects_t* objects);
+int _GameMap_writeObjects(const GMapObjects_t* objects, FILE* fp);
+GMapObjects_t* _GameMap_readObjects(const unsigned char* data, size_t size, const GameMap_t* map);
+
+/*
+  Custom properties (properties_GameMap.cpp)
+*/
+int _GameMap_loadProperties(GameMap_t* map, const json11::Json& jsonMap,
+                            const std::vector<json11::Json>& jsonLayers,
+                            const std::vector<json11::Json>& jsonTilesets);
+void _GameMap_freeProperties(GMapProperties_t* properties);
+size_t _GameMap_propertiesFileBytes(const GMapProperties_t* properties);
+int _GameMap_writeProperties(const GMapProperties_t* properties, FILE* fp);
+GMapProperties_t* _GameMap_readProperties(const unsigned char* data, size_t size, const GameMap_t* map);
+
+/*
+  Layer storage (storage_GameMap.cpp)
+*/
+void _GameMap_packLayer(GMapTilelayer_t* layer);
+size_t _GameMap_layerDataBytes(const GMapTilelayer_t* layer);
+void _GameMap_freeLayerData(GMapTilelayer_t* layer);
+void _GameMap_copyLayerTiles(const GMapTilelayer_t* layer, size_t first, int n, unsigned int* out, bool keepFlags);
+uint64_t _GameMap_sparseNum(const GMapTilelayer_t* layer);
+uint64_t _GameMap_sparseBytes(int storage, int width, int height, uint64_t sparseNum);
+bool _GameMap_checkSparse(const GMapTilelayer_t* layer, uint64_t sparseNum);
+
+/*
+  Worker threads (pool_GameMap.cpp)
+*/
+void _GameMap_runTasks(int tasksNum, void (*task)(void* arg, int index), void* arg);
+int _GameMap_workersNum();
 
 struct GameMap_t{
 
@@ -54,12 +167,14 @@ struct GameMap_t{
   GMapTilelayer_t *layers;        // Array of Layers
                                   // *Stored in render order,
                                   // bottom: layers[0] ----> top: layers[layersNum]
-
-  //GMapProperties_t *properties;
+  GMapObjects_t   *objects;       // Objects of all object layers, nullptr: none
+  GMapProperties_t *properties;   // Custom properties of the map, layers, tilesets and tiles, nullptr: none
 
   //Depends on DxLib
   int* tileHandles; //DXlib Graph Handles
   int tileHandlesNum;
+
+  _GameMap_Mapping_t* mapping; //.gmapbin mapping layer data points into, nullptr: data is malloc'd
 };
 
 
@@ -67,12 +182,25 @@ struct GameMap_t{
 *******************************************************************************/
 
 #define _LAYER_NAME_MAXLEN 128
+#define _STORE_U32 0
+#define _STORE_U16 1
+#define _STORE_U8 2
+#define _STORE_BLOCKS 3
+#define _STORE_RUNS 4
 struct GMapTilelayer_t{
 
   int id;                              //unique across all layers
   char name[_LAYER_NAME_MAXLEN];       //Name assigned to this layer
   size_t nameHash;
+  //Tiles of dense layers, by storage:
+  //_STORE_U32: data, GIDs with flip flags (as in Tiled)
+  //_STORE_U16 / _STORE_U8: cells, GIDs only, and flags, flip flags 4 bits
+  //per tile (tile i: flags[i / 2] >> (i % 2 * 4)), nullptr: no tile flipped
+  //_STORE_BLOCKS / _STORE_RUNS: cells, sparse layers (see below)
   unsigned int *data;
+  void *cells;
+  unsigned char *flags;
+  int storage;
   int width;
   int height;
 
@@ -81,22 +209,116 @@ struct GMapTilelayer_t{
   double opacity; //Value between 0 and 1
   unsigned int visible; //FALSE == 0, TRUE != 0
 
+  //Infinite map layers: tiles are in chunks, data is nullptr
+  //width, height, startx and starty are the bounds of all chunks, in tiles
+  GMapChunks_t *chunks;
+  int startx;
+  int starty;
+
   //uint32 tintcolor
   //uint32 transparentcolor
 
-  //GMapProperties_t *properties;
+  //Custom properties: in GameMap_t::properties
 
 };
 
 /*******************************************************************************
 *******************************************************************************/
 
+//Sparse layers, mostly empty, cells of _STORE_BLOCKS layers:
+//  uint64_t masks[blocksNum]   blocks of 8 x 8 tiles, bit (y % 8) * 8 + x % 8
+//                              set where the tile is not 0
+//  uint32_t firsts[blocksNum]  index in tiles of the first tile of each block
+//  uint32_t tiles[]            tiles not 0 (with flip flags), block by block
+//cells of _STORE_RUNS layers, for rows of repeated tiles (width <= UINT16_MAX):
+//  uint32_t rows[height + 1]   index in runs of the first run of each row
+//  GMapRun_t runs[]            runs of tiles not 0, by row then x
+#define _SPARSE_SHIFT 3
+#define _SPARSE_SIZE (1 << _SPARSE_SHIFT)
+typedef struct {
+  uint16_t x;
+  uint16_t n;
+  uint32_t tile;
+} GMapRun_t;
+
+/*******************************************************************************
+*******************************************************************************/
+
+//Chunks of an infinite layer: blocks of _CHUNK_SIZE x _CHUNK_SIZE tiles,
+//only where the layer has tiles, found by chunk coordinates in a hash table
+#define _CHUNK_SHIFT 4
+#define _CHUNK_SIZE (1 << _CHUNK_SHIFT)
+#define _CHUNK_TILES (_CHUNK_SIZE * _CHUNK_SIZE)
+struct GMapChunks_t{
+  unsigned long long *keys;  //Packed chunk (x,y) of each slot
+  int *slots;                //Block of each slot, -1: empty slot
+  unsigned int mask;         //Slots number - 1, slots number is a power of 2
+  int blocksNum;
+  int blocksCap;
+  unsigned int *tiles;       //blocksNum * _CHUNK_TILES GIDs, rows of each block in order
+  int *coords;               //Chunk (x,y) of each block
+  int minx, miny;            //Bounds of all blocks, in chunks
+  int maxx, maxy;            //(max are exclusive)
+  bool mapped;               //tiles point into a .gmapbin mapping
+};
+
+/*******************************************************************************
+*******************************************************************************/
+
+//Objects of all object layers, one array per field, object i of the map is
+//index i of every array. Object layers are in layers too, without tiles.
+struct GMapObjects_t{
+  int num;
+  int pointsNum;             //Points of all polygons and polylines
+  int stringsLen;            //Bytes of strings
+  int *id;
+  int *layer;                //Index in GameMap_t::layers
+  int *shape;                //GameMap_ObjectShape_t
+  unsigned int *gid;         //With flip flags, 0: not a tile object
+  int *name, *type;          //Offsets into strings, 0: ""
+  int *pointsStart, *pointsCount;
+  float *x, *y, *width, *height, *rotation;
+  float *minx, *miny, *maxx, *maxy; //Bounds, rotation and points included
+  float *points;             //x,y pairs, relative to the object x,y
+  char *strings;
+  //Grid: objects over cell (cx,cy) are cellObjects[cellStart[c] .. cellStart[c + 1]),
+  //c = (cy - gridy) * gridw + (cx - gridx), c = gridw * gridh: objects over many cells
+  float cellSize;            //In pixels
+  int gridx, gridy;          //First cell
+  int gridw, gridh;
+  int *cellStart;
+  int *cellObjects;
+  size_t byteSize;
+};
+
+/*******************************************************************************
+*******************************************************************************/
+
+//Custom properties of a map, one table: properties of owner o are
+//props[ownerStart[o] .. ownerStart[o + 1]). Owners are the map (0), then
+//layer l (1 + l), tileset t (1 + layersNum + t), tile GID g (tilesOwner + g)
+struct GMapProperties_t{
+  int num;
+  int ownersNum;             //tilesOwner + tilesNum
+  int tilesOwner;
+  int tilesNum;              //Tiles GIDs 0 .. tilesNum - 1 have an owner
+  int stringsLen;            //Bytes of strings
+  GameMap_Property_t *props;
+  int *ownerStart;           //ownersNum + 1
+  char *strings;             //Names and string values
+  size_t byteSize;
+};
+
+/*******************************************************************************
+*******************************************************************************/
+
 #define _TILESET_NAME_MAXLEN 128
 #define _TILESET_FILEPATH_LEN 256
 struct GMapTileset_t{
   /**/
   char name[_TILESET_FILEPATH_LEN];
   char imgPath[_TILESET_FILEPATH_LEN];  //Image file path
+  char source[_TILESET_FILEPATH_LEN];   //External tileset file path, "": embedded in the map
 
   int firstgid;
 
@@ -106,7 +328,83 @@ struct GMapTileset_t{
   int tilewidth;
   int tileheight;
   int tilecount;
+
+  GMapTileGraphs_t* graphs;  //Shared tile graphics, nullptr: not loaded
 };
 
 
+/*******************************************************************************
+*******************************************************************************/
+
+//Tile i of a dense layer, GID with flip flags
+template <typename T>
+static inline unsigned int _GameMap_cellTile(const GMapTilelayer_t* layer, size_t i)
+{
+  unsigned int _tile = ((const T*)layer->cells)[i];
+  if (layer->flags != nullptr)
+    _tile |= (unsigned int)((layer->flags[i >> 1] >> ((i & 1) << 2)) & _FLAGS_NIBBLE) << _FLAGS_SHIFT;
+  return _tile;
+}
+
+//Tile (tx,ty) of a _STORE_BLOCKS layer
+static inline unsigned int _GameMap_blocksTile(const GMapTilelayer_t* layer, int tx, int ty)
+{
+  size_t _blocksW = ((size_t)layer->width + _SPARSE_SIZE - 1) >> _SPARSE_SHIFT;
+  size_t _blocksNum = _blocksW * (((size_t)layer->height + _SPARSE_SIZE - 1) >> _SPARSE_SHIFT);
+  size_t b = (ty >> _SPARSE_SHIFT) * _blocksW + (tx >> _SPARSE_SHIFT);
+  const uint64_t* _masks = (const uint64_t*)layer->cells;
+  uint64_t _bit = (uint64_t)1 << (((ty & (_SPARSE_SIZE - 1)) << _SPARSE_SHIFT) | (tx & (_SPARSE_SIZE - 1)));
+  if ((_masks[b] & _bit) == 0)
+    return 0;
+  const uint32_t* _firsts = (const uint32_t*)(_masks + _blocksNum);
+  const uint32_t* _tiles = _firsts + _blocksNum;
+  return _tiles[_firsts[b] + std::bitset<64>(_masks[b] & (_bit - 1)).count()];
+}
+
+//First run of row ty of a _STORE_RUNS layer ending after tx, the row's runs end at *end
+static inline const GMapRun_t* _GameMap_findRun(const GMapTilelayer_t* layer, int tx, int ty, const GMapRun_t** end)
+{
+  const uint32_t* _rows = (const uint32_t*)layer->cells;
+  const GMapRun_t* _runs = (const GMapRun_t*)(_rows + layer->height + 1);
+  const GMapRun_t* _lo = _runs + _rows[ty];
+  const GMapRun_t* _hi = _runs + _rows[ty + 1];
+  *end = _hi;
+  while (_lo < _hi) {
+    const GMapRun_t* _mid = _lo + (_hi - _lo) / 2;
+    if (_mid->x + _mid->n <= tx) _lo = _mid + 1;
+    else _hi = _mid;
+  }
+  return _lo;
+}
+
+static inline unsigned int _GameMap_runsTile(const GMapTilelayer_t* layer, int tx, int ty)
+{
+  const GMapRun_t* _end;
+  const GMapRun_t* _run = _GameMap_findRun(layer, tx, ty, &_end);
+  return _run != _end && _run->x <= tx ? _run->tile : 0;
+}
+
+//Tile (tx,ty) of a dense layer, inside it
+static inline unsigned int _GameMap_denseTile(const GMapTilelayer_t* layer, int tx, int ty)
+{
+  size_t i = (size_t)ty * layer->width + tx;
+  switch (layer->storage) {
+  case _STORE_U8: return _GameMap_cellTile<uint8_t>(layer, i);
+  case _STORE_U16: return _GameMap_cellTile<uint16_t>(layer, i);
+  case _STORE_BLOCKS: return _GameMap_blocksTile(layer, tx, ty);
+  case _STORE_RUNS: return _GameMap_runsTile(layer, tx, ty);
+  default: return layer->data[i];
+  }
+}
+
+//Tile at (tx,ty) of any layer, GID with flip flags, 0 where the layer has no tile
+static inline unsigned int _GameMap_layerTile(const GMapTilelayer_t* layer, int tx, int ty)
+{
+  if (layer->chunks != nullptr)
+    return _GameMap_getChunkTile(layer->chunks, tx, ty);
+  if (tx < 0 || ty < 0 || tx >= layer->width || ty >= layer->height)
+    return 0;
+  return _GameMap_denseTile(layer, tx, ty);
+}
+
 #endif
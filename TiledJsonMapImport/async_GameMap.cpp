@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * GameMap background loading
+ * Maps are loaded without graphics on a worker thread. GameMap_pollAsync(),
+ * called by the frame loop, loads their graphics on its own thread (DxLib is
+ * not thread safe) and hands them to the callbacks, so the frame loop only
+ * waits for LoadDivGraph() and never for the JSON or .gmapbin loading.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <system_error>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+//Load running on a worker thread
+typedef struct {
+  std::string path;
+  GameMap_LoadCallback_t callback;
+  void* userData;
+  bool loadGraphs;          //false: callback gets the map without graphics
+  std::thread worker;
+  std::atomic<bool> done;   //map and err are set
+  GameMap_t* map;           //Without graphics, nullptr: load error
+  std::string err;          //Error string of the worker thread
+} _AsyncLoad_t;
+
+static std::vector<_AsyncLoad_t*> _GameMap_asyncLoads; //Only used by the polling thread
+
+/*
+Private functions
+*/
+static void _loadWorker(_AsyncLoad_t* load);
+
+/*******************************************************************************/
+/**
+ * Start loading map on a worker thread
+ *
+ * @return != 0 : load not started
+ */
+int GameMap_loadAsync(const char* jsonPath, GameMap_LoadCallback_t callback, void* userData)
+{
+  return _GameMap_loadAsync(jsonPath, callback, userData, true);
+}
+
+/*******************************************************************************/
+/**
+ * GameMap_loadAsync(), loadGraphs == false: callback gets the map without
+ * graphics (GameMap_pollWatch() loads only the changed ones)
+ */
+int _GameMap_loadAsync(const char* jsonPath, GameMap_LoadCallback_t callback, void* userData, bool loadGraphs)
+{
+  if (jsonPath == nullptr || callback == nullptr)
+    return -1;
+  _AsyncLoad_t* _load = new _AsyncLoad_t();
+  _load->path = jsonPath;
+  _load->callback = callback;
+  _load->userData = userData;
+  _load->loadGraphs = loadGraphs;
+  _load->done = false;
+  _load->map = nullptr;
+  try {
+    _load->worker = std::thread(_loadWorker, _load);
+  }
+  catch (const std::system_error&) {
+    delete _load;
+    _GameMap_clearErrStr();
+    _GameMap_appendToErrStr("Can not start loading thread for \"" + (std::string)jsonPath + "\"\n");
+    return -1;
+  }
+  _GameMap_asyncLoads.push_back(_load);
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Hand finished loads to their callbacks, graphics loaded on this thread
+ *
+ * @return number of loads still running
+ */
+int GameMap_pollAsync()
+{
+  for (size_t i = 0; i < _GameMap_asyncLoads.size(); ) {
+    _AsyncLoad_t* _load = _GameMap_asyncLoads[i];
+    if (false == _load->done.load(std::memory_order_acquire)) {
+      i++;
+      continue;
+    }
+    _load->worker.join();
+    _GameMap_asyncLoads.erase(_GameMap_asyncLoads.begin() + i);
+
+    //Same result GameMap_loadCached() would give on this thread
+    GameMap_t* map = _load->map;
+    _GameMap_clearErrStr();
+    _GameMap_appendToErrStr(_load->err);
+    if (map != nullptr && _load->loadGraphs && 0 != ReloadGameMapGraphs(map)) {
+      GameMap_free(map);
+      map = nullptr;
+    }
+    //(callbacks may start new loads, they are appended)
+    _load->callback(map, _load->path.c_str(), _load->userData);
+    delete _load;
+  }
+  return (int)_GameMap_asyncLoads.size();
+}
+
+/*******************************************************************************/
+static void _loadWorker(_AsyncLoad_t* load)
+{
+  load->map = _GameMap_loadCached(load->path.c_str(), false);
+  load->err = GameMap_getErrStr();
+  load->done.store(true, std::memory_order_release);
+}
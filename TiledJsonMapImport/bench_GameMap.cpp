@@ -0,0 +1,211 @@
+/******************************************************************************
+* GameMap load benchmark
+* Compares GameMap_loadFromTiledJSON() (json11 tree),
+* GameMap_loadFromTiledJSONStreaming() and GameMap_loadCached() (.gmapbin,
+* written by the first cached load) on the same files:
+*   - load time (average of several loads)
+*   - GameMap_saveToTiledJSON() time, CSV and base64 layer data (save)
+*   - peak bytes allocated with new (json11 tree, strings)
+*   - peak process RSS
+* Graphics are not loaded: the DxLib parts (video_GameMap.cpp) are replaced
+* by the stubs of stubs_GameMap.cpp.
+*
+* Build: bench_GameMap.vcxproj (console program, in pandd_testing.sln), in
+* Release. Run it from this directory, where the default map.json is.
+*
+* Usage:
+*   bench_GameMap [--only dom|stream|cached|save] [--synthetic SIZE LAYERS] [map.json ...]
+*   --synthetic writes a SIZExSIZE map with LAYERS layers to bench_map.json first
+*   --only runs a single loader, to get its own peak RSS from a fresh process
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <chrono>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "GameMap.h"
+#include "_GameMap.h"
+
+/******************************************************************************/
+/* Allocation tracking (operator new only, GameMap's own buffers use malloc
+   and are the same for both loaders: see map bytes) */
+static size_t _liveBytes = 0;
+static size_t _peakBytes = 0;
+static const size_t _HEADER = 16;
+
+void* operator new(size_t size)
+{
+  char* p = (char*)malloc(size + _HEADER);
+  if (p == nullptr) throw std::bad_alloc();
+  *(size_t*)p = size;
+  _liveBytes += size;
+  if (_liveBytes > _peakBytes) _peakBytes = _liveBytes;
+  return p + _HEADER;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept
+{
+  if (p == nullptr) return;
+  char* base = (char*)p - _HEADER;
+  _liveBytes -= *(size_t*)base;
+  free(base);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+/******************************************************************************/
+static double _peakRssMB()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.PeakWorkingSetSize / (1024.0 * 1024.0);
+  return 0;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+/******************************************************************************/
+/* Write a Tiled-like map with SIZExSIZE layers */
+static int _writeSyntheticMap(const char* path, int size, int layers)
+{
+  FILE* fp = fopen(path, "wb");
+  if (fp == nullptr) return 1;
+  unsigned int rng = 2463534242u;
+  fprintf(fp, "{ \"compressionlevel\":-1,\n \"height\":%d,\n \"infinite\":false,\n \"layers\":[\n", size);
+  for (int l = 0; l < layers; l++) {
+    fprintf(fp, "        {\n         \"data\":[");
+    for (int t = 0; t < size * size; t++) {
+      rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+      unsigned int gid = (l == 0 || (rng & 3) == 0) ? 1 + (rng >> 8) % 20 : 0;
+      if (gid != 0 && (rng & 0x70) == 0) gid |= 0xA0000000u;
+      fprintf(fp, t == 0 ? "%u" : ", %u", gid);
+    }
+    fprintf(fp, "],\n         \"height\":%d,\n         \"id\":%d,\n"
+                "         \"name\":\"Tile Layer %d\",\n         \"opacity\":1,\n"
+                "         \"type\":\"tilelayer\",\n         \"visible\":true,\n"
+                "         \"width\":%d,\n         \"x\":0,\n         \"y\":0\n        }%s\n",
+            size, l + 1, l + 1, size, l + 1 == layers ? "" : ", ");
+  }
+  fprintf(fp, " ],\n \"nextlayerid\":%d,\n \"nextobjectid\":1,\n \"orientation\":\"orthogonal\",\n"
+              " \"renderorder\":\"right-down\",\n \"tiledversion\":\"1.8.2\",\n \"tileheight\":80,\n"
+              " \"tilesets\":[\n        {\n         \"columns\":5,\n         \"firstgid\":1,\n"
+              "         \"image\":\"tileset.png\",\n         \"imageheight\":320,\n"
+              "         \"imagewidth\":400,\n         \"margin\":0,\n         \"name\":\"tileset\",\n"
+              "         \"spacing\":0,\n         \"tilecount\":20,\n         \"tileheight\":80,\n"
+              "         \"tilewidth\":80\n        }],\n \"tilewidth\":80,\n \"type\":\"map\",\n"
+              " \"version\":\"1.8\",\n \"width\":%d\n}", layers + 1, size);
+  fclose(fp);
+  return 0;
+}
+
+/******************************************************************************/
+typedef GameMap_t* (*_Loader_t)(const char* path);
+
+static void _bench(const char* name, _Loader_t loader, const char* path)
+{
+  typedef std::chrono::steady_clock clock;
+  _peakBytes = _liveBytes;
+  size_t _before = _liveBytes;
+  int runs = 0;
+  size_t mapBytes = 0;
+  double elapsed = 0;
+  auto start = clock::now();
+  do {
+    GameMap_t* map = loader(path);
+    if (map == nullptr) {
+      printf("%-24s %-7s error: %s\n", path, name, GameMap_getErrStr());
+      return;
+    }
+    mapBytes = map->byteSize;
+    GameMap_free(map);
+    runs++;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  } while (elapsed < 1.0 && runs < 100);
+  printf("%-24s %-7s %9.2f ms/load %9.2f MB peak new %9.2f MB map %9.1f MB peak RSS\n",
+         path, name, elapsed * 1000.0 / runs, (_peakBytes - _before) / (1024.0 * 1024.0),
+         mapBytes / (1024.0 * 1024.0), _peakRssMB());
+  fflush(stdout);
+}
+
+static void _benchSave(const char* path)
+{
+  typedef std::chrono::steady_clock clock;
+  GameMap_t* map = GameMap_loadFromTiledJSONStreaming(path);
+  if (map == nullptr) {
+    printf("%-24s %-7s error: %s\n", path, "save", GameMap_getErrStr());
+    return;
+  }
+  for (int base64 = 0; base64 < 2; base64++) {
+    const char* name = base64 ? "save64" : "save";
+    int runs = 0;
+    double elapsed = 0;
+    auto start = clock::now();
+    do {
+      if (GameMap_saveToTiledJSON(map, "bench_save.json", base64 != 0) != 0) {
+        printf("%-24s %-7s error: %s\n", path, name, GameMap_getErrStr());
+        break;
+      }
+      runs++;
+      elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < 1.0 && runs < 100);
+    if (runs > 0)
+      printf("%-24s %-7s %9.2f ms/save\n", path, name, elapsed * 1000.0 / runs);
+  }
+  remove("bench_save.json");
+  GameMap_free(map);
+  fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+  std::string only;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+      only = argv[++i];
+    }
+    else if (strcmp(argv[i], "--synthetic") == 0 && i + 2 < argc) {
+      int size = atoi(argv[++i]);
+      int layers = atoi(argv[++i]);
+      if (_writeSyntheticMap("bench_map.json", size, layers) != 0) {
+        printf("Can not write bench_map.json\n");
+        return 1;
+      }
+      files.push_back("bench_map.json");
+    }
+    else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) files.push_back("map.json");
+
+  for (size_t i = 0; i < files.size(); i++) {
+    if (only == "" || only == "dom")
+      _bench("dom", GameMap_loadFromTiledJSON, files[i].c_str());
+    if (only == "" || only == "stream")
+      _bench("stream", GameMap_loadFromTiledJSONStreaming, files[i].c_str());
+    if (only == "" || only == "cached") {
+      GameMap_free(GameMap_loadCached(files[i].c_str())); //write cache
+      _bench("cached", GameMap_loadCached, files[i].c_str());
+    }
+    if (only == "" || only == "save")
+      _benchSave(files[i].c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,759 @@
+/*******************************************************************************
+ * GameMap binary cache (.gmapbin)
+ * A GameMap_t saved as-is, loaded with a memory mapping: layer data points
+ * into the mapping, nothing is parsed or copied.
+ *
+ * File layout (little endian, offsets from file start):
+ *   _BinHeader_t
+ *   _BinTileset_t[tilesetsNum]
+ *   _BinLayer_t[layersNum]
+ *   layer data blocks, each block 32 byte aligned: GIDs as stored
+ *   (_STORE_U32: uint32 with flip flags, _STORE_U16 / _STORE_U8: narrow
+ *    GIDs, then the flags plane 32 byte aligned, _STORE_BLOCKS / _STORE_RUNS:
+ *    sparse layer cells, see storage_GameMap.cpp)
+ *   (infinite map layers: int32 chunk (x,y) pairs, then the chunk tiles,
+ *    _CHUNK_TILES GIDs per chunk, 32 byte aligned)
+ *   objects of the object layers, see _GameMap_writeObjects() (copied when
+ *   loaded, their grid is built again)
+ *   custom properties, see _GameMap_writeProperties() (copied when loaded)
+ *
+ * The header keeps size, modification time and content hash of the JSON
+ * file the map came from, and the tileset table those of the external
+ * tileset files: GameMap_loadCached() uses them to know when the cache is
+ * out of date.
+*******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+/*******************************************************************************/
+#define _BIN_VERSION 7
+#define _BIN_BYTE_ORDER 0x01020304u //Reads back different on other endianness
+#define _BIN_DATA_ALIGN 32
+static const char _BIN_MAGIC[8] = "GMAPBIN";
+
+typedef struct {
+  char magic[8];          //_BIN_MAGIC
+  uint32_t version;       //_BIN_VERSION
+  uint32_t byteOrder;     //_BIN_BYTE_ORDER
+  uint64_t fileSize;
+  uint64_t sourceSize;    //JSON file size
+  int64_t sourceMtime;    //JSON file modification time (ns), -1: check the hash
+  uint64_t sourceHash;    //JSON file contents hash (FNV-1a)
+  int32_t width;
+  int32_t height;
+  int32_t tilewidth;
+  int32_t tileheight;
+  int32_t layersNum;
+  int32_t tilesetsNum;
+  uint64_t tilesetsOffset;
+  uint64_t layersOffset;
+  uint64_t objectsOffset;
+  uint64_t objectsBytes;  //0: no objects
+  uint64_t propertiesOffset;
+  uint64_t propertiesBytes; //0: no properties
+} _BinHeader_t;
+
+typedef struct {
+  char name[_TILESET_FILEPATH_LEN];
+  char image[_TILESET_FILEPATH_LEN]; //Relative to the map directory
+  int32_t firstgid;
+  int32_t imageheight;
+  int32_t imagewidth;
+  int32_t tilewidth;
+  int32_t tileheight;
+  int32_t tilecount;
+  char source[_TILESET_FILEPATH_LEN]; //External tileset file relative to the map directory, "": embedded
+  uint64_t sourceSize;    //Same as the header fields, for the external tileset file
+  int64_t sourceMtime;
+  uint64_t sourceHash;
+} _BinTileset_t;
+
+typedef struct {
+  char name[_LAYER_NAME_MAXLEN];
+  int32_t id;
+  int32_t width;
+  int32_t height;
+  int32_t offsetx;
+  int32_t offsety;
+  uint32_t visible;
+  int32_t startx;
+  int32_t starty;
+  int32_t chunksNum;      //-1: dense layer, data is width * height GIDs
+  int32_t storage;        //_STORE_ type of dense layers, | _BIN_FLAGS_PLANE
+  double opacity;
+  uint64_t dataOffset;    //_BIN_DATA_ALIGN aligned
+  uint64_t sparseNum;     //Tiles not 0 of _STORE_BLOCKS layers, runs of _STORE_RUNS layers
+} _BinLayer_t;
+
+static_assert(sizeof(_BinHeader_t) == 120, "_BinHeader_t layout");
+static_assert(sizeof(_BinTileset_t) == 3 * _TILESET_FILEPATH_LEN + 48, "_BinTileset_t layout");
+static_assert(sizeof(_BinLayer_t) == _LAYER_NAME_MAXLEN + 64, "_BinLayer_t layout");
+
+#define _BIN_FLAGS_PLANE 0x100        //Flags plane after the narrow GIDs
+#define _BIN_MAP_SIZE_MAX (1 << 15) //Same limits as the JSON loaders
+#define _BIN_CHUNK_COORD_MAX (1 << 28)
+#define _BIN_RACY_SECONDS 2         //Sources changed this recently may change again unnoticed
+
+//Read only file mapping, copy on write
+struct _GameMap_Mapping_t {
+  unsigned char* base;
+  size_t size;
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#endif
+};
+
+/*
+Private functions
+*/
+static int _fileHash(const char* path, uint64_t* hash);
+static int _readHeader(const char* path, _BinHeader_t* header);
+static bool _checkHeader(const _BinHeader_t* header, size_t fileSize);
+static int _statSource(const char* path, uint64_t* size, int64_t* mtime, uint64_t* hash);
+static bool _sourceUpToDate(const char* path, uint64_t size, int64_t mtime, uint64_t hash);
+static bool _tilesetFilesUpToDate(const char* binPath, const _BinHeader_t* header);
+static _GameMap_Mapping_t* _mapFile(const char* path);
+static std::string _cachePath(const char* jsonPath);
+static uint64_t _layerBytes(const _BinLayer_t* layer);
+static uint64_t _chunkCoordsBytes(int chunksNum);
+static uint64_t _denseBytes(const _BinLayer_t* layer, uint64_t* flagsOffset);
+
+/*******************************************************************************/
+/**
+ * Save map as .gmapbin
+ *
+ * @return != 0 : error writing file
+ */
+int GameMap_saveBinary(const GameMap_t* map, const char* path, const char* sourcePath)
+{
+  if (map == nullptr || path == nullptr || sourcePath == nullptr)
+    return -1;
+
+  _BinHeader_t _header;
+  memset(&_header, 0, sizeof(_header));
+  memcpy(_header.magic, _BIN_MAGIC, sizeof(_header.magic));
+  _header.version = _BIN_VERSION;
+  _header.byteOrder = _BIN_BYTE_ORDER;
+  if (0 != _statSource(sourcePath, &_header.sourceSize, &_header.sourceMtime, &_header.sourceHash)) {
+    _GameMap_appendToErrStr("Can not open file: \"" + (std::string)sourcePath + "\"\n");
+    return -1;
+  }
+  _header.width = map->width;
+  _header.height = map->height;
+  _header.tilewidth = map->tilewidth;
+  _header.tileheight = map->tileheight;
+  _header.layersNum = map->layersNum;
+  _header.tilesetsNum = map->tilesetsNum;
+  _header.tilesetsOffset = sizeof(_BinHeader_t);
+  _header.layersOffset = _header.tilesetsOffset + sizeof(_BinTileset_t) * map->tilesetsNum;
+
+  //Tileset table, image and external tileset paths made relative to the map directory again
+  std::string _mapDir = _GameMap_getDir(sourcePath);
+  _BinTileset_t* _tilesets = (_BinTileset_t*)calloc(map->tilesetsNum + 1, sizeof(_BinTileset_t));
+  _BinLayer_t* _layers = (_BinLayer_t*)calloc(map->layersNum + 1, sizeof(_BinLayer_t));
+  if (_tilesets == nullptr || _layers == nullptr) {
+    free(_tilesets);
+    free(_layers);
+    return -1;
+  }
+  for (int i = 0; i < map->tilesetsNum; i++) {
+    const GMapTileset_t* _src = &map->tilesets[i];
+    const char* _image = _src->imgPath;
+    if (0 == strncmp(_image, _mapDir.c_str(), _mapDir.size()))
+      _image += _mapDir.size();
+    strncpy_s(_tilesets[i].name, _src->name, sizeof(_tilesets[i].name) - 1);
+    strncpy_s(_tilesets[i].image, _image, sizeof(_tilesets[i].image) - 1);
+    if (_src->source[0] != '\0') {
+      const char* _source = _src->source;
+      if (0 == strncmp(_source, _mapDir.c_str(), _mapDir.size()))
+        _source += _mapDir.size();
+      strncpy_s(_tilesets[i].source, _source, sizeof(_tilesets[i].source) - 1);
+      if (0 != _statSource(_src->source, &_tilesets[i].sourceSize, &_tilesets[i].sourceMtime, &_tilesets[i].sourceHash))
+        _tilesets[i].sourceSize = UINT64_MAX; //Never up to date
+    }
+    _tilesets[i].firstgid = _src->firstgid;
+    _tilesets[i].imageheight = _src->imageheight;
+    _tilesets[i].imagewidth = _src->imagewidth;
+    _tilesets[i].tilewidth = _src->tilewidth;
+    _tilesets[i].tileheight = _src->tileheight;
+    _tilesets[i].tilecount = _src->tilecount;
+  }
+  //Layer table, data blocks follow it
+  uint64_t _offset = _header.layersOffset + sizeof(_BinLayer_t) * map->layersNum;
+  for (int i = 0; i < map->layersNum; i++) {
+    const GMapTilelayer_t* _src = &map->layers[i];
+    _offset = (_offset + _BIN_DATA_ALIGN - 1) & ~(uint64_t)(_BIN_DATA_ALIGN - 1);
+    strncpy_s(_layers[i].name, _src->name, sizeof(_layers[i].name) - 1);
+    _layers[i].id = _src->id;
+    _layers[i].width = _src->width;
+    _layers[i].height = _src->height;
+    _layers[i].offsetx = _src->offsetx;
+    _layers[i].offsety = _src->offsety;
+    _layers[i].visible = _src->visible;
+    _layers[i].startx = _src->startx;
+    _layers[i].starty = _src->starty;
+    _layers[i].chunksNum = _src->chunks != nullptr ? _src->chunks->blocksNum : -1;
+    _layers[i].storage = _src->storage | (_src->flags != nullptr ? _BIN_FLAGS_PLANE : 0);
+    _layers[i].opacity = _src->opacity;
+    _layers[i].dataOffset = _offset;
+    _layers[i].sparseNum = _src->chunks == nullptr ? _GameMap_sparseNum(_src) : 0;
+    _offset += _layerBytes(&_layers[i]);
+  }
+  _header.objectsBytes = _GameMap_objectsFileBytes(map->objects);
+  _header.objectsOffset = _header.objectsBytes > 0 ? _offset : 0;
+  _header.propertiesBytes = _GameMap_propertiesFileBytes(map->properties);
+  _header.propertiesOffset = _header.propertiesBytes > 0 ? _offset + _header.objectsBytes : 0;
+  _header.fileSize = _offset + _header.objectsBytes + _header.propertiesBytes;
+
+  //Write to a temporary file, then replace the old cache
+  //(one per thread, the same map can be loaded by two threads at once)
+  size_t _threadHash = std::hash<std::thread::id>()(std::this_thread::get_id());
+  std::string _tmpPath = (std::string)path + "." + std::to_string(_threadHash % 1000000) + ".tmp";
+  FILE* fp = fopen(_tmpPath.c_str(), "wb");
+  int rc = fp == nullptr ? -1 : 0; //return code
+  static const unsigned char _zeros[_BIN_DATA_ALIGN] = { 0 };
+  if (rc == 0 && 1 != fwrite(&_header, sizeof(_header), 1, fp)) rc = -1;
+  if (rc == 0 && map->tilesetsNum > 0
+      && (size_t)map->tilesetsNum != fwrite(_tilesets, sizeof(_BinTileset_t), map->tilesetsNum, fp)) rc = -1;
+  if (rc == 0 && map->layersNum > 0
+      && (size_t)map->layersNum != fwrite(_layers, sizeof(_BinLayer_t), map->layersNum, fp)) rc = -1;
+  _offset = _header.layersOffset + sizeof(_BinLayer_t) * map->layersNum;
+  for (int i = 0; rc == 0 && i < map->layersNum; i++) {
+    const GMapTilelayer_t* _src = &map->layers[i];
+    size_t _padding = (size_t)(_layers[i].dataOffset - _offset);
+    if (_padding > 0 && 1 != fwrite(_zeros, _padding, 1, fp)) rc = -1;
+    if (_src->chunks != nullptr) {
+      size_t _count = (size_t)_src->chunks->blocksNum;
+      size_t _coordsPadding = (size_t)_chunkCoordsBytes(_src->chunks->blocksNum) - _count * 2 * sizeof(int32_t);
+      if (rc == 0 && _count > 0 && _count * 2 != fwrite(_src->chunks->coords, sizeof(int32_t), _count * 2, fp)) rc = -1;
+      if (rc == 0 && _coordsPadding > 0 && 1 != fwrite(_zeros, _coordsPadding, 1, fp)) rc = -1;
+      if (rc == 0 && _count > 0 && _count != fwrite(_src->chunks->tiles, sizeof(uint32_t) * _CHUNK_TILES, _count, fp)) rc = -1;
+    }
+    else if (_src->storage == _STORE_U32) {
+      size_t _count = (size_t)_src->width * _src->height;
+      if (rc == 0 && _count > 0 && _count != fwrite(_src->data, sizeof(uint32_t), _count, fp)) rc = -1;
+    }
+    else if (_src->storage == _STORE_BLOCKS || _src->storage == _STORE_RUNS) {
+      if (rc == 0 && 1 != fwrite(_src->cells, _GameMap_layerDataBytes(_src), 1, fp)) rc = -1;
+    }
+    else {
+      uint64_t _count = (uint64_t)_src->width * _src->height, _flagsOffset = 0;
+      uint64_t _bytes = _denseBytes(&_layers[i], &_flagsOffset);
+      size_t _cellsBytes = (size_t)_count * (_src->storage == _STORE_U8 ? 1 : 2);
+      if (rc == 0 && 1 != fwrite(_src->cells, _cellsBytes, 1, fp)) rc = -1;
+      if (_src->flags != nullptr) {
+        size_t _flagsPadding = (size_t)_flagsOffset - _cellsBytes;
+        if (rc == 0 && _flagsPadding > 0 && 1 != fwrite(_zeros, _flagsPadding, 1, fp)) rc = -1;
+        if (rc == 0 && 1 != fwrite(_src->flags, (size_t)(_bytes - _flagsOffset), 1, fp)) rc = -1;
+      }
+    }
+    _offset = _layers[i].dataOffset + _layerBytes(&_layers[i]);
+  }
+  if (rc == 0 && 0 != _GameMap_writeObjects(map->objects, fp)) rc = -1;
+  if (rc == 0 && 0 != _GameMap_writeProperties(map->properties, fp)) rc = -1;
+  if (fp != nullptr && 0 != fclose(fp)) rc = -1;
+  free(_tilesets);
+  free(_layers);
+  if (rc == 0) {
+    remove(path);
+    if (0 != rename(_tmpPath.c_str(), path)) rc = -1;
+  }
+  if (rc != 0) {
+    remove(_tmpPath.c_str());
+    _GameMap_appendToErrStr("Can not write file: \"" + (std::string)path + "\"\n");
+  }
+  return rc;
+}
+
+/*******************************************************************************/
+/**
+ * Load map from .gmapbin, layer data points into the file mapping
+ *
+ * @return nullptr : error loading file
+ */
+GameMap_t* GameMap_loadBinary(const char* path)
+{
+  return _GameMap_loadBinary(path, true);
+}
+
+//loadGraphs == false: see _GameMap_loadStreaming()
+GameMap_t* _GameMap_loadBinary(const char* path, bool loadGraphs)
+{
+  _GameMap_clearErrStr();
+  if (path == nullptr)
+    return nullptr;
+  _GameMap_Mapping_t* _mapping = _mapFile(path);
+  if (_mapping == nullptr) {
+    _GameMap_appendToErrStr("Can not open file: \"" + (std::string)path + "\"\n");
+    return nullptr;
+  }
+  _GameMap_addFileBytes(_mapping->size);
+  const _BinHeader_t* _header = (const _BinHeader_t*)_mapping->base;
+  if (_mapping->size < sizeof(_BinHeader_t) || false == _checkHeader(_header, _mapping->size)) {
+    _GameMap_appendToErrStr(path + (std::string)"\nBinary map error: bad header\n");
+    _GameMap_closeMapping(_mapping);
+    return nullptr;
+  }
+  const _BinTileset_t* _tilesets = (const _BinTileset_t*)(_mapping->base + _header->tilesetsOffset);
+  const _BinLayer_t* _layers = (const _BinLayer_t*)(_mapping->base + _header->layersOffset);
+
+  //allocate map
+  GameMap_t* map = (GameMap_t*)calloc(1, sizeof(GameMap_t));
+  if (map == nullptr) {
+    _GameMap_closeMapping(_mapping);
+    return nullptr;
+  }
+  map->mapping = _mapping;
+  map->byteSize = sizeof(GameMap_t);
+  map->width = _header->width;
+  map->height = _header->height;
+  map->tilewidth = _header->tilewidth;
+  map->tileheight = _header->tileheight;
+
+  //layers
+  int rc = 0; //return code
+  map->layersNum = _header->layersNum;
+  map->layers = (GMapTilelayer_t*)calloc(_header->layersNum + 1, sizeof(GMapTilelayer_t));
+  map->byteSize += sizeof(GMapTilelayer_t) * _header->layersNum;
+  if (map->layers == nullptr) rc = -1;
+  std::hash<std::string> hasher;
+  for (int i = 0; rc == 0 && i < map->layersNum; i++) {
+    const _BinLayer_t* _src = &_layers[i];
+    GMapTilelayer_t* _layer = &map->layers[i];
+    bool _chunked = _src->chunksNum >= 0;
+    int _sizeMax = _chunked ? _BIN_CHUNK_COORD_MAX : _BIN_MAP_SIZE_MAX;
+    uint64_t _coordsBytes = _chunked ? _chunkCoordsBytes(_src->chunksNum) : 0;
+    uint64_t _flagsOffset = 0;
+    int _storage = _src->storage & ~_BIN_FLAGS_PLANE;
+    bool _sparse = _storage == _STORE_BLOCKS || _storage == _STORE_RUNS;
+    bool _validStorage = _storage == _STORE_U32 ? _src->storage == _STORE_U32
+                       : _sparse ? _src->storage == _storage && false == _chunked
+                       : (_storage == _STORE_U16 || _storage == _STORE_U8) && false == _chunked;
+    uint64_t _bytes = _chunked ? _coordsBytes + (uint64_t)_src->chunksNum * _CHUNK_TILES * sizeof(uint32_t)
+                               : _denseBytes(_src, &_flagsOffset);
+    if (_src->width < 0 || _src->width > _sizeMax || _src->height < 0 || _src->height > _sizeMax
+        || false == _validStorage || _src->sparseNum > (uint64_t)_src->width * _src->height
+        || _src->chunksNum < -1 || _src->dataOffset % _BIN_DATA_ALIGN != 0 || _src->dataOffset > _mapping->size
+        || _bytes > _mapping->size - _src->dataOffset) {
+      _GameMap_appendToErrStr(path + (std::string)"\nBinary map error: bad layer " + std::to_string(i) + "\n");
+      rc = -1;
+      break;
+    }
+    memcpy(_layer->name, _src->name, sizeof(_layer->name));
+    _layer->name[_LAYER_NAME_MAXLEN - 1] = '\0';
+    _layer->nameHash = hasher(std::string(_layer->name));
+    _layer->id = _src->id;
+    _layer->width = _src->width;
+    _layer->height = _src->height;
+    _layer->offsetx = _src->offsetx;
+    _layer->offsety = _src->offsety;
+    _layer->visible = _src->visible;
+    _layer->opacity = _src->opacity;
+    _layer->startx = _src->startx;
+    _layer->starty = _src->starty;
+    if (false == _chunked) {
+      _layer->storage = _storage;
+      if (_storage == _STORE_U32)
+        _layer->data = (unsigned int*)(_mapping->base + _src->dataOffset);
+      else
+        _layer->cells = _mapping->base + _src->dataOffset;
+      if (_src->storage & _BIN_FLAGS_PLANE)
+        _layer->flags = _mapping->base + _src->dataOffset + _flagsOffset;
+      if (_sparse && false == _GameMap_checkSparse(_layer, _src->sparseNum)) {
+        _GameMap_appendToErrStr(path + (std::string)"\nBinary map error: bad layer " + std::to_string(i) + "\n");
+        rc = -1;
+        break;
+      }
+      map->byteSize += _GameMap_layerDataBytes(_layer);
+      continue;
+    }
+    //Chunk table over the mapped chunks, their coordinates must fit the JSON loaders limits
+    const int32_t* _coords = (const int32_t*)(_mapping->base + _src->dataOffset);
+    for (int c = 0; rc == 0 && c < 2 * _src->chunksNum; c++)
+      if (_coords[c] < -(_BIN_CHUNK_COORD_MAX >> _CHUNK_SHIFT) || _coords[c] > (_BIN_CHUNK_COORD_MAX >> _CHUNK_SHIFT))
+        rc = -1;
+    if (rc != 0) {
+      _GameMap_appendToErrStr(path + (std::string)"\nBinary map error: bad layer " + std::to_string(i) + "\n");
+      break;
+    }
+    _layer->chunks = _GameMap_newChunks(_src->chunksNum, (const int*)_coords,
+                                        (unsigned int*)(_mapping->base + _src->dataOffset + _coordsBytes));
+    if (_layer->chunks == nullptr) {
+      rc = -1;
+      break;
+    }
+    map->byteSize += _GameMap_chunksByteSize(_layer->chunks);
+  }
+
+  //tilesets, image paths are relative to the .gmapbin directory
+  std::string _mapDir = _GameMap_getDir(path);
+  if (rc == 0 && _header->tilesetsNum > 0) {
+    map->tilesetsNum = _header->tilesetsNum;
+    map->tilesets = (GMapTileset_t*)calloc(_header->tilesetsNum, sizeof(GMapTileset_t));
+    map->byteSize += sizeof(GMapTileset_t) * _header->tilesetsNum;
+    if (map->tilesets == nullptr) rc = -1;
+  }
+  for (int i = 0; rc == 0 && i < map->tilesetsNum; i++) {
+    const _BinTileset_t* _src = &_tilesets[i];
+    GMapTileset_t* _tileset = &map->tilesets[i];
+    //Same ranges as the JSON tileset schema, GIDs of the tiles fit in _GID_MASK,
+    //the image has all the tiles (LoadDivGraph)
+    if (_src->tilewidth < 1 || _src->tilewidth > _BIN_MAP_SIZE_MAX || _src->tileheight < 1 || _src->tileheight > _BIN_MAP_SIZE_MAX
+        || _src->imagewidth < 1 || _src->imagewidth > _BIN_MAP_SIZE_MAX || _src->imageheight < 1 || _src->imageheight > _BIN_MAP_SIZE_MAX
+        || _src->firstgid < 1 || (unsigned)_src->firstgid > _GID_MASK
+        || _src->tilecount < 0 || (unsigned)_src->tilecount > _GID_MASK + 1 - (unsigned)_src->firstgid
+        || _src->tilecount > (_src->imagewidth / _src->tilewidth) * (_src->imageheight / _src->tileheight)) {
+      _GameMap_appendToErrStr(path + (std::string)"\nBinary map error: bad tileset " + std::to_string(i) + "\n");
+      rc = -1;
+      break;
+    }
+    memcpy(_tileset->name, _src->name, sizeof(_tileset->name));
+    _tileset->name[sizeof(_tileset->name) - 1] = '\0';
+    std::string _image(_src->image, strnlen(_src->image, sizeof(_src->image)));
+    strncpy_s(_tileset->imgPath, (_mapDir + _image).c_str(), sizeof(_tileset->imgPath) - 1);
+    std::string _source(_src->source, strnlen(_src->source, sizeof(_src->source)));
+    if (_source.size() > 0)
+      strncpy_s(_tileset->source, (_mapDir + _source).c_str(), sizeof(_tileset->source) - 1);
+    _tileset->firstgid = _src->firstgid;
+    _tileset->imageheight = _src->imageheight;
+    _tileset->imagewidth = _src->imagewidth;
+    _tileset->tilewidth = _src->tilewidth;
+    _tileset->tileheight = _src->tileheight;
+    _tileset->tilecount = _src->tilecount;
+  }
+
+  //objects
+  if (rc == 0 && _header->objectsBytes > 0) {
+    map->objects = _GameMap_readObjects(_mapping->base + _header->objectsOffset, (size_t)_header->objectsBytes, map);
+    if (map->objects == nullptr) {
+      _GameMap_appendToErrStr(path + (std::string)"\nBinary map error: bad objects\n");
+      rc = -1;
+    }
+    else {
+      map->objectsNum = map->objects->num;
+      map->byteSize += map->objects->byteSize;
+    }
+  }
+
+  //properties
+  if (rc == 0 && _header->propertiesBytes > 0) {
+    map->properties = _GameMap_readProperties(_mapping->base + _header->propertiesOffset,
+                                              (size_t)_header->propertiesBytes, map);
+    if (map->properties == nullptr) {
+      _GameMap_appendToErrStr(path + (std::string)"\nBinary map error: bad properties\n");
+      rc = -1;
+    }
+    else
+      map->byteSize += map->properties->byteSize;
+  }
+
+  if (rc == 0 && loadGraphs) rc = ReloadGameMapGraphs(map);
+  if (rc != 0) {
+    GameMap_free(map);
+    return nullptr;
+  }
+  return map;
+}
+
+/*******************************************************************************/
+/**
+ * Load Tiled JSON map through its .gmapbin cache
+ */
+GameMap_t* GameMap_loadCached(const char* jsonPath)
+{
+  return _GameMap_loadCached(jsonPath, true);
+}
+
+//loadGraphs == false: see _GameMap_loadStreaming()
+GameMap_t* _GameMap_loadCached(const char* jsonPath, bool loadGraphs)
+{
+  if (jsonPath == nullptr)
+    return nullptr;
+  std::string _binPath = _cachePath(jsonPath);
+
+  //Use the cache when it was made from this JSON file
+  uint64_t _size = 0;
+  int64_t _mtime = 0;
+  _BinHeader_t _header;
+  bool _haveSource = 0 == _GameMap_fileStat(jsonPath, &_size, &_mtime);
+  bool _haveCache = 0 == _readHeader(_binPath.c_str(), &_header);
+  bool _upToDate = _haveCache && (false == _haveSource
+    || (_sourceUpToDate(jsonPath, _header.sourceSize, _header.sourceMtime, _header.sourceHash)
+        && _tilesetFilesUpToDate(_binPath.c_str(), &_header)));
+  if (_upToDate) {
+    GameMap_t* map = _GameMap_loadBinary(_binPath.c_str(), loadGraphs);
+    if (map != nullptr || false == _haveSource)
+      return map;
+  }
+
+  //Cache missing or out of date: load JSON and write the cache (best effort)
+  GameMap_t* map = _GameMap_loadStreaming(jsonPath, loadGraphs);
+  if (map != nullptr) {
+    GameMap_saveBinary(map, _binPath.c_str(), jsonPath);
+    _GameMap_clearErrStr();
+  }
+  return map;
+}
+
+/*******************************************************************************/
+void _GameMap_closeMapping(_GameMap_Mapping_t* mapping)
+{
+  if (mapping == nullptr)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(mapping->base);
+  CloseHandle(mapping->mapping);
+  CloseHandle(mapping->file);
+#else
+  munmap(mapping->base, mapping->size);
+#endif
+  free(mapping);
+}
+
+/*******************************************************************************/
+/**
+ * Map whole file, copy on write so layer data stays writable
+ *
+ * @return nullptr : can not map file
+ */
+static _GameMap_Mapping_t* _mapFile(const char* path)
+{
+  _GameMap_Mapping_t* _mapping = (_GameMap_Mapping_t*)calloc(1, sizeof(_GameMap_Mapping_t));
+  if (_mapping == nullptr)
+    return nullptr;
+#ifdef _WIN32
+  _mapping->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  LARGE_INTEGER _size;
+  if (_mapping->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(_mapping->file, &_size) || _size.QuadPart == 0) {
+    if (_mapping->file != INVALID_HANDLE_VALUE) CloseHandle(_mapping->file);
+    free(_mapping);
+    return nullptr;
+  }
+  _mapping->size = (size_t)_size.QuadPart;
+  _mapping->mapping = CreateFileMappingA(_mapping->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if (_mapping->mapping != NULL)
+    _mapping->base = (unsigned char*)MapViewOfFile(_mapping->mapping, FILE_MAP_COPY, 0, 0, 0);
+  if (_mapping->base == nullptr) {
+    if (_mapping->mapping != NULL) CloseHandle(_mapping->mapping);
+    CloseHandle(_mapping->file);
+    free(_mapping);
+    return nullptr;
+  }
+#else
+  int fd = open(path, O_RDONLY);
+  struct stat _st;
+  if (fd < 0 || fstat(fd, &_st) != 0 || _st.st_size == 0) {
+    if (fd >= 0) close(fd);
+    free(_mapping);
+    return nullptr;
+  }
+  _mapping->size = (size_t)_st.st_size;
+  void* _base = mmap(nullptr, _mapping->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (_base == MAP_FAILED) {
+    free(_mapping);
+    return nullptr;
+  }
+  _mapping->base = (unsigned char*)_base;
+#endif
+  return _mapping;
+}
+
+/*******************************************************************************/
+static bool _checkHeader(const _BinHeader_t* header, size_t fileSize)
+{
+  if (0 != memcmp(header->magic, _BIN_MAGIC, sizeof(header->magic))
+      || header->version != _BIN_VERSION
+      || header->byteOrder != _BIN_BYTE_ORDER
+      || header->fileSize != fileSize)
+    return false;
+  if (header->width < 0 || header->width > _BIN_MAP_SIZE_MAX || header->height < 0 || header->height > _BIN_MAP_SIZE_MAX
+      || header->tilewidth < 1 || header->tileheight < 1 || header->layersNum < 0 || header->tilesetsNum < 0)
+    return false;
+  //Tables inside the file
+  if (header->tilesetsOffset > fileSize || header->layersOffset > fileSize
+      || (fileSize - header->tilesetsOffset) / sizeof(_BinTileset_t) < (uint64_t)header->tilesetsNum
+      || (fileSize - header->layersOffset) / sizeof(_BinLayer_t) < (uint64_t)header->layersNum
+      || header->tilesetsOffset % 8 != 0 || header->layersOffset % 8 != 0
+      || header->objectsOffset > fileSize || header->objectsBytes > fileSize - header->objectsOffset
+      || header->propertiesOffset > fileSize || header->propertiesBytes > fileSize - header->propertiesOffset)
+    return false;
+  return true;
+}
+
+/*******************************************************************************/
+/**
+ * @return != 0 : no file or not a .gmapbin
+ */
+static int _readHeader(const char* path, _BinHeader_t* header)
+{
+  FILE* fp = fopen(path, "rb");
+  if (fp == nullptr)
+    return -1;
+  size_t _read = fread(header, sizeof(_BinHeader_t), 1, fp);
+  fclose(fp);
+  if (_read != 1 || 0 != memcmp(header->magic, _BIN_MAGIC, sizeof(header->magic))
+      || header->version != _BIN_VERSION || header->byteOrder != _BIN_BYTE_ORDER)
+    return -1;
+  return 0;
+}
+
+/*******************************************************************************/
+//Size, time and hash of a file a cache is made from
+static int _statSource(const char* path, uint64_t* size, int64_t* mtime, uint64_t* hash)
+{
+  if (0 != _GameMap_fileStat(path, size, mtime) || 0 != _fileHash(path, hash))
+    return -1;
+  //A source saved again in the same clock tick would keep its time: rely on the hash
+  if (*mtime / 1000000000 + _BIN_RACY_SECONDS >= (int64_t)time(nullptr))
+    *mtime = -1;
+  return 0;
+}
+
+//Source file same as when the cache was made
+static bool _sourceUpToDate(const char* path, uint64_t size, int64_t mtime, uint64_t hash)
+{
+  uint64_t _size = 0;
+  int64_t _mtime = 0;
+  if (0 != _GameMap_fileStat(path, &_size, &_mtime) || _size != size)
+    return false;
+  if (_mtime == mtime)
+    return true;
+  //Same size, new time (checkout, copy): compare contents
+  uint64_t _hash;
+  return 0 == _fileHash(path, &_hash) && _hash == hash;
+}
+
+//External tileset files of the cached map same as when the cache was made
+static bool _tilesetFilesUpToDate(const char* binPath, const _BinHeader_t* header)
+{
+  FILE* fp = fopen(binPath, "rb");
+  if (fp == nullptr)
+    return false;
+  std::string _mapDir = _GameMap_getDir(binPath);
+  bool _upToDate = 0 == fseek(fp, (long)header->tilesetsOffset, SEEK_SET);
+  for (int i = 0; _upToDate && i < header->tilesetsNum; i++) {
+    _BinTileset_t _tileset;
+    _upToDate = 1 == fread(&_tileset, sizeof(_tileset), 1, fp);
+    std::string _source(_tileset.source, strnlen(_tileset.source, sizeof(_tileset.source)));
+    if (_upToDate && _source.size() > 0)
+      _upToDate = _sourceUpToDate((_mapDir + _source).c_str(), _tileset.sourceSize, _tileset.sourceMtime, _tileset.sourceHash);
+  }
+  fclose(fp);
+  return _upToDate;
+}
+
+/*******************************************************************************/
+//Size and modification time in ns since 1970
+int _GameMap_fileStat(const char* path, uint64_t* size, int64_t* mtime)
+{
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA _attr;
+  if (!GetFileAttributesExA(path, GetFileExInfoStandard, &_attr))
+    return -1;
+  *size = ((uint64_t)_attr.nFileSizeHigh << 32) | _attr.nFileSizeLow;
+  uint64_t _ticks = ((uint64_t)_attr.ftLastWriteTime.dwHighDateTime << 32) | _attr.ftLastWriteTime.dwLowDateTime;
+  *mtime = ((int64_t)_ticks - 116444736000000000ll) * 100; //100 ns ticks since 1601
+#else
+  struct stat _st;
+  if (0 != stat(path, &_st))
+    return -1;
+  *size = (uint64_t)_st.st_size;
+#ifdef __APPLE__
+  *mtime = (int64_t)_st.st_mtimespec.tv_sec * 1000000000 + _st.st_mtimespec.tv_nsec;
+#else
+  *mtime = (int64_t)_st.st_mtim.tv_sec * 1000000000 + _st.st_mtim.tv_nsec;
+#endif
+#endif
+  return 0;
+}
+
+/*******************************************************************************/
+//FNV-1a 64 of the whole file
+static int _fileHash(const char* path, uint64_t* hash)
+{
+  FILE* fp = fopen(path, "rb");
+  if (fp == nullptr)
+    return -1;
+  const size_t _bufferSize = 64 * 1024;
+  unsigned char* _buffer = (unsigned char*)malloc(_bufferSize); //Not on the stack of loader threads
+  if (_buffer == nullptr) {
+    fclose(fp);
+    return -1;
+  }
+  uint64_t _hash = 14695981039346656037ull;
+  size_t _read;
+  while ((_read = fread(_buffer, 1, _bufferSize, fp)) > 0) {
+    for (size_t i = 0; i < _read; i++) {
+      _hash ^= _buffer[i];
+      _hash *= 1099511628211ull;
+    }
+  }
+  free(_buffer);
+  fclose(fp);
+  *hash = _hash;
+  return 0;
+}
+
+/*******************************************************************************/
+//"dir/map.json" -> "dir/map.gmapbin"
+static std::string _cachePath(const char* jsonPath)
+{
+  std::string _path = jsonPath;
+  size_t _dot = _path.find_last_of('.');
+  size_t _slash = _path.find_last_of("\\/");
+  if (_dot != std::string::npos && (_slash == std::string::npos || _dot > _slash))
+    _path.erase(_dot);
+  return _path + ".gmapbin";
+}
+
+/*******************************************************************************/
+//Bytes of a layer data block
+static uint64_t _layerBytes(const _BinLayer_t* layer)
+{
+  uint64_t _flagsOffset;
+  if (layer->chunksNum < 0)
+    return _denseBytes(layer, &_flagsOffset);
+  return _chunkCoordsBytes(layer->chunksNum) + (uint64_t)layer->chunksNum * _CHUNK_TILES * sizeof(uint32_t);
+}
+
+//Bytes of a dense layer block, flags plane offset in it
+static uint64_t _denseBytes(const _BinLayer_t* layer, uint64_t* flagsOffset)
+{
+  int _type = layer->storage & ~_BIN_FLAGS_PLANE;
+  uint64_t _tilesNum = (uint64_t)layer->width * layer->height;
+  uint64_t _bytes = _tilesNum * (_type == _STORE_U8 ? 1 : _type == _STORE_U16 ? 2 : 4);
+  if (_type == _STORE_BLOCKS || _type == _STORE_RUNS)
+    _bytes = _GameMap_sparseBytes(_type, layer->width, layer->height, layer->sparseNum);
+  *flagsOffset = (_bytes + _BIN_DATA_ALIGN - 1) & ~(uint64_t)(_BIN_DATA_ALIGN - 1);
+  if (layer->storage & _BIN_FLAGS_PLANE)
+    _bytes = *flagsOffset + (_tilesNum + 1) / 2;
+  return _bytes;
+}
+
+//Bytes of the chunk (x,y) pairs, chunk tiles after them stay aligned
+static uint64_t _chunkCoordsBytes(int chunksNum)
+{
+  uint64_t _bytes = (uint64_t)chunksNum * 2 * sizeof(int32_t);
+  return (_bytes + _BIN_DATA_ALIGN - 1) & ~(uint64_t)(_BIN_DATA_ALIGN - 1);
+}
@@ -0,0 +1,259 @@
+/*******************************************************************************
+ * GameMap infinite map layers
+ * Tiled infinite maps keep layer data in chunks placed anywhere (also at
+ * negative coordinates). Tiles are stored here in _CHUNK_SIZE x _CHUNK_SIZE
+ * blocks, a block only exists where the layer has non zero tiles, and blocks
+ * are found by chunk coordinates in an open addressing hash table.
+ *
+ * Tile (tx,ty) is in chunk (tx >> _CHUNK_SHIFT, ty >> _CHUNK_SHIFT), at
+ * (tx & (_CHUNK_SIZE - 1), ty & (_CHUNK_SIZE - 1)) inside it
+ * (>> of negative ints is arithmetic on every compiler this builds with)
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+#define _CHUNK_MASK (_CHUNK_SIZE - 1)
+#define _SLOTS_MIN 16
+
+/*
+Private functions
+*/
+static GMapChunks_t* _newTable(int slotsNum);
+static int _findBlock(const GMapChunks_t* chunks, int cx, int cy);
+static int _insertSlot(GMapChunks_t* chunks, int cx, int cy, int block);
+static int _addBlock(GMapChunks_t* chunks, int cx, int cy);
+
+/*******************************************************************************/
+static inline unsigned long long _chunkKey(int cx, int cy)
+{
+  return ((unsigned long long)(unsigned int)cx << 32) | (unsigned int)cy;
+}
+
+static inline unsigned int _chunkHash(unsigned long long key)
+{
+  return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+/*******************************************************************************/
+/**
+ * Copy a w x h chunk of tiles at tile (x,y) into the layer chunks
+ * Zero tiles are skipped, blocks are only made for non zero tiles
+ *
+ * @return != 0 : out of memory
+ */
+int _GameMap_putChunk(GMapTilelayer_t* layer, int x, int y, int w, int h, const unsigned int* data)
+{
+  if (layer->chunks == nullptr) {
+    layer->chunks = _newTable(_SLOTS_MIN);
+    if (layer->chunks == nullptr)
+      return -1;
+  }
+  GMapChunks_t* _chunks = layer->chunks;
+  //Neighbour tiles share a block, look it up once per block row
+  int _lastcx = 0, _lastcy = 0, _block = -1;
+  for (int r = 0; r < h; r++) {
+    int ty = y + r;
+    int cy = ty >> _CHUNK_SHIFT;
+    for (int c = 0; c < w; c++) {
+      unsigned int _gid = data[(size_t)r * w + c];
+      if (_gid == 0)
+        continue;
+      int tx = x + c;
+      int cx = tx >> _CHUNK_SHIFT;
+      if (_block < 0 || cx != _lastcx || cy != _lastcy) {
+        _block = _findBlock(_chunks, cx, cy);
+        if (_block < 0) _block = _addBlock(_chunks, cx, cy);
+        if (_block < 0) return -1;
+        _lastcx = cx;
+        _lastcy = cy;
+      }
+      _chunks->tiles[(size_t)_block * _CHUNK_TILES + ((ty & _CHUNK_MASK) << _CHUNK_SHIFT) + (tx & _CHUNK_MASK)] = _gid;
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Make a chunk table over blocks already in memory (a .gmapbin mapping)
+ * coords: chunk (x,y) of each block, tiles: blocksNum * _CHUNK_TILES GIDs
+ * Neither is copied nor freed by _GameMap_freeChunks()
+ */
+GMapChunks_t* _GameMap_newChunks(int blocksNum, const int* coords, unsigned int* tiles)
+{
+  int _slotsNum = _SLOTS_MIN;
+  while (_slotsNum < blocksNum * 2) _slotsNum *= 2;
+  GMapChunks_t* _chunks = _newTable(_slotsNum);
+  if (_chunks == nullptr)
+    return nullptr;
+  _chunks->mapped = true;
+  _chunks->tiles = tiles;
+  _chunks->coords = (int*)coords;
+  _chunks->blocksNum = blocksNum;
+  _chunks->blocksCap = blocksNum;
+  for (int i = 0; i < blocksNum; i++) {
+    int cx = coords[2 * i], cy = coords[2 * i + 1];
+    _insertSlot(_chunks, cx, cy, i);
+    if (i == 0 || cx < _chunks->minx) _chunks->minx = cx;
+    if (i == 0 || cy < _chunks->miny) _chunks->miny = cy;
+    if (i == 0 || cx >= _chunks->maxx) _chunks->maxx = cx + 1;
+    if (i == 0 || cy >= _chunks->maxy) _chunks->maxy = cy + 1;
+  }
+  return _chunks;
+}
+
+/*******************************************************************************/
+/**
+ * @return _CHUNK_TILES GIDs of chunk (cx,cy)
+ * @return nullptr : chunk has no tiles
+ */
+const unsigned int* _GameMap_findChunk(const GMapChunks_t* chunks, int cx, int cy)
+{
+  int _block = _findBlock(chunks, cx, cy);
+  if (_block < 0)
+    return nullptr;
+  return chunks->tiles + (size_t)_block * _CHUNK_TILES;
+}
+
+/*******************************************************************************/
+/**
+ * @return tile value (with flip flags) at tile (tx,ty), 0 if there is none
+ */
+unsigned int _GameMap_getChunkTile(const GMapChunks_t* chunks, int tx, int ty)
+{
+  const unsigned int* _tiles = _GameMap_findChunk(chunks, tx >> _CHUNK_SHIFT, ty >> _CHUNK_SHIFT);
+  if (_tiles == nullptr)
+    return 0;
+  return _tiles[((ty & _CHUNK_MASK) << _CHUNK_SHIFT) + (tx & _CHUNK_MASK)];
+}
+
+/*******************************************************************************/
+size_t _GameMap_chunksByteSize(const GMapChunks_t* chunks)
+{
+  if (chunks == nullptr)
+    return 0;
+  size_t _slotsNum = (size_t)chunks->mask + 1;
+  return sizeof(GMapChunks_t)
+       + _slotsNum * (sizeof(unsigned long long) + sizeof(int))
+       + (size_t)chunks->blocksCap * (_CHUNK_TILES * sizeof(unsigned int) + 2 * sizeof(int));
+}
+
+/*******************************************************************************/
+void _GameMap_freeChunks(GMapChunks_t* chunks)
+{
+  if (chunks == nullptr)
+    return;
+  free(chunks->keys);
+  free(chunks->slots);
+  if (false == chunks->mapped) {
+    free(chunks->tiles);
+    free(chunks->coords);
+  }
+  free(chunks);
+}
+
+/*******************************************************************************/
+static GMapChunks_t* _newTable(int slotsNum)
+{
+  GMapChunks_t* _chunks = (GMapChunks_t*)calloc(1, sizeof(GMapChunks_t));
+  if (_chunks == nullptr)
+    return nullptr;
+  _chunks->keys = (unsigned long long*)malloc(slotsNum * sizeof(unsigned long long));
+  _chunks->slots = (int*)malloc(slotsNum * sizeof(int));
+  if (_chunks->keys == nullptr || _chunks->slots == nullptr) {
+    _GameMap_freeChunks(_chunks);
+    return nullptr;
+  }
+  for (int i = 0; i < slotsNum; i++)
+    _chunks->slots[i] = -1;
+  _chunks->mask = slotsNum - 1;
+  return _chunks;
+}
+
+/*******************************************************************************/
+//@return block of chunk (cx,cy), -1 if there is none
+static int _findBlock(const GMapChunks_t* chunks, int cx, int cy)
+{
+  unsigned long long _key = _chunkKey(cx, cy);
+  for (unsigned int i = _chunkHash(_key) & chunks->mask; ; i = (i + 1) & chunks->mask) {
+    int _block = chunks->slots[i];
+    if (_block < 0 || chunks->keys[i] == _key)
+      return _block;
+  }
+}
+
+/*******************************************************************************/
+//Slots are never more than half full, there is always a free one
+static int _insertSlot(GMapChunks_t* chunks, int cx, int cy, int block)
+{
+  unsigned long long _key = _chunkKey(cx, cy);
+  unsigned int i = _chunkHash(_key) & chunks->mask;
+  while (chunks->slots[i] >= 0)
+    i = (i + 1) & chunks->mask;
+  chunks->keys[i] = _key;
+  chunks->slots[i] = block;
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Add an empty block for chunk (cx,cy)
+ *
+ * @return new block
+ * @return -1 : out of memory
+ */
+static int _addBlock(GMapChunks_t* chunks, int cx, int cy)
+{
+  //Grow blocks
+  if (chunks->blocksNum == chunks->blocksCap) {
+    int _cap = chunks->blocksCap == 0 ? 4 : chunks->blocksCap * 2;
+    unsigned int* _tiles = (unsigned int*)realloc(chunks->tiles, (size_t)_cap * _CHUNK_TILES * sizeof(unsigned int));
+    if (_tiles == nullptr)
+      return -1;
+    chunks->tiles = _tiles;
+    int* _coords = (int*)realloc(chunks->coords, (size_t)_cap * 2 * sizeof(int));
+    if (_coords == nullptr)
+      return -1;
+    chunks->coords = _coords;
+    chunks->blocksCap = _cap;
+  }
+  //Grow slots, keeping them at most half full
+  unsigned int _slotsNum = chunks->mask + 1;
+  if ((unsigned int)(chunks->blocksNum + 1) * 2 > _slotsNum) {
+    unsigned long long* _keys = chunks->keys;
+    int* _slots = chunks->slots;
+    unsigned int _newSlotsNum = _slotsNum * 2;
+    chunks->keys = (unsigned long long*)malloc(_newSlotsNum * sizeof(unsigned long long));
+    chunks->slots = (int*)malloc(_newSlotsNum * sizeof(int));
+    if (chunks->keys == nullptr || chunks->slots == nullptr) {
+      free(chunks->keys);
+      free(chunks->slots);
+      chunks->keys = _keys;
+      chunks->slots = _slots;
+      return -1;
+    }
+    for (unsigned int i = 0; i < _newSlotsNum; i++)
+      chunks->slots[i] = -1;
+    chunks->mask = _newSlotsNum - 1;
+    for (unsigned int i = 0; i < _slotsNum; i++)
+      if (_slots[i] >= 0)
+        _insertSlot(chunks, chunks->coords[2 * _slots[i]], chunks->coords[2 * _slots[i] + 1], _slots[i]);
+    free(_keys);
+    free(_slots);
+  }
+
+  int _block = chunks->blocksNum++;
+  memset(chunks->tiles + (size_t)_block * _CHUNK_TILES, 0, _CHUNK_TILES * sizeof(unsigned int));
+  chunks->coords[2 * _block] = cx;
+  chunks->coords[2 * _block + 1] = cy;
+  _insertSlot(chunks, cx, cy, _block);
+  if (_block == 0 || cx < chunks->minx) chunks->minx = cx;
+  if (_block == 0 || cy < chunks->miny) chunks->miny = cy;
+  if (_block == 0 || cx >= chunks->maxx) chunks->maxx = cx + 1;
+  if (_block == 0 || cy >= chunks->maxy) chunks->maxy = cy + 1;
+  return _block;
+}
@@ -0,0 +1,820 @@
+/*******************************************************************************
+ * GameMap layer data codecs
+ * Decodes Tiled "encoding":"base64" layer data, optionally compressed with
+ * "compression":"zlib" | "gzip" | "zstd", straight into the tile buffer:
+ *   - base64 is decoded with a lookup table (16 chars at a time with SSSE3,
+ *     on x64 builds when the CPU has it)
+ *   - zlib/gzip are inflated by the small inflater below (no zlib needed),
+ *     writing into the tile buffer as it goes
+ *   - zstd needs libzstd: define GAMEMAP_USE_ZSTD and link zstd to enable it
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#if defined(__SSSE3__) || defined(__AVX__) || defined(_M_X64)
+#include <tmmintrin.h>
+#define _BASE64_SSSE3
+#endif
+#if defined(_M_X64) && !defined(__AVX__)
+#include <intrin.h>
+#define _BASE64_CPUID     //x64 only guarantees SSE2, SSSE3 is checked at run time
+#endif
+#ifdef GAMEMAP_USE_ZSTD
+#include <zstd.h>
+#endif
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+/*******************************************************************************/
+//Inflater state, reads LSB first bits from in, writes to out
+typedef struct {
+  const unsigned char* in;
+  const unsigned char* inEnd;
+  uint64_t bits;       //Bit buffer
+  int bitCount;        //Valid bits in bits
+  unsigned char* outBegin;
+  unsigned char* out;
+  unsigned char* outEnd;
+  const char* err;
+} _Inflate_t;
+
+//Canonical Huffman code, codes up to _FAST_BITS long are decoded with one lookup
+#define _FAST_BITS 10
+#define _MAX_BITS 15
+typedef struct {
+  uint16_t fast[1 << _FAST_BITS]; //(length << 9) | symbol, 0: code is longer
+  uint16_t count[_MAX_BITS + 1];  //Codes of each length
+  uint16_t symbol[288];           //Symbols in canonical order
+} _Huffman_t;
+
+/*
+Private functions
+*/
+static int _base64Decode(const char* src, size_t len, unsigned char* out, size_t outLen);
+static size_t _base64DecodedLen(const char* src, size_t len);
+static const unsigned char* _inflate(const unsigned char* src, size_t srcLen, unsigned char* out, size_t outLen, size_t* written, const char** err);
+static int _zlibDecompress(const unsigned char* src, size_t srcLen, unsigned char* out, size_t outLen, std::string& err);
+static int _gzipDecompress(const unsigned char* src, size_t srcLen, unsigned char* out, size_t outLen, std::string& err);
+static void _toHostOrder(unsigned int* data, size_t count);
+static std::string _sizeError(size_t written, size_t outLen);
+
+/*******************************************************************************/
+/**
+ * Supported "compression" values for base64 layers
+ */
+bool _GameMap_isCompressionSupported(const std::string& compression)
+{
+  return compression == ""
+      || compression == "zlib"
+      || compression == "gzip"
+#ifdef GAMEMAP_USE_ZSTD
+      || compression == "zstd"
+#endif
+      ;
+}
+
+/*******************************************************************************/
+/**
+ * Decode base64 (and compressed) layer data into a new tilesNum GIDs buffer
+ *
+ * @return malloc'd tile data
+ * @return nullptr : bad data, err is set
+ */
+unsigned int* _GameMap_decodeLayerData(const char* text, size_t textLen, const std::string& compression, size_t tilesNum, std::string& err)
+{
+  size_t _bytes = tilesNum * sizeof(unsigned int);
+  unsigned int* _data = (unsigned int*)malloc(_bytes > 0 ? _bytes : 1);
+  if (_data == nullptr) {
+    err = "out of memory";
+    return nullptr;
+  }
+  if (0 != _GameMap_decodeLayerInto(text, textLen, compression, _data, tilesNum, err)) {
+    free(_data);
+    return nullptr;
+  }
+  return _data;
+}
+
+/*******************************************************************************/
+/**
+ * Decode base64 (and compressed) layer data into data, tilesNum GIDs
+ * allocated by the caller
+ *
+ * @return != 0 : bad data, err is set
+ */
+int _GameMap_decodeLayerInto(const char* text, size_t textLen, const std::string& compression, unsigned int* data,
+                             size_t tilesNum, std::string& err)
+{
+  size_t _bytes = tilesNum * sizeof(unsigned int);
+  size_t _decodedLen = _base64DecodedLen(text, textLen);
+  if (_decodedLen == (size_t)-1) {
+    err = "bad base64 data length";
+    return -1;
+  }
+  unsigned int* _data = data;
+
+  int rc = 0; //return code
+  if (compression == "") {
+    //Uncompressed: base64 goes straight into the tile buffer
+    if (_decodedLen != _bytes) {
+      err = _sizeError(_decodedLen, _bytes);
+      rc = -1;
+    }
+    else if (0 != _base64Decode(text, textLen, (unsigned char*)_data, _bytes)) {
+      err = "bad base64 data";
+      rc = -1;
+    }
+  }
+  else {
+    unsigned char* _packed = (unsigned char*)malloc(_decodedLen > 0 ? _decodedLen : 1);
+    if (_packed == nullptr) {
+      err = "out of memory";
+      rc = -1;
+    }
+    else if (0 != _base64Decode(text, textLen, _packed, _decodedLen)) {
+      err = "bad base64 data";
+      rc = -1;
+    }
+    else if (compression == "zlib") {
+      rc = _zlibDecompress(_packed, _decodedLen, (unsigned char*)_data, _bytes, err);
+    }
+    else if (compression == "gzip") {
+      rc = _gzipDecompress(_packed, _decodedLen, (unsigned char*)_data, _bytes, err);
+    }
+#ifdef GAMEMAP_USE_ZSTD
+    else if (compression == "zstd") {
+      size_t _written = ZSTD_decompress(_data, _bytes, _packed, _decodedLen);
+      if (ZSTD_isError(_written)) {
+        err = std::string("zstd: ") + ZSTD_getErrorName(_written);
+        rc = -1;
+      }
+      else if (_written != _bytes) {
+        err = _sizeError(_written, _bytes);
+        rc = -1;
+      }
+    }
+#endif
+    else {
+      err = "compression \"" + compression + "\" not supported";
+      rc = -1;
+    }
+    free(_packed);
+  }
+
+  if (rc != 0)
+    return rc;
+  _toHostOrder(_data, tilesNum);
+  return 0;
+}
+
+/*******************************************************************************/
+//Tile GIDs are stored as little endian uint32
+static void _toHostOrder(unsigned int* data, size_t count)
+{
+  const uint16_t _one = 1;
+  if (*(const unsigned char*)&_one == 1)
+    return;
+  for (size_t i = 0; i < count; i++) {
+    const unsigned char* b = (const unsigned char*)&data[i];
+    data[i] = b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned int)b[3] << 24);
+  }
+}
+
+/*******************************************************************************
+ * base64
+*******************************************************************************/
+
+//6 bit value of each char, 0xFF: not a base64 char
+static const unsigned char _BASE64_VALUES[256] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,   62, 0xFF, 0xFF, 0xFF,   63,
+    52,   53,   54,   55,   56,   57,   58,   59,   60,   61, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF,    0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,
+    15,   16,   17,   18,   19,   20,   21,   22,   23,   24,   25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF,   26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40,
+    41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/*******************************************************************************/
+/**
+ * Decoded size of padded base64 text
+ *
+ * @return (size_t)-1 : length is not a multiple of 4
+ */
+static size_t _base64DecodedLen(const char* src, size_t len)
+{
+  if (len % 4 != 0)
+    return (size_t)-1;
+  size_t _padding = 0;
+  if (len > 0 && src[len - 1] == '=') _padding++;
+  if (len > 1 && src[len - 2] == '=') _padding++;
+  return len / 4 * 3 - _padding;
+}
+
+#ifdef _BASE64_SSSE3
+#ifdef _BASE64_CPUID
+static bool _cpuHasSsse3()
+{
+  int _regs[4];
+  __cpuid(_regs, 1);
+  return (_regs[2] & (1 << 9)) != 0;
+}
+static const bool _useSsse3 = _cpuHasSsse3();
+#else
+static const bool _useSsse3 = true;
+#endif
+
+/*******************************************************************************/
+/**
+ * Decode 16 base64 chars to 12 bytes, 16 bytes are written to out
+ *
+ * @return != 0 : not 16 plain base64 chars (padding or bad chars)
+ */
+static inline int _base64Decode16(const char* src, unsigned char* out)
+{
+  const __m128i c = _mm_loadu_si128((const __m128i*)src);
+  //Ranges, bytes >= 0x80 are negative and match none
+  const __m128i _upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+  const __m128i _lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+  const __m128i _digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+  const __m128i _plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+  const __m128i _slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+  const __m128i _valid = _mm_or_si128(_mm_or_si128(_upper, _lower), _mm_or_si128(_digit, _mm_or_si128(_plus, _slash)));
+  if (_mm_movemask_epi8(_valid) != 0xFFFF)
+    return -1;
+  //char -> 6 bit value
+  __m128i _shift = _mm_and_si128(_upper, _mm_set1_epi8(-65));
+  _shift = _mm_or_si128(_shift, _mm_and_si128(_lower, _mm_set1_epi8(-71)));
+  _shift = _mm_or_si128(_shift, _mm_and_si128(_digit, _mm_set1_epi8(4)));
+  _shift = _mm_or_si128(_shift, _mm_and_si128(_plus, _mm_set1_epi8(19)));
+  _shift = _mm_or_si128(_shift, _mm_and_si128(_slash, _mm_set1_epi8(16)));
+  const __m128i v = _mm_add_epi8(c, _shift);
+  //Pack 4 x 6 bits to 24 bits per 32 bit lane, then keep 3 bytes of each lane
+  const __m128i _pairs = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+  const __m128i _lanes = _mm_madd_epi16(_pairs, _mm_set1_epi32(0x00011000));
+  const __m128i _bytes = _mm_shuffle_epi8(_lanes, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  _mm_storeu_si128((__m128i*)out, _bytes);
+  return 0;
+}
+#endif
+
+/*******************************************************************************/
+/**
+ * Decode padded base64 text to out, outLen must be _base64DecodedLen()
+ *
+ * @return != 0 : bad base64 char, or outLen too small
+ */
+static int _base64Decode(const char* src, size_t len, unsigned char* out, size_t outLen)
+{
+  const char* _end = src + len;
+  unsigned char* _outEnd = out + outLen;
+#ifdef _BASE64_SSSE3
+  //16 chars -> 12 bytes, stops at padding or bad chars to let the loop below handle them
+  while (_useSsse3 && _end - src >= 16 && _outEnd - out >= 16 && 0 == _base64Decode16(src, out)) {
+    src += 16;
+    out += 12;
+  }
+#endif
+  while (src != _end) {
+    unsigned int a = _BASE64_VALUES[(unsigned char)src[0]];
+    unsigned int b = _BASE64_VALUES[(unsigned char)src[1]];
+    unsigned int c = _BASE64_VALUES[(unsigned char)src[2]];
+    unsigned int d = _BASE64_VALUES[(unsigned char)src[3]];
+    src += 4;
+    if ((a | b | c | d) < 64) {
+      if (_outEnd - out < 3)
+        return -1;
+      unsigned int _triple = (a << 18) | (b << 12) | (c << 6) | d;
+      out[0] = (unsigned char)(_triple >> 16);
+      out[1] = (unsigned char)(_triple >> 8);
+      out[2] = (unsigned char)_triple;
+      out += 3;
+      continue;
+    }
+    //Padding, only in the last quad: "xx==" or "xxx="
+    if (src != _end || a > 63 || b > 63 || src[-1] != '=' || (c > 63 && src[-2] != '='))
+      return -1;
+    if (_outEnd - out < (c <= 63 ? 2 : 1))
+      return -1;
+    out[0] = (unsigned char)((a << 2) | (b >> 4));
+    if (c <= 63)
+      out[1] = (unsigned char)((b << 4) | (c >> 2));
+  }
+  return 0;
+}
+
+/*******************************************************************************
+ * Inflate (RFC 1951), output size is known so data is written in place
+*******************************************************************************/
+
+static const uint16_t _LENGTH_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t _LENGTH_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t _DIST_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t _DIST_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+//Order of code length code lengths in dynamic blocks
+static const uint8_t _CLEN_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+/*******************************************************************************/
+static inline void _refill(_Inflate_t* s)
+{
+  while (s->bitCount <= 56 && s->in != s->inEnd) {
+    s->bits |= (uint64_t)*s->in++ << s->bitCount;
+    s->bitCount += 8;
+  }
+}
+
+/*******************************************************************************/
+/**
+ * Take n bits (n <= 32)
+ *
+ * @return -1 : end of input
+ */
+static inline int _getBits(_Inflate_t* s, int n, unsigned int* value)
+{
+  if (s->bitCount < n) {
+    _refill(s);
+    if (s->bitCount < n) {
+      s->err = "unexpected end of compressed data";
+      return -1;
+    }
+  }
+  *value = (unsigned int)(s->bits & ((1ull << n) - 1));
+  s->bits >>= n;
+  s->bitCount -= n;
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Build canonical Huffman code from code lengths
+ *
+ * @return != 0 : over subscribed code lengths
+ */
+static int _buildHuffman(_Huffman_t* h, const uint8_t* lengths, int n)
+{
+  uint16_t _offsets[_MAX_BITS + 2];
+  memset(h->count, 0, sizeof(h->count));
+  memset(h->fast, 0, sizeof(h->fast));
+  for (int i = 0; i < n; i++)
+    h->count[lengths[i]]++;
+  h->count[0] = 0;
+  int _left = 1;
+  for (int len = 1; len <= _MAX_BITS; len++) {
+    _left = (_left << 1) - h->count[len];
+    if (_left < 0)
+      return -1;
+  }
+  _offsets[1] = 0;
+  for (int len = 1; len <= _MAX_BITS; len++)
+    _offsets[len + 1] = _offsets[len] + h->count[len];
+  for (int i = 0; i < n; i++)
+    if (lengths[i] != 0)
+      h->symbol[_offsets[lengths[i]]++] = (uint16_t)i;
+
+  //Fast table, codes are stored MSB first so they are bit reversed for lookup
+  unsigned int _code = 0;
+  int _index = 0;
+  for (int len = 1; len <= _FAST_BITS; len++) {
+    for (int i = 0; i < h->count[len]; i++, _code++, _index++) {
+      unsigned int _reversed = 0;
+      for (int b = 0; b < len; b++)
+        _reversed |= ((_code >> b) & 1) << (len - 1 - b);
+      uint16_t _entry = (uint16_t)((len << 9) | h->symbol[_index]);
+      for (unsigned int k = _reversed; k < (1u << _FAST_BITS); k += 1u << len)
+        h->fast[k] = _entry;
+    }
+    _code <<= 1;
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Decode one symbol
+ *
+ * @return -1 : bad code or end of input
+ */
+static inline int _decodeSymbol(_Inflate_t* s, const _Huffman_t* h)
+{
+  if (s->bitCount < _MAX_BITS)
+    _refill(s);
+  unsigned int _entry = h->fast[s->bits & ((1u << _FAST_BITS) - 1)];
+  if (_entry != 0) {
+    int _len = _entry >> 9;
+    if (_len > s->bitCount) {
+      s->err = "unexpected end of compressed data";
+      return -1;
+    }
+    s->bits >>= _len;
+    s->bitCount -= _len;
+    return _entry & 511;
+  }
+  //Long code, one bit at a time
+  int _code = 0, _first = 0, _index = 0;
+  for (int len = 1; len <= _MAX_BITS; len++) {
+    unsigned int _bit;
+    if (_getBits(s, 1, &_bit) != 0)
+      return -1;
+    _code |= _bit;
+    int _count = h->count[len];
+    if (_code - _count < _first)
+      return h->symbol[_index + (_code - _first)];
+    _index += _count;
+    _first = (_first + _count) << 1;
+    _code <<= 1;
+  }
+  s->err = "bad Huffman code";
+  return -1;
+}
+
+/*******************************************************************************/
+/**
+ * Decode a compressed block with lit/length and distance codes
+ */
+static int _inflateCodes(_Inflate_t* s, const _Huffman_t* lit, const _Huffman_t* dist)
+{
+  while (true) {
+    int _symbol = _decodeSymbol(s, lit);
+    if (_symbol < 0)
+      return -1;
+    if (_symbol < 256) {
+      if (s->out == s->outEnd) {
+        s->err = "decompressed data larger than width * height";
+        return -1;
+      }
+      *s->out++ = (unsigned char)_symbol;
+      continue;
+    }
+    if (_symbol == 256)
+      return 0;
+    //Length and distance
+    _symbol -= 257;
+    if (_symbol >= 29) {
+      s->err = "bad length code";
+      return -1;
+    }
+    unsigned int _extra;
+    if (_getBits(s, _LENGTH_EXTRA[_symbol], &_extra) != 0)
+      return -1;
+    size_t _length = _LENGTH_BASE[_symbol] + _extra;
+    _symbol = _decodeSymbol(s, dist);
+    if (_symbol < 0)
+      return -1;
+    if (_symbol >= 30) {
+      s->err = "bad distance code";
+      return -1;
+    }
+    if (_getBits(s, _DIST_EXTRA[_symbol], &_extra) != 0)
+      return -1;
+    size_t _distance = _DIST_BASE[_symbol] + _extra;
+    if (_distance > (size_t)(s->out - s->outBegin)) {
+      s->err = "distance too far back";
+      return -1;
+    }
+    if (_length > (size_t)(s->outEnd - s->out)) {
+      s->err = "decompressed data larger than width * height";
+      return -1;
+    }
+    const unsigned char* _from = s->out - _distance;
+    if (_distance >= _length) {
+      memcpy(s->out, _from, _length);
+      s->out += _length;
+    }
+    else {
+      //Overlapping copy repeats the last _distance bytes
+      for (size_t i = 0; i < _length; i++)
+        *s->out++ = _from[i];
+    }
+  }
+}
+
+/*******************************************************************************/
+static int _inflateStored(_Inflate_t* s)
+{
+  //Back to byte boundary, unread whole bytes go back to the input
+  s->bits >>= s->bitCount & 7;
+  s->bitCount -= s->bitCount & 7;
+  s->in -= s->bitCount / 8;
+  s->bits = 0;
+  s->bitCount = 0;
+  if (s->inEnd - s->in < 4) {
+    s->err = "unexpected end of compressed data";
+    return -1;
+  }
+  unsigned int _len = s->in[0] | (s->in[1] << 8);
+  unsigned int _nlen = s->in[2] | (s->in[3] << 8);
+  s->in += 4;
+  if (_len != (~_nlen & 0xFFFF)) {
+    s->err = "bad stored block length";
+    return -1;
+  }
+  if (_len > (size_t)(s->inEnd - s->in)) {
+    s->err = "unexpected end of compressed data";
+    return -1;
+  }
+  if (_len > (size_t)(s->outEnd - s->out)) {
+    s->err = "decompressed data larger than width * height";
+    return -1;
+  }
+  memcpy(s->out, s->in, _len);
+  s->in += _len;
+  s->out += _len;
+  return 0;
+}
+
+/*******************************************************************************/
+typedef struct {
+  _Huffman_t lit;
+  _Huffman_t dist;
+} _FixedCodes_t;
+
+static _FixedCodes_t _buildFixedCodes()
+{
+  _FixedCodes_t _codes;
+  uint8_t _lengths[288];
+  int i = 0;
+  for (; i < 144; i++) _lengths[i] = 8;
+  for (; i < 256; i++) _lengths[i] = 9;
+  for (; i < 280; i++) _lengths[i] = 7;
+  for (; i < 288; i++) _lengths[i] = 8;
+  _buildHuffman(&_codes.lit, _lengths, 288);
+  for (i = 0; i < 30; i++) _lengths[i] = 5;
+  _buildHuffman(&_codes.dist, _lengths, 30);
+  return _codes;
+}
+
+static int _inflateFixed(_Inflate_t* s)
+{
+  static const _FixedCodes_t _codes = _buildFixedCodes();
+  return _inflateCodes(s, &_codes.lit, &_codes.dist);
+}
+
+/*******************************************************************************/
+static int _inflateDynamic(_Inflate_t* s)
+{
+  _Huffman_t _lit, _dist;
+  uint8_t _lengths[288 + 30];
+  unsigned int _nlen, _ndist, _ncode;
+  if (_getBits(s, 5, &_nlen) != 0 || _getBits(s, 5, &_ndist) != 0 || _getBits(s, 4, &_ncode) != 0)
+    return -1;
+  _nlen += 257;
+  _ndist += 1;
+  _ncode += 4;
+  if (_nlen > 286 || _ndist > 30) {
+    s->err = "bad dynamic block counts";
+    return -1;
+  }
+  //Code length code
+  memset(_lengths, 0, 19);
+  for (unsigned int i = 0; i < _ncode; i++) {
+    unsigned int _len;
+    if (_getBits(s, 3, &_len) != 0)
+      return -1;
+    _lengths[_CLEN_ORDER[i]] = (uint8_t)_len;
+  }
+  if (_buildHuffman(&_lit, _lengths, 19) != 0) {
+    s->err = "bad code length code";
+    return -1;
+  }
+  //Literal/length and distance code lengths
+  unsigned int _index = 0;
+  while (_index < _nlen + _ndist) {
+    int _symbol = _decodeSymbol(s, &_lit);
+    if (_symbol < 0)
+      return -1;
+    if (_symbol < 16) {
+      _lengths[_index++] = (uint8_t)_symbol;
+      continue;
+    }
+    uint8_t _repeat = 0;
+    unsigned int _times;
+    if (_symbol == 16) {
+      if (_index == 0) {
+        s->err = "repeat with no first length";
+        return -1;
+      }
+      _repeat = _lengths[_index - 1];
+      if (_getBits(s, 2, &_times) != 0) return -1;
+      _times += 3;
+    }
+    else if (_symbol == 17) {
+      if (_getBits(s, 3, &_times) != 0) return -1;
+      _times += 3;
+    }
+    else {
+      if (_getBits(s, 7, &_times) != 0) return -1;
+      _times += 11;
+    }
+    if (_index + _times > _nlen + _ndist) {
+      s->err = "too many code lengths";
+      return -1;
+    }
+    while (_times--)
+      _lengths[_index++] = _repeat;
+  }
+  if (_lengths[256] == 0) {
+    s->err = "missing end of block code";
+    return -1;
+  }
+  if (_buildHuffman(&_lit, _lengths, _nlen) != 0 || _buildHuffman(&_dist, _lengths + _nlen, _ndist) != 0) {
+    s->err = "bad literal or distance code lengths";
+    return -1;
+  }
+  return _inflateCodes(s, &_lit, &_dist);
+}
+
+/*******************************************************************************/
+/**
+ * Inflate a raw deflate stream into out[outLen]
+ * *written: decompressed bytes
+ *
+ * @return end of the deflate stream in src
+ * @return nullptr : bad or truncated data, *err is set
+ */
+static const unsigned char* _inflate(const unsigned char* src, size_t srcLen, unsigned char* out, size_t outLen, size_t* written, const char** err)
+{
+  _Inflate_t s = { src, src + srcLen, 0, 0, out, out, out + outLen, nullptr };
+  unsigned int _last = 0;
+  int rc = 0; //return code
+  while (rc == 0 && _last == 0) {
+    unsigned int _type;
+    if (_getBits(&s, 1, &_last) != 0 || _getBits(&s, 2, &_type) != 0) {
+      rc = -1;
+      break;
+    }
+    if (_type == 0) rc = _inflateStored(&s);
+    else if (_type == 1) rc = _inflateFixed(&s);
+    else if (_type == 2) rc = _inflateDynamic(&s);
+    else {
+      s.err = "bad block type";
+      rc = -1;
+    }
+  }
+  *written = s.out - s.outBegin;
+  *err = s.err;
+  //Unused whole bytes in the bit buffer are the stream trailer
+  s.in -= s.bitCount / 8;
+  return rc == 0 ? s.in : nullptr;
+}
+
+/*******************************************************************************/
+static uint32_t _adler32(const unsigned char* data, size_t len)
+{
+  uint32_t a = 1, b = 0;
+  while (len > 0) {
+    size_t _block = len < 5552 ? len : 5552; //Largest block without uint32 overflow
+    len -= _block;
+    while (_block--) {
+      a += *data++;
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return (b << 16) | a;
+}
+
+typedef struct {
+  uint32_t v[256];
+} _Crc32Table_t;
+
+static _Crc32Table_t _buildCrc32Table()
+{
+  _Crc32Table_t _table;
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    _table.v[i] = c;
+  }
+  return _table;
+}
+
+static uint32_t _crc32(const unsigned char* data, size_t len)
+{
+  static const _Crc32Table_t _table = _buildCrc32Table();
+  uint32_t _crc = 0xFFFFFFFFu;
+  while (len--)
+    _crc = _table.v[(_crc ^ *data++) & 0xFF] ^ (_crc >> 8);
+  return _crc ^ 0xFFFFFFFFu;
+}
+
+/*******************************************************************************/
+static std::string _sizeError(size_t written, size_t outLen)
+{
+  return "size of data is " + std::to_string(written) + " bytes"
+       + ", expected width * height * 4 = " + std::to_string(outLen);
+}
+
+/*******************************************************************************/
+/**
+ * zlib stream (RFC 1950): 2 bytes header, deflate data, adler32
+ */
+static int _zlibDecompress(const unsigned char* src, size_t srcLen, unsigned char* out, size_t outLen, std::string& err)
+{
+  if (srcLen < 6 || (src[0] & 0x0F) != 8 || ((src[0] << 8) | src[1]) % 31 != 0 || (src[1] & 0x20) != 0) {
+    err = "bad zlib header";
+    return -1;
+  }
+  size_t _written;
+  const char* _err;
+  const unsigned char* _tail = _inflate(src + 2, srcLen - 2, out, outLen, &_written, &_err);
+  if (_tail == nullptr) {
+    err = std::string("zlib: ") + _err;
+    return -1;
+  }
+  if (_written != outLen) {
+    err = _sizeError(_written, outLen);
+    return -1;
+  }
+  if (src + srcLen - _tail < 4) {
+    err = "zlib: missing adler32";
+    return -1;
+  }
+  uint32_t _expected = ((uint32_t)_tail[0] << 24) | (_tail[1] << 16) | (_tail[2] << 8) | _tail[3];
+  if (_adler32(out, outLen) != _expected) {
+    err = "zlib: adler32 mismatch";
+    return -1;
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * gzip member (RFC 1952): header, deflate data, crc32, size
+ */
+static int _gzipDecompress(const unsigned char* src, size_t srcLen, unsigned char* out, size_t outLen, std::string& err)
+{
+  const unsigned char* p = src + 10;
+  const unsigned char* _end = src + srcLen;
+  if (srcLen < 18 || src[0] != 0x1F || src[1] != 0x8B || src[2] != 8) {
+    err = "bad gzip header";
+    return -1;
+  }
+  unsigned char _flags = src[3];
+  if (_flags & 4) { //FEXTRA
+    if (_end - p < 2) { err = "bad gzip header"; return -1; }
+    size_t _extraLen = p[0] | (p[1] << 8);
+    p += 2;
+    if ((size_t)(_end - p) < _extraLen) { err = "bad gzip header"; return -1; }
+    p += _extraLen;
+  }
+  for (int _field = 8; _field <= 16; _field <<= 1) { //FNAME, FCOMMENT: zero terminated
+    if ((_flags & _field) == 0)
+      continue;
+    while (p != _end && *p != 0) p++;
+    if (p == _end) { err = "bad gzip header"; return -1; }
+    p++;
+  }
+  if (_flags & 2) { //FHCRC
+    if (_end - p < 2) { err = "bad gzip header"; return -1; }
+    p += 2;
+  }
+  if (_end - p < 8) {
+    err = "bad gzip header";
+    return -1;
+  }
+  size_t _written;
+  const char* _err;
+  const unsigned char* _tail = _inflate(p, _end - p, out, outLen, &_written, &_err);
+  if (_tail == nullptr) {
+    err = std::string("gzip: ") + _err;
+    return -1;
+  }
+  if (_written != outLen) {
+    err = _sizeError(_written, outLen);
+    return -1;
+  }
+  if (_end - _tail < 8) {
+    err = "gzip: missing crc32";
+    return -1;
+  }
+  uint32_t _crc = _tail[0] | (_tail[1] << 8) | (_tail[2] << 16) | ((uint32_t)_tail[3] << 24);
+  uint32_t _size = _tail[4] | (_tail[5] << 8) | (_tail[6] << 16) | ((uint32_t)_tail[7] << 24);
+  if (_size != (uint32_t)outLen || _crc32(out, outLen) != _crc) {
+    err = "gzip: crc32 mismatch";
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,338 @@
+/*******************************************************************************
+ * GameMap collision
+ * A collision layer is turned once into a bitset (1 bit per tile, set for
+ * solid tiles), then boxes are tested and swept against it in batches.
+ *
+ * Sweeps walk the tile columns and rows the leading edges of a box enter, in
+ * the order they enter them, so the cost is the number of tiles crossed and
+ * fast boxes do not tunnel through thin walls. Tiles a box overlaps before it
+ * moves are not hits, so boxes stuck in a wall can still move out of it.
+ *
+ * Coordinates and sizes are in tiles (like DrawGameMap()), boxes are
+ * [x, x + w) x [y, y + h): a box touching a tile does not overlap it
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+#define _COLLISION_EPS 1e-4f              //Edges closer than this to a tile border are on it
+#define _COLLISION_MAX_BITS (1ull << 31)  //256 MiB of bits at most
+#define _COLLISION_MAX_COORD 1.0e9f       //Coordinates beyond this are no hit
+
+struct GameMap_Collision_t {
+  int x0, y0;         //Tile of bit 0
+  int width, height;  //Bounds of the bitset, in tiles, tiles outside are not solid
+  int rowWords;       //uint64_t words per row
+  uint64_t* bits;
+};
+
+/*
+Private functions
+*/
+static int _fillBits(GameMap_Collision_t* col, const GameMap_t* map, int layerId,
+                     const unsigned int* solidGids, int solidGidsNum);
+static bool _columnSolid(const GameMap_Collision_t* col, int tx, int ty0, int ty1);
+static bool _rowSolid(const GameMap_Collision_t* col, int ty, int tx0, int tx1);
+static float _sweepBox(const GameMap_Collision_t* col, float x, float y, float w, float h,
+                       float vx, float vy, float* nx, float* ny);
+
+/*******************************************************************************/
+//Tile spans overlapped by [p, p + size)
+static inline int _firstTile(float p)
+{
+  return (int)floorf(p + _COLLISION_EPS);
+}
+
+static inline int _lastTile(float p, float size)
+{
+  return (int)ceilf(p + size - _COLLISION_EPS) - 1;
+}
+
+static inline bool _isSolid(const GameMap_Collision_t* col, int tx, int ty)
+{
+  tx -= col->x0;
+  ty -= col->y0;
+  if ((unsigned int)tx >= (unsigned int)col->width || (unsigned int)ty >= (unsigned int)col->height)
+    return false;
+  return 0 != ((col->bits[(size_t)ty * col->rowWords + (tx >> 6)] >> (tx & 63)) & 1);
+}
+
+/*******************************************************************************/
+/**
+ * Make collision bitset of layer "layerName"
+ * Tiles with a GID in solidGids are solid, or every non zero tile when
+ * solidGids is nullptr. The bitset is a copy: make it again when the layer
+ * changes (GameMap_pollWatch()).
+ *
+ * @return nullptr : wrong layer or out of memory (see GameMap_getErrStr())
+ */
+GameMap_Collision_t* GameMap_newCollision(const GameMap_t* map, const char* layerName,
+                                          const unsigned int* solidGids, int solidGidsNum)
+{
+  _GameMap_clearErrStr();
+  int _layerId = GameMap_getLayerId(map, layerName);
+  if (_layerId < 0) {
+    _GameMap_appendToErrStr("Collision layer \"" + (std::string)(layerName ? layerName : "") + "\" not found\n");
+    return nullptr;
+  }
+  if (solidGidsNum < 0) solidGidsNum = 0;
+
+  //Bounds, chunked layers by their blocks
+  const GMapTilelayer_t* _layer = &map->layers[_layerId];
+  GameMap_Collision_t* _col = (GameMap_Collision_t*)calloc(1, sizeof(GameMap_Collision_t));
+  if (_col == nullptr) {
+    _GameMap_appendToErrStr("Collision layer \"" + (std::string)layerName + "\": out of memory\n");
+    return nullptr;
+  }
+  if (_layer->chunks != nullptr && _layer->chunks->blocksNum > 0) {
+    _col->x0 = _layer->chunks->minx * _CHUNK_SIZE;
+    _col->y0 = _layer->chunks->miny * _CHUNK_SIZE;
+    _col->width = (_layer->chunks->maxx - _layer->chunks->minx) * _CHUNK_SIZE;
+    _col->height = (_layer->chunks->maxy - _layer->chunks->miny) * _CHUNK_SIZE;
+  }
+  else if (_layer->chunks == nullptr) {
+    _col->width = _layer->width;
+    _col->height = _layer->height;
+  }
+  _col->rowWords = (_col->width + 63) / 64;
+  if ((unsigned long long)_col->rowWords * 64 * _col->height > _COLLISION_MAX_BITS) {
+    _GameMap_appendToErrStr("Collision layer \"" + (std::string)layerName + "\": too big, "
+                            + std::to_string(_col->width) + "x" + std::to_string(_col->height) + " tiles\n");
+    GameMap_freeCollision(_col);
+    return nullptr;
+  }
+  if (0 != _fillBits(_col, map, _layerId, solidGids, solidGidsNum)) {
+    _GameMap_appendToErrStr("Collision layer \"" + (std::string)layerName + "\": out of memory\n");
+    GameMap_freeCollision(_col);
+    return nullptr;
+  }
+  return _col;
+}
+
+/*******************************************************************************/
+void GameMap_freeCollision(GameMap_Collision_t* col)
+{
+  if (col == nullptr)
+    return;
+  free(col->bits);
+  free(col);
+}
+
+/*******************************************************************************/
+/**
+ * Test boxes against solid tiles, hit[i] = 1 when box i overlaps one
+ *
+ * @return number of boxes overlapping solid tiles
+ * @return -1 : wrong arguments
+ */
+int GameMap_overlapBoxes(const GameMap_Collision_t* col, int boxesNum,
+                         const float* x, const float* y, const float* w, const float* h,
+                         unsigned char* hit)
+{
+  if (col == nullptr || boxesNum < 0 || x == nullptr || y == nullptr
+      || w == nullptr || h == nullptr || hit == nullptr)
+    return -1;
+  int _hitsNum = 0;
+  for (int i = 0; i < boxesNum; i++) {
+    hit[i] = 0;
+    if (!(fabsf(x[i]) < _COLLISION_MAX_COORD && fabsf(y[i]) < _COLLISION_MAX_COORD
+          && w[i] >= 0 && w[i] < _COLLISION_MAX_COORD && h[i] >= 0 && h[i] < _COLLISION_MAX_COORD))
+      continue;
+    int _ty1 = _lastTile(y[i], h[i]);
+    int _tx0 = _firstTile(x[i]), _tx1 = _lastTile(x[i], w[i]);
+    for (int ty = _firstTile(y[i]); ty <= _ty1; ty++) {
+      if (_rowSolid(col, ty, _tx0, _tx1)) {
+        hit[i] = 1;
+        _hitsNum++;
+        break;
+      }
+    }
+  }
+  return _hitsNum;
+}
+
+/*******************************************************************************/
+/**
+ * Sweep boxes by (vx,vy) against solid tiles
+ * toi[i]: fraction of the move done before box i hits a tile, 1 if it does not
+ * (nx[i],ny[i]): normal of the tile side hit, -1, 0 or 1 each, both set when
+ * a corner is hit, (0,0) when nothing is hit
+ *
+ * @return number of boxes hitting solid tiles
+ * @return -1 : wrong arguments
+ */
+int GameMap_sweepBoxes(const GameMap_Collision_t* col, int boxesNum,
+                       const float* x, const float* y, const float* w, const float* h,
+                       const float* vx, const float* vy,
+                       float* toi, float* nx, float* ny)
+{
+  if (col == nullptr || boxesNum < 0 || x == nullptr || y == nullptr || w == nullptr || h == nullptr
+      || vx == nullptr || vy == nullptr || toi == nullptr || nx == nullptr || ny == nullptr)
+    return -1;
+  int _hitsNum = 0;
+  for (int i = 0; i < boxesNum; i++) {
+    toi[i] = _sweepBox(col, x[i], y[i], w[i], h[i], vx[i], vy[i], &nx[i], &ny[i]);
+    if (nx[i] != 0 || ny[i] != 0)
+      _hitsNum++;
+  }
+  return _hitsNum;
+}
+
+/*******************************************************************************/
+/**
+ * @return time of impact in [0,1], 1: no hit
+ */
+static float _sweepBox(const GameMap_Collision_t* col, float x, float y, float w, float h,
+                       float vx, float vy, float* nx, float* ny)
+{
+  *nx = 0;
+  *ny = 0;
+  //NaN fails every test
+  if (!(fabsf(x) < _COLLISION_MAX_COORD && fabsf(y) < _COLLISION_MAX_COORD
+        && w >= 0 && w < _COLLISION_MAX_COORD && h >= 0 && h < _COLLISION_MAX_COORD
+        && fabsf(vx) < _COLLISION_MAX_COORD && fabsf(vy) < _COLLISION_MAX_COORD))
+    return 1.0f;
+  int sx = vx > 0 ? 1 : (vx < 0 ? -1 : 0);
+  int sy = vy > 0 ? 1 : (vy < 0 ? -1 : 0);
+
+  //Next tile border each leading edge crosses (kx, ky), and when (tx, ty)
+  //Borders an edge is on (or just past) count as not crossed yet
+  float _edgex = sx > 0 ? x + w : x;
+  float _edgey = sy > 0 ? y + h : y;
+  int kx = sx > 0 ? (int)ceilf(_edgex - _COLLISION_EPS) : (int)floorf(_edgex + _COLLISION_EPS);
+  int ky = sy > 0 ? (int)ceilf(_edgey - _COLLISION_EPS) : (int)floorf(_edgey + _COLLISION_EPS);
+  //Borders before the bitset have no solid tiles behind them, skip them
+  if (sx > 0 && kx < col->x0) kx = col->x0;
+  if (sx < 0 && kx > col->x0 + col->width) kx = col->x0 + col->width;
+  if (sy > 0 && ky < col->y0) ky = col->y0;
+  if (sy < 0 && ky > col->y0 + col->height) ky = col->y0 + col->height;
+  float tx = sx != 0 ? fmaxf(0.0f, (kx - _edgex) / vx) : 2.0f;
+  float ty = sy != 0 ? fmaxf(0.0f, (ky - _edgey) / vy) : 2.0f;
+
+  for (;;) {
+    float t = tx < ty ? tx : ty;
+    if (t > 1.0f)
+      return 1.0f;
+    //Tile column and row entered (kx, ky are borders)
+    int _col = sx > 0 ? kx : kx - 1;
+    int _row = sy > 0 ? ky : ky - 1;
+    float _px = x + vx * t, _py = y + vy * t;
+    bool _hitx = false, _hity = false;
+    if (tx <= ty)
+      _hitx = _columnSolid(col, _col, _firstTile(_py), _lastTile(_py, h));
+    if (ty <= tx)
+      _hity = _rowSolid(col, _row, _firstTile(_px), _lastTile(_px, w));
+    //Both edges cross at once: the tile in the corner is entered too
+    if (tx == ty && !_hitx && !_hity && _isSolid(col, _col, _row))
+      _hitx = _hity = true;
+    if (_hitx || _hity) {
+      if (_hitx) *nx = (float)-sx;
+      if (_hity) *ny = (float)-sy;
+      return t;
+    }
+    //Past the bitset nothing more can be hit on that axis
+    if (tx <= t) {
+      kx += sx;
+      tx = (kx - _edgex) / vx;
+      if (kx < col->x0 || kx > col->x0 + col->width) tx = 2.0f;
+    }
+    if (ty <= t) {
+      ky += sy;
+      ty = (ky - _edgey) / vy;
+      if (ky < col->y0 || ky > col->y0 + col->height) ty = 2.0f;
+    }
+  }
+}
+
+/*******************************************************************************/
+//@return true if a tile in column tx, rows [ty0,ty1] is solid
+static bool _columnSolid(const GameMap_Collision_t* col, int tx, int ty0, int ty1)
+{
+  tx -= col->x0;
+  if ((unsigned int)tx >= (unsigned int)col->width)
+    return false;
+  ty0 -= col->y0;
+  ty1 -= col->y0;
+  if (ty0 < 0) ty0 = 0;
+  if (ty1 >= col->height) ty1 = col->height - 1;
+  const uint64_t* _word = col->bits + (size_t)ty0 * col->rowWords + (tx >> 6);
+  uint64_t _bit = 1ull << (tx & 63);
+  for (int ty = ty0; ty <= ty1; ty++, _word += col->rowWords)
+    if (*_word & _bit)
+      return true;
+  return false;
+}
+
+/*******************************************************************************/
+//@return true if a tile in row ty, columns [tx0,tx1] is solid
+static bool _rowSolid(const GameMap_Collision_t* col, int ty, int tx0, int tx1)
+{
+  ty -= col->y0;
+  if ((unsigned int)ty >= (unsigned int)col->height)
+    return false;
+  tx0 -= col->x0;
+  tx1 -= col->x0;
+  if (tx0 < 0) tx0 = 0;
+  if (tx1 >= col->width) tx1 = col->width - 1;
+  if (tx0 > tx1)
+    return false;
+  const uint64_t* _row = col->bits + (size_t)ty * col->rowWords;
+  int w0 = tx0 >> 6, w1 = tx1 >> 6;
+  uint64_t _first = ~0ull << (tx0 & 63);
+  uint64_t _last = ~0ull >> (63 - (tx1 & 63));
+  if (w0 == w1)
+    return 0 != (_row[w0] & _first & _last);
+  if (_row[w0] & _first)
+    return true;
+  for (int i = w0 + 1; i < w1; i++)
+    if (_row[i] != 0)
+      return true;
+  return 0 != (_row[w1] & _last);
+}
+
+/*******************************************************************************/
+/**
+ * Set bits of solid tiles, a layer row at a time
+ *
+ * @return != 0 : out of memory
+ */
+static int _fillBits(GameMap_Collision_t* col, const GameMap_t* map, int layerId,
+                     const unsigned int* solidGids, int solidGidsNum)
+{
+  col->bits = (uint64_t*)calloc((size_t)col->rowWords * col->height + 1, sizeof(uint64_t));
+  if (col->bits == nullptr)
+    return -1;
+  //Solid GID lookup table
+  unsigned int _gidsNum = 0;
+  for (int i = 0; i < solidGidsNum; i++)
+    if ((solidGids[i] & _GID_MASK) >= _gidsNum) _gidsNum = (solidGids[i] & _GID_MASK) + 1;
+  unsigned char* _solidGid = (unsigned char*)calloc(_gidsNum + 1, 1);
+  unsigned int* _tiles = (unsigned int*)malloc(((size_t)col->width + 1) * sizeof(unsigned int));
+  if (_solidGid == nullptr || _tiles == nullptr) {
+    free(_solidGid);
+    free(_tiles);
+    return -1;
+  }
+  for (int i = 0; i < solidGidsNum; i++)
+    _solidGid[solidGids[i] & _GID_MASK] = 1;
+
+  for (int r = 0; r < col->height; r++) {
+    GameMap_getTileRegion(map, layerId, col->x0, col->y0 + r, col->width, 1, _tiles, col->width);
+    uint64_t* _row = col->bits + (size_t)r * col->rowWords;
+    for (int c = 0; c < col->width; c++) {
+      unsigned int _gid = _tiles[c];
+      bool _solid = solidGids == nullptr ? _gid != 0 : (_gid < _gidsNum && _solidGid[_gid] != 0);
+      if (_solid)
+        _row[c >> 6] |= 1ull << (c & 63);
+    }
+  }
+  free(_solidGid);
+  free(_tiles);
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*******************************************************************************
+ * GameMap load contexts
+ * Everything a load keeps besides the map: its errors, scratch memory and
+ * stats. Loaders reach the context of the load running on their thread with
+ * the functions below, so any number of threads can load maps at once.
+ * GameMap_loadWithContext() makes a context current for one load; other loads
+ * use their thread's own context, which GameMap_getErrStr() reads.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string>
+#include <chrono>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+struct GameMap_LoadContext_t {
+  std::string err;            //Errors of the last load
+  GameMap_LoadStats_t stats;
+  char* scratch;              //Kept between loads, nullptr: none yet
+  size_t scratchSize;
+  bool scratchUsed;
+  bool keepScratch;           //false: thread context, scratch memory is not kept
+};
+
+static thread_local GameMap_LoadContext_t _GameMap_threadContext = { "", {}, nullptr, 0, false, false };
+static thread_local GameMap_LoadContext_t* _GameMap_context = nullptr; //Set by GameMap_loadWithContext()
+
+/*
+Private functions
+*/
+static GameMap_LoadContext_t* _currentContext();
+
+/*******************************************************************************/
+/**
+ * New load context, for the loads of one thread at a time
+ */
+GameMap_LoadContext_t* GameMap_newLoadContext()
+{
+  GameMap_LoadContext_t* ctx = new GameMap_LoadContext_t();
+  ctx->stats = {};
+  ctx->scratch = nullptr;
+  ctx->scratchSize = 0;
+  ctx->scratchUsed = false;
+  ctx->keepScratch = true;
+  return ctx;
+}
+
+/*******************************************************************************/
+void GameMap_freeLoadContext(GameMap_LoadContext_t* ctx)
+{
+  if (ctx == nullptr)
+    return;
+  free(ctx->scratch);
+  delete ctx;
+}
+
+/*******************************************************************************/
+/**
+ * Load map like GameMap_loadCached(), errors and stats going to ctx
+ * (loadGraphs == false on threads other than the DxLib one)
+ */
+GameMap_t* GameMap_loadWithContext(GameMap_LoadContext_t* ctx, const char* jsonPath, bool loadGraphs)
+{
+  if (ctx == nullptr)
+    return nullptr;
+  GameMap_LoadContext_t* _outer = _GameMap_context;
+  _GameMap_context = ctx;
+  std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+  GameMap_t* map = _GameMap_loadCached(jsonPath, loadGraphs);
+  std::chrono::duration<double, std::milli> _time = std::chrono::steady_clock::now() - _start;
+  ctx->stats.loadsNum++;
+  ctx->stats.loadMs += _time.count();
+  if (map == nullptr)
+    ctx->stats.failsNum++;
+  else
+    ctx->stats.mapBytes += map->byteSize;
+  _GameMap_context = _outer;
+  return map;
+}
+
+/*******************************************************************************/
+const char* GameMap_getLoadContextErr(const GameMap_LoadContext_t* ctx)
+{
+  return ctx != nullptr ? ctx->err.c_str() : "";
+}
+
+const GameMap_LoadStats_t* GameMap_getLoadStats(const GameMap_LoadContext_t* ctx)
+{
+  return ctx != nullptr ? &ctx->stats : nullptr;
+}
+
+/*******************************************************************************/
+//Errors of the current load
+
+void _GameMap_clearErrStr()
+{
+  _currentContext()->err = "";
+}
+
+void _GameMap_appendToErrStr(const char* str)
+{ _currentContext()->err += str; }
+
+void _GameMap_appendToErrStr(std::string str)
+{ _currentContext()->err += str; }
+
+const char* GameMap_getErrStr()
+{
+  return _GameMap_threadContext.err.c_str();
+}
+
+/*******************************************************************************/
+//Bytes of map files read by the current load
+void _GameMap_addFileBytes(size_t bytes)
+{
+  _currentContext()->stats.fileBytes += bytes;
+}
+
+/*******************************************************************************/
+/**
+ * Memory for the whole map file, kept by the context for its next loads
+ * (the thread context does not keep it: malloc'd and freed every load)
+ * Give it back with _GameMap_scratchFree()
+ */
+char* _GameMap_scratchAlloc(size_t size)
+{
+  GameMap_LoadContext_t* ctx = _currentContext();
+  if (false == ctx->keepScratch || ctx->scratchUsed)
+    return (char*)malloc(size);
+  if (ctx->scratchSize < size) {
+    free(ctx->scratch);
+    ctx->scratch = (char*)malloc(size);
+    ctx->scratchSize = ctx->scratch != nullptr ? size : 0;
+    if (ctx->scratch == nullptr)
+      return nullptr;
+  }
+  ctx->scratchUsed = true;
+  return ctx->scratch;
+}
+
+void _GameMap_scratchFree(char* scratch)
+{
+  GameMap_LoadContext_t* ctx = _currentContext();
+  if (scratch != nullptr && scratch == ctx->scratch)
+    ctx->scratchUsed = false;
+  else
+    free(scratch);
+}
+
+/*******************************************************************************/
+static GameMap_LoadContext_t* _currentContext()
+{
+  return _GameMap_context != nullptr ? _GameMap_context : &_GameMap_threadContext;
+}
@@ -0,0 +1,57 @@
+/******************************************************************************
+* Tiled JSON map -> .gmapbin converter
+* Writes the binary cache GameMap_loadCached() would write, to make it ahead
+* of time (for example when packaging a game with its maps), or a Tiled JSON
+* map again when the output is a .json file (GameMap_saveToTiledJSON())
+* Graphics are not loaded: the DxLib parts (video_GameMap.cpp) are replaced
+* by the stubs of stubs_GameMap.cpp.
+*
+* Build: convert_GameMap.vcxproj (console program, in pandd_testing.sln)
+*
+* Usage:
+*   convert_GameMap map.json [map.gmapbin | out.json]
+*   without output path "map.json" is written to "map.gmapbin"
+******************************************************************************/
+
+#include <stdio.h>
+#include <string>
+
+#include "GameMap.h"
+#include "_GameMap.h"
+
+int main(int argc, char** argv)
+{
+  if (argc < 2 || argc > 3) {
+    printf("Usage: %s map.json [map.gmapbin]\n", argv[0]);
+    return 1;
+  }
+  std::string _out;
+  if (argc == 3) {
+    _out = argv[2];
+  }
+  else {
+    _out = argv[1];
+    size_t _dot = _out.find_last_of('.');
+    size_t _slash = _out.find_last_of("\\/");
+    if (_dot != std::string::npos && (_slash == std::string::npos || _dot > _slash))
+      _out.erase(_dot);
+    _out += ".gmapbin";
+  }
+
+  GameMap_t* map = GameMap_loadFromTiledJSONStreaming(argv[1]);
+  if (map == nullptr) {
+    printf("%s", GameMap_getErrStr());
+    return 1;
+  }
+  int rc;
+  if (_out.size() > 5 && _out.compare(_out.size() - 5, 5, ".json") == 0)
+    rc = GameMap_saveToTiledJSON(map, _out.c_str());
+  else
+    rc = GameMap_saveBinary(map, _out.c_str(), argv[1]);
+  if (rc != 0)
+    printf("%s", GameMap_getErrStr());
+  else
+    printf("%s -> %s\n", argv[1], _out.c_str());
+  GameMap_free(map);
+  return rc == 0 ? 0 : 1;
+}
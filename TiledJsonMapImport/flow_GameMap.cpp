@@ -0,0 +1,497 @@
+/*******************************************************************************
+ * GameMap flow fields
+ * For a set of goal tiles, the cost to the nearest goal is found for every
+ * tile (integration field), then the step toward the cheaper neighbour
+ * (direction field), so any number of units going to the same goals only
+ * read their tile each frame.
+ *
+ * The grid is cut in _FLOW_BLOCK x _FLOW_BLOCK blocks solved in parallel on
+ * the worker threads: a block takes the costs on the borders of its
+ * neighbours, runs Dijkstra inside itself, and marks the neighbours beside
+ * changed border tiles to be solved again, until no block changes. Blocks
+ * are solved in 4 colors by their (x,y) parity so blocks solved at the same
+ * time never touch. The result is the same as one Dijkstra over the grid.
+ *
+ * Moves are 8 way without cutting corners (like GameMap_findPath()), a step
+ * toward the goals costs the cost of the tile entered, times _COST_STRAIGHT
+ * or _COST_DIAGONAL.
+ * Fields are cached by goal set, the least recently used one is replaced.
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+#define _FLOW_BLOCK 32
+#define _FLOW_MAX_TILES (1 << 20)     //Costs fit 32 bits
+#define _FLOW_UNREACHED 0xFFFFFFFFu
+#define _COST_STRAIGHT 10
+#define _COST_DIAGONAL 14
+
+//Direction field values: 0 ~ 7 a step of _dirDx/_dirDy, else:
+#define _DIR_GOAL 8
+#define _DIR_NONE 9  //Blocked or no path to a goal
+
+//Border sides of a block whose costs changed
+#define _SIDE_LEFT 1
+#define _SIDE_RIGHT 2
+#define _SIDE_TOP 4
+#define _SIDE_BOTTOM 8
+
+//Straight steps first, they win ties
+static const int _dirDx[8] = { 1, -1, 0, 0, 1, -1, 1, -1 };
+static const int _dirDy[8] = { 0, 0, 1, -1, 1, 1, -1, -1 };
+
+typedef struct {
+  std::vector<int> goals;           //Grid indices, sorted
+  unsigned long long lastUse;
+  std::vector<unsigned int> cost;   //Integration field, empty: slot not used
+  std::vector<unsigned char> dir;   //Direction field
+} _FlowField_t;
+
+struct GameMap_Flows_t {
+  std::string layerName;
+  std::vector<unsigned char> gidCost;  //Cost of each GID, 0: blocked
+  int x0, y0;                          //Tile of grid index 0
+  int width, height;
+  std::vector<unsigned char> tileCost; //1 per tile, 0: blocked
+  int blocksw, blocksh;
+  std::vector<_FlowField_t> fields;
+  unsigned long long useClock;
+  //Solving
+  std::vector<unsigned char> dirty;    //Blocks to solve again
+  std::vector<unsigned char> solved;   //Blocks solved once
+  std::vector<unsigned char> changed;  //_SIDE_ flags of the last solve
+  std::vector<int> tasks;              //Blocks solved by the current job
+  _FlowField_t* field;
+};
+
+/*
+Private functions
+*/
+static int _loadCosts(GameMap_Flows_t* flows, const GameMap_t* map, int x0, int y0, int w, int h);
+static void _computeField(GameMap_Flows_t* flows, _FlowField_t* field);
+static void _solveBlockTask(void* arg, int index);
+static void _directionsTask(void* arg, int index);
+
+/*******************************************************************************/
+static inline bool _inGrid(const GameMap_Flows_t* flows, int gx, int gy)
+{
+  return (unsigned int)gx < (unsigned int)flows->width && (unsigned int)gy < (unsigned int)flows->height;
+}
+
+/*******************************************************************************/
+/**
+ * Make flow fields of layer "layerName"
+ * gidCosts[gid]: cost of entering a tile (1 ~ 255), 0 or GIDs past the table:
+ * blocked. With gidCosts == nullptr, empty tiles cost 1 and the others are
+ * blocked. Up to fieldsMax fields are kept.
+ *
+ * @return nullptr : wrong layer or layer too big (see GameMap_getErrStr())
+ */
+GameMap_Flows_t* GameMap_newFlows(const GameMap_t* map, const char* layerName,
+                                  const unsigned char* gidCosts, int gidCostsNum, int fieldsMax)
+{
+  _GameMap_clearErrStr();
+  int _layerId = GameMap_getLayerId(map, layerName);
+  if (_layerId < 0) {
+    _GameMap_appendToErrStr("Flow layer \"" + (std::string)(layerName ? layerName : "") + "\" not found\n");
+    return nullptr;
+  }
+  GameMap_Flows_t* flows = new GameMap_Flows_t();
+  flows->layerName = layerName;
+  if (gidCosts == nullptr)
+    flows->gidCost.assign(1, 1);
+  else if (gidCostsNum > 0)
+    flows->gidCost.assign(gidCosts, gidCosts + gidCostsNum);
+
+  //Bounds, chunked layers by their blocks
+  const GMapTilelayer_t* _layer = &map->layers[_layerId];
+  if (_layer->chunks != nullptr && _layer->chunks->blocksNum > 0) {
+    flows->x0 = _layer->chunks->minx * _CHUNK_SIZE;
+    flows->y0 = _layer->chunks->miny * _CHUNK_SIZE;
+    flows->width = (_layer->chunks->maxx - _layer->chunks->minx) * _CHUNK_SIZE;
+    flows->height = (_layer->chunks->maxy - _layer->chunks->miny) * _CHUNK_SIZE;
+  }
+  else if (_layer->chunks == nullptr) {
+    flows->width = _layer->width;
+    flows->height = _layer->height;
+  }
+  if ((long long)flows->width * flows->height > _FLOW_MAX_TILES) {
+    _GameMap_appendToErrStr("Flow layer \"" + (std::string)layerName + "\": too big, "
+                            + std::to_string(flows->width) + "x" + std::to_string(flows->height) + " tiles\n");
+    delete flows;
+    return nullptr;
+  }
+  flows->tileCost.assign((size_t)flows->width * flows->height, 0);
+  flows->blocksw = (flows->width + _FLOW_BLOCK - 1) / _FLOW_BLOCK;
+  flows->blocksh = (flows->height + _FLOW_BLOCK - 1) / _FLOW_BLOCK;
+  flows->fields.resize(fieldsMax > 0 ? fieldsMax : 1);
+  flows->useClock = 0;
+  _loadCosts(flows, map, flows->x0, flows->y0, flows->width, flows->height);
+  return flows;
+}
+
+/*******************************************************************************/
+void GameMap_freeFlows(GameMap_Flows_t* flows)
+{
+  delete flows;
+}
+
+/*******************************************************************************/
+/**
+ * Read tile costs (x0,y0,w,h) from the layer again, after it changed
+ * Cached fields are dropped.
+ *
+ * @return != 0 : layer not found in map
+ */
+int GameMap_updateFlows(GameMap_Flows_t* flows, const GameMap_t* map, int x0, int y0, int w, int h)
+{
+  if (flows == nullptr || 0 != _loadCosts(flows, map, x0, y0, w, h))
+    return -1;
+  for (size_t i = 0; i < flows->fields.size(); i++) {
+    flows->fields[i].cost.clear();
+    flows->fields[i].dir.clear();
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Get field of goal tiles (x,y pairs), made when it is not cached
+ * Goals outside the grid or blocked are left out.
+ *
+ * @return field id for the functions below, valid until a
+ *         GameMap_getFlowField() call makes a new field
+ * @return -1 : wrong arguments
+ */
+int GameMap_getFlowField(GameMap_Flows_t* flows, const int* goals, int goalsNum)
+{
+  if (flows == nullptr || goalsNum < 0 || (goals == nullptr && goalsNum > 0))
+    return -1;
+  std::vector<int> _goals;
+  _goals.reserve(goalsNum);
+  for (int i = 0; i < goalsNum; i++) {
+    int gx = goals[2 * i] - flows->x0, gy = goals[2 * i + 1] - flows->y0;
+    if (_inGrid(flows, gx, gy) && flows->tileCost[(size_t)gy * flows->width + gx] != 0)
+      _goals.push_back(gy * flows->width + gx);
+  }
+  std::sort(_goals.begin(), _goals.end());
+  _goals.erase(std::unique(_goals.begin(), _goals.end()), _goals.end());
+
+  //Cached, else replace the least recently used
+  size_t _oldest = 0;
+  for (size_t i = 0; i < flows->fields.size(); i++) {
+    _FlowField_t* _field = &flows->fields[i];
+    if (false == _field->cost.empty() && _field->goals == _goals) {
+      _field->lastUse = ++flows->useClock;
+      return (int)i;
+    }
+    if (_field->cost.empty() || _field->lastUse < flows->fields[_oldest].lastUse)
+      _oldest = i;
+  }
+  _FlowField_t* _field = &flows->fields[_oldest];
+  _field->goals.swap(_goals);
+  _field->lastUse = ++flows->useClock;
+  _computeField(flows, _field);
+  return (int)_oldest;
+}
+
+/*******************************************************************************/
+/**
+ * Step (dx,dy) toward the goals from tile (tx,ty), (0,0) on a goal
+ *
+ * @return != 0 : tile blocked, outside the grid or without path to a goal
+ */
+int GameMap_getFlowDir(const GameMap_Flows_t* flows, int field, int tx, int ty, int* dx, int* dy)
+{
+  *dx = *dy = 0;
+  if (flows == nullptr || field < 0 || field >= (int)flows->fields.size() || flows->fields[field].dir.empty())
+    return -1;
+  int gx = tx - flows->x0, gy = ty - flows->y0;
+  if (false == _inGrid(flows, gx, gy))
+    return -1;
+  unsigned char _dir = flows->fields[field].dir[(size_t)gy * flows->width + gx];
+  if (_dir == _DIR_NONE)
+    return -1;
+  if (_dir != _DIR_GOAL) {
+    *dx = _dirDx[_dir];
+    *dy = _dirDy[_dir];
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Directions of units at (x[i],y[i]) in tiles, (dx[i],dy[i]) has length 1,
+ * (0,0) on a goal or without path
+ *
+ * @return number of units with a direction, -1 on wrong arguments
+ */
+int GameMap_sampleFlow(const GameMap_Flows_t* flows, int field, int unitsNum,
+                       const float* x, const float* y, float* dx, float* dy)
+{
+  if (flows == nullptr || field < 0 || field >= (int)flows->fields.size() || flows->fields[field].dir.empty()
+      || unitsNum < 0 || x == nullptr || y == nullptr || dx == nullptr || dy == nullptr)
+    return -1;
+  static const float _len[8] = { 1.0f, 1.0f, 1.0f, 1.0f, 0.70710678f, 0.70710678f, 0.70710678f, 0.70710678f };
+  const unsigned char* _dirs = flows->fields[field].dir.data();
+  int _movingNum = 0;
+  for (int i = 0; i < unitsNum; i++) {
+    dx[i] = dy[i] = 0.0f;
+    if (!(fabsf(x[i]) < 1.0e9f && fabsf(y[i]) < 1.0e9f))
+      continue;
+    int gx = (int)floorf(x[i]) - flows->x0, gy = (int)floorf(y[i]) - flows->y0;
+    if (false == _inGrid(flows, gx, gy))
+      continue;
+    unsigned char _dir = _dirs[(size_t)gy * flows->width + gx];
+    if (_dir >= _DIR_GOAL)
+      continue;
+    dx[i] = _dirDx[_dir] * _len[_dir];
+    dy[i] = _dirDy[_dir] * _len[_dir];
+    _movingNum++;
+  }
+  return _movingNum;
+}
+
+/*******************************************************************************/
+/**
+ * Cost to the nearest goal from tile (tx,ty), in steps of cost 1 (a diagonal
+ * step is 1.4)
+ *
+ * @return < 0 : no path
+ */
+float GameMap_getFlowCost(const GameMap_Flows_t* flows, int field, int tx, int ty)
+{
+  if (flows == nullptr || field < 0 || field >= (int)flows->fields.size() || flows->fields[field].cost.empty())
+    return -1.0f;
+  int gx = tx - flows->x0, gy = ty - flows->y0;
+  if (false == _inGrid(flows, gx, gy))
+    return -1.0f;
+  unsigned int _cost = flows->fields[field].cost[(size_t)gy * flows->width + gx];
+  return _cost == _FLOW_UNREACHED ? -1.0f : (float)_cost / _COST_STRAIGHT;
+}
+
+/*******************************************************************************/
+/**
+ * Read tile costs of a region from the layer
+ *
+ * @return != 0 : layer not found
+ */
+static int _loadCosts(GameMap_Flows_t* flows, const GameMap_t* map, int x0, int y0, int w, int h)
+{
+  int _layerId = GameMap_getLayerId(map, flows->layerName.c_str());
+  if (_layerId < 0)
+    return -1;
+  long long _gx0 = (long long)x0 - flows->x0, _gy0 = (long long)y0 - flows->y0;
+  long long _gx1 = _gx0 + w, _gy1 = _gy0 + h;
+  if (_gx0 < 0) _gx0 = 0;
+  if (_gy0 < 0) _gy0 = 0;
+  if (_gx1 > flows->width) _gx1 = flows->width;
+  if (_gy1 > flows->height) _gy1 = flows->height;
+  if (_gx0 >= _gx1 || _gy0 >= _gy1)
+    return 0;
+  int _w = (int)(_gx1 - _gx0);
+  std::vector<unsigned int> _tiles(_w);
+  for (int gy = (int)_gy0; gy < _gy1; gy++) {
+    GameMap_getTileRegion(map, _layerId, flows->x0 + (int)_gx0, flows->y0 + gy, _w, 1, _tiles.data(), _w);
+    unsigned char* _row = &flows->tileCost[(size_t)gy * flows->width + _gx0];
+    for (int c = 0; c < _w; c++)
+      _row[c] = _tiles[c] < flows->gidCost.size() ? flows->gidCost[_tiles[c]] : 0;
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+//Solve blocks until none changes, then directions of all blocks
+static void _computeField(GameMap_Flows_t* flows, _FlowField_t* field)
+{
+  size_t _tilesNum = (size_t)flows->width * flows->height;
+  size_t _blocksNum = (size_t)flows->blocksw * flows->blocksh;
+  field->cost.assign(_tilesNum, _FLOW_UNREACHED);
+  field->dir.resize(_tilesNum);
+  flows->field = field;
+  flows->dirty.assign(_blocksNum, 0);
+  flows->solved.assign(_blocksNum, 0);
+  flows->changed.assign(_blocksNum, 0);
+  bool _anyDirty = false;
+  for (size_t i = 0; i < field->goals.size(); i++) {
+    int _goal = field->goals[i];
+    field->cost[_goal] = 0;
+    int bx = (_goal % flows->width) / _FLOW_BLOCK, by = (_goal / flows->width) / _FLOW_BLOCK;
+    flows->dirty[(size_t)by * flows->blocksw + bx] = 1;
+    _anyDirty = true;
+  }
+
+  while (_anyDirty) {
+    _anyDirty = false;
+    for (int color = 0; color < 4; color++) {
+      flows->tasks.clear();
+      for (int by = color >> 1; by < flows->blocksh; by += 2)
+        for (int bx = color & 1; bx < flows->blocksw; bx += 2)
+          if (flows->dirty[(size_t)by * flows->blocksw + bx]) {
+            flows->dirty[(size_t)by * flows->blocksw + bx] = 0;
+            flows->tasks.push_back(by * flows->blocksw + bx);
+          }
+      _GameMap_runTasks((int)flows->tasks.size(), _solveBlockTask, flows);
+      //Neighbours beside changed borders, diagonal ones when a corner may have changed
+      for (size_t t = 0; t < flows->tasks.size(); t++) {
+        int b = flows->tasks[t];
+        unsigned char _sides = flows->changed[b];
+        if (_sides == 0)
+          continue;
+        int bx = b % flows->blocksw, by = b / flows->blocksw;
+        for (int ny = by - 1; ny <= by + 1; ny++) {
+          for (int nx = bx - 1; nx <= bx + 1; nx++) {
+            if ((nx == bx && ny == by) || nx < 0 || ny < 0 || nx >= flows->blocksw || ny >= flows->blocksh)
+              continue;
+            bool _x = nx == bx || (_sides & (nx < bx ? _SIDE_LEFT : _SIDE_RIGHT));
+            bool _y = ny == by || (_sides & (ny < by ? _SIDE_TOP : _SIDE_BOTTOM));
+            if (_x && _y) {
+              flows->dirty[(size_t)ny * flows->blocksw + nx] = 1;
+              _anyDirty = true;
+            }
+          }
+        }
+      }
+    }
+  }
+  _GameMap_runTasks((int)_blocksNum, _directionsTask, flows);
+  flows->field = nullptr;
+}
+
+/*******************************************************************************/
+/**
+ * Dijkstra inside block index, from its goals (first solve) and from the
+ * borders of its neighbours. Sets flows->changed[index].
+ */
+static void _solveBlockTask(void* arg, int index)
+{
+  GameMap_Flows_t* flows = (GameMap_Flows_t*)arg;
+  int b = flows->tasks[index];
+  unsigned int* _cost = flows->field->cost.data();
+  const unsigned char* _tileCost = flows->tileCost.data();
+  int _w = flows->width;
+  int x0 = (b % flows->blocksw) * _FLOW_BLOCK, y0 = (b / flows->blocksw) * _FLOW_BLOCK;
+  int x1 = std::min(x0 + _FLOW_BLOCK, flows->width) - 1, y1 = std::min(y0 + _FLOW_BLOCK, flows->height) - 1;
+  //Open list of (cost, tile), reused by the thread
+  static thread_local std::vector<std::pair<unsigned int, int> > _open;
+  typedef std::greater<std::pair<unsigned int, int> > _Later_t;
+  _open.clear();
+
+  if (false == flows->solved[b]) {
+    flows->solved[b] = 1;
+    for (int y = y0; y <= y1; y++)
+      for (int x = x0; x <= x1; x++)
+        if (_cost[(size_t)y * _w + x] != _FLOW_UNREACHED)
+          _open.push_back(std::make_pair(_cost[(size_t)y * _w + x], y * _w + x));
+  }
+  //Border tiles reached from outside the block
+  for (int y = y0; y <= y1; y++) {
+    int _step = (y == y0 || y == y1 || x1 == x0) ? 1 : x1 - x0;
+    for (int x = x0; x <= x1; x += _step) {
+      int _tile = y * _w + x;
+      if (_tileCost[_tile] == 0)
+        continue;
+      unsigned int _best = _cost[_tile];
+      for (int d = 0; d < 8; d++) {
+        int nx = x - _dirDx[d], ny = y - _dirDy[d];
+        if ((nx >= x0 && nx <= x1 && ny >= y0 && ny <= y1) || false == _inGrid(flows, nx, ny))
+          continue;
+        unsigned int _from = _cost[(size_t)ny * _w + nx];
+        if (_from == _FLOW_UNREACHED)
+          continue;
+        if (d >= 4 && (_tileCost[(size_t)ny * _w + x] == 0 || _tileCost[(size_t)y * _w + nx] == 0))
+          continue;
+        _from += _tileCost[(size_t)ny * _w + nx] * (d < 4 ? _COST_STRAIGHT : _COST_DIAGONAL);
+        if (_from < _best)
+          _best = _from;
+      }
+      if (_best < _cost[_tile]) {
+        _cost[_tile] = _best;
+        _open.push_back(std::make_pair(_best, _tile));
+      }
+    }
+  }
+  std::make_heap(_open.begin(), _open.end(), _Later_t());
+
+  unsigned char _sides = 0;
+  while (false == _open.empty()) {
+    std::pop_heap(_open.begin(), _open.end(), _Later_t());
+    std::pair<unsigned int, int> _top = _open.back();
+    _open.pop_back();
+    int _tile = _top.second;
+    if (_top.first != _cost[_tile])
+      continue;
+    int x = _tile % _w, y = _tile / _w;
+    if (x == x0) _sides |= _SIDE_LEFT;
+    if (x == x1) _sides |= _SIDE_RIGHT;
+    if (y == y0) _sides |= _SIDE_TOP;
+    if (y == y1) _sides |= _SIDE_BOTTOM;
+    for (int d = 0; d < 8; d++) {
+      int nx = x + _dirDx[d], ny = y + _dirDy[d];
+      if (nx < x0 || nx > x1 || ny < y0 || ny > y1)
+        continue;
+      int _next = ny * _w + nx;
+      if (_tileCost[_next] == 0)
+        continue;
+      if (d >= 4 && (_tileCost[(size_t)y * _w + nx] == 0 || _tileCost[(size_t)ny * _w + x] == 0))
+        continue;
+      unsigned int _g = _top.first + _tileCost[_tile] * (d < 4 ? _COST_STRAIGHT : _COST_DIAGONAL);
+      if (_g < _cost[_next]) {
+        _cost[_next] = _g;
+        _open.push_back(std::make_pair(_g, _next));
+        std::push_heap(_open.begin(), _open.end(), _Later_t());
+      }
+    }
+  }
+  flows->changed[b] = _sides;
+}
+
+/*******************************************************************************/
+//Step to the neighbour the cost of each tile of block index came from
+static void _directionsTask(void* arg, int index)
+{
+  GameMap_Flows_t* flows = (GameMap_Flows_t*)arg;
+  const unsigned int* _cost = flows->field->cost.data();
+  const unsigned char* _tileCost = flows->tileCost.data();
+  unsigned char* _dir = flows->field->dir.data();
+  int _w = flows->width;
+  int x0 = (index % flows->blocksw) * _FLOW_BLOCK, y0 = (index / flows->blocksw) * _FLOW_BLOCK;
+  int x1 = std::min(x0 + _FLOW_BLOCK, flows->width) - 1, y1 = std::min(y0 + _FLOW_BLOCK, flows->height) - 1;
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      size_t _tile = (size_t)y * _w + x;
+      if (_cost[_tile] == _FLOW_UNREACHED) {
+        _dir[_tile] = _DIR_NONE;
+        continue;
+      }
+      if (_cost[_tile] == 0) {
+        _dir[_tile] = _DIR_GOAL;
+        continue;
+      }
+      unsigned int _best = _FLOW_UNREACHED;
+      unsigned char _bestDir = _DIR_NONE;
+      for (int d = 0; d < 8; d++) {
+        int nx = x + _dirDx[d], ny = y + _dirDy[d];
+        if (false == _inGrid(flows, nx, ny) || _cost[(size_t)ny * _w + nx] == _FLOW_UNREACHED)
+          continue;
+        if (d >= 4 && (_tileCost[(size_t)y * _w + nx] == 0 || _tileCost[(size_t)ny * _w + x] == 0))
+          continue;
+        unsigned int _via = _cost[(size_t)ny * _w + nx]
+                          + _tileCost[(size_t)ny * _w + nx] * (d < 4 ? _COST_STRAIGHT : _COST_DIAGONAL);
+        if (_via < _best) {
+          _best = _via;
+          _bestDir = (unsigned char)d;
+        }
+      }
+      _dir[_tile] = _bestDir;
+    }
+  }
+}
@@ -0,0 +1,962 @@
+/*******************************************************************************
+ * GameMap navigation
+ * Hierarchical path finding (HPA*) over a walkability grid made from a layer.
+ *
+ * The grid is cut in _NAV_CLUSTER x _NAV_CLUSTER clusters. Where two
+ * neighbour clusters have walkable tiles face to face along their border,
+ * entrances are placed (one in the middle of short openings, one at each
+ * end of long ones): a node on each side, joined by a one step edge. Nodes of
+ * a cluster are joined by the cost of the shortest path between them inside
+ * the cluster. A query links start and goal to the nodes of their clusters,
+ * runs A* over the nodes, then fills in each step inside a cluster with
+ * Jump Point Search bounded to that cluster.
+ *
+ * Moves are 8 way, diagonals only when both tiles beside them are walkable
+ * (no corner cutting), costs are _COST_STRAIGHT and _COST_DIAGONAL.
+ * Changed tiles only mark their clusters, which are built again (with their
+ * neighbours, they share entrances) on the next query.
+ * Search buffers belong to the nav and are reused: queries do not allocate.
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+#define _NAV_CLUSTER 16
+#define _NAV_LOCAL_TILES (_NAV_CLUSTER * _NAV_CLUSTER)
+#define _NAV_ENTRANCE_SPLIT 6      //Openings this long get an entrance at each end
+#define _NAV_MAX_TILES (1 << 24)   //Path costs fit an int
+#define _COST_STRAIGHT 10
+#define _COST_DIAGONAL 14
+
+//Inter cluster edge directions of a node
+#define _DIR_LEFT 1
+#define _DIR_RIGHT 2
+#define _DIR_UP 4
+#define _DIR_DOWN 8
+
+//Binary heap of ids ordered by key[id], pos[id] < 0: not in heap
+typedef struct {
+  std::vector<int> items;
+  std::vector<int> pos;
+  const int* key;
+  int size;
+} _Heap_t;
+
+typedef struct {
+  std::vector<int> tiles;           //Grid index of each node
+  std::vector<unsigned char> dirs;  //_DIR_ flags, entrances of each node
+  std::vector<int> costs;           //nodesNum x nodesNum, -1: no path inside the cluster
+  int offset;                       //Id of node 0 in the abstract graph
+} _NavCluster_t;
+
+//Search inside one cluster, indices are local: (y - y0) * _NAV_CLUSTER + (x - x0)
+typedef struct {
+  int x0, y0, x1, y1;               //Bounds, inclusive
+  int goal;                         //Local index, -1: none (Dijkstra)
+  int g[_NAV_LOCAL_TILES];
+  int f[_NAV_LOCAL_TILES];
+  int parent[_NAV_LOCAL_TILES];
+  unsigned int seen[_NAV_LOCAL_TILES]; //== stamp: g and parent are set
+  unsigned int want[_NAV_LOCAL_TILES]; //== stamp: Dijkstra target not reached yet
+  unsigned int stamp;
+  _Heap_t heap;
+} _NavLocal_t;
+
+struct GameMap_Nav_t {
+  std::string layerName;
+  std::vector<unsigned char> solidGid;  //Lookup of solid GIDs, empty: every non zero GID
+  int x0, y0;                           //Tile of grid index 0
+  int width, height;
+  std::vector<unsigned char> walkable;  //1 per tile
+  int clustersw, clustersh;
+  std::vector<_NavCluster_t> clusters;
+  std::vector<unsigned char> dirty;     //Clusters to build again
+  bool anyDirty;
+  //Abstract graph search, ids: nodes, then start and goal
+  int nodesNum;
+  std::vector<int> nodeCluster;
+  std::vector<int> component;           //Nodes joined by edges have the same one
+  std::vector<unsigned int> componentSeen;
+  std::vector<int> g, f, parent;
+  std::vector<unsigned int> seen;
+  unsigned int stamp;
+  _Heap_t heap;
+  std::vector<int> startCost, goalCost; //Per node of the start / goal cluster
+  std::vector<int> route;               //Abstract path, goal first
+  _NavLocal_t local;
+};
+
+/*
+Private functions
+*/
+static int _loadWalkable(GameMap_Nav_t* nav, const GameMap_t* map, int x0, int y0, int w, int h);
+static void _markDirty(GameMap_Nav_t* nav, int gx, int gy);
+static void _rebuild(GameMap_Nav_t* nav);
+static void _findNodes(GameMap_Nav_t* nav, int cx, int cy);
+static void _addEntrances(GameMap_Nav_t* nav, _NavCluster_t* cluster, int ax, int ay, int bx, int by,
+                          int stepx, int stepy, int len, unsigned char dir);
+static void _findCosts(GameMap_Nav_t* nav, int c);
+static void _findComponents(GameMap_Nav_t* nav);
+static unsigned int _nextStamp(GameMap_Nav_t* nav);
+static void _setLocalBounds(GameMap_Nav_t* nav, int c);
+static void _localDijkstra(GameMap_Nav_t* nav, int from, const int* targets, int targetsNum, int target);
+static int _localJps(GameMap_Nav_t* nav, int from, int to);
+static int _jump(const GameMap_Nav_t* nav, int x, int y, int dx, int dy);
+static int _abstractSearch(GameMap_Nav_t* nav, int start, int goal, int startCluster, int goalCluster);
+static int _emitSegment(GameMap_Nav_t* nav, int from, int to, int* path, int pathMax, int pathNum);
+static void _heapReset(_Heap_t* heap, size_t capacity, const int* key);
+static void _heapPush(_Heap_t* heap, int id);
+static int _heapPop(_Heap_t* heap);
+
+/*******************************************************************************/
+static inline int _octile(int ax, int ay, int bx, int by)
+{
+  int dx = ax > bx ? ax - bx : bx - ax;
+  int dy = ay > by ? ay - by : by - ay;
+  return dx < dy ? _COST_DIAGONAL * dx + _COST_STRAIGHT * (dy - dx)
+                 : _COST_DIAGONAL * dy + _COST_STRAIGHT * (dx - dy);
+}
+
+static inline bool _walk(const GameMap_Nav_t* nav, int gx, int gy)
+{
+  return (unsigned int)gx < (unsigned int)nav->width && (unsigned int)gy < (unsigned int)nav->height
+      && nav->walkable[(size_t)gy * nav->width + gx] != 0;
+}
+
+//Walkable and inside the bounds of the local search
+static inline bool _walkLocal(const GameMap_Nav_t* nav, int gx, int gy)
+{
+  const _NavLocal_t* l = &nav->local;
+  return gx >= l->x0 && gx <= l->x1 && gy >= l->y0 && gy <= l->y1
+      && nav->walkable[(size_t)gy * nav->width + gx] != 0;
+}
+
+static inline int _clusterOf(const GameMap_Nav_t* nav, int gx, int gy)
+{
+  return (gy / _NAV_CLUSTER) * nav->clustersw + gx / _NAV_CLUSTER;
+}
+
+//Id of the node on tile (gx,gy), -1: none
+static inline int _findNode(const GameMap_Nav_t* nav, int gx, int gy)
+{
+  const _NavCluster_t* _cluster = &nav->clusters[_clusterOf(nav, gx, gy)];
+  int _tile = gy * nav->width + gx;
+  for (size_t n = 0; n < _cluster->tiles.size(); n++)
+    if (_cluster->tiles[n] == _tile)
+      return _cluster->offset + (int)n;
+  return -1;
+}
+
+/*******************************************************************************/
+/**
+ * Make navigation grid of layer "layerName" and its cluster graph
+ * Tiles with a GID in solidGids are not walkable, or every non zero tile
+ * when solidGids is nullptr (same as GameMap_newCollision())
+ *
+ * @return nullptr : wrong layer or layer too big (see GameMap_getErrStr())
+ */
+GameMap_Nav_t* GameMap_newNav(const GameMap_t* map, const char* layerName,
+                              const unsigned int* solidGids, int solidGidsNum)
+{
+  _GameMap_clearErrStr();
+  int _layerId = GameMap_getLayerId(map, layerName);
+  if (_layerId < 0) {
+    _GameMap_appendToErrStr("Navigation layer \"" + (std::string)(layerName ? layerName : "") + "\" not found\n");
+    return nullptr;
+  }
+  GameMap_Nav_t* nav = new GameMap_Nav_t();
+  nav->layerName = layerName;
+  for (int i = 0; solidGids != nullptr && i < solidGidsNum; i++) {
+    unsigned int _gid = solidGids[i] & _GID_MASK;
+    if (_gid >= nav->solidGid.size()) nav->solidGid.resize((size_t)_gid + 1, 0);
+    nav->solidGid[_gid] = 1;
+  }
+  if (solidGids != nullptr && nav->solidGid.empty())
+    nav->solidGid.push_back(0); //Nothing is solid
+
+  //Bounds, chunked layers by their blocks
+  const GMapTilelayer_t* _layer = &map->layers[_layerId];
+  if (_layer->chunks != nullptr && _layer->chunks->blocksNum > 0) {
+    nav->x0 = _layer->chunks->minx * _CHUNK_SIZE;
+    nav->y0 = _layer->chunks->miny * _CHUNK_SIZE;
+    nav->width = (_layer->chunks->maxx - _layer->chunks->minx) * _CHUNK_SIZE;
+    nav->height = (_layer->chunks->maxy - _layer->chunks->miny) * _CHUNK_SIZE;
+  }
+  else if (_layer->chunks == nullptr) {
+    nav->width = _layer->width;
+    nav->height = _layer->height;
+  }
+  if ((long long)nav->width * nav->height > _NAV_MAX_TILES) {
+    _GameMap_appendToErrStr("Navigation layer \"" + (std::string)layerName + "\": too big, "
+                            + std::to_string(nav->width) + "x" + std::to_string(nav->height) + " tiles\n");
+    delete nav;
+    return nullptr;
+  }
+  nav->walkable.assign((size_t)nav->width * nav->height, 0);
+  nav->clustersw = (nav->width + _NAV_CLUSTER - 1) / _NAV_CLUSTER;
+  nav->clustersh = (nav->height + _NAV_CLUSTER - 1) / _NAV_CLUSTER;
+  nav->clusters.resize((size_t)nav->clustersw * nav->clustersh);
+  nav->dirty.assign(nav->clusters.size(), 1);
+  nav->anyDirty = true;
+  nav->nodesNum = 0;
+  nav->stamp = 0;
+  nav->local.stamp = 0;
+  memset(nav->local.seen, 0, sizeof(nav->local.seen));
+  memset(nav->local.want, 0, sizeof(nav->local.want));
+  _heapReset(&nav->local.heap, _NAV_LOCAL_TILES, nav->local.f);
+  _loadWalkable(nav, map, nav->x0, nav->y0, nav->width, nav->height);
+  _rebuild(nav);
+  return nav;
+}
+
+/*******************************************************************************/
+void GameMap_freeNav(GameMap_Nav_t* nav)
+{
+  delete nav;
+}
+
+/*******************************************************************************/
+/**
+ * Set tile (tx,ty) walkable or not, its clusters are built again on the next
+ * GameMap_findPath()
+ *
+ * @return != 0 : tile outside the grid
+ */
+int GameMap_setNavTile(GameMap_Nav_t* nav, int tx, int ty, bool walkable)
+{
+  if (nav == nullptr)
+    return -1;
+  int gx = tx - nav->x0, gy = ty - nav->y0;
+  if ((unsigned int)gx >= (unsigned int)nav->width || (unsigned int)gy >= (unsigned int)nav->height)
+    return -1;
+  unsigned char* _tile = &nav->walkable[(size_t)gy * nav->width + gx];
+  if ((*_tile != 0) != walkable) {
+    *_tile = walkable ? 1 : 0;
+    _markDirty(nav, gx, gy);
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Read tiles (x0,y0,w,h) from the layer again, after it changed
+ * (GameMap_pollWatch(), game code editing tiles)
+ *
+ * @return != 0 : layer not found in map
+ */
+int GameMap_updateNav(GameMap_Nav_t* nav, const GameMap_t* map, int x0, int y0, int w, int h)
+{
+  if (nav == nullptr || GameMap_getLayerId(map, nav->layerName.c_str()) < 0)
+    return -1;
+  _loadWalkable(nav, map, x0, y0, w, h);
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Find a path from tile (sx,sy) to tile (gx,gy)
+ * path gets x,y pairs of the tiles, start and goal included, one step apart
+ *
+ * @return number of tiles of the path (only the first pathMax are written)
+ * @return -1 : no path
+ */
+int GameMap_findPath(GameMap_Nav_t* nav, int sx, int sy, int gx, int gy, int* path, int pathMax)
+{
+  if (nav == nullptr)
+    return -1;
+  if (path == nullptr) pathMax = 0;
+  sx -= nav->x0;
+  sy -= nav->y0;
+  gx -= nav->x0;
+  gy -= nav->y0;
+  if (false == _walk(nav, sx, sy) || false == _walk(nav, gx, gy))
+    return -1;
+  if (nav->anyDirty)
+    _rebuild(nav);
+  int _start = sy * nav->width + sx;
+  int _goal = gy * nav->width + gx;
+  int _startCluster = _clusterOf(nav, sx, sy);
+  int _goalCluster = _clusterOf(nav, gx, gy);
+  if (0 != _abstractSearch(nav, _start, _goal, _startCluster, _goalCluster))
+    return -1;
+
+  //Fill in the steps between nodes, route is goal first
+  int _pathNum = 0;
+  if (pathMax > 0) {
+    path[0] = sx + nav->x0;
+    path[1] = sy + nav->y0;
+  }
+  _pathNum = 1;
+  int _from = _start;
+  for (int r = (int)nav->route.size() - 1; r >= 0; r--) {
+    int _id = nav->route[r];
+    int _to = _id == nav->nodesNum + 1 ? _goal
+            : nav->clusters[nav->nodeCluster[_id]].tiles[_id - nav->clusters[nav->nodeCluster[_id]].offset];
+    _pathNum = _emitSegment(nav, _from, _to, path, pathMax, _pathNum);
+    _from = _to;
+  }
+  return _pathNum;
+}
+
+/*******************************************************************************/
+/**
+ * Check a path found before against the tiles now
+ *
+ * @return index of the first tile that is not walkable anymore (or is not a
+ *         step away from the one before), -1 if the path is still good
+ */
+int GameMap_checkPath(const GameMap_Nav_t* nav, const int* path, int pathNum)
+{
+  if (nav == nullptr || path == nullptr)
+    return 0;
+  for (int i = 0; i < pathNum; i++) {
+    int x = path[2 * i] - nav->x0, y = path[2 * i + 1] - nav->y0;
+    if (false == _walk(nav, x, y))
+      return i;
+    if (i == 0)
+      continue;
+    int px = path[2 * i - 2] - nav->x0, py = path[2 * i - 1] - nav->y0;
+    int dx = x - px, dy = y - py;
+    if (dx < -1 || dx > 1 || dy < -1 || dy > 1
+        || (dx != 0 && dy != 0 && (false == _walk(nav, px + dx, py) || false == _walk(nav, px, py + dy))))
+      return i;
+  }
+  return -1;
+}
+
+/*******************************************************************************/
+/**
+ * Read walkable tiles of a region from the layer, marking changed clusters
+ *
+ * @return != 0 : layer not found
+ */
+static int _loadWalkable(GameMap_Nav_t* nav, const GameMap_t* map, int x0, int y0, int w, int h)
+{
+  int _layerId = GameMap_getLayerId(map, nav->layerName.c_str());
+  if (_layerId < 0)
+    return -1;
+  //Clip to the grid
+  long long _gx0 = (long long)x0 - nav->x0, _gy0 = (long long)y0 - nav->y0;
+  long long _gx1 = _gx0 + w, _gy1 = _gy0 + h;
+  if (_gx0 < 0) _gx0 = 0;
+  if (_gy0 < 0) _gy0 = 0;
+  if (_gx1 > nav->width) _gx1 = nav->width;
+  if (_gy1 > nav->height) _gy1 = nav->height;
+  if (_gx0 >= _gx1 || _gy0 >= _gy1)
+    return 0;
+  int _w = (int)(_gx1 - _gx0);
+  std::vector<unsigned int> _tiles(_w);
+  for (int gy = (int)_gy0; gy < _gy1; gy++) {
+    GameMap_getTileRegion(map, _layerId, nav->x0 + (int)_gx0, nav->y0 + gy, _w, 1, _tiles.data(), _w);
+    for (int c = 0; c < _w; c++) {
+      unsigned int _gid = _tiles[c];
+      bool _solid = nav->solidGid.empty() ? _gid != 0
+                  : _gid < nav->solidGid.size() && nav->solidGid[_gid] != 0;
+      unsigned char* _tile = &nav->walkable[(size_t)gy * nav->width + _gx0 + c];
+      if (*_tile != (_solid ? 0 : 1)) {
+        *_tile = _solid ? 0 : 1;
+        _markDirty(nav, (int)_gx0 + c, gy);
+      }
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+//Tiles on a border change the entrances of the neighbour cluster too
+static void _markDirty(GameMap_Nav_t* nav, int gx, int gy)
+{
+  int cx = gx / _NAV_CLUSTER, cy = gy / _NAV_CLUSTER;
+  int ix = gx % _NAV_CLUSTER, iy = gy % _NAV_CLUSTER;
+  nav->dirty[(size_t)cy * nav->clustersw + cx] = 1;
+  if (ix == 0 && cx > 0) nav->dirty[(size_t)cy * nav->clustersw + cx - 1] = 1;
+  if (ix == _NAV_CLUSTER - 1 && cx + 1 < nav->clustersw) nav->dirty[(size_t)cy * nav->clustersw + cx + 1] = 1;
+  if (iy == 0 && cy > 0) nav->dirty[(size_t)(cy - 1) * nav->clustersw + cx] = 1;
+  if (iy == _NAV_CLUSTER - 1 && cy + 1 < nav->clustersh) nav->dirty[(size_t)(cy + 1) * nav->clustersw + cx] = 1;
+  nav->anyDirty = true;
+}
+
+/*******************************************************************************/
+//Build nodes and costs of dirty clusters, then number all nodes again
+static void _rebuild(GameMap_Nav_t* nav)
+{
+  for (int cy = 0; cy < nav->clustersh; cy++)
+    for (int cx = 0; cx < nav->clustersw; cx++)
+      if (nav->dirty[(size_t)cy * nav->clustersw + cx])
+        _findNodes(nav, cx, cy);
+  for (size_t c = 0; c < nav->clusters.size(); c++)
+    if (nav->dirty[c])
+      _findCosts(nav, (int)c);
+  std::fill(nav->dirty.begin(), nav->dirty.end(), 0);
+  nav->anyDirty = false;
+
+  size_t _nodesNum = 0, _clusterNodesMax = 0;
+  for (size_t c = 0; c < nav->clusters.size(); c++) {
+    nav->clusters[c].offset = (int)_nodesNum;
+    _nodesNum += nav->clusters[c].tiles.size();
+    _clusterNodesMax = std::max(_clusterNodesMax, nav->clusters[c].tiles.size());
+  }
+  nav->nodesNum = (int)_nodesNum;
+  nav->nodeCluster.resize(_nodesNum);
+  for (size_t c = 0; c < nav->clusters.size(); c++)
+    for (size_t n = 0; n < nav->clusters[c].tiles.size(); n++)
+      nav->nodeCluster[nav->clusters[c].offset + n] = (int)c;
+  //Search buffers, + start and goal
+  nav->g.resize(_nodesNum + 2);
+  nav->f.resize(_nodesNum + 2);
+  nav->parent.resize(_nodesNum + 2);
+  nav->seen.assign(_nodesNum + 2, 0);
+  nav->stamp = 0;
+  _heapReset(&nav->heap, _nodesNum + 2, nav->f.data());
+  nav->startCost.resize(_clusterNodesMax + 1);
+  nav->goalCost.resize(_clusterNodesMax + 1);
+  nav->route.reserve(_nodesNum + 2);
+  _findComponents(nav);
+}
+
+/*******************************************************************************/
+//Label connected nodes, so queries between unconnected tiles end at once
+static void _findComponents(GameMap_Nav_t* nav)
+{
+  nav->component.assign(nav->nodesNum, -1);
+  std::vector<int> _stack;
+  int _componentsNum = 0;
+  for (int first = 0; first < nav->nodesNum; first++) {
+    if (nav->component[first] >= 0)
+      continue;
+    nav->component[first] = _componentsNum;
+    _stack.push_back(first);
+    while (false == _stack.empty()) {
+      int _id = _stack.back();
+      _stack.pop_back();
+      const _NavCluster_t* _cluster = &nav->clusters[nav->nodeCluster[_id]];
+      int _local = _id - _cluster->offset;
+      int _n = (int)_cluster->tiles.size();
+      int x = _cluster->tiles[_local] % nav->width, y = _cluster->tiles[_local] / nav->width;
+      for (int e = -4; e < _n; e++) {
+        int _next = -1;
+        if (e >= 0) {
+          if (_cluster->costs[(size_t)_local * _n + e] >= 0)
+            _next = _cluster->offset + e;
+        }
+        else if (_cluster->dirs[_local] & (1 << (e + 4))) {
+          static const int _dirDx[4] = { -1, 1, 0, 0 }, _dirDy[4] = { 0, 0, -1, 1 };
+          _next = _findNode(nav, x + _dirDx[e + 4], y + _dirDy[e + 4]);
+        }
+        if (_next >= 0 && nav->component[_next] < 0) {
+          nav->component[_next] = _componentsNum;
+          _stack.push_back(_next);
+        }
+      }
+    }
+    _componentsNum++;
+  }
+  nav->componentSeen.assign(_componentsNum, 0);
+}
+
+//Stamp for the seen arrays of the abstract search
+static unsigned int _nextStamp(GameMap_Nav_t* nav)
+{
+  if (++nav->stamp == 0) {
+    std::fill(nav->seen.begin(), nav->seen.end(), 0);
+    std::fill(nav->componentSeen.begin(), nav->componentSeen.end(), 0);
+    nav->stamp = 1;
+  }
+  return nav->stamp;
+}
+
+/*******************************************************************************/
+/**
+ * Find the entrances on the 4 borders of cluster (cx,cy)
+ * Both clusters of a border find the same ones
+ */
+static void _findNodes(GameMap_Nav_t* nav, int cx, int cy)
+{
+  _NavCluster_t* _cluster = &nav->clusters[(size_t)cy * nav->clustersw + cx];
+  _cluster->tiles.clear();
+  _cluster->dirs.clear();
+  int x0 = cx * _NAV_CLUSTER, y0 = cy * _NAV_CLUSTER;
+  int x1 = std::min(x0 + _NAV_CLUSTER, nav->width) - 1;
+  int y1 = std::min(y0 + _NAV_CLUSTER, nav->height) - 1;
+  //Tiles of this cluster (a) and facing tiles of the neighbour (b), along each border
+  if (cx > 0)
+    _addEntrances(nav, _cluster, x0, y0, x0 - 1, y0, 0, 1, y1 - y0 + 1, _DIR_LEFT);
+  if (cx + 1 < nav->clustersw)
+    _addEntrances(nav, _cluster, x1, y0, x1 + 1, y0, 0, 1, y1 - y0 + 1, _DIR_RIGHT);
+  if (cy > 0)
+    _addEntrances(nav, _cluster, x0, y0, x0, y0 - 1, 1, 0, x1 - x0 + 1, _DIR_UP);
+  if (cy + 1 < nav->clustersh)
+    _addEntrances(nav, _cluster, x0, y1, x0, y1 + 1, 1, 0, x1 - x0 + 1, _DIR_DOWN);
+}
+
+//Openings along a border: runs of walkable tile pairs
+static void _addEntrances(GameMap_Nav_t* nav, _NavCluster_t* cluster, int ax, int ay, int bx, int by,
+                          int stepx, int stepy, int len, unsigned char dir)
+{
+  int _run = 0;
+  for (int i = 0; i <= len; i++) {
+    bool _open = i < len && _walk(nav, ax + i * stepx, ay + i * stepy) && _walk(nav, bx + i * stepx, by + i * stepy);
+    if (_open) {
+      _run++;
+      continue;
+    }
+    if (_run == 0)
+      continue;
+    int _first = i - _run, _last = i - 1;
+    int _at[2] = { (_first + _last) / 2, -1 };
+    if (_run >= _NAV_ENTRANCE_SPLIT) {
+      _at[0] = _first;
+      _at[1] = _last;
+    }
+    for (int e = 0; e < 2 && _at[e] >= 0; e++) {
+      int _tile = (ay + _at[e] * stepy) * nav->width + ax + _at[e] * stepx;
+      size_t n = 0;
+      while (n < cluster->tiles.size() && cluster->tiles[n] != _tile) n++;
+      if (n == cluster->tiles.size()) {
+        cluster->tiles.push_back(_tile);
+        cluster->dirs.push_back(0);
+      }
+      cluster->dirs[n] |= dir;
+    }
+    _run = 0;
+  }
+}
+
+/*******************************************************************************/
+//Costs between the nodes of cluster c, inside it
+static void _findCosts(GameMap_Nav_t* nav, int c)
+{
+  _NavCluster_t* _cluster = &nav->clusters[c];
+  size_t n = _cluster->tiles.size();
+  _cluster->costs.assign(n * n, -1);
+  _setLocalBounds(nav, c);
+  _NavLocal_t* l = &nav->local;
+  for (size_t a = 0; a < n; a++) {
+    int _from = _cluster->tiles[a];
+    _cluster->costs[a * n + a] = 0;
+    if (a + 1 == n)
+      break;
+    //Costs are the same both ways, nodes before a are done
+    _localDijkstra(nav, _from, &_cluster->tiles[a + 1], (int)(n - a - 1), -1);
+    for (size_t b = a + 1; b < n; b++) {
+      int bx = _cluster->tiles[b] % nav->width, by = _cluster->tiles[b] / nav->width;
+      int _b = (by - l->y0) * _NAV_CLUSTER + (bx - l->x0);
+      if (l->seen[_b] == l->stamp)
+        _cluster->costs[a * n + b] = _cluster->costs[b * n + a] = l->g[_b];
+    }
+  }
+}
+
+static void _setLocalBounds(GameMap_Nav_t* nav, int c)
+{
+  _NavLocal_t* l = &nav->local;
+  l->x0 = (c % nav->clustersw) * _NAV_CLUSTER;
+  l->y0 = (c / nav->clustersw) * _NAV_CLUSTER;
+  l->x1 = std::min(l->x0 + _NAV_CLUSTER, nav->width) - 1;
+  l->y1 = std::min(l->y0 + _NAV_CLUSTER, nav->height) - 1;
+}
+
+/*******************************************************************************/
+/**
+ * Costs from grid index from to the tiles of the local bounds, until the
+ * targets (grid indices, and target when >= 0) are reached
+ */
+static void _localDijkstra(GameMap_Nav_t* nav, int from, const int* targets, int targetsNum, int target)
+{
+  _NavLocal_t* l = &nav->local;
+  if (++l->stamp == 0) {
+    memset(l->seen, 0, sizeof(l->seen));
+    memset(l->want, 0, sizeof(l->want));
+    l->stamp = 1;
+  }
+  int _wanted = 0;
+  for (int i = -1; i < targetsNum; i++) {
+    int _t = i < 0 ? target : targets[i];
+    if (_t < 0)
+      continue;
+    int _local = (_t / nav->width - l->y0) * _NAV_CLUSTER + (_t % nav->width - l->x0);
+    if (l->want[_local] != l->stamp) {
+      l->want[_local] = l->stamp;
+      _wanted++;
+    }
+  }
+  _heapReset(&l->heap, 0, l->f);
+  int fx = from % nav->width, fy = from / nav->width;
+  int _from = (fy - l->y0) * _NAV_CLUSTER + (fx - l->x0);
+  l->g[_from] = 0;
+  l->f[_from] = 0;
+  l->seen[_from] = l->stamp;
+  _heapPush(&l->heap, _from);
+  while (l->heap.size > 0 && _wanted > 0) {
+    int _cur = _heapPop(&l->heap);
+    if (l->want[_cur] == l->stamp) {
+      l->want[_cur] = 0;
+      _wanted--;
+    }
+    int x = l->x0 + _cur % _NAV_CLUSTER, y = l->y0 + _cur / _NAV_CLUSTER;
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        if ((dx == 0 && dy == 0) || false == _walkLocal(nav, x + dx, y + dy))
+          continue;
+        if (dx != 0 && dy != 0 && (false == _walkLocal(nav, x + dx, y) || false == _walkLocal(nav, x, y + dy)))
+          continue;
+        int _next = _cur + dy * _NAV_CLUSTER + dx;
+        int _g = l->g[_cur] + (dx != 0 && dy != 0 ? _COST_DIAGONAL : _COST_STRAIGHT);
+        if (l->seen[_next] == l->stamp && l->g[_next] <= _g)
+          continue;
+        l->seen[_next] = l->stamp;
+        l->g[_next] = _g;
+        l->f[_next] = _g;
+        _heapPush(&l->heap, _next);
+      }
+    }
+  }
+}
+
+/*******************************************************************************/
+/**
+ * Jump Point Search from grid index from to grid index to, inside the local
+ * bounds. Jump points are chained by parent, from to[...] back to from.
+ *
+ * @return != 0 : no path
+ */
+static int _localJps(GameMap_Nav_t* nav, int from, int to)
+{
+  _NavLocal_t* l = &nav->local;
+  if (++l->stamp == 0) {
+    memset(l->seen, 0, sizeof(l->seen));
+    memset(l->want, 0, sizeof(l->want));
+    l->stamp = 1;
+  }
+  _heapReset(&l->heap, 0, l->f);
+  int tx = to % nav->width, ty = to / nav->width;
+  int fx = from % nav->width, fy = from / nav->width;
+  int _from = (fy - l->y0) * _NAV_CLUSTER + (fx - l->x0);
+  l->goal = (ty - l->y0) * _NAV_CLUSTER + (tx - l->x0);
+  l->g[_from] = 0;
+  l->f[_from] = _octile(fx, fy, tx, ty);
+  l->parent[_from] = -1;
+  l->seen[_from] = l->stamp;
+  _heapPush(&l->heap, _from);
+  while (l->heap.size > 0) {
+    int _cur = _heapPop(&l->heap);
+    if (_cur == l->goal)
+      return 0;
+    int x = l->x0 + _cur % _NAV_CLUSTER, y = l->y0 + _cur / _NAV_CLUSTER;
+    //Pruned neighbours: all of them at the start, else the ones ahead of the move here
+    int _dirs[8][2];
+    int _dirsNum = 0;
+    if (l->parent[_cur] < 0) {
+      for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++)
+          if ((dx != 0 || dy != 0) && _walkLocal(nav, x + dx, y + dy)
+              && (dx == 0 || dy == 0 || (_walkLocal(nav, x + dx, y) && _walkLocal(nav, x, y + dy)))) {
+            _dirs[_dirsNum][0] = dx;
+            _dirs[_dirsNum++][1] = dy;
+          }
+    }
+    else {
+      int px = l->x0 + l->parent[_cur] % _NAV_CLUSTER, py = l->y0 + l->parent[_cur] / _NAV_CLUSTER;
+      int dx = (x > px) - (x < px), dy = (y > py) - (y < py);
+      if (dx != 0 && dy != 0) {
+        bool _v = _walkLocal(nav, x, y + dy), _h = _walkLocal(nav, x + dx, y);
+        if (_v) { _dirs[_dirsNum][0] = 0; _dirs[_dirsNum++][1] = dy; }
+        if (_h) { _dirs[_dirsNum][0] = dx; _dirs[_dirsNum++][1] = 0; }
+        if (_v && _h && _walkLocal(nav, x + dx, y + dy)) { _dirs[_dirsNum][0] = dx; _dirs[_dirsNum++][1] = dy; }
+      }
+      else {
+        //Straight move: sides are (sx,sy) and (-sx,-sy)
+        int sx = dy != 0 ? 1 : 0, sy = dx != 0 ? 1 : 0;
+        bool _next = _walkLocal(nav, x + dx, y + dy);
+        bool _a = _walkLocal(nav, x + sx, y + sy), _b = _walkLocal(nav, x - sx, y - sy);
+        if (_next) {
+          _dirs[_dirsNum][0] = dx; _dirs[_dirsNum++][1] = dy;
+          if (_a) { _dirs[_dirsNum][0] = dx + sx; _dirs[_dirsNum++][1] = dy + sy; }
+          if (_b) { _dirs[_dirsNum][0] = dx - sx; _dirs[_dirsNum++][1] = dy - sy; }
+        }
+        if (_a) { _dirs[_dirsNum][0] = sx; _dirs[_dirsNum++][1] = sy; }
+        if (_b) { _dirs[_dirsNum][0] = -sx; _dirs[_dirsNum++][1] = -sy; }
+      }
+    }
+    for (int d = 0; d < _dirsNum; d++) {
+      int _jp = _jump(nav, x + _dirs[d][0], y + _dirs[d][1], _dirs[d][0], _dirs[d][1]);
+      if (_jp < 0)
+        continue;
+      int jx = l->x0 + _jp % _NAV_CLUSTER, jy = l->y0 + _jp / _NAV_CLUSTER;
+      int _g = l->g[_cur] + _octile(x, y, jx, jy);
+      if (l->seen[_jp] == l->stamp && l->g[_jp] <= _g)
+        continue;
+      l->seen[_jp] = l->stamp;
+      l->g[_jp] = _g;
+      l->f[_jp] = _g + _octile(jx, jy, tx, ty);
+      l->parent[_jp] = _cur;
+      _heapPush(&l->heap, _jp);
+    }
+  }
+  return -1;
+}
+
+/*******************************************************************************/
+/**
+ * Move from (x,y) by (dx,dy) until a jump point: the goal, or a tile with
+ * neighbours only reachable through it
+ *
+ * @return local index of the jump point, -1: none
+ */
+static int _jump(const GameMap_Nav_t* nav, int x, int y, int dx, int dy)
+{
+  const _NavLocal_t* l = &nav->local;
+  for (;;) {
+    if (false == _walkLocal(nav, x, y))
+      return -1;
+    int _here = (y - l->y0) * _NAV_CLUSTER + (x - l->x0);
+    if (_here == l->goal)
+      return _here;
+    if (dx != 0 && dy != 0) {
+      if (_jump(nav, x + dx, y, dx, 0) >= 0 || _jump(nav, x, y + dy, 0, dy) >= 0)
+        return _here;
+    }
+    else if (dx != 0) {
+      if ((_walkLocal(nav, x, y - 1) && false == _walkLocal(nav, x - dx, y - 1))
+          || (_walkLocal(nav, x, y + 1) && false == _walkLocal(nav, x - dx, y + 1)))
+        return _here;
+    }
+    else {
+      if ((_walkLocal(nav, x - 1, y) && false == _walkLocal(nav, x - 1, y - dy))
+          || (_walkLocal(nav, x + 1, y) && false == _walkLocal(nav, x + 1, y - dy)))
+        return _here;
+    }
+    //Diagonals need both tiles beside them
+    if (false == _walkLocal(nav, x + dx, y) || false == _walkLocal(nav, x, y + dy))
+      return -1;
+    x += dx;
+    y += dy;
+  }
+}
+
+/*******************************************************************************/
+/**
+ * A* over the nodes, start and goal linked to the nodes of their clusters
+ * On success nav->route has the nodes after start, goal first
+ *
+ * @return != 0 : no path
+ */
+static int _abstractSearch(GameMap_Nav_t* nav, int start, int goal, int startCluster, int goalCluster)
+{
+  int _startId = nav->nodesNum, _goalId = nav->nodesNum + 1;
+  const _NavCluster_t* _sc = &nav->clusters[startCluster];
+  const _NavCluster_t* _gc = &nav->clusters[goalCluster];
+  int gx = goal % nav->width, gy = goal / nav->width;
+  _NavLocal_t* l = &nav->local;
+
+  //Costs from start to its cluster nodes (and goal when it is in the same cluster)
+  _setLocalBounds(nav, startCluster);
+  _localDijkstra(nav, start, _sc->tiles.data(), (int)_sc->tiles.size(), startCluster == goalCluster ? goal : -1);
+  int _direct = -1;
+  for (size_t n = 0; n < _sc->tiles.size(); n++) {
+    int _t = _sc->tiles[n];
+    int _i = (_t / nav->width - l->y0) * _NAV_CLUSTER + (_t % nav->width - l->x0);
+    nav->startCost[n] = l->seen[_i] == l->stamp ? l->g[_i] : -1;
+  }
+  if (startCluster == goalCluster) {
+    int _i = (gy - l->y0) * _NAV_CLUSTER + (gx - l->x0);
+    _direct = l->seen[_i] == l->stamp ? l->g[_i] : -1;
+  }
+  //Costs from goal cluster nodes to goal
+  _setLocalBounds(nav, goalCluster);
+  _localDijkstra(nav, goal, _gc->tiles.data(), (int)_gc->tiles.size(), -1);
+  for (size_t n = 0; n < _gc->tiles.size(); n++) {
+    int _t = _gc->tiles[n];
+    int _i = (_t / nav->width - l->y0) * _NAV_CLUSTER + (_t % nav->width - l->x0);
+    nav->goalCost[n] = l->seen[_i] == l->stamp ? l->g[_i] : -1;
+  }
+
+  //Unconnected: no node reached from start is connected to one reaching goal
+  if (_direct < 0) {
+    unsigned int _stamp = _nextStamp(nav);
+    for (size_t n = 0; n < _sc->tiles.size(); n++)
+      if (nav->startCost[n] >= 0)
+        nav->componentSeen[nav->component[_sc->offset + n]] = _stamp;
+    bool _connected = false;
+    for (size_t n = 0; n < _gc->tiles.size() && false == _connected; n++)
+      _connected = nav->goalCost[n] >= 0 && nav->componentSeen[nav->component[_gc->offset + n]] == _stamp;
+    if (false == _connected)
+      return -1;
+  }
+
+  _nextStamp(nav);
+  _heapReset(&nav->heap, 0, nav->f.data());
+  nav->g[_startId] = 0;
+  nav->f[_startId] = _octile(start % nav->width, start / nav->width, gx, gy);
+  nav->parent[_startId] = -1;
+  nav->seen[_startId] = nav->stamp;
+  _heapPush(&nav->heap, _startId);
+  while (nav->heap.size > 0) {
+    int _cur = _heapPop(&nav->heap);
+    if (_cur == _goalId) {
+      nav->route.clear();
+      for (int id = _goalId; id != _startId; id = nav->parent[id])
+        nav->route.push_back(id);
+      return 0;
+    }
+    //Edges of the current node: (id, cost) pairs
+    int _curCluster = _cur == _startId ? startCluster : nav->nodeCluster[_cur];
+    const _NavCluster_t* _cluster = &nav->clusters[_curCluster];
+    int _local = _cur == _startId ? -1 : _cur - _cluster->offset;
+    int _n = (int)_cluster->tiles.size();
+    int _curTile = _cur == _startId ? start : _cluster->tiles[_local];
+    int cx = _curTile % nav->width, cy = _curTile / nav->width;
+    for (int e = -5; e < _n; e++) {
+      int _next, _cost;
+      if (e >= 0) {
+        //Nodes of the same cluster
+        _next = _cluster->offset + e;
+        _cost = _cur == _startId ? nav->startCost[e] : _cluster->costs[(size_t)_local * _n + e];
+        if (_next == _cur) continue;
+      }
+      else if (e == -5) {
+        //Goal
+        _next = _goalId;
+        _cost = _cur == _startId ? _direct : (_curCluster == goalCluster ? nav->goalCost[_local] : -1);
+      }
+      else {
+        //Entrances to the neighbour clusters
+        static const int _dirDx[4] = { -1, 1, 0, 0 }, _dirDy[4] = { 0, 0, -1, 1 };
+        int d = e + 4;
+        if (_cur == _startId || 0 == (_cluster->dirs[_local] & (1 << d)))
+          continue;
+        _next = _findNode(nav, cx + _dirDx[d], cy + _dirDy[d]);
+        _cost = _next < 0 ? -1 : _COST_STRAIGHT;
+      }
+      if (_cost < 0)
+        continue;
+      int _g = nav->g[_cur] + _cost;
+      if (nav->seen[_next] == nav->stamp && nav->g[_next] <= _g)
+        continue;
+      int _nextTile = _next == _goalId ? goal
+                    : nav->clusters[nav->nodeCluster[_next]].tiles[_next - nav->clusters[nav->nodeCluster[_next]].offset];
+      nav->seen[_next] = nav->stamp;
+      nav->g[_next] = _g;
+      nav->f[_next] = _g + _octile(_nextTile % nav->width, _nextTile / nav->width, gx, gy);
+      nav->parent[_next] = _cur;
+      _heapPush(&nav->heap, _next);
+    }
+  }
+  return -1;
+}
+
+/*******************************************************************************/
+/**
+ * Append the tiles after grid index from up to grid index to
+ * (next tile across a border, or a JPS path inside a cluster)
+ *
+ * @return path tiles number
+ */
+static int _emitSegment(GameMap_Nav_t* nav, int from, int to, int* path, int pathMax, int pathNum)
+{
+  if (from == to)
+    return pathNum;
+  int fx = from % nav->width, fy = from / nav->width;
+  int tx = to % nav->width, ty = to / nav->width;
+  int _cluster = _clusterOf(nav, fx, fy);
+  if (_cluster != _clusterOf(nav, tx, ty)) {
+    if (pathNum < pathMax) {
+      path[2 * pathNum] = tx + nav->x0;
+      path[2 * pathNum + 1] = ty + nav->y0;
+    }
+    return pathNum + 1;
+  }
+  //Jump points from to back to from, then every tile between them
+  _setLocalBounds(nav, _cluster);
+  _localJps(nav, from, to);
+  _NavLocal_t* l = &nav->local;
+  int _jumps[_NAV_LOCAL_TILES];
+  int _jumpsNum = 0;
+  for (int j = l->goal; j >= 0 && _jumpsNum < _NAV_LOCAL_TILES; j = l->parent[j])
+    _jumps[_jumpsNum++] = j;
+  int x = fx, y = fy;
+  for (int j = _jumpsNum - 2; j >= 0; j--) {
+    int jx = l->x0 + _jumps[j] % _NAV_CLUSTER, jy = l->y0 + _jumps[j] / _NAV_CLUSTER;
+    int dx = (jx > x) - (jx < x), dy = (jy > y) - (jy < y);
+    while (x != jx || y != jy) {
+      x += dx;
+      y += dy;
+      if (pathNum < pathMax) {
+        path[2 * pathNum] = x + nav->x0;
+        path[2 * pathNum + 1] = y + nav->y0;
+      }
+      pathNum++;
+    }
+  }
+  return pathNum;
+}
+
+/*******************************************************************************/
+//Heap
+
+static void _heapReset(_Heap_t* heap, size_t capacity, const int* key)
+{
+  if (capacity > heap->items.size()) {
+    heap->items.resize(capacity);
+    heap->pos.resize(capacity, -1);
+  }
+  for (int i = 0; i < heap->size; i++)
+    heap->pos[heap->items[i]] = -1;
+  heap->key = key;
+  heap->size = 0;
+}
+
+static void _heapSift(_Heap_t* heap, int i)
+{
+  int* items = heap->items.data();
+  int _id = items[i];
+  int _key = heap->key[_id];
+  //Up
+  while (i > 0 && heap->key[items[(i - 1) / 2]] > _key) {
+    items[i] = items[(i - 1) / 2];
+    heap->pos[items[i]] = i;
+    i = (i - 1) / 2;
+  }
+  //Down
+  for (;;) {
+    int c = 2 * i + 1;
+    if (c >= heap->size)
+      break;
+    if (c + 1 < heap->size && heap->key[items[c + 1]] < heap->key[items[c]]) c++;
+    if (heap->key[items[c]] >= _key)
+      break;
+    items[i] = items[c];
+    heap->pos[items[i]] = i;
+    i = c;
+  }
+  items[i] = _id;
+  heap->pos[_id] = i;
+}
+
+//Push id, or move it after its key got smaller
+static void _heapPush(_Heap_t* heap, int id)
+{
+  int i = heap->pos[id];
+  if (i < 0) {
+    i = heap->size++;
+    heap->items[i] = id;
+  }
+  _heapSift(heap, i);
+}
+
+static int _heapPop(_Heap_t* heap)
+{
+  int _top = heap->items[0];
+  heap->pos[_top] = -1;
+  if (--heap->size > 0) {
+    heap->items[0] = heap->items[heap->size];
+    _heapSift(heap, 0);
+  }
+  return _top;
+}
@@ -0,0 +1,661 @@
+/*******************************************************************************
+ * GameMap objects
+ * Objects of all object layers are kept in one store, a field per array
+ * (struct of arrays), and indexed by a uniform grid built when the map is
+ * loaded: a cell keeps the objects its bounds overlap, so area and point
+ * queries only look at the objects of the cells they cover.
+ *
+ * Coordinates are in pixels, like Tiled saves them. Objects are rotated
+ * clockwise around (x,y), tile objects have (x,y) at their bottom left corner.
+*******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <vector>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+#include "json11.hpp"
+
+#define _GRID_CELL_TILES 4      //Grid cell size, in tiles
+#define _GRID_CELLS_MIN 1024    //Grids grow cells instead of count past this
+#define _GRID_SPAN_MAX 64       //Objects over more cells are in the big objects list
+#define _OBJECT_COORD_MAX (1 << 28)
+#define _ARRAYS_NUM 13          //Per object arrays saved in .gmapbin files
+
+/*
+Private functions
+*/
+static GMapObjects_t* _newObjects(int num, int pointsNum, int stringsLen);
+static int _readObject(const json11::Json& jsonObject, int layerId, GMapObjects_t* objects,
+                       int i, int* points, int* strings, std::string& err);
+static int _addString(GMapObjects_t* objects, int* strings, const std::string& str);
+static void _setBounds(GMapObjects_t* objects, int i);
+static int _buildGrid(GMapObjects_t* objects, int cellSize);
+static bool _containsPoint(const GMapObjects_t* objects, int i, float px, float py);
+static void _savedArrays(const GMapObjects_t* objects, void** arrays);
+
+/*
+Pre-hashed JSON keys
+*/
+static const json11::Json::Key _KEY_CLASS("class");
+static const json11::Json::Key _KEY_ELLIPSE("ellipse");
+static const json11::Json::Key _KEY_GID("gid");
+static const json11::Json::Key _KEY_HEIGHT("height");
+static const json11::Json::Key _KEY_ID("id");
+static const json11::Json::Key _KEY_NAME("name");
+static const json11::Json::Key _KEY_OBJECTS("objects");
+static const json11::Json::Key _KEY_POINT("point");
+static const json11::Json::Key _KEY_POLYGON("polygon");
+static const json11::Json::Key _KEY_POLYLINE("polyline");
+static const json11::Json::Key _KEY_ROTATION("rotation");
+static const json11::Json::Key _KEY_TEXT("text");
+static const json11::Json::Key _KEY_TYPE("type");
+static const json11::Json::Key _KEY_WIDTH("width");
+static const json11::Json::Key _KEY_X("x");
+static const json11::Json::Key _KEY_Y("y");
+
+/*
+JSON shape checks
+*/
+static const json11::JsonSchema _objectLayerSchema = json11::JsonSchema()
+  .field("objects", json11::Json::ARRAY);
+static const json11::JsonSchema _objectSchema = json11::JsonSchema()
+  .field("id", json11::Json::NUMBER, false)
+  .field("name", json11::Json::STRING, false)
+  .field("type", json11::Json::STRING, false)
+  .field("class", json11::Json::STRING, false)
+  .field("x", json11::Json::NUMBER).range(-_OBJECT_COORD_MAX, _OBJECT_COORD_MAX)
+  .field("y", json11::Json::NUMBER).range(-_OBJECT_COORD_MAX, _OBJECT_COORD_MAX)
+  .field("width", json11::Json::NUMBER, false).range(0, _OBJECT_COORD_MAX)
+  .field("height", json11::Json::NUMBER, false).range(0, _OBJECT_COORD_MAX)
+  .field("rotation", json11::Json::NUMBER, false).range(-360, 360)
+  .field("gid", json11::Json::NUMBER, false).range(0, 0xFFFFFFFFu)
+  .field("point", json11::Json::BOOL, false)
+  .field("ellipse", json11::Json::BOOL, false)
+  .field("polygon", json11::Json::ARRAY, false)
+  .field("polyline", json11::Json::ARRAY, false);
+static const json11::JsonSchema _pointSchema = json11::JsonSchema()
+  .field("x", json11::Json::NUMBER).range(-_OBJECT_COORD_MAX, _OBJECT_COORD_MAX)
+  .field("y", json11::Json::NUMBER).range(-_OBJECT_COORD_MAX, _OBJECT_COORD_MAX);
+
+/*******************************************************************************/
+/**
+ * Load the objects of the object layers (type "objectgroup") in jsonLayers,
+ * jsonLayers[i] is map->layers[i]. Sets map->objects and map->objectsNum.
+ *
+ * @return != 0 : object error
+ */
+int _GameMap_loadObjects(GameMap_t* map, const std::vector<json11::Json>& jsonLayers)
+{
+  //Count objects, points and string bytes first, the store is allocated once
+  std::string _err;
+  size_t _num = 0, _pointsNum = 0, _stringsLen = 1;
+  for (size_t l = 0; l < jsonLayers.size(); l++) {
+    const json11::Json& _layer = jsonLayers[l];
+    if ("objectgroup" != _layer[_KEY_TYPE].string_value())
+      continue;
+    if (false == _objectLayerSchema.validate(_layer, _err)) {
+      _GameMap_appendToErrStr("Layer \"" + _layer[_KEY_NAME].string_value() + "\": " + _err + "\n");
+      return -1;
+    }
+    const json11::Json::array& _objects = _layer[_KEY_OBJECTS].array_items();
+    for (size_t i = 0; i < _objects.size(); i++) {
+      _pointsNum += _objects[i][_KEY_POLYGON].array_items().size() + _objects[i][_KEY_POLYLINE].array_items().size();
+      _stringsLen += _objects[i][_KEY_NAME].string_value().size() + 1;
+      _stringsLen += _objects[i][_KEY_TYPE].string_value().size() + _objects[i][_KEY_CLASS].string_value().size() + 1;
+    }
+    _num += _objects.size();
+  }
+  if (_num == 0)
+    return 0;
+  if (_num > INT32_MAX / 4 || _pointsNum > INT32_MAX / 8 || _stringsLen > INT32_MAX) {
+    _GameMap_appendToErrStr("Too many objects\n");
+    return -1;
+  }
+
+  GMapObjects_t* _objects = _newObjects((int)_num, (int)_pointsNum, (int)_stringsLen);
+  if (_objects == nullptr) {
+    _GameMap_appendToErrStr("Objects: out of memory\n");
+    return -1;
+  }
+  int _points = 0, _strings = 1, i = 0;
+  for (size_t l = 0; l < jsonLayers.size(); l++) {
+    const json11::Json& _layer = jsonLayers[l];
+    if ("objectgroup" != _layer[_KEY_TYPE].string_value())
+      continue;
+    const json11::Json::array& _jsonObjects = _layer[_KEY_OBJECTS].array_items();
+    for (size_t o = 0; o < _jsonObjects.size(); o++, i++) {
+      if (0 != _readObject(_jsonObjects[o], (int)l, _objects, i, &_points, &_strings, _err)) {
+        _GameMap_appendToErrStr("Layer \"" + _layer[_KEY_NAME].string_value() + "\": object "
+                                + std::to_string(o) + ": " + _err + "\n");
+        _GameMap_freeObjects(_objects);
+        return -1;
+      }
+    }
+  }
+  _objects->pointsNum = _points;
+  _objects->stringsLen = _strings;
+  if (0 != _buildGrid(_objects, _GRID_CELL_TILES * (map->tilewidth > map->tileheight ? map->tilewidth : map->tileheight))) {
+    _GameMap_appendToErrStr("Objects: out of memory\n");
+    _GameMap_freeObjects(_objects);
+    return -1;
+  }
+  map->objects = _objects;
+  map->objectsNum = _objects->num;
+  map->byteSize += _objects->byteSize;
+  return 0;
+}
+
+/*******************************************************************************/
+void _GameMap_freeObjects(GMapObjects_t* objects)
+{
+  if (objects == nullptr)
+    return;
+  free(objects->id); //All object arrays are in its block
+  free(objects->cellStart);
+  free(objects);
+}
+
+/*******************************************************************************/
+/**
+ * Bytes _GameMap_writeObjects() writes
+ */
+size_t _GameMap_objectsFileBytes(const GMapObjects_t* objects)
+{
+  if (objects == nullptr)
+    return 0;
+  return 4 * sizeof(int32_t) + (size_t)objects->num * _ARRAYS_NUM * 4
+       + (size_t)objects->pointsNum * 2 * sizeof(float) + objects->stringsLen;
+}
+
+/*******************************************************************************/
+/**
+ * Write objects to a .gmapbin file: counts, then each array (the grid is
+ * built again when loaded)
+ *
+ * @return != 0 : error writing file
+ */
+int _GameMap_writeObjects(const GMapObjects_t* objects, FILE* fp)
+{
+  if (objects == nullptr)
+    return 0;
+  int32_t _counts[4] = { objects->num, objects->pointsNum, objects->stringsLen, 0 };
+  if (1 != fwrite(_counts, sizeof(_counts), 1, fp))
+    return -1;
+  void* _arrays[_ARRAYS_NUM];
+  _savedArrays(objects, _arrays);
+  for (int a = 0; a < _ARRAYS_NUM; a++)
+    if ((size_t)objects->num != fwrite(_arrays[a], 4, objects->num, fp))
+      return -1;
+  if (objects->pointsNum > 0
+      && (size_t)objects->pointsNum * 2 != fwrite(objects->points, sizeof(float), (size_t)objects->pointsNum * 2, fp))
+    return -1;
+  if (1 != fwrite(objects->strings, objects->stringsLen, 1, fp))
+    return -1;
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Read objects written by _GameMap_writeObjects(), checking every index
+ *
+ * @return nullptr : bad data or out of memory
+ */
+GMapObjects_t* _GameMap_readObjects(const unsigned char* data, size_t size, const GameMap_t* map)
+{
+  int32_t _counts[4];
+  if (size < sizeof(_counts))
+    return nullptr;
+  memcpy(_counts, data, sizeof(_counts));
+  if (_counts[0] <= 0 || _counts[0] > INT32_MAX / 4 || _counts[1] < 0 || _counts[1] > INT32_MAX / 8
+      || _counts[2] < 1 || size != 4 * sizeof(int32_t) + (size_t)_counts[0] * _ARRAYS_NUM * 4
+                                   + (size_t)_counts[1] * 2 * sizeof(float) + (size_t)_counts[2])
+    return nullptr;
+  GMapObjects_t* _objects = _newObjects(_counts[0], _counts[1], _counts[2]);
+  if (_objects == nullptr)
+    return nullptr;
+  data += sizeof(_counts);
+  void* _arrays[_ARRAYS_NUM];
+  _savedArrays(_objects, _arrays);
+  for (int a = 0; a < _ARRAYS_NUM; a++, data += (size_t)_objects->num * 4)
+    memcpy(_arrays[a], data, (size_t)_objects->num * 4);
+  memcpy(_objects->points, data, (size_t)_objects->pointsNum * 2 * sizeof(float));
+  data += (size_t)_objects->pointsNum * 2 * sizeof(float);
+  memcpy(_objects->strings, data, _objects->stringsLen);
+
+  bool _ok = _objects->strings[_objects->stringsLen - 1] == '\0';
+  for (int i = 0; _ok && i < _objects->num; i++) {
+    _ok = _objects->layer[i] >= 0 && _objects->layer[i] < map->layersNum
+       && _objects->shape[i] >= GAMEMAP_OBJECT_RECT && _objects->shape[i] <= GAMEMAP_OBJECT_TEXT
+       && _objects->name[i] >= 0 && _objects->name[i] < _objects->stringsLen
+       && _objects->type[i] >= 0 && _objects->type[i] < _objects->stringsLen
+       && _objects->pointsStart[i] >= 0 && _objects->pointsCount[i] >= 0
+       && _objects->pointsStart[i] <= _objects->pointsNum - _objects->pointsCount[i]
+       && fabsf(_objects->x[i]) <= _OBJECT_COORD_MAX && fabsf(_objects->y[i]) <= _OBJECT_COORD_MAX
+       && _objects->width[i] >= 0 && _objects->width[i] <= _OBJECT_COORD_MAX
+       && _objects->height[i] >= 0 && _objects->height[i] <= _OBJECT_COORD_MAX
+       && fabsf(_objects->rotation[i]) <= 360;
+  }
+  for (int p = 0; _ok && p < 2 * _objects->pointsNum; p++)
+    _ok = fabsf(_objects->points[p]) <= _OBJECT_COORD_MAX;
+  if (_ok) {
+    for (int i = 0; i < _objects->num; i++)
+      _setBounds(_objects, i);
+    _ok = 0 == _buildGrid(_objects, _GRID_CELL_TILES * (map->tilewidth > map->tileheight ? map->tilewidth : map->tileheight));
+  }
+  if (false == _ok) {
+    _GameMap_freeObjects(_objects);
+    return nullptr;
+  }
+  return _objects;
+}
+
+/*******************************************************************************/
+int GameMap_getObjectsNum(const GameMap_t* map)
+{
+  return map != nullptr ? map->objectsNum : 0;
+}
+
+/*******************************************************************************/
+/**
+ * Get object index (0 .. GameMap_getObjectsNum() - 1)
+ * Strings and points point into the map, valid until it is freed
+ *
+ * @return != 0 : wrong index
+ */
+int GameMap_getObject(const GameMap_t* map, int index, GameMap_Object_t* object)
+{
+  if (map == nullptr || map->objects == nullptr || object == nullptr || index < 0 || index >= map->objectsNum)
+    return -1;
+  const GMapObjects_t* _objects = map->objects;
+  object->id = _objects->id[index];
+  object->name = _objects->strings + _objects->name[index];
+  object->type = _objects->strings + _objects->type[index];
+  object->layerId = _objects->layer[index];
+  object->shape = (GameMap_ObjectShape_t)_objects->shape[index];
+  object->x = _objects->x[index];
+  object->y = _objects->y[index];
+  object->width = _objects->width[index];
+  object->height = _objects->height[index];
+  object->rotation = _objects->rotation[index];
+  object->gid = _objects->gid[index];
+  object->pointsNum = _objects->pointsCount[index];
+  object->points = _objects->points + 2 * (size_t)_objects->pointsStart[index];
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Find objects whose bounds overlap rectangle (x,y,w,h)
+ * Indices of the first outMax found are written to out
+ *
+ * @return number of objects found (can be more than outMax)
+ */
+int GameMap_queryObjects(const GameMap_t* map, float x, float y, float w, float h, int* out, int outMax)
+{
+  if (map == nullptr || map->objects == nullptr || !(w >= 0) || !(h >= 0)
+      || !(fabsf(x) < 2.0f * _OBJECT_COORD_MAX) || !(fabsf(y) < 2.0f * _OBJECT_COORD_MAX))
+    return 0;
+  const GMapObjects_t* _objects = map->objects;
+  float _x1 = x + w, _y1 = y + h;
+  //Cells covered, clipped to the grid
+  int _cx0 = (int)floorf(x / _objects->cellSize) - _objects->gridx;
+  int _cy0 = (int)floorf(y / _objects->cellSize) - _objects->gridy;
+  int _cx1 = (int)fminf(floorf(_x1 / _objects->cellSize) - _objects->gridx, (float)_objects->gridw - 1);
+  int _cy1 = (int)fminf(floorf(_y1 / _objects->cellSize) - _objects->gridy, (float)_objects->gridh - 1);
+  int _qx0 = _cx0 < 0 ? 0 : _cx0, _qy0 = _cy0 < 0 ? 0 : _cy0;
+  int _found = 0;
+  for (int cy = _qy0; cy <= _cy1; cy++) {
+    for (int cx = _qx0; cx <= _cx1; cx++) {
+      int _cell = cy * _objects->gridw + cx;
+      for (int c = _objects->cellStart[_cell]; c < _objects->cellStart[_cell + 1]; c++) {
+        int i = _objects->cellObjects[c];
+        if (_objects->minx[i] > _x1 || _objects->maxx[i] < x || _objects->miny[i] > _y1 || _objects->maxy[i] < y)
+          continue;
+        //An object in several cells is reported by the first one the query covers
+        int _ocx = (int)floorf(_objects->minx[i] / _objects->cellSize) - _objects->gridx;
+        int _ocy = (int)floorf(_objects->miny[i] / _objects->cellSize) - _objects->gridy;
+        if (cx != (_ocx > _qx0 ? _ocx : _qx0) || cy != (_ocy > _qy0 ? _ocy : _qy0))
+          continue;
+        if (_found < outMax && out != nullptr)
+          out[_found] = i;
+        _found++;
+      }
+    }
+  }
+  //Big objects
+  size_t _big = (size_t)_objects->gridw * _objects->gridh;
+  for (int c = _objects->cellStart[_big]; c < _objects->cellStart[_big + 1]; c++) {
+    int i = _objects->cellObjects[c];
+    if (_objects->minx[i] > _x1 || _objects->maxx[i] < x || _objects->miny[i] > _y1 || _objects->maxy[i] < y)
+      continue;
+    if (_found < outMax && out != nullptr)
+      out[_found] = i;
+    _found++;
+  }
+  return _found;
+}
+
+/*******************************************************************************/
+/**
+ * Find objects containing point (x,y): rectangles, ellipses, polygons,
+ * tiles and texts by their shape. Points and polylines have no area.
+ *
+ * @return number of objects found (can be more than outMax)
+ */
+int GameMap_queryObjectsAt(const GameMap_t* map, float x, float y, int* out, int outMax)
+{
+  if (map == nullptr || map->objects == nullptr
+      || !(fabsf(x) < 2.0f * _OBJECT_COORD_MAX) || !(fabsf(y) < 2.0f * _OBJECT_COORD_MAX))
+    return 0;
+  const GMapObjects_t* _objects = map->objects;
+  int cx = (int)floorf(x / _objects->cellSize) - _objects->gridx;
+  int cy = (int)floorf(y / _objects->cellSize) - _objects->gridy;
+  if (cx < 0 || cy < 0 || cx >= _objects->gridw || cy >= _objects->gridh)
+    return 0;
+  int _found = 0;
+  //Objects of the cell, then big objects
+  size_t _cells[2] = { (size_t)cy * _objects->gridw + cx, (size_t)_objects->gridw * _objects->gridh };
+  for (int l = 0; l < 2; l++) {
+    for (int c = _objects->cellStart[_cells[l]]; c < _objects->cellStart[_cells[l] + 1]; c++) {
+      int i = _objects->cellObjects[c];
+      if (false == _containsPoint(_objects, i, x, y))
+        continue;
+      if (_found < outMax && out != nullptr)
+        out[_found] = i;
+      _found++;
+    }
+  }
+  return _found;
+}
+
+/*******************************************************************************/
+/**
+ * Allocate an object store, arrays in one block
+ * (the 13 saved arrays, bounds, points, strings)
+ */
+static GMapObjects_t* _newObjects(int num, int pointsNum, int stringsLen)
+{
+  GMapObjects_t* _objects = (GMapObjects_t*)calloc(1, sizeof(GMapObjects_t));
+  if (_objects == nullptr)
+    return nullptr;
+  size_t _bytes = (size_t)num * (_ARRAYS_NUM + 4) * 4 + (size_t)pointsNum * 2 * sizeof(float) + stringsLen;
+  unsigned char* _block = (unsigned char*)calloc(_bytes, 1);
+  if (_block == nullptr) {
+    free(_objects);
+    return nullptr;
+  }
+  _objects->num = num;
+  _objects->pointsNum = pointsNum;
+  _objects->stringsLen = stringsLen;
+  _objects->byteSize = sizeof(GMapObjects_t) + _bytes;
+  int* _ints = (int*)_block;
+  _objects->id = _ints;
+  _objects->layer = _ints + (size_t)num;
+  _objects->shape = _ints + 2 * (size_t)num;
+  _objects->gid = (unsigned int*)(_ints + 3 * (size_t)num);
+  _objects->name = _ints + 4 * (size_t)num;
+  _objects->type = _ints + 5 * (size_t)num;
+  _objects->pointsStart = _ints + 6 * (size_t)num;
+  _objects->pointsCount = _ints + 7 * (size_t)num;
+  float* _floats = (float*)(_ints + 8 * (size_t)num);
+  _objects->x = _floats;
+  _objects->y = _floats + (size_t)num;
+  _objects->width = _floats + 2 * (size_t)num;
+  _objects->height = _floats + 3 * (size_t)num;
+  _objects->rotation = _floats + 4 * (size_t)num;
+  _objects->minx = _floats + 5 * (size_t)num;
+  _objects->miny = _floats + 6 * (size_t)num;
+  _objects->maxx = _floats + 7 * (size_t)num;
+  _objects->maxy = _floats + 8 * (size_t)num;
+  _objects->points = _floats + 9 * (size_t)num;
+  _objects->strings = (char*)(_objects->points + 2 * (size_t)pointsNum);
+  return _objects;
+}
+
+//Arrays saved in .gmapbin files, in file order
+static void _savedArrays(const GMapObjects_t* objects, void** arrays)
+{
+  void* _list[_ARRAYS_NUM] = { objects->id, objects->layer, objects->shape, objects->gid,
+                               objects->name, objects->type, objects->pointsStart, objects->pointsCount,
+                               objects->x, objects->y, objects->width, objects->height, objects->rotation };
+  memcpy(arrays, _list, sizeof(_list));
+}
+
+/*******************************************************************************/
+/**
+ * Read object i from JSON, *points and *strings are the next free ones
+ *
+ * @return != 0 : object error, described in err
+ */
+static int _readObject(const json11::Json& jsonObject, int layerId, GMapObjects_t* objects,
+                       int i, int* points, int* strings, std::string& err)
+{
+  if (false == _objectSchema.validate(jsonObject, err))
+    return -1;
+  objects->id[i] = jsonObject[_KEY_ID].int_value();
+  objects->layer[i] = layerId;
+  objects->x[i] = (float)jsonObject[_KEY_X].number_value();
+  objects->y[i] = (float)jsonObject[_KEY_Y].number_value();
+  objects->width[i] = (float)jsonObject[_KEY_WIDTH].number_value();
+  objects->height[i] = (float)jsonObject[_KEY_HEIGHT].number_value();
+  objects->rotation[i] = (float)jsonObject[_KEY_ROTATION].number_value();
+  objects->gid[i] = jsonObject[_KEY_GID].uint32_value();
+  objects->name[i] = _addString(objects, strings, jsonObject[_KEY_NAME].string_value());
+  //Tiled 1.9 renamed "type" to "class"
+  const json11::Json& _type = jsonObject[_KEY_TYPE].is_null() ? jsonObject[_KEY_CLASS] : jsonObject[_KEY_TYPE];
+  objects->type[i] = _addString(objects, strings, _type.string_value());
+
+  const json11::Json::array* _points = nullptr;
+  if (jsonObject[_KEY_POINT].bool_value()) {
+    objects->shape[i] = GAMEMAP_OBJECT_POINT;
+  }
+  else if (jsonObject[_KEY_ELLIPSE].bool_value()) {
+    objects->shape[i] = GAMEMAP_OBJECT_ELLIPSE;
+  }
+  else if (jsonObject[_KEY_POLYGON].is_array()) {
+    objects->shape[i] = GAMEMAP_OBJECT_POLYGON;
+    _points = &jsonObject[_KEY_POLYGON].array_items();
+  }
+  else if (jsonObject[_KEY_POLYLINE].is_array()) {
+    objects->shape[i] = GAMEMAP_OBJECT_POLYLINE;
+    _points = &jsonObject[_KEY_POLYLINE].array_items();
+  }
+  else if (objects->gid[i] != 0) {
+    objects->shape[i] = GAMEMAP_OBJECT_TILE;
+  }
+  else if (false == jsonObject[_KEY_TEXT].is_null()) {
+    objects->shape[i] = GAMEMAP_OBJECT_TEXT;
+  }
+  else {
+    objects->shape[i] = GAMEMAP_OBJECT_RECT;
+  }
+
+  objects->pointsStart[i] = *points;
+  objects->pointsCount[i] = 0;
+  for (size_t p = 0; _points != nullptr && p < _points->size(); p++) {
+    if (false == _pointSchema.validate((*_points)[p], err)) {
+      err = "point " + std::to_string(p) + ": " + err;
+      return -1;
+    }
+    objects->points[2 * (size_t)*points] = (float)(*_points)[p][_KEY_X].number_value();
+    objects->points[2 * (size_t)*points + 1] = (float)(*_points)[p][_KEY_Y].number_value();
+    (*points)++;
+    objects->pointsCount[i]++;
+  }
+  _setBounds(objects, i);
+  return 0;
+}
+
+//@return offset of str in the strings, "" is at offset 0
+static int _addString(GMapObjects_t* objects, int* strings, const std::string& str)
+{
+  if (str.empty())
+    return 0;
+  int _offset = *strings;
+  memcpy(objects->strings + _offset, str.c_str(), str.size() + 1);
+  *strings += (int)str.size() + 1;
+  return _offset;
+}
+
+/*******************************************************************************/
+//Rotate (px,py) clockwise by the object rotation (y goes down)
+static inline void _rotate(float sn, float cs, float px, float py, float* rx, float* ry)
+{
+  *rx = px * cs - py * sn;
+  *ry = px * sn + py * cs;
+}
+
+//Axis aligned bounds of object i, rotation and points included
+static void _setBounds(GMapObjects_t* objects, int i)
+{
+  float _angle = objects->rotation[i] * 3.14159265358979f / 180.0f;
+  float sn = sinf(_angle), cs = cosf(_angle);
+  float _w = objects->width[i], _h = objects->height[i];
+  float _top = objects->shape[i] == GAMEMAP_OBJECT_TILE ? -_h : 0;
+  float _corners[8] = { 0, _top, _w, _top, 0, _top + _h, _w, _top + _h };
+  const float* _points = _corners;
+  int _pointsNum = objects->shape[i] == GAMEMAP_OBJECT_POINT ? 1 : 4;
+  if (objects->shape[i] == GAMEMAP_OBJECT_POLYGON || objects->shape[i] == GAMEMAP_OBJECT_POLYLINE) {
+    _points = objects->points + 2 * (size_t)objects->pointsStart[i];
+    _pointsNum = objects->pointsCount[i];
+  }
+  float _minx = 0, _miny = 0, _maxx = 0, _maxy = 0;
+  for (int p = 0; p < _pointsNum; p++) {
+    float rx, ry;
+    _rotate(sn, cs, _points[2 * p], _points[2 * p + 1], &rx, &ry);
+    if (p == 0 || rx < _minx) _minx = rx;
+    if (p == 0 || ry < _miny) _miny = ry;
+    if (p == 0 || rx > _maxx) _maxx = rx;
+    if (p == 0 || ry > _maxy) _maxy = ry;
+  }
+  objects->minx[i] = objects->x[i] + _minx;
+  objects->miny[i] = objects->y[i] + _miny;
+  objects->maxx[i] = objects->x[i] + _maxx;
+  objects->maxy[i] = objects->y[i] + _maxy;
+}
+
+/*******************************************************************************/
+/**
+ * Build the grid over the bounds of all objects
+ * Cells get bigger when there would be too many for the objects, objects
+ * over more than _GRID_SPAN_MAX cells go to one more list checked by every query
+ *
+ * @return != 0 : out of memory
+ */
+static int _buildGrid(GMapObjects_t* objects, int cellSize)
+{
+  float _minx = objects->minx[0], _miny = objects->miny[0];
+  float _maxx = objects->maxx[0], _maxy = objects->maxy[0];
+  for (int i = 1; i < objects->num; i++) {
+    _minx = fminf(_minx, objects->minx[i]);
+    _miny = fminf(_miny, objects->miny[i]);
+    _maxx = fmaxf(_maxx, objects->maxx[i]);
+    _maxy = fmaxf(_maxy, objects->maxy[i]);
+  }
+  double _cellsMax = objects->num * 2.0 > _GRID_CELLS_MIN ? objects->num * 2.0 : _GRID_CELLS_MIN;
+  float _cell = (float)(cellSize > 0 ? cellSize : 1);
+  while (((double)floorf(_maxx / _cell) - floorf(_minx / _cell) + 1)
+         * ((double)floorf(_maxy / _cell) - floorf(_miny / _cell) + 1) > _cellsMax)
+    _cell *= 2;
+  objects->cellSize = _cell;
+  objects->gridx = (int)floorf(_minx / _cell);
+  objects->gridy = (int)floorf(_miny / _cell);
+  objects->gridw = (int)floorf(_maxx / _cell) - objects->gridx + 1;
+  objects->gridh = (int)floorf(_maxy / _cell) - objects->gridy + 1;
+
+  //Count objects of each cell (the list of big objects is cell _cellsNum)
+  size_t _cellsNum = (size_t)objects->gridw * objects->gridh;
+  std::vector<int> _cells(2 * (size_t)objects->num);
+  std::vector<int> _next(_cellsNum + 1, 0);
+  size_t _refsNum = 0;
+  for (int i = 0; i < objects->num; i++) {
+    int _cx0 = (int)floorf(objects->minx[i] / _cell) - objects->gridx;
+    int _cy0 = (int)floorf(objects->miny[i] / _cell) - objects->gridy;
+    int _cx1 = (int)floorf(objects->maxx[i] / _cell) - objects->gridx;
+    int _cy1 = (int)floorf(objects->maxy[i] / _cell) - objects->gridy;
+    _cells[2 * i] = _cy0 * objects->gridw + _cx0;
+    _cells[2 * i + 1] = (_cy1 - _cy0 + 1) * (_cx1 - _cx0 + 1) > _GRID_SPAN_MAX ? -1 : _cy1 * objects->gridw + _cx1;
+    if (_cells[2 * i + 1] < 0) {
+      _next[_cellsNum]++;
+      _refsNum++;
+      continue;
+    }
+    for (int cy = _cy0; cy <= _cy1; cy++)
+      for (int cx = _cx0; cx <= _cx1; cx++)
+        _next[(size_t)cy * objects->gridw + cx]++;
+    _refsNum += (size_t)(_cy1 - _cy0 + 1) * (_cx1 - _cx0 + 1);
+  }
+  objects->cellStart = (int*)malloc((_cellsNum + 2 + _refsNum) * sizeof(int));
+  if (objects->cellStart == nullptr)
+    return -1;
+  objects->cellObjects = objects->cellStart + _cellsNum + 2;
+  objects->byteSize += (_cellsNum + 2 + _refsNum) * sizeof(int);
+  int _start = 0;
+  for (size_t c = 0; c <= _cellsNum; c++) {
+    objects->cellStart[c] = _start;
+    _start += _next[c];
+    _next[c] = objects->cellStart[c];
+  }
+  objects->cellStart[_cellsNum + 1] = _start;
+
+  //Fill them, in object order
+  for (int i = 0; i < objects->num; i++) {
+    if (_cells[2 * i + 1] < 0) {
+      objects->cellObjects[_next[_cellsNum]++] = i;
+      continue;
+    }
+    int _cx0 = _cells[2 * i] % objects->gridw, _cy0 = _cells[2 * i] / objects->gridw;
+    int _cx1 = _cells[2 * i + 1] % objects->gridw, _cy1 = _cells[2 * i + 1] / objects->gridw;
+    for (int cy = _cy0; cy <= _cy1; cy++)
+      for (int cx = _cx0; cx <= _cx1; cx++)
+        objects->cellObjects[_next[(size_t)cy * objects->gridw + cx]++] = i;
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+//@return true if object i contains (px,py)
+static bool _containsPoint(const GMapObjects_t* objects, int i, float px, float py)
+{
+  if (px < objects->minx[i] || px > objects->maxx[i] || py < objects->miny[i] || py > objects->maxy[i])
+    return false;
+  int _shape = objects->shape[i];
+  if (_shape == GAMEMAP_OBJECT_POINT || _shape == GAMEMAP_OBJECT_POLYLINE)
+    return false;
+  //Point in object coordinates: rotated back around (x,y)
+  float _angle = objects->rotation[i] * 3.14159265358979f / 180.0f;
+  float lx, ly;
+  _rotate(-sinf(_angle), cosf(_angle), px - objects->x[i], py - objects->y[i], &lx, &ly);
+  float _w = objects->width[i], _h = objects->height[i];
+  switch (_shape) {
+  case GAMEMAP_OBJECT_TILE:
+    return lx >= 0 && lx <= _w && ly >= -_h && ly <= 0;
+  case GAMEMAP_OBJECT_ELLIPSE: {
+    if (_w <= 0 || _h <= 0)
+      return false;
+    float ex = (lx - _w / 2) / (_w / 2), ey = (ly - _h / 2) / (_h / 2);
+    return ex * ex + ey * ey <= 1.0f;
+  }
+  case GAMEMAP_OBJECT_POLYGON: {
+    //Even-odd rule
+    const float* _points = objects->points + 2 * (size_t)objects->pointsStart[i];
+    int n = objects->pointsCount[i];
+    bool _inside = false;
+    for (int a = 0, b = n - 1; a < n; b = a++) {
+      float ax = _points[2 * a], ay = _points[2 * a + 1];
+      float bx = _points[2 * b], by = _points[2 * b + 1];
+      if ((ay > ly) != (by > ly) && lx < (bx - ax) * (ly - ay) / (by - ay) + ax)
+        _inside = !_inside;
+    }
+    return _inside;
+  }
+  default:
+    return lx >= 0 && lx <= _w && ly >= 0 && ly <= _h;
+  }
+}
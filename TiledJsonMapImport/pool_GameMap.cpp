@@ -0,0 +1,158 @@
+/*******************************************************************************
+ * GameMap worker threads
+ * One pool of threads, started on first use, runs the independent tasks of a
+ * job in parallel (flow field blocks...). The calling thread runs tasks too
+ * and returns when all of them are done. Jobs from several threads run one
+ * after the other, a task starting a job runs it on its own thread.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <system_error>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+#define _POOL_MAX_WORKERS 32
+
+typedef struct {
+  std::mutex jobMutex;            //One job at a time
+  std::mutex mutex;               //Job fields and waking up
+  std::condition_variable wake;   //New job or stop
+  std::condition_variable finished;
+  std::vector<std::thread> workers;
+  bool started;
+  bool stop;
+  unsigned int generation;        //Job number, workers wait for a new one
+  void (*task)(void* arg, int index);
+  void* arg;
+  int tasksNum;
+  std::atomic<int> next;          //Next task index to run
+  int running;                    //Workers inside the job
+} _Pool_t;
+
+static _Pool_t _GameMap_pool;
+static thread_local bool _GameMap_inTask = false;
+
+/*
+Private functions
+*/
+static void _startPool(_Pool_t* pool);
+static void _worker(_Pool_t* pool);
+static void _runJobTasks(_Pool_t* pool);
+
+//Workers are stopped when the program ends
+static struct _PoolStopper_t {
+  ~_PoolStopper_t() {
+    {
+      std::lock_guard<std::mutex> _lock(_GameMap_pool.mutex);
+      _GameMap_pool.stop = true;
+    }
+    _GameMap_pool.wake.notify_all();
+    for (size_t i = 0; i < _GameMap_pool.workers.size(); i++)
+      _GameMap_pool.workers[i].join();
+  }
+} _GameMap_poolStopper;
+
+/*******************************************************************************/
+/**
+ * Run task(arg, 0) ... task(arg, tasksNum - 1) on the pool and this thread,
+ * return when all are done. Tasks must not depend on each other.
+ */
+void _GameMap_runTasks(int tasksNum, void (*task)(void* arg, int index), void* arg)
+{
+  _Pool_t* pool = &_GameMap_pool;
+  if (tasksNum <= 0)
+    return;
+  if (_GameMap_inTask || tasksNum == 1) {
+    for (int i = 0; i < tasksNum; i++)
+      task(arg, i);
+    return;
+  }
+  std::lock_guard<std::mutex> _job(pool->jobMutex);
+  {
+    std::unique_lock<std::mutex> _lock(pool->mutex);
+    if (false == pool->started)
+      _startPool(pool);
+    pool->task = task;
+    pool->arg = arg;
+    pool->tasksNum = tasksNum;
+    pool->next = 0;
+    pool->generation++;
+  }
+  pool->wake.notify_all();
+  _runJobTasks(pool);
+  //Workers still running the last tasks
+  std::unique_lock<std::mutex> _lock(pool->mutex);
+  pool->finished.wait(_lock, [pool] { return pool->running == 0; });
+  pool->tasksNum = 0;
+}
+
+/*******************************************************************************/
+/**
+ * Threads running tasks, the calling thread included
+ */
+int _GameMap_workersNum()
+{
+  unsigned int _cores = std::thread::hardware_concurrency();
+  if (_cores == 0) _cores = 1;
+  if (_cores > _POOL_MAX_WORKERS + 1) _cores = _POOL_MAX_WORKERS + 1;
+  return (int)_cores;
+}
+
+/*******************************************************************************/
+//Called with pool->mutex locked, without threads tasks all run on the caller
+static void _startPool(_Pool_t* pool)
+{
+  pool->started = true;
+  int _workersNum = _GameMap_workersNum() - 1;
+  for (int i = 0; i < _workersNum; i++) {
+    try {
+      pool->workers.push_back(std::thread(_worker, pool));
+    }
+    catch (const std::system_error&) {
+      break;
+    }
+  }
+}
+
+static void _worker(_Pool_t* pool)
+{
+  _GameMap_inTask = true;
+  unsigned int _generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> _lock(pool->mutex);
+      pool->wake.wait(_lock, [pool, _generation] { return pool->stop || pool->generation != _generation; });
+      if (pool->stop)
+        return;
+      _generation = pool->generation;
+      if (pool->tasksNum == 0)
+        continue;
+      pool->running++;
+    }
+    _runJobTasks(pool);
+    {
+      std::lock_guard<std::mutex> _lock(pool->mutex);
+      pool->running--;
+    }
+    pool->finished.notify_one();
+  }
+}
+
+static void _runJobTasks(_Pool_t* pool)
+{
+  bool _inTask = _GameMap_inTask;
+  _GameMap_inTask = true;
+  for (;;) {
+    int i = pool->next.fetch_add(1);
+    if (i >= pool->tasksNum)
+      break;
+    pool->task(pool->arg, i);
+  }
+  _GameMap_inTask = _inTask;
+}
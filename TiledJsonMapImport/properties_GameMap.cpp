@@ -0,0 +1,497 @@
+/*******************************************************************************
+ * GameMap custom properties
+ * Properties set in Tiled on the map, its layers, tilesets and tiles are read
+ * when the map is loaded into one flat table of typed values. Names are
+ * interned: a name has the same id in every map, looked up once by the game.
+ *
+ * The table is sorted by owner: the map, then each layer, each tileset, then
+ * each tile GID, so the properties of a tile are found by indexing with its
+ * GID, without searching, in per frame collision and AI loops.
+*******************************************************************************/
+
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+#include "json11.hpp"
+
+#define _PROPERTY_GID_MAX (1 << 24)   //Tiles with properties past this GID are an error
+#define _PROPERTY_INTS 6              //int32 per property saved in .gmapbin files
+
+//Property names of all maps, id: index in names
+static struct {
+  std::mutex mutex;
+  std::unordered_map<std::string, int> ids;
+  std::vector<std::string> names;
+} _GameMap_propertyNames;
+
+//Property not set, returned instead of nullptr
+static const GameMap_Property_t _noProperty = { -1, GAMEMAP_PROPERTY_NONE, 0, 0.0f, 0, "", "" };
+
+//Properties array of an owner, while loading
+typedef struct {
+  int owner;
+  const json11::Json::array* properties;
+} _Owner_t;
+
+/*
+Private functions
+*/
+static int _addOwner(std::vector<_Owner_t>* owners, int owner, const json11::Json& jsonOwner, std::string& err);
+static int _readProperty(const json11::Json& jsonProperty, GameMap_Property_t* prop, std::string* value, std::string& err);
+static std::string _ownerName(const GameMap_t* map, int owner);
+static GMapProperties_t* _newProperties(int num, int ownersNum, int stringsLen);
+static const GameMap_Property_t* _findProperty(const GMapProperties_t* properties, int owner, int nameId);
+
+/*
+Pre-hashed JSON keys
+*/
+static const json11::Json::Key _KEY_ID("id");
+static const json11::Json::Key _KEY_NAME("name");
+static const json11::Json::Key _KEY_PROPERTIES("properties");
+static const json11::Json::Key _KEY_TILES("tiles");
+static const json11::Json::Key _KEY_TYPE("type");
+static const json11::Json::Key _KEY_VALUE("value");
+
+/*
+JSON shape checks
+*/
+static const json11::JsonSchema _ownerSchema = json11::JsonSchema()
+  .field("properties", json11::Json::ARRAY, false);
+static const json11::JsonSchema _tilesSchema = json11::JsonSchema()
+  .field("tiles", json11::Json::ARRAY, false);
+static const json11::JsonSchema _tileSchema = json11::JsonSchema()
+  .field("id", json11::Json::NUMBER).range(0, _PROPERTY_GID_MAX)
+  .field("properties", json11::Json::ARRAY, false);
+static const json11::JsonSchema _propertySchema = json11::JsonSchema()
+  .field("name", json11::Json::STRING)
+  .field("type", json11::Json::STRING, false);
+
+/*******************************************************************************/
+/**
+ * Load the properties of the map, of jsonLayers (map->layers order), of
+ * jsonTilesets (map->tilesets order, external ones as read from their file)
+ * and of their tiles. Sets map->properties, nullptr when none is set.
+ *
+ * @return != 0 : property error
+ */
+int _GameMap_loadProperties(GameMap_t* map, const json11::Json& jsonMap,
+                            const std::vector<json11::Json>& jsonLayers,
+                            const std::vector<json11::Json>& jsonTilesets)
+{
+  //Owners with properties, in table order
+  std::string _err;
+  std::vector<_Owner_t> _owners;
+  int rc = _addOwner(&_owners, 0, jsonMap, _err);
+  if (rc != 0)
+    _GameMap_appendToErrStr("Map properties: " + _err + "\n");
+  for (size_t l = 0; rc == 0 && l < jsonLayers.size(); l++) {
+    rc = _addOwner(&_owners, 1 + (int)l, jsonLayers[l], _err);
+    if (rc != 0)
+      _GameMap_appendToErrStr("Layer \"" + jsonLayers[l][_KEY_NAME].string_value() + "\" properties: " + _err + "\n");
+  }
+  int _tilesOwner = 1 + map->layersNum + map->tilesetsNum;
+  int _tilesNum = 0;
+  for (size_t t = 0; rc == 0 && t < jsonTilesets.size(); t++) {
+    rc = _addOwner(&_owners, 1 + map->layersNum + (int)t, jsonTilesets[t], _err);
+    if (rc == 0 && false == _tilesSchema.validate(jsonTilesets[t], _err))
+      rc = -1;
+    //Tiles with properties, by id in the tileset
+    const json11::Json::array& _tiles = jsonTilesets[t][_KEY_TILES].array_items();
+    for (size_t i = 0; rc == 0 && i < _tiles.size(); i++) {
+      if (false == _tileSchema.validate(_tiles[i], _err)) {
+        rc = -1;
+        break;
+      }
+      int _id = _tiles[i][_KEY_ID].int_value();
+      int _gid = map->tilesets[t].firstgid + _id;
+      if (_id >= map->tilesets[t].tilecount || _gid >= _PROPERTY_GID_MAX) {
+        _err = "tile id " + std::to_string(_id) + " out of the tileset";
+        rc = -1;
+        break;
+      }
+      if (_tiles[i][_KEY_PROPERTIES].array_items().size() == 0)
+        continue;
+      rc = _addOwner(&_owners, _tilesOwner + _gid, _tiles[i], _err);
+      if (_gid >= _tilesNum)
+        _tilesNum = _gid + 1;
+    }
+    if (rc != 0)
+      _GameMap_appendToErrStr("Tileset \"" + jsonTilesets[t][_KEY_NAME].string_value() + "\" properties: " + _err + "\n");
+  }
+  if (rc != 0)
+    return -1;
+  if (_owners.size() == 0)
+    return 0;
+
+  //Read values, counting them by owner, then move them to their owner's range
+  int _ownersNum = _tilesOwner + _tilesNum;
+  std::vector<int> _ownerStart(_ownersNum + 1, 0);
+  std::vector<GameMap_Property_t> _props;
+  std::vector<int> _propOwners;
+  std::vector<int> _propStrings;     //Name and string value of each of _props, offsets into _strings
+  std::unordered_map<std::string, int> _stringOffsets;
+  std::string _strings(1, '\0');      //Offset 0: ""
+  for (size_t o = 0; o < _owners.size(); o++) {
+    const json11::Json::array& _jsonProps = *_owners[o].properties;
+    for (size_t p = 0; p < _jsonProps.size(); p++) {
+      GameMap_Property_t _prop;
+      std::string _value;
+      if (0 != _readProperty(_jsonProps[p], &_prop, &_value, _err)) {
+        _GameMap_appendToErrStr(_ownerName(map, _owners[o].owner) + " property \""
+                                + _jsonProps[p][_KEY_NAME].string_value() + "\": " + _err + "\n");
+        return -1;
+      }
+      if (_prop.type == GAMEMAP_PROPERTY_NONE)
+        continue;  //Not supported (class properties)
+      const std::string* _texts[2] = { &_jsonProps[p][_KEY_NAME].string_value(), &_value };
+      int _offsets[2] = { 0, 0 };
+      for (int s = 0; s < 2; s++) {
+        if (_texts[s]->size() == 0)
+          continue;
+        std::unordered_map<std::string, int>::const_iterator _found = _stringOffsets.find(*_texts[s]);
+        if (_found == _stringOffsets.end()) {
+          if (_strings.size() + _texts[s]->size() + 1 > INT32_MAX) {
+            _GameMap_appendToErrStr("Properties: too many strings\n");
+            return -1;
+          }
+          _found = _stringOffsets.emplace(*_texts[s], (int)_strings.size()).first;
+          _strings.append(*_texts[s]).push_back('\0');
+        }
+        _offsets[s] = _found->second;
+      }
+      _props.push_back(_prop);
+      _propStrings.push_back(_offsets[0]);
+      _propStrings.push_back(_offsets[1]);
+      _propOwners.push_back(_owners[o].owner);
+      _ownerStart[_owners[o].owner + 1]++;
+    }
+  }
+  if (_props.size() == 0)
+    return 0;
+  if (_props.size() > INT32_MAX / sizeof(GameMap_Property_t)) {
+    _GameMap_appendToErrStr("Too many properties\n");
+    return -1;
+  }
+  GMapProperties_t* _properties = _newProperties((int)_props.size(), _ownersNum, (int)_strings.size());
+  if (_properties == nullptr) {
+    _GameMap_appendToErrStr("Properties: out of memory\n");
+    return -1;
+  }
+  memcpy(_properties->strings, _strings.data(), _strings.size());
+  for (int o = 0; o < _ownersNum; o++)
+    _ownerStart[o + 1] += _ownerStart[o];
+  memcpy(_properties->ownerStart, _ownerStart.data(), (_ownersNum + 1) * sizeof(int));
+  for (size_t p = 0; p < _props.size(); p++) {
+    GameMap_Property_t* _prop = &_properties->props[_ownerStart[_propOwners[p]]++];
+    *_prop = _props[p];
+    _prop->name = _properties->strings + _propStrings[2 * p];
+    _prop->s = _properties->strings + _propStrings[2 * p + 1];
+  }
+  _properties->tilesOwner = _tilesOwner;
+  _properties->tilesNum = _tilesNum;
+  map->properties = _properties;
+  map->byteSize += _properties->byteSize;
+  return 0;
+}
+
+/*******************************************************************************/
+void _GameMap_freeProperties(GMapProperties_t* properties)
+{
+  free(properties); //Arrays are in its block
+}
+
+/*******************************************************************************/
+/**
+ * Bytes _GameMap_writeProperties() writes
+ */
+size_t _GameMap_propertiesFileBytes(const GMapProperties_t* properties)
+{
+  if (properties == nullptr)
+    return 0;
+  return 4 * sizeof(int32_t) + ((size_t)properties->ownersNum + 1) * sizeof(int32_t)
+       + (size_t)properties->num * _PROPERTY_INTS * sizeof(int32_t) + properties->stringsLen;
+}
+
+/*******************************************************************************/
+/**
+ * Write properties to a .gmapbin file: counts, owner starts, properties
+ * (names and strings as offsets into the strings), strings
+ *
+ * @return != 0 : error writing file
+ */
+int _GameMap_writeProperties(const GMapProperties_t* properties, FILE* fp)
+{
+  if (properties == nullptr)
+    return 0;
+  int32_t _counts[4] = { properties->num, properties->ownersNum, properties->tilesNum, properties->stringsLen };
+  if (1 != fwrite(_counts, sizeof(_counts), 1, fp))
+    return -1;
+  if ((size_t)properties->ownersNum + 1 != fwrite(properties->ownerStart, sizeof(int32_t), (size_t)properties->ownersNum + 1, fp))
+    return -1;
+  for (int p = 0; p < properties->num; p++) {
+    const GameMap_Property_t* _prop = &properties->props[p];
+    int32_t _ints[_PROPERTY_INTS] = { (int32_t)(_prop->name - properties->strings), _prop->type, _prop->i, 0,
+                                      (int32_t)_prop->color, (int32_t)(_prop->s - properties->strings) };
+    memcpy(&_ints[3], &_prop->f, sizeof(float));
+    if (1 != fwrite(_ints, sizeof(_ints), 1, fp))
+      return -1;
+  }
+  if (1 != fwrite(properties->strings, properties->stringsLen, 1, fp))
+    return -1;
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Read properties written by _GameMap_writeProperties(), checking every
+ * index (name ids are looked up again, they are not the same in every run)
+ *
+ * @return nullptr : bad data or out of memory
+ */
+GMapProperties_t* _GameMap_readProperties(const unsigned char* data, size_t size, const GameMap_t* map)
+{
+  int32_t _counts[4];
+  if (size < sizeof(_counts))
+    return nullptr;
+  memcpy(_counts, data, sizeof(_counts));
+  int _tilesOwner = 1 + map->layersNum + map->tilesetsNum;
+  if (_counts[0] <= 0 || (size_t)_counts[0] > INT32_MAX / sizeof(GameMap_Property_t)
+      || _counts[2] < 0 || _counts[2] > _PROPERTY_GID_MAX || _counts[1] != _tilesOwner + _counts[2]
+      || _counts[3] < 1 || size != 4 * sizeof(int32_t) + ((size_t)_counts[1] + 1) * sizeof(int32_t)
+                                   + (size_t)_counts[0] * _PROPERTY_INTS * sizeof(int32_t) + (size_t)_counts[3])
+    return nullptr;
+  GMapProperties_t* _properties = _newProperties(_counts[0], _counts[1], _counts[3]);
+  if (_properties == nullptr)
+    return nullptr;
+  _properties->tilesOwner = _tilesOwner;
+  _properties->tilesNum = _counts[2];
+  data += sizeof(_counts);
+  memcpy(_properties->ownerStart, data, ((size_t)_properties->ownersNum + 1) * sizeof(int32_t));
+  data += ((size_t)_properties->ownersNum + 1) * sizeof(int32_t);
+  const unsigned char* _propsData = data;
+  data += (size_t)_properties->num * _PROPERTY_INTS * sizeof(int32_t);
+  memcpy(_properties->strings, data, _properties->stringsLen);
+
+  bool _ok = _properties->strings[_properties->stringsLen - 1] == '\0'
+          && _properties->ownerStart[0] == 0 && _properties->ownerStart[_properties->ownersNum] == _properties->num;
+  for (int o = 0; _ok && o < _properties->ownersNum; o++)
+    _ok = _properties->ownerStart[o] <= _properties->ownerStart[o + 1];
+  for (int p = 0; _ok && p < _properties->num; p++) {
+    int32_t _ints[_PROPERTY_INTS];
+    memcpy(_ints, _propsData + (size_t)p * sizeof(_ints), sizeof(_ints));
+    _ok = _ints[0] >= 0 && _ints[0] < _properties->stringsLen && _ints[5] >= 0 && _ints[5] < _properties->stringsLen
+       && _ints[1] > GAMEMAP_PROPERTY_NONE && _ints[1] <= GAMEMAP_PROPERTY_FILE;
+    if (false == _ok)
+      break;
+    GameMap_Property_t* _prop = &_properties->props[p];
+    _prop->name = _properties->strings + _ints[0];
+    _prop->nameId = GameMap_getPropertyId(_prop->name);
+    _prop->type = (GameMap_PropertyType_t)_ints[1];
+    _prop->i = _ints[2];
+    memcpy(&_prop->f, &_ints[3], sizeof(float));
+    _prop->color = (unsigned int)_ints[4];
+    _prop->s = _properties->strings + _ints[5];
+  }
+  if (false == _ok) {
+    _GameMap_freeProperties(_properties);
+    return nullptr;
+  }
+  return _properties;
+}
+
+/*******************************************************************************/
+/**
+ * Id of a property name, the same in every map (new names get a new id)
+ */
+int GameMap_getPropertyId(const char* name)
+{
+  if (name == nullptr)
+    return -1;
+  std::lock_guard<std::mutex> _lock(_GameMap_propertyNames.mutex);
+  std::unordered_map<std::string, int>::const_iterator _found = _GameMap_propertyNames.ids.find(name);
+  if (_found != _GameMap_propertyNames.ids.end())
+    return _found->second;
+  int _id = (int)_GameMap_propertyNames.names.size();
+  _GameMap_propertyNames.names.push_back(name);
+  _GameMap_propertyNames.ids.emplace(name, _id);
+  return _id;
+}
+
+/*******************************************************************************/
+const GameMap_Property_t* GameMap_getMapProperty(const GameMap_t* map, int nameId)
+{
+  if (map == nullptr || map->properties == nullptr)
+    return &_noProperty;
+  return _findProperty(map->properties, 0, nameId);
+}
+
+const GameMap_Property_t* GameMap_getLayerProperty(const GameMap_t* map, int layerId, int nameId)
+{
+  if (map == nullptr || map->properties == nullptr || layerId < 0 || layerId >= map->layersNum)
+    return &_noProperty;
+  return _findProperty(map->properties, 1 + layerId, nameId);
+}
+
+const GameMap_Property_t* GameMap_getTilesetProperty(const GameMap_t* map, int tilesetId, int nameId)
+{
+  if (map == nullptr || map->properties == nullptr || tilesetId < 0 || tilesetId >= map->tilesetsNum)
+    return &_noProperty;
+  return _findProperty(map->properties, 1 + map->layersNum + tilesetId, nameId);
+}
+
+const GameMap_Property_t* GameMap_getTileProperty(const GameMap_t* map, unsigned int gid, int nameId)
+{
+  gid &= _GID_MASK;
+  if (map == nullptr || map->properties == nullptr || gid >= (unsigned int)map->properties->tilesNum)
+    return &_noProperty;
+  return _findProperty(map->properties, map->properties->tilesOwner + (int)gid, nameId);
+}
+
+/*******************************************************************************/
+/**
+ * Properties of the tile that has them, *props points to the first
+ *
+ * @return number of properties
+ */
+int GameMap_getTileProperties(const GameMap_t* map, unsigned int gid, const GameMap_Property_t** props)
+{
+  gid &= _GID_MASK;
+  if (map == nullptr || map->properties == nullptr || gid >= (unsigned int)map->properties->tilesNum)
+    return 0;
+  const GMapProperties_t* _properties = map->properties;
+  int _owner = _properties->tilesOwner + (int)gid;
+  if (props != nullptr)
+    *props = _properties->props + _properties->ownerStart[_owner];
+  return _properties->ownerStart[_owner + 1] - _properties->ownerStart[_owner];
+}
+
+/*******************************************************************************/
+//Add the properties of jsonOwner, if it has some
+static int _addOwner(std::vector<_Owner_t>* owners, int owner, const json11::Json& jsonOwner, std::string& err)
+{
+  if (false == _ownerSchema.validate(jsonOwner, err))
+    return -1;
+  const json11::Json::array& _properties = jsonOwner[_KEY_PROPERTIES].array_items();
+  if (_properties.size() > 0)
+    owners->push_back({ owner, &_properties });
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Typed value of a Tiled property, string values to *value
+ * (prop->type is GAMEMAP_PROPERTY_NONE for the types not supported)
+ *
+ * @return != 0 : wrong property
+ */
+static int _readProperty(const json11::Json& jsonProperty, GameMap_Property_t* prop, std::string* value, std::string& err)
+{
+  if (false == _propertySchema.validate(jsonProperty, err))
+    return -1;
+  *prop = _noProperty;
+  const json11::Json& _value = jsonProperty[_KEY_VALUE];
+  const std::string& _type = jsonProperty[_KEY_TYPE].string_value();
+  if (_type == "class")
+    return 0;
+  if (_type == "bool") {
+    if (false == _value.is_bool()) {
+      err = "bool value expected";
+      return -1;
+    }
+    prop->type = GAMEMAP_PROPERTY_BOOL;
+    prop->i = _value.bool_value() ? 1 : 0;
+    prop->f = (float)prop->i;
+  }
+  else if (_type == "int" || _type == "float" || _type == "object") {
+    if (false == _value.is_number()) {
+      err = "number value expected";
+      return -1;
+    }
+    prop->type = _type == "float" ? GAMEMAP_PROPERTY_FLOAT : GAMEMAP_PROPERTY_INT;
+    double _number = _value.number_value();
+    prop->i = _number < INT32_MIN ? INT32_MIN : _number > INT32_MAX ? INT32_MAX : (int)_number;
+    prop->f = (float)_number;
+  }
+  else if (_type == "" || _type == "string" || _type == "file" || _type == "color") {
+    if (false == _value.is_string()) {
+      err = "string value expected";
+      return -1;
+    }
+    prop->type = _type == "file" ? GAMEMAP_PROPERTY_FILE : _type == "color" ? GAMEMAP_PROPERTY_COLOR
+               : GAMEMAP_PROPERTY_STRING;
+    *value = _value.string_value();
+    if (prop->type == GAMEMAP_PROPERTY_COLOR && value->size() > 0) {
+      //"#AARRGGBB", or "#RRGGBB" opaque: hex digits only (strtoul() also
+      //takes spaces, a sign and "0x")
+      bool _hex = (*value)[0] == '#' && (value->size() == 7 || value->size() == 9);
+      for (size_t c = 1; _hex && c < value->size(); c++)
+        _hex = 0 != isxdigit((unsigned char)(*value)[c]);
+      if (false == _hex) {
+        err = "color \"#AARRGGBB\" expected";
+        return -1;
+      }
+      unsigned long _color = strtoul(value->c_str() + 1, nullptr, 16);
+      prop->color = (unsigned int)_color | (value->size() == 7 ? 0xFF000000u : 0);
+      prop->i = (int)prop->color;
+      prop->f = (float)prop->color;
+    }
+  }
+  else {
+    err = "unknown type \"" + _type + "\"";
+    return -1;
+  }
+  prop->nameId = GameMap_getPropertyId(jsonProperty[_KEY_NAME].string_value().c_str());
+  return 0;
+}
+
+/*******************************************************************************/
+//For errors: Map, Layer "name", Tileset "name" or Tile gid
+static std::string _ownerName(const GameMap_t* map, int owner)
+{
+  if (owner == 0)
+    return "Map";
+  if (owner <= map->layersNum)
+    return "Layer \"" + (std::string)map->layers[owner - 1].name + "\"";
+  if (owner <= map->layersNum + map->tilesetsNum)
+    return "Tileset \"" + (std::string)map->tilesets[owner - 1 - map->layersNum].name + "\"";
+  return "Tile " + std::to_string(owner - 1 - map->layersNum - map->tilesetsNum);
+}
+
+/*******************************************************************************/
+//Properties table in one block: props, ownerStart, strings
+static GMapProperties_t* _newProperties(int num, int ownersNum, int stringsLen)
+{
+  size_t _bytes = sizeof(GMapProperties_t) + (size_t)num * sizeof(GameMap_Property_t)
+                + ((size_t)ownersNum + 1) * sizeof(int) + stringsLen;
+  GMapProperties_t* _properties = (GMapProperties_t*)calloc(1, _bytes);
+  if (_properties == nullptr)
+    return nullptr;
+  _properties->num = num;
+  _properties->ownersNum = ownersNum;
+  _properties->stringsLen = stringsLen;
+  _properties->props = (GameMap_Property_t*)(_properties + 1);
+  _properties->ownerStart = (int*)(_properties->props + num);
+  _properties->strings = (char*)(_properties->ownerStart + ownersNum + 1);
+  _properties->byteSize = _bytes;
+  return _properties;
+}
+
+/*******************************************************************************/
+static const GameMap_Property_t* _findProperty(const GMapProperties_t* properties, int owner, int nameId)
+{
+  const GameMap_Property_t* _prop = properties->props + properties->ownerStart[owner];
+  const GameMap_Property_t* _end = properties->props + properties->ownerStart[owner + 1];
+  for (; _prop < _end; _prop++)
+    if (_prop->nameId == nameId)
+      return _prop;
+  return &_noProperty;
+}
@@ -0,0 +1,151 @@
+/*******************************************************************************
+ * GameMap region queries
+ * Copies a rectangle of tiles of one or more layers into a caller buffer:
+ * the rectangle is clipped to the layer once, tiles outside it are 0, and
+ * rows inside it are copied whole (flip flags stripped 8 tiles at a time
+ * with SSE2) instead of a layer lookup and bounds check per tile.
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define _REGION_SSE2
+#endif
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+/*
+Private functions
+*/
+static void _copyRow(unsigned int* out, const unsigned int* src, int n, bool keepFlags);
+static void _copyDenseRegion(const GMapTilelayer_t* layer, int x0, int y0, int w, int h,
+                             unsigned int* out, int stride, bool keepFlags);
+static void _copyChunkedRegion(const GMapTilelayer_t* layer, int x0, int y0, int w, int h,
+                               unsigned int* out, int stride, bool keepFlags);
+
+/*******************************************************************************/
+/**
+ * Copy tile IDs of the w x h tiles at (x0,y0) of a layer into out,
+ * rows stride tiles apart. Tiles outside the layer are 0.
+ * keepFlags == false: flip flags are stripped like GameMap_getTileId() does
+ *
+ * @return != 0 : wrong layer or region
+ */
+int GameMap_getTileRegion(const GameMap_t* map, int layerId, int x0, int y0, int w, int h,
+                          unsigned int* out, int stride, bool keepFlags)
+{
+  if (map == nullptr || layerId < 0 || layerId >= map->layersNum
+      || w < 0 || h < 0 || stride < w || (out == nullptr && w > 0 && h > 0))
+    return -1;
+  if (w == 0 || h == 0)
+    return 0;
+  const GMapTilelayer_t* _layer = &map->layers[layerId];
+  if (_layer->chunks != nullptr)
+    _copyChunkedRegion(_layer, x0, y0, w, h, out, stride, keepFlags);
+  else
+    _copyDenseRegion(_layer, x0, y0, w, h, out, stride, keepFlags);
+  return 0;
+}
+
+int GameMap_getTileRegion(const GameMap_t* map, const char* layerName, int x0, int y0, int w, int h,
+                          unsigned int* out, int stride, bool keepFlags)
+{
+  return GameMap_getTileRegion(map, GameMap_getLayerId(map, layerName), x0, y0, w, h, out, stride, keepFlags);
+}
+
+/*******************************************************************************/
+/**
+ * Same region of several layers, layer i is copied to out + i * layerStride
+ *
+ * @return != 0 : wrong layer or region (layers before the wrong one are copied)
+ */
+int GameMap_getTileRegion(const GameMap_t* map, const int* layerIds, int layersNum, int x0, int y0, int w, int h,
+                          unsigned int* out, int stride, size_t layerStride, bool keepFlags)
+{
+  if (layerIds == nullptr || layersNum < 0 || (layersNum > 1 && layerStride < (size_t)stride * h))
+    return -1;
+  for (int i = 0; i < layersNum; i++)
+    if (0 != GameMap_getTileRegion(map, layerIds[i], x0, y0, w, h, out + i * layerStride, stride, keepFlags))
+      return -1;
+  return 0;
+}
+
+/*******************************************************************************/
+static void _copyDenseRegion(const GMapTilelayer_t* layer, int x0, int y0, int w, int h,
+                             unsigned int* out, int stride, bool keepFlags)
+{
+  //Part of the region inside the layer: columns [cx0,cx1), rows [cy0,cy1), region relative
+  long long cx0 = -(long long)x0, cx1 = (long long)layer->width - x0;
+  long long cy0 = -(long long)y0, cy1 = (long long)layer->height - y0;
+  if (cx0 < 0) cx0 = 0;
+  if (cy0 < 0) cy0 = 0;
+  if (cx1 > w) cx1 = w;
+  if (cy1 > h) cy1 = h;
+  if (cx0 >= cx1 || cy0 >= cy1) {
+    cx0 = cx1 = 0;
+    cy0 = cy1 = 0;
+  }
+  for (int r = 0; r < h; r++) {
+    unsigned int* _row = out + (size_t)r * stride;
+    if (r < cy0 || r >= cy1) {
+      memset(_row, 0, w * sizeof(unsigned int));
+      continue;
+    }
+    size_t _first = (size_t)(y0 + r) * layer->width + (x0 + cx0);
+    memset(_row, 0, (size_t)cx0 * sizeof(unsigned int));
+    if (layer->storage == _STORE_U32)
+      _copyRow(_row + cx0, layer->data + _first, (int)(cx1 - cx0), keepFlags);
+    else
+      _GameMap_copyLayerTiles(layer, _first, (int)(cx1 - cx0), _row + cx0, keepFlags);
+    memset(_row + cx1, 0, (size_t)(w - cx1) * sizeof(unsigned int));
+  }
+}
+
+/*******************************************************************************/
+//Rows are copied a chunk span at a time, missing chunks are 0
+static void _copyChunkedRegion(const GMapTilelayer_t* layer, int x0, int y0, int w, int h,
+                               unsigned int* out, int stride, bool keepFlags)
+{
+  for (int r = 0; r < h; r++) {
+    unsigned int* _row = out + (size_t)r * stride;
+    int ty = y0 + r;
+    int cy = ty >> _CHUNK_SHIFT;
+    for (int c = 0; c < w; ) {
+      int tx = x0 + c;
+      int _inChunk = tx & (_CHUNK_SIZE - 1);
+      int _n = _CHUNK_SIZE - _inChunk;
+      if (_n > w - c) _n = w - c;
+      const unsigned int* _tiles = _GameMap_findChunk(layer->chunks, tx >> _CHUNK_SHIFT, cy);
+      if (_tiles == nullptr) {
+        memset(_row + c, 0, _n * sizeof(unsigned int));
+      }
+      else {
+        _copyRow(_row + c, _tiles + ((ty & (_CHUNK_SIZE - 1)) << _CHUNK_SHIFT) + _inChunk, _n, keepFlags);
+      }
+      c += _n;
+    }
+  }
+}
+
+/*******************************************************************************/
+static void _copyRow(unsigned int* out, const unsigned int* src, int n, bool keepFlags)
+{
+  if (keepFlags) {
+    memcpy(out, src, n * sizeof(unsigned int));
+    return;
+  }
+  int i = 0;
+#ifdef _REGION_SSE2
+  const __m128i _mask = _mm_set1_epi32((int)_GID_MASK);
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 4));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_and_si128(a, _mask));
+    _mm_storeu_si128((__m128i*)(out + i + 4), _mm_and_si128(b, _mask));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = src[i] & _GID_MASK;
+}
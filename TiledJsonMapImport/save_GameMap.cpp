@@ -0,0 +1,544 @@
+/*******************************************************************************
+ * GameMap Tiled JSON export
+ * Writes a GameMap_t back out as a Tiled JSON map, streamed straight to the
+ * file: the small parts (map, layer, tileset and object fields) are written
+ * as text, and layer data is formatted by blocks of rows on the worker
+ * threads (CSV with json11::Json::dump_array()), then written in order. No
+ * json11 tree is built.
+ *
+ * Layer data is CSV, one row of tiles per line, or uncompressed base64.
+ * What the map does not keep is not saved: text object contents, object
+ * visibility, image layers (saved as empty object layers) and group layers
+ * (their layers are saved flattened, like they were loaded).
+*******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+#define _SAVE_BLOCK_TILES (3 << 16)     //Tiles of dense layers formatted by one task (about)
+#define _SAVE_PARALLEL_MIN (1 << 15)    //Layers with fewer tiles are formatted on the calling thread
+#define _SAVE_FLUSH_BYTES (1 << 20)
+
+//Output file, written when its buffer is full
+typedef struct {
+  FILE* fp;
+  std::string buf;
+  bool failed;
+} _Writer_t;
+
+//Formatting of the data of a dense layer: one task per block of rows,
+//blockRows rows from row firstRow + task * blockRows, text to texts[task]
+typedef struct {
+  const GMapTilelayer_t* layer;
+  bool base64;
+  int blockRows;              //A multiple of 3 for base64, blocks are whole base64 groups
+  int firstRow;
+  std::vector<std::string> texts;
+} _DataJob_t;
+
+/*
+Private functions
+*/
+static void _writeLayer(_Writer_t* w, const GameMap_t* map, int l, int id, const std::vector<int>& objects,
+                        bool base64);
+static void _writeDenseData(_Writer_t* w, const GMapTilelayer_t* layer, bool base64);
+static void _writeChunks(_Writer_t* w, const GMapTilelayer_t* layer, bool base64);
+static void _writeObject(_Writer_t* w, const GameMap_Object_t* object);
+static void _writeTileset(_Writer_t* w, const GameMap_t* map, int t, const std::string& mapDir);
+static void _writeProperties(_Writer_t* w, const GMapProperties_t* properties, int owner, const char* indent);
+static void _dataTask(void* arg, int index);
+static void _formatBase64(std::string* out, const unsigned char* bytes, size_t n);
+static void _put(_Writer_t* w, const char* text);
+static void _putString(_Writer_t* w, const char* str);
+static void _putNumber(_Writer_t* w, double value);
+static void _putFloat(_Writer_t* w, float value);
+static void _putInt(_Writer_t* w, long long value);
+static void _flush(_Writer_t* w);
+
+/*******************************************************************************/
+/**
+ * Save map as a Tiled JSON file
+ *
+ * @return != 0 : error writing file
+ */
+int GameMap_saveToTiledJSON(const GameMap_t* map, const char* path, bool base64)
+{
+  _GameMap_clearErrStr();
+  if (map == nullptr || path == nullptr)
+    return -1;
+  std::string _mapDir = _GameMap_getDir(path);
+
+  //Objects of each layer, layer ids (new ones for the layers without a
+  //unique id, maps made at runtime), and the ids Tiled gives next
+  std::vector<std::vector<int> > _layerObjects(map->layersNum);
+  std::vector<int> _layerIds(map->layersNum, 0);
+  int _nextObjectId = 1, _nextLayerId = 1;
+  bool _infinite = false;
+  for (int i = 0; i < map->objectsNum; i++) {
+    GameMap_Object_t _object;
+    GameMap_getObject(map, i, &_object);
+    _layerObjects[_object.layerId].push_back(i);
+    if (_object.id >= _nextObjectId) _nextObjectId = _object.id + 1;
+  }
+  for (int l = 0; l < map->layersNum; l++) {
+    if (map->layers[l].id >= _nextLayerId) _nextLayerId = map->layers[l].id + 1;
+    if (map->layers[l].chunks != nullptr) _infinite = true;
+  }
+  for (int l = 0; l < map->layersNum; l++) {
+    int _id = map->layers[l].id;
+    if (_id > 0 && _layerIds.end() == std::find(_layerIds.begin(), _layerIds.end(), _id))
+      _layerIds[l] = _id;
+  }
+  for (int l = 0; l < map->layersNum; l++)
+    if (_layerIds[l] == 0) _layerIds[l] = _nextLayerId++;
+
+  //Write to a temporary file, then replace the old one
+  std::string _tmpPath = (std::string)path + ".tmp";
+  _Writer_t _w = { fopen(_tmpPath.c_str(), "wb"), "", false };
+  _w.failed = _w.fp == nullptr;
+  _put(&_w, "{ \"compressionlevel\":-1,\n \"height\":");
+  _putInt(&_w, map->height);
+  _put(&_w, ",\n \"infinite\":");
+  _put(&_w, _infinite ? "true" : "false");
+  _put(&_w, ",\n \"layers\":[");
+  for (int l = 0; l < map->layersNum; l++) {
+    _put(&_w, l > 0 ? ",\n  " : "\n  ");
+    _writeLayer(&_w, map, l, _layerIds[l], _layerObjects[l], base64);
+  }
+  _put(&_w, "],\n \"nextlayerid\":");
+  _putInt(&_w, _nextLayerId);
+  _put(&_w, ",\n \"nextobjectid\":");
+  _putInt(&_w, _nextObjectId);
+  _put(&_w, ",\n \"orientation\":\"orthogonal\"");
+  _writeProperties(&_w, map->properties, 0, "\n ");
+  _put(&_w, ",\n \"renderorder\":\"right-down\",\n \"tiledversion\":\"1.10.2\",\n \"tileheight\":");
+  _putInt(&_w, map->tileheight);
+  _put(&_w, ",\n \"tilesets\":[");
+  for (int t = 0; t < map->tilesetsNum; t++) {
+    _put(&_w, t > 0 ? ",\n  " : "\n  ");
+    _writeTileset(&_w, map, t, _mapDir);
+  }
+  _put(&_w, "],\n \"tilewidth\":");
+  _putInt(&_w, map->tilewidth);
+  _put(&_w, ",\n \"type\":\"map\",\n \"version\":\"1.10\",\n \"width\":");
+  _putInt(&_w, map->width);
+  _put(&_w, "\n}\n");
+  _flush(&_w);
+
+  int rc = _w.failed ? -1 : 0; //return code
+  if (_w.fp != nullptr && 0 != fclose(_w.fp)) rc = -1;
+  if (rc == 0) {
+    remove(path);
+    if (0 != rename(_tmpPath.c_str(), path)) rc = -1;
+  }
+  if (rc != 0) {
+    remove(_tmpPath.c_str());
+    _GameMap_appendToErrStr("Can not write file: \"" + (std::string)path + "\"\n");
+  }
+  return rc;
+}
+
+/*******************************************************************************/
+/**
+ * Layer l: tile layer, infinite map tile layer (chunks), or object layer
+ * for the layers without tiles
+ */
+static void _writeLayer(_Writer_t* w, const GameMap_t* map, int l, int id, const std::vector<int>& objects,
+                        bool base64)
+{
+  const GMapTilelayer_t* _layer = &map->layers[l];
+  bool _isTiles = _layer->chunks != nullptr || (size_t)_layer->width * _layer->height > 0;
+  _put(w, "{ ");
+  if (_layer->chunks != nullptr) {
+    _put(w, "\"chunks\":[");
+    _writeChunks(w, _layer, base64);
+    _put(w, "],\n   ");
+  }
+  else if (_isTiles) {
+    _put(w, "\"data\":");
+    _writeDenseData(w, _layer, base64);
+    _put(w, ",\n   ");
+  }
+  else
+    _put(w, "\"draworder\":\"topdown\",\n   ");
+  if (_isTiles && base64)
+    _put(w, "\"encoding\":\"base64\",\n   ");
+  if (_isTiles) {
+    _put(w, "\"height\":");
+    _putInt(w, _layer->height);
+    _put(w, ",\n   ");
+  }
+  _put(w, "\"id\":");
+  _putInt(w, id);
+  _put(w, ",\n   \"name\":");
+  _putString(w, _layer->name);
+  if (false == _isTiles) {
+    _put(w, ",\n   \"objects\":[");
+    for (size_t i = 0; i < objects.size(); i++) {
+      GameMap_Object_t _object;
+      GameMap_getObject(map, objects[i], &_object);
+      _put(w, i > 0 ? ",\n    " : "\n    ");
+      _writeObject(w, &_object);
+    }
+    _put(w, "]");
+  }
+  if (_layer->offsetx != 0) {
+    _put(w, ",\n   \"offsetx\":");
+    _putInt(w, _layer->offsetx);
+  }
+  if (_layer->offsety != 0) {
+    _put(w, ",\n   \"offsety\":");
+    _putInt(w, _layer->offsety);
+  }
+  _put(w, ",\n   \"opacity\":");
+  _putNumber(w, _layer->opacity);
+  _writeProperties(w, map->properties, 1 + l, "\n   ");
+  if (_layer->chunks != nullptr) {
+    _put(w, ",\n   \"startx\":");
+    _putInt(w, _layer->startx);
+    _put(w, ",\n   \"starty\":");
+    _putInt(w, _layer->starty);
+  }
+  _put(w, _isTiles ? ",\n   \"type\":\"tilelayer\"" : ",\n   \"type\":\"objectgroup\"");
+  _put(w, ",\n   \"visible\":");
+  _put(w, _layer->visible != 0 ? "true" : "false");
+  if (_isTiles) {
+    _put(w, ",\n   \"width\":");
+    _putInt(w, _layer->width);
+  }
+  _put(w, ",\n   \"x\":0,\n   \"y\":0\n  }");
+}
+
+/*******************************************************************************/
+/**
+ * Tiles of a dense layer, CSV rows or base64 of the little endian GIDs
+ * Rows are formatted by blocks on the worker threads, a batch of blocks at a
+ * time, and written in order
+ */
+static void _writeDenseData(_Writer_t* w, const GMapTilelayer_t* layer, bool base64)
+{
+  size_t _tilesNum = (size_t)layer->width * layer->height;
+  if (_tilesNum == 0) {
+    _put(w, base64 ? "\"\"" : "[]");
+    return;
+  }
+  _DataJob_t _job;
+  _job.layer = layer;
+  _job.base64 = base64;
+  _job.blockRows = _SAVE_BLOCK_TILES / layer->width;
+  _job.blockRows = _job.blockRows < 3 ? 3 : _job.blockRows - _job.blockRows % 3;
+  int _blocksNum = (layer->height + _job.blockRows - 1) / _job.blockRows;
+  int _batchNum = _tilesNum < _SAVE_PARALLEL_MIN ? 1 : 2 * _GameMap_workersNum();
+
+  _put(w, base64 ? "\"" : "[\n");
+  for (int b = 0; b < _blocksNum; b += _batchNum) {
+    int _tasksNum = _blocksNum - b < _batchNum ? _blocksNum - b : _batchNum;
+    _job.firstRow = b * _job.blockRows;
+    _job.texts.assign(_tasksNum, std::string());
+    if (_tasksNum == 1)
+      _dataTask(&_job, 0);
+    else
+      _GameMap_runTasks(_tasksNum, _dataTask, &_job);
+    _flush(w);
+    for (int t = 0; t < _tasksNum; t++)
+      if (false == w->failed && _job.texts[t].size() > 0
+          && 1 != fwrite(_job.texts[t].data(), _job.texts[t].size(), 1, w->fp))
+        w->failed = true;
+  }
+  _put(w, base64 ? "\"" : "\n  ]");
+}
+
+//Format a block of rows of _DataJob_t
+static void _dataTask(void* arg, int index)
+{
+  _DataJob_t* _job = (_DataJob_t*)arg;
+  const GMapTilelayer_t* _layer = _job->layer;
+  int _row = _job->firstRow + index * _job->blockRows;
+  int _rows = _layer->height - _row < _job->blockRows ? _layer->height - _row : _job->blockRows;
+  size_t _width = (size_t)_layer->width;
+  std::string* _out = &_job->texts[index];
+  std::vector<unsigned int> _tiles(_rows * _width);
+  for (int r = 0; r < _rows; r++) {
+    size_t _first = (size_t)(_row + r) * _width;
+    if (_layer->storage == _STORE_U32)
+      memcpy(_tiles.data() + r * _width, _layer->data + _first, _width * sizeof(unsigned int));
+    else
+      _GameMap_copyLayerTiles(_layer, _first, (int)_width, _tiles.data() + r * _width, true);
+  }
+  if (_job->base64)
+    _formatBase64(_out, (const unsigned char*)_tiles.data(), _tiles.size() * sizeof(unsigned int));
+  else {
+    //Items of the layer array, one row per line
+    if (_row > 0) _out->append(",\n");
+    json11::Json::dump_array(_tiles.data(), _tiles.size(), *_out, _width, false);
+  }
+}
+
+/*******************************************************************************/
+//Chunks of an infinite map layer, by rows of chunks
+static void _writeChunks(_Writer_t* w, const GMapTilelayer_t* layer, bool base64)
+{
+  const GMapChunks_t* _chunks = layer->chunks;
+  std::vector<int> _order(_chunks->blocksNum);
+  for (int i = 0; i < _chunks->blocksNum; i++) _order[i] = i;
+  std::sort(_order.begin(), _order.end(), [_chunks](int a, int b) {
+    return _chunks->coords[2 * a + 1] != _chunks->coords[2 * b + 1] ? _chunks->coords[2 * a + 1] < _chunks->coords[2 * b + 1]
+                                                                    : _chunks->coords[2 * a] < _chunks->coords[2 * b];
+  });
+  std::string _text;
+  for (size_t i = 0; i < _order.size(); i++) {
+    const unsigned int* _tiles = _chunks->tiles + (size_t)_order[i] * _CHUNK_TILES;
+    _put(w, i > 0 ? ",\n    { \"data\":" : "\n    { \"data\":");
+    _text.clear();
+    if (base64) {
+      _text = "\"";
+      _formatBase64(&_text, (const unsigned char*)_tiles, _CHUNK_TILES * sizeof(unsigned int));
+      _text += "\"";
+    }
+    else
+      json11::Json::dump_array(_tiles, _CHUNK_TILES, _text, _CHUNK_SIZE);
+    _put(w, _text.c_str());
+    _put(w, ", \"height\":");
+    _putInt(w, _CHUNK_SIZE);
+    _put(w, ", \"width\":");
+    _putInt(w, _CHUNK_SIZE);
+    _put(w, ", \"x\":");
+    _putInt(w, (long long)_chunks->coords[2 * _order[i]] * _CHUNK_SIZE);
+    _put(w, ", \"y\":");
+    _putInt(w, (long long)_chunks->coords[2 * _order[i] + 1] * _CHUNK_SIZE);
+    _put(w, " }");
+  }
+}
+
+/*******************************************************************************/
+static void _writeObject(_Writer_t* w, const GameMap_Object_t* object)
+{
+  _put(w, "{ ");
+  if (object->shape == GAMEMAP_OBJECT_ELLIPSE)
+    _put(w, "\"ellipse\":true, ");
+  if (object->shape == GAMEMAP_OBJECT_TILE) {
+    _put(w, "\"gid\":");
+    _putInt(w, object->gid);
+    _put(w, ", ");
+  }
+  _put(w, "\"height\":");
+  _putFloat(w, object->height);
+  _put(w, ", \"id\":");
+  _putInt(w, object->id);
+  _put(w, ", \"name\":");
+  _putString(w, object->name);
+  if (object->shape == GAMEMAP_OBJECT_POINT)
+    _put(w, ", \"point\":true");
+  if (object->shape == GAMEMAP_OBJECT_POLYGON || object->shape == GAMEMAP_OBJECT_POLYLINE) {
+    _put(w, object->shape == GAMEMAP_OBJECT_POLYGON ? ", \"polygon\":[" : ", \"polyline\":[");
+    for (int p = 0; p < object->pointsNum; p++) {
+      _put(w, p > 0 ? ", { \"x\":" : "{ \"x\":");
+      _putFloat(w, object->points[2 * p]);
+      _put(w, ", \"y\":");
+      _putFloat(w, object->points[2 * p + 1]);
+      _put(w, " }");
+    }
+    _put(w, "]");
+  }
+  _put(w, ", \"rotation\":");
+  _putFloat(w, object->rotation);
+  if (object->shape == GAMEMAP_OBJECT_TEXT)
+    _put(w, ", \"text\":{ \"text\":\"\", \"wrap\":true }");
+  _put(w, ", \"type\":");
+  _putString(w, object->type);
+  _put(w, ", \"visible\":true, \"width\":");
+  _putFloat(w, object->width);
+  _put(w, ", \"x\":");
+  _putFloat(w, object->x);
+  _put(w, ", \"y\":");
+  _putFloat(w, object->y);
+  _put(w, " }");
+}
+
+/*******************************************************************************/
+/**
+ * Tileset t: embedded, with its properties and the ones of its tiles, or
+ * external, only referenced (its file keeps the rest)
+ */
+static void _writeTileset(_Writer_t* w, const GameMap_t* map, int t, const std::string& mapDir)
+{
+  const GMapTileset_t* _tileset = &map->tilesets[t];
+  if (_tileset->source[0] != '\0') {
+    _put(w, "{ \"firstgid\":");
+    _putInt(w, _tileset->firstgid);
+    _put(w, ", \"source\":");
+    _putString(w, _GameMap_relativePath(_tileset->source, mapDir).c_str());
+    _put(w, " }");
+    return;
+  }
+  _put(w, "{ \"columns\":");
+  _putInt(w, _tileset->tilewidth > 0 ? _tileset->imagewidth / _tileset->tilewidth : 0);
+  _put(w, ",\n   \"firstgid\":");
+  _putInt(w, _tileset->firstgid);
+  _put(w, ",\n   \"image\":");
+  _putString(w, _GameMap_relativePath(_tileset->imgPath, mapDir).c_str());
+  _put(w, ",\n   \"imageheight\":");
+  _putInt(w, _tileset->imageheight);
+  _put(w, ",\n   \"imagewidth\":");
+  _putInt(w, _tileset->imagewidth);
+  _put(w, ",\n   \"margin\":0,\n   \"name\":");
+  _putString(w, _tileset->name);
+  _writeProperties(w, map->properties, 1 + map->layersNum + t, "\n   ");
+  _put(w, ",\n   \"spacing\":0,\n   \"tilecount\":");
+  _putInt(w, _tileset->tilecount);
+  _put(w, ",\n   \"tileheight\":");
+  _putInt(w, _tileset->tileheight);
+  //Tiles with properties
+  const GMapProperties_t* _properties = map->properties;
+  bool _first = true;
+  for (int i = 0; _properties != nullptr && i < _tileset->tilecount; i++) {
+    int _gid = _tileset->firstgid + i;
+    if (_gid >= _properties->tilesNum)
+      break;
+    int _owner = _properties->tilesOwner + _gid;
+    if (_properties->ownerStart[_owner] == _properties->ownerStart[_owner + 1])
+      continue;
+    _put(w, _first ? ",\n   \"tiles\":[\n    { \"id\":" : ",\n    { \"id\":");
+    _putInt(w, i);
+    _writeProperties(w, _properties, _owner, " ");
+    _put(w, " }");
+    _first = false;
+  }
+  if (false == _first)
+    _put(w, "]");
+  _put(w, ",\n   \"tilewidth\":");
+  _putInt(w, _tileset->tilewidth);
+  _put(w, "\n  }");
+}
+
+/*******************************************************************************/
+//",properties":[...] of owner (see GMapProperties_t), nothing if it has none
+static void _writeProperties(_Writer_t* w, const GMapProperties_t* properties, int owner, const char* indent)
+{
+  if (properties == nullptr || properties->ownerStart[owner] == properties->ownerStart[owner + 1])
+    return;
+  static const char* _types[] = { "string", "bool", "int", "float", "string", "color", "file" };
+  _put(w, ",");
+  _put(w, indent);
+  _put(w, "\"properties\":[");
+  for (int p = properties->ownerStart[owner]; p < properties->ownerStart[owner + 1]; p++) {
+    const GameMap_Property_t* _prop = &properties->props[p];
+    _put(w, p > properties->ownerStart[owner] ? ", { \"name\":" : "{ \"name\":");
+    _putString(w, _prop->name);
+    _put(w, ", \"type\":\"");
+    _put(w, _types[_prop->type]);
+    _put(w, "\", \"value\":");
+    if (_prop->type == GAMEMAP_PROPERTY_BOOL)
+      _put(w, _prop->i != 0 ? "true" : "false");
+    else if (_prop->type == GAMEMAP_PROPERTY_INT)
+      _putInt(w, _prop->i);
+    else if (_prop->type == GAMEMAP_PROPERTY_FLOAT)
+      _putFloat(w, _prop->f);
+    else
+      _putString(w, _prop->s);
+    _put(w, " }");
+  }
+  _put(w, "]");
+}
+
+/*******************************************************************************/
+//Base64 of n bytes, padded
+static void _formatBase64(std::string* out, const unsigned char* bytes, size_t n)
+{
+  static const char _chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t _len = out->size();
+  out->resize(_len + (n + 2) / 3 * 4);
+  char* _p = &(*out)[_len];
+  size_t i = 0;
+  for (; i + 3 <= n; i += 3, _p += 4) {
+    uint32_t _v = (uint32_t)bytes[i] << 16 | (uint32_t)bytes[i + 1] << 8 | bytes[i + 2];
+    _p[0] = _chars[_v >> 18];
+    _p[1] = _chars[(_v >> 12) & 63];
+    _p[2] = _chars[(_v >> 6) & 63];
+    _p[3] = _chars[_v & 63];
+  }
+  if (i < n) {
+    uint32_t _v = (uint32_t)bytes[i] << 16 | (i + 1 < n ? (uint32_t)bytes[i + 1] << 8 : 0);
+    _p[0] = _chars[_v >> 18];
+    _p[1] = _chars[(_v >> 12) & 63];
+    _p[2] = i + 1 < n ? _chars[(_v >> 6) & 63] : '=';
+    _p[3] = '=';
+  }
+}
+
+/*******************************************************************************/
+//Writer
+
+static void _put(_Writer_t* w, const char* text)
+{
+  w->buf.append(text);
+  if (w->buf.size() >= _SAVE_FLUSH_BYTES)
+    _flush(w);
+}
+
+//JSON string, quoted and escaped
+static void _putString(_Writer_t* w, const char* str)
+{
+  w->buf.push_back('"');
+  for (const unsigned char* _c = (const unsigned char*)str; *_c != '\0'; _c++) {
+    if (*_c == '"' || *_c == '\\') {
+      w->buf.push_back('\\');
+      w->buf.push_back((char)*_c);
+    }
+    else if (*_c == '\n')
+      w->buf.append("\\n");
+    else if (*_c < 0x20) {
+      char _escape[8];
+      snprintf(_escape, sizeof(_escape), "\\u%04x", *_c);
+      w->buf.append(_escape);
+    }
+    else
+      w->buf.push_back((char)*_c);
+  }
+  _put(w, "\"");
+}
+
+//Shortest text that reads back as the same value: 0.7 and not 0.69999999
+static void _putNumber(_Writer_t* w, double value)
+{
+  char _text[32];
+  for (int _digits = 6; _digits <= 17; _digits++) {
+    snprintf(_text, sizeof(_text), "%.*g", _digits, value);
+    if (strtod(_text, nullptr) == value)
+      break;
+  }
+  _put(w, _text);
+}
+
+static void _putFloat(_Writer_t* w, float value)
+{
+  char _text[32];
+  for (int _digits = 6; _digits <= 9; _digits++) {
+    snprintf(_text, sizeof(_text), "%.*g", _digits, value);
+    if (strtof(_text, nullptr) == value)
+      break;
+  }
+  _put(w, _text);
+}
+
+static void _putInt(_Writer_t* w, long long value)
+{
+  char _text[24];
+  snprintf(_text, sizeof(_text), "%lld", value);
+  _put(w, _text);
+}
+
+static void _flush(_Writer_t* w)
+{
+  if (false == w->failed && w->buf.size() > 0 && 1 != fwrite(w->buf.data(), w->buf.size(), 1, w->fp))
+    w->failed = true;
+  w->buf.clear();
+}
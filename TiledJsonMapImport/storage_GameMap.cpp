@@ -0,0 +1,346 @@
+/*******************************************************************************
+ * GameMap layer storage
+ * Dense layers are loaded as uint32 GIDs with the flip flags in their top bits
+ * (as Tiled saves them), then packed into the narrowest GID type their largest
+ * GID fits: uint8 or uint16 cells, flip flags moved to a plane of 4 bits per
+ * tile, left out when no tile is flipped. Most maps use less than 256 tiles,
+ * so layers take 1/4 of the memory and of the cache lines read when drawn.
+ *
+ * Mostly empty layers (decorations, collisions...) are stored sparse instead,
+ * when it takes half of the memory or less: 8 x 8 tile blocks with a bit mask
+ * of their tiles not 0 (one popcount per tile read), or runs of the same tile
+ * per row (one binary search in the row per tile read), whichever is smaller
+ * (runs only for layers up to UINT16_MAX tiles wide).
+ *
+ * Tiles are read with _GameMap_denseTile() / _GameMap_layerTile() (_GameMap.h)
+ * and copied by rows with _GameMap_copyLayerTiles().
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+/*
+Private functions
+*/
+template <typename T> static void _packCells(GMapTilelayer_t* layer, size_t tilesNum);
+template <typename T> static void _copyCells(const GMapTilelayer_t* layer, size_t first, int n,
+                                             unsigned int* out, bool keepFlags);
+static int _packSparse(GMapTilelayer_t* layer, int storage, uint64_t sparseNum);
+static void _copyBlocks(const GMapTilelayer_t* layer, int tx, int ty, int n, unsigned int* out);
+static void _copyRuns(const GMapTilelayer_t* layer, int tx, int ty, int n, unsigned int* out);
+static size_t _blocksNum(int width, int height);
+
+/*******************************************************************************/
+/**
+ * Pack layer->data of a dense layer into narrow cells or a sparse layer, when
+ * it takes less memory (layers stay _STORE_U32 when not, or when out of memory)
+ */
+void _GameMap_packLayer(GMapTilelayer_t* layer)
+{
+  size_t _tilesNum = (size_t)layer->width * layer->height;
+  if (layer->chunks != nullptr || layer->data == nullptr || layer->storage != _STORE_U32 || _tilesNum == 0)
+    return;
+  unsigned int _maxGid = 0, _anyFlags = 0;
+  uint64_t _tilesSet = 0, _runsNum = 0; //Tiles not 0, runs of the same tile not 0
+  for (int y = 0; y < layer->height; y++) {
+    const unsigned int* _row = layer->data + (size_t)y * layer->width;
+    for (int x = 0; x < layer->width; x++) {
+      unsigned int _gid = _row[x] & _GID_MASK;
+      if (_gid > _maxGid) _maxGid = _gid;
+      _anyFlags |= _row[x] & _FLAGS_MASK;
+      if (_row[x] == 0)
+        continue;
+      _tilesSet++;
+      if (x == 0 || _row[x - 1] != _row[x])
+        _runsNum++;
+    }
+  }
+  size_t _cellBytes = _maxGid <= 0xFF ? 1 : _maxGid <= 0xFFFF ? 2 : 4;
+  uint64_t _denseBytes = _tilesNum * _cellBytes + (_anyFlags != 0 && _cellBytes < 4 ? (_tilesNum + 1) / 2 : 0);
+  uint64_t _blocksBytes = _GameMap_sparseBytes(_STORE_BLOCKS, layer->width, layer->height, _tilesSet);
+  uint64_t _runsBytes = _GameMap_sparseBytes(_STORE_RUNS, layer->width, layer->height, _runsNum);
+  //Runs start and length are uint16_t (GMapRun_t): no runs for wider rows
+  if (layer->width > UINT16_MAX)
+    _runsBytes = UINT64_MAX;
+  //Sparse tiles are slower to read, worth it for half of the memory
+  if (_blocksBytes <= _runsBytes && _blocksBytes <= _denseBytes / 2) {
+    if (0 == _packSparse(layer, _STORE_BLOCKS, _tilesSet))
+      return;
+  }
+  else if (_runsBytes <= _denseBytes / 2) {
+    if (0 == _packSparse(layer, _STORE_RUNS, _runsNum))
+      return;
+  }
+  if (_cellBytes == 4)
+    return;
+  layer->cells = malloc(_tilesNum * _cellBytes);
+  layer->flags = _anyFlags == 0 ? nullptr : (unsigned char*)calloc((_tilesNum + 1) / 2, 1);
+  if (layer->cells == nullptr || (_anyFlags != 0 && layer->flags == nullptr)) {
+    free(layer->cells);
+    free(layer->flags);
+    layer->cells = nullptr;
+    layer->flags = nullptr;
+    return;
+  }
+  if (_cellBytes == 1)
+    _packCells<uint8_t>(layer, _tilesNum);
+  else
+    _packCells<uint16_t>(layer, _tilesNum);
+  layer->storage = _cellBytes == 1 ? _STORE_U8 : _STORE_U16;
+  free(layer->data);
+  layer->data = nullptr;
+}
+
+template <typename T>
+static void _packCells(GMapTilelayer_t* layer, size_t tilesNum)
+{
+  T* _cells = (T*)layer->cells;
+  for (size_t i = 0; i < tilesNum; i++)
+    _cells[i] = (T)(layer->data[i] & _GID_MASK);
+  if (layer->flags == nullptr)
+    return;
+  for (size_t i = 0; i < tilesNum; i++)
+    layer->flags[i >> 1] |= (unsigned char)((layer->data[i] >> _FLAGS_SHIFT) << ((i & 1) << 2));
+}
+
+//sparseNum: tiles not 0 (_STORE_BLOCKS) or runs (_STORE_RUNS) of layer->data
+static int _packSparse(GMapTilelayer_t* layer, int storage, uint64_t sparseNum)
+{
+  int w = layer->width, h = layer->height;
+  unsigned char* _cells = (unsigned char*)calloc((size_t)_GameMap_sparseBytes(storage, w, h, sparseNum), 1);
+  if (_cells == nullptr)
+    return -1;
+  if (storage == _STORE_BLOCKS) {
+    size_t _blocksW = ((size_t)w + _SPARSE_SIZE - 1) >> _SPARSE_SHIFT;
+    size_t _blocks = _blocksNum(w, h);
+    uint64_t* _masks = (uint64_t*)_cells;
+    uint32_t* _firsts = (uint32_t*)(_masks + _blocks);
+    uint32_t* _tiles = _firsts + _blocks;
+    uint32_t _next = 0;
+    for (size_t b = 0; b < _blocks; b++) {
+      int _bx = (int)(b % _blocksW) << _SPARSE_SHIFT, _by = (int)(b / _blocksW) << _SPARSE_SHIFT;
+      _firsts[b] = _next;
+      for (int y = _by; y < _by + _SPARSE_SIZE && y < h; y++)
+        for (int x = _bx; x < _bx + _SPARSE_SIZE && x < w; x++) {
+          unsigned int _tile = layer->data[(size_t)y * w + x];
+          if (_tile == 0)
+            continue;
+          _masks[b] |= (uint64_t)1 << (((y - _by) << _SPARSE_SHIFT) | (x - _bx));
+          _tiles[_next++] = _tile;
+        }
+    }
+  }
+  else {
+    uint32_t* _rows = (uint32_t*)_cells;
+    GMapRun_t* _runs = (GMapRun_t*)(_rows + h + 1);
+    uint32_t _next = 0;
+    for (int y = 0; y < h; y++) {
+      const unsigned int* _row = layer->data + (size_t)y * w;
+      _rows[y] = _next;
+      for (int x = 0; x < w; x++) {
+        if (_row[x] == 0)
+          continue;
+        if (x > 0 && _row[x - 1] == _row[x]) {
+          _runs[_next - 1].n++;
+          continue;
+        }
+        _runs[_next].x = (uint16_t)x;
+        _runs[_next].n = 1;
+        _runs[_next].tile = _row[x];
+        _next++;
+      }
+    }
+    _rows[h] = _next;
+  }
+  layer->cells = _cells;
+  layer->storage = storage;
+  free(layer->data);
+  layer->data = nullptr;
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Bytes of the tiles of a dense layer, as stored
+ */
+size_t _GameMap_layerDataBytes(const GMapTilelayer_t* layer)
+{
+  size_t _tilesNum = (size_t)layer->width * layer->height;
+  if (layer->chunks != nullptr)
+    return 0;
+  switch (layer->storage) {
+  case _STORE_U8:
+    return _tilesNum + (layer->flags != nullptr ? (_tilesNum + 1) / 2 : 0);
+  case _STORE_U16:
+    return _tilesNum * 2 + (layer->flags != nullptr ? (_tilesNum + 1) / 2 : 0);
+  case _STORE_BLOCKS:
+  case _STORE_RUNS:
+    return (size_t)_GameMap_sparseBytes(layer->storage, layer->width, layer->height, _GameMap_sparseNum(layer));
+  default:
+    return _tilesNum * sizeof(unsigned int);
+  }
+}
+
+/*******************************************************************************/
+/**
+ * Tiles not 0 of a _STORE_BLOCKS layer, runs of a _STORE_RUNS layer
+ */
+uint64_t _GameMap_sparseNum(const GMapTilelayer_t* layer)
+{
+  if (layer->storage == _STORE_RUNS)
+    return ((const uint32_t*)layer->cells)[layer->height];
+  size_t _blocks = _blocksNum(layer->width, layer->height);
+  if (layer->storage != _STORE_BLOCKS || _blocks == 0)
+    return 0;
+  const uint64_t* _masks = (const uint64_t*)layer->cells;
+  const uint32_t* _firsts = (const uint32_t*)(_masks + _blocks);
+  return _firsts[_blocks - 1] + std::bitset<64>(_masks[_blocks - 1]).count();
+}
+
+/*******************************************************************************/
+/**
+ * Bytes of the cells of a sparse layer
+ */
+uint64_t _GameMap_sparseBytes(int storage, int width, int height, uint64_t sparseNum)
+{
+  if (storage == _STORE_BLOCKS)
+    return (uint64_t)_blocksNum(width, height) * (sizeof(uint64_t) + sizeof(uint32_t)) + sparseNum * sizeof(uint32_t);
+  return ((uint64_t)height + 1) * sizeof(uint32_t) + sparseNum * sizeof(GMapRun_t);
+}
+
+/*******************************************************************************/
+/**
+ * Check the cells of a sparse layer read from a file, sparseNum of them
+ * (reading its tiles stays inside the cells)
+ */
+bool _GameMap_checkSparse(const GMapTilelayer_t* layer, uint64_t sparseNum)
+{
+  if (layer->storage == _STORE_BLOCKS) {
+    size_t _blocks = _blocksNum(layer->width, layer->height);
+    const uint64_t* _masks = (const uint64_t*)layer->cells;
+    const uint32_t* _firsts = (const uint32_t*)(_masks + _blocks);
+    uint64_t _next = 0;
+    for (size_t b = 0; b < _blocks; b++) {
+      if (_firsts[b] != _next)
+        return false;
+      _next += std::bitset<64>(_masks[b]).count();
+    }
+    return _next == sparseNum;
+  }
+  const uint32_t* _rows = (const uint32_t*)layer->cells;
+  const GMapRun_t* _runs = (const GMapRun_t*)(_rows + layer->height + 1);
+  if (_rows[0] != 0 || _rows[layer->height] != sparseNum)
+    return false;
+  for (int y = 0; y < layer->height; y++) {
+    if (_rows[y + 1] < _rows[y])
+      return false;
+    //Runs in x order, not overlapping, inside the row
+    int _x = 0;
+    for (uint32_t r = _rows[y]; r < _rows[y + 1]; r++) {
+      if (_runs[r].x < _x || _runs[r].n == 0 || _runs[r].x + _runs[r].n > layer->width)
+        return false;
+      _x = _runs[r].x + _runs[r].n;
+    }
+  }
+  return true;
+}
+
+/*******************************************************************************/
+/**
+ * Free the tiles of a dense layer (not for layers of a .gmapbin mapping)
+ */
+void _GameMap_freeLayerData(GMapTilelayer_t* layer)
+{
+  free(layer->data);
+  free(layer->cells);
+  free(layer->flags);
+  layer->data = nullptr;
+  layer->cells = nullptr;
+  layer->flags = nullptr;
+}
+
+/*******************************************************************************/
+/**
+ * Copy n tiles of a dense layer from tile index first into out, all in one row
+ * keepFlags == false: flip flags are stripped like GameMap_getTileId() does
+ * (_STORE_U32 layers are copied by the caller)
+ */
+void _GameMap_copyLayerTiles(const GMapTilelayer_t* layer, size_t first, int n, unsigned int* out, bool keepFlags)
+{
+  int _tx = (int)(first % layer->width), _ty = (int)(first / layer->width);
+  switch (layer->storage) {
+  case _STORE_U8:
+    _copyCells<uint8_t>(layer, first, n, out, keepFlags);
+    return;
+  case _STORE_U16:
+    _copyCells<uint16_t>(layer, first, n, out, keepFlags);
+    return;
+  case _STORE_BLOCKS:
+    _copyBlocks(layer, _tx, _ty, n, out);
+    break;
+  case _STORE_RUNS:
+    _copyRuns(layer, _tx, _ty, n, out);
+    break;
+  default:
+    return;
+  }
+  for (int i = 0; false == keepFlags && i < n; i++)
+    out[i] &= _GID_MASK;
+}
+
+template <typename T>
+static void _copyCells(const GMapTilelayer_t* layer, size_t first, int n, unsigned int* out, bool keepFlags)
+{
+  const T* _cells = (const T*)layer->cells + first;
+  for (int i = 0; i < n; i++)
+    out[i] = _cells[i];
+  if (false == keepFlags || layer->flags == nullptr)
+    return;
+  for (int i = 0; i < n; i++) {
+    size_t t = first + i;
+    out[i] |= (unsigned int)((layer->flags[t >> 1] >> ((t & 1) << 2)) & _FLAGS_NIBBLE) << _FLAGS_SHIFT;
+  }
+}
+
+//One popcount per block crossed, tiles of a block are consecutive
+static void _copyBlocks(const GMapTilelayer_t* layer, int tx, int ty, int n, unsigned int* out)
+{
+  size_t _blocks = _blocksNum(layer->width, layer->height);
+  const uint64_t* _masks = (const uint64_t*)layer->cells;
+  const uint32_t* _firsts = (const uint32_t*)(_masks + _blocks);
+  const uint32_t* _tiles = _firsts + _blocks;
+  size_t _rowBlock = (size_t)(ty >> _SPARSE_SHIFT) * (((size_t)layer->width + _SPARSE_SIZE - 1) >> _SPARSE_SHIFT);
+  int _rowBit = (ty & (_SPARSE_SIZE - 1)) << _SPARSE_SHIFT;
+  for (int i = 0; i < n; ) {
+    int x = tx + i;
+    size_t b = _rowBlock + (x >> _SPARSE_SHIFT);
+    uint64_t _mask = _masks[b];
+    uint64_t _bit = (uint64_t)1 << (_rowBit | (x & (_SPARSE_SIZE - 1)));
+    const uint32_t* _tile = _tiles + _firsts[b] + std::bitset<64>(_mask & (_bit - 1)).count();
+    int _blockEnd = i + _SPARSE_SIZE - (x & (_SPARSE_SIZE - 1));
+    if (_blockEnd > n) _blockEnd = n;
+    for (; i < _blockEnd; i++, _bit <<= 1)
+      out[i] = (_mask & _bit) != 0 ? *_tile++ : 0;
+  }
+}
+
+static void _copyRuns(const GMapTilelayer_t* layer, int tx, int ty, int n, unsigned int* out)
+{
+  const GMapRun_t* _end;
+  const GMapRun_t* _run = _GameMap_findRun(layer, tx, ty, &_end);
+  memset(out, 0, (size_t)n * sizeof(unsigned int));
+  for (; _run != _end && _run->x < tx + n; _run++) {
+    int _x0 = _run->x > tx ? _run->x : tx;
+    int _x1 = _run->x + _run->n < tx + n ? _run->x + _run->n : tx + n;
+    for (int x = _x0; x < _x1; x++)
+      out[x - tx] = _run->tile;
+  }
+}
+
+static size_t _blocksNum(int width, int height)
+{
+  return (((size_t)width + _SPARSE_SIZE - 1) >> _SPARSE_SHIFT) * (((size_t)height + _SPARSE_SIZE - 1) >> _SPARSE_SHIFT);
+}
@@ -0,0 +1,867 @@
+/*******************************************************************************
+ * GameMap streaming loader
+ * Loads a Tiled JSON map without building a json11 tree of the whole file:
+ * the file is tokenized once and tile numbers are written straight into the
+ * layer data buffers as they are scanned. Only the small objects around them
+ * (map fields, layer fields, tilesets) are handed to json11.
+ * Gives the same GameMap_t as GameMap_loadFromTiledJSON()
+*******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+#include "json11.hpp"
+
+/*******************************************************************************/
+//Tokenizer state
+typedef struct {
+  const char* begin; //File data
+  const char* p;     //Current position
+  const char* end;   //End of file data
+  std::string err;   //First error found
+} _Scanner_t;
+
+//"data" of a layer or chunk, found while scanning
+typedef struct {
+  bool hasDataKey;             //"data" found and not null
+  json11::Json::Type type;     //of "data"
+  unsigned int* data;          //malloc'd tile data
+  size_t dataLen;
+  bool hasText;                //"data" is a string (base64)
+  const char* text;            //base64 in the file buffer, nullptr: see unescaped
+  size_t textLen;
+  std::string unescaped;       //base64 that had json escapes
+} _StreamData_t;
+
+//Chunk of an infinite map layer
+typedef struct {
+  json11::Json fields;         //All chunk fields but data (the value itself if not an object)
+  _StreamData_t tiles;
+} _StreamChunk_t;
+
+//Layer found while scanning, before it is copied into GameMap_t
+typedef struct {
+  json11::Json::object fields; //All layer fields but data, chunks and layers
+  _StreamData_t tiles;
+  std::vector<_StreamChunk_t> chunks; //"chunks" is in fields as an empty array if found
+} _StreamLayer_t;
+
+#define _LAYER_TREE_MAX_DEPTH 10   //Same limit as _getLayers() in GameMap.cpp
+#define _DATA_INITIAL_CAPACITY 1024
+#define _DECODE_PARALLEL_MIN (1 << 15)  //Same as GameMap.cpp
+
+//Decoding of base64 and infinite layers, one task per layer on the worker
+//threads, then one task per layer to pack it (CSV data is already decoded)
+typedef struct {
+  std::vector<_StreamLayer_t>* layers;
+  std::vector<json11::Json>* jsonLayers;
+  GameMap_t* map;
+  std::vector<int> decodes;       //Layers with data to decode
+  std::vector<int> packs;         //Layers packed once decoded
+  std::vector<std::string> errs;  //Decoding error of each layer, "": none
+} _StoreJob_t;
+
+/*
+Private functions
+*/
+static char* _readFile(const char* path, size_t* size);
+static int _fail(_Scanner_t* s, const char* msg);
+static void _skipSpaces(_Scanner_t* s);
+static int _expect(_Scanner_t* s, char c);
+static int _scanString(_Scanner_t* s, std::string* out);
+static int _skipValue(_Scanner_t* s, const char** start);
+static int _scanValue(_Scanner_t* s, json11::Json* out);
+static int _scanTileData(_Scanner_t* s, _StreamData_t* tiles);
+static int _scanData(_Scanner_t* s, _StreamData_t* tiles);
+static int _scanChunks(_Scanner_t* s, std::vector<_StreamChunk_t>* chunks);
+static int _scanLayer(_Scanner_t* s, std::vector<_StreamLayer_t>* layers, int depth);
+static int _scanMap(_Scanner_t* s, json11::Json::object* fields, std::vector<_StreamLayer_t>* layers);
+static int _storeLayers(std::vector<_StreamLayer_t>* layers, GameMap_t* map, std::vector<json11::Json>* jsonLayers);
+static int _storeChunks(_StreamLayer_t* src, const json11::Json& fields, GMapTilelayer_t* layer, std::string& err);
+static void _takeData(_StreamData_t* tiles, bool isBase64, const std::string& compression, size_t expected, std::string& err);
+static void _decodeTask(void* arg, int index);
+static void _packTask(void* arg, int index);
+static const char* _typeName(json11::Json::Type type);
+static void _freeChunks(std::vector<_StreamChunk_t>* chunks);
+static void _freeStreamLayer(_StreamLayer_t* layer);
+static void _freeStreamLayers(std::vector<_StreamLayer_t>* layers);
+
+/*******************************************************************************/
+/**
+ * Load game map from Tiled JSON file, tokenizing it once
+ * (no json11 tree of the whole file is built)
+ */
+GameMap_t* GameMap_loadFromTiledJSONStreaming(const char* path)
+{
+  return _GameMap_loadStreaming(path, true);
+}
+
+/*******************************************************************************/
+/**
+ * loadGraphs == false: map is loaded without graphics (for loading threads,
+ * graphics are loaded later with ReloadGameMapGraphs() on the DxLib thread)
+ */
+GameMap_t* _GameMap_loadStreaming(const char* path, bool loadGraphs)
+{
+  _GameMap_clearErrStr();
+  if (path == nullptr) {
+    return nullptr;
+  }
+
+  //read whole file
+  size_t _size = 0;
+  char* _text = _readFile(path, &_size);
+  if (_text == nullptr || _size == 0) {
+    _GameMap_scratchFree(_text);
+    _GameMap_appendToErrStr("Can not open file: \"");
+    _GameMap_appendToErrStr(path);
+    _GameMap_appendToErrStr("\"\n");
+    return nullptr;
+  }
+
+  _GameMap_addFileBytes(_size);
+
+  //scan json, tile data goes straight into malloc'd buffers
+  _Scanner_t _scanner = { _text, _text, _text + _size, "" };
+  json11::Json::object _fields;
+  std::vector<_StreamLayer_t> _layers;
+  int rc = _scanMap(&_scanner, &_fields, &_layers);
+  if (rc != 0) {
+    _GameMap_appendToErrStr(path + (std::string)"\nJSON Parse Error:" + _scanner.err + "\n");
+    _freeStreamLayers(&_layers);
+    _GameMap_scratchFree(_text);
+    return nullptr;
+  }
+
+  //allocate map
+  json11::Json _jsonMap(std::move(_fields));
+  GameMap_t* map = _GameMap_newFromJSON(_jsonMap, path);
+  if (map == nullptr) {
+    _freeStreamLayers(&_layers);
+    _GameMap_scratchFree(_text);
+    return nullptr;
+  }
+
+  std::string mapDir = _GameMap_getDir(path);
+  std::vector<json11::Json> _jsonLayers, _jsonTilesets;
+  if (rc == 0) rc = _storeLayers(&_layers, map, &_jsonLayers);
+  _GameMap_scratchFree(_text); //base64 layer data was decoded from it
+  if (rc == 0) rc = _GameMap_loadMapTilesets(&_jsonMap, map, mapDir.c_str(), &_jsonTilesets);
+  if (rc == 0) rc = _GameMap_loadProperties(map, _jsonMap, _jsonLayers, _jsonTilesets);
+  if (rc == 0 && loadGraphs) rc = ReloadGameMapGraphs(map);
+
+  _freeStreamLayers(&_layers); //only frees data not moved into map
+  if (rc != 0) {
+    GameMap_free(map);
+    return nullptr;
+  }
+  return map;
+}
+
+/*******************************************************************************/
+/**
+ * Read whole file into a '\0' terminated buffer of the load context
+ * (free it with _GameMap_scratchFree())
+ * @return nullptr : can not read file
+ */
+static char* _readFile(const char* path, size_t* size)
+{
+  FILE* fp = fopen(path, "rb");
+  if (fp == nullptr)
+    return nullptr;
+  fseek(fp, 0, SEEK_END);
+  long _len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (_len < 0) {
+    fclose(fp);
+    return nullptr;
+  }
+  char* _buf = _GameMap_scratchAlloc((size_t)_len + 1);
+  if (_buf != nullptr) {
+    *size = fread(_buf, 1, (size_t)_len, fp);
+    _buf[*size] = '\0';
+  }
+  fclose(fp);
+  return _buf;
+}
+
+/*******************************************************************************/
+//Tokenizer
+
+static int _fail(_Scanner_t* s, const char* msg)
+{
+  if (s->err.empty()) {
+    char _buf[64];
+    snprintf(_buf, sizeof(_buf), " at offset %ld", (long)(s->p - s->begin));
+    s->err = msg;
+    s->err += _buf;
+  }
+  return -1;
+}
+
+static void _skipSpaces(_Scanner_t* s)
+{
+  while (s->p != s->end && (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t'))
+    s->p++;
+}
+
+static int _expect(_Scanner_t* s, char c)
+{
+  _skipSpaces(s);
+  if (s->p == s->end || *s->p != c) {
+    char _msg[32];
+    snprintf(_msg, sizeof(_msg), "expected '%c'", c);
+    return _fail(s, _msg);
+  }
+  s->p++;
+  return 0;
+}
+
+/**
+ * Scan a string, current position must be the opening quote
+ * Strings with escapes are decoded by json11, out == nullptr skips the string
+ */
+static int _scanString(_Scanner_t* s, std::string* out)
+{
+  if (_expect(s, '"') != 0)
+    return -1;
+  const char* _start = s->p;
+  bool _escaped = false;
+  while (s->p != s->end && *s->p != '"') {
+    if (*s->p == '\\') {
+      _escaped = true;
+      s->p++;
+      if (s->p == s->end) break;
+    }
+    s->p++;
+  }
+  if (s->p == s->end)
+    return _fail(s, "unexpected end of input in string");
+  s->p++;
+  if (out == nullptr) {
+    return 0;
+  }
+  if (_escaped) {
+    std::string _err;
+    *out = json11::Json::parse(std::string(_start - 1, s->p), _err).string_value();
+    if (!_err.empty()) return _fail(s, _err.c_str());
+  }
+  else {
+    out->assign(_start, s->p - 1);
+  }
+  return 0;
+}
+
+/**
+ * Skip over any json value, *start is set to its first character
+ * (values are checked when parsed by _scanValue)
+ */
+static int _skipValue(_Scanner_t* s, const char** start)
+{
+  _skipSpaces(s);
+  *start = s->p;
+  if (s->p == s->end)
+    return _fail(s, "unexpected end of input");
+  if (*s->p == '"') {
+    return _scanString(s, nullptr);
+  }
+  if (*s->p == '{' || *s->p == '[') {
+    int _depth = 0;
+    while (s->p != s->end) {
+      char c = *s->p;
+      if (c == '"') {
+        if (_scanString(s, nullptr) != 0) return -1;
+        continue;
+      }
+      if (c == '{' || c == '[') _depth++;
+      if (c == '}' || c == ']') _depth--;
+      s->p++;
+      if (_depth == 0) return 0;
+    }
+    return _fail(s, "unexpected end of input");
+  }
+  //number, true, false, null
+  while (s->p != s->end && *s->p != ',' && *s->p != '}' && *s->p != ']'
+    && *s->p != ' ' && *s->p != '\n' && *s->p != '\r' && *s->p != '\t')
+    s->p++;
+  return 0;
+}
+
+/**
+ * Scan a (small) json value and parse it with json11
+ */
+static int _scanValue(_Scanner_t* s, json11::Json* out)
+{
+  const char* _start;
+  if (_skipValue(s, &_start) != 0)
+    return -1;
+  std::string _err;
+  *out = json11::Json::parse(std::string(_start, s->p), _err);
+  if (!_err.empty())
+    return _fail(s, _err.c_str());
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Scan a "data":[...] array of tile GIDs into tiles->data
+ * Plain integers are converted while scanning, anything else
+ * (signs, fractions, exponents) is converted like json11's uint32_value()
+ */
+static int _scanTileData(_Scanner_t* s, _StreamData_t* tiles)
+{
+  if (_expect(s, '[') != 0)
+    return -1;
+  size_t _cap = _DATA_INITIAL_CAPACITY;
+  size_t _len = 0;
+  unsigned int* _data = (unsigned int*)malloc(_cap * sizeof(unsigned int));
+  if (_data == nullptr)
+    return _fail(s, "out of memory");
+  tiles->data = _data;
+  tiles->dataLen = 0;
+
+  _skipSpaces(s);
+  if (s->p != s->end && *s->p == ']') {
+    s->p++;
+    return 0;
+  }
+  while (true) {
+    if (_len == _cap) {
+      _cap *= 2;
+      unsigned int* _grown = (unsigned int*)realloc(_data, _cap * sizeof(unsigned int));
+      if (_grown == nullptr)
+        return _fail(s, "out of memory");
+      _data = _grown;
+      tiles->data = _data;
+    }
+    _skipSpaces(s);
+    //Fast path: plain integer
+    const char* p = s->p;
+    unsigned long long _value = 0;
+    int _digits = 0;
+    while (p != s->end && *p >= '0' && *p <= '9' && _digits < 19) {
+      _value = _value * 10 + (unsigned)(*p - '0');
+      p++;
+      _digits++;
+    }
+    if (_digits > 1 && *s->p == '0')
+      return _fail(s, "leading 0s not permitted in numbers");
+    if (_digits > 0 && p != s->end && *p != '.' && *p != 'e' && *p != 'E' && (*p < '0' || *p > '9')) {
+      _data[_len++] = (unsigned int)_value;
+      s->p = p;
+    }
+    else {
+      //Slow path: let json11 convert it
+      json11::Json _number;
+      if (_scanValue(s, &_number) != 0)
+        return -1;
+      if (!_number.is_number())
+        return _fail(s, "expected number in layer data");
+      _data[_len++] = _number.uint32_value();
+    }
+    _skipSpaces(s);
+    if (s->p == s->end)
+      return _fail(s, "unexpected end of input in layer data");
+    char c = *s->p++;
+    if (c == ']')
+      break;
+    if (c != ',')
+      return _fail(s, "expected ',' in layer data");
+  }
+  //Trim to size, the buffer becomes GMapTilelayer_t::data
+  unsigned int* _trimmed = (unsigned int*)realloc(_data, (_len > 0 ? _len : 1) * sizeof(unsigned int));
+  if (_trimmed != nullptr)
+    tiles->data = _trimmed;
+  tiles->dataLen = _len;
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Scan a "data" value: tile GIDs array, base64 string, or anything else
+ * A repeated "data" key replaces the value before, like in json11 objects
+ */
+static int _scanData(_Scanner_t* s, _StreamData_t* tiles)
+{
+  free(tiles->data);
+  *tiles = _StreamData_t();
+  _skipSpaces(s);
+  if (s->p != s->end && *s->p == '[') {
+    tiles->hasDataKey = true;
+    tiles->type = json11::Json::ARRAY;
+    return _scanTileData(s, tiles);
+  }
+  if (s->p != s->end && *s->p == '"') {
+    //base64, decoded from the file buffer once encoding and compression are known
+    const char* _start = s->p;
+    tiles->hasDataKey = true;
+    tiles->type = json11::Json::STRING;
+    tiles->hasText = true;
+    int rc = _scanString(s, nullptr);
+    if (rc == 0 && nullptr == memchr(_start + 1, '\\', s->p - _start - 2)) {
+      tiles->text = _start + 1;
+      tiles->textLen = s->p - _start - 2;
+    }
+    else if (rc == 0) {
+      s->p = _start;
+      rc = _scanString(s, &tiles->unescaped);
+    }
+    return rc;
+  }
+  json11::Json _value;
+  if (_scanValue(s, &_value) != 0)
+    return -1;
+  tiles->hasDataKey = false == _value.is_null();
+  tiles->type = _value.type();
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Scan a "chunks":[...] array of an infinite map layer
+ * Chunk fields go to a json11 object, chunk data is scanned like layer data
+ */
+static int _scanChunks(_Scanner_t* s, std::vector<_StreamChunk_t>* chunks)
+{
+  if (_expect(s, '[') != 0)
+    return -1;
+  _skipSpaces(s);
+  if (s->p != s->end && *s->p == ']') {
+    s->p++;
+    return 0;
+  }
+  while (true) {
+    chunks->push_back(_StreamChunk_t());
+    _StreamChunk_t* _chunk = &chunks->back();
+    _skipSpaces(s);
+    if (s->p == s->end || *s->p != '{') {
+      //Not an object, kept for the chunk schema to report
+      if (_scanValue(s, &_chunk->fields) != 0)
+        return -1;
+    }
+    else {
+      json11::Json::object _fields;
+      s->p++;
+      _skipSpaces(s);
+      if (s->p != s->end && *s->p == '}') {
+        s->p++;
+      }
+      else while (true) {
+        std::string _key;
+        if (_scanString(s, &_key) != 0 || _expect(s, ':') != 0)
+          return -1;
+        if (_key == "data") {
+          if (_scanData(s, &_chunk->tiles) != 0)
+            return -1;
+        }
+        else {
+          json11::Json _value;
+          if (_scanValue(s, &_value) != 0)
+            return -1;
+          _fields[_key] = _value;
+        }
+        _skipSpaces(s);
+        if (s->p != s->end && *s->p == '}') {
+          s->p++;
+          break;
+        }
+        if (_expect(s, ',') != 0)
+          return -1;
+      }
+      _chunk->fields = json11::Json(std::move(_fields));
+    }
+    _skipSpaces(s);
+    if (s->p != s->end && *s->p == ']') {
+      s->p++;
+      return 0;
+    }
+    if (_expect(s, ',') != 0)
+      return -1;
+  }
+}
+
+/*******************************************************************************/
+/**
+ * Scan a layer object, appending tile layers to *layers
+ * Group layers are flattened like _getLayers() in GameMap.cpp does
+ */
+static int _scanLayer(_Scanner_t* s, std::vector<_StreamLayer_t>* layers, int depth)
+{
+  _StreamLayer_t _layer = _StreamLayer_t();
+  bool _isGroup = false;
+
+  if (_expect(s, '{') != 0)
+    return -1;
+  _skipSpaces(s);
+  if (s->p != s->end && *s->p == '}') {
+    s->p++;
+  }
+  else while (true) {
+    std::string _key;
+    if (_scanString(s, &_key) != 0 || _expect(s, ':') != 0) {
+      _freeStreamLayer(&_layer);
+      return -1;
+    }
+    _skipSpaces(s);
+    int rc = 0;
+    if (_key == "data") {
+      rc = _scanData(s, &_layer.tiles);
+    }
+    else if (_key == "chunks" && s->p != s->end && *s->p == '[') {
+      //Infinite map layer, "chunks" stays in fields for the layer schema
+      _freeChunks(&_layer.chunks);
+      _layer.fields[_key] = json11::Json::array();
+      rc = _scanChunks(s, &_layer.chunks);
+    }
+    else if (_key == "layers" && s->p != s->end && *s->p == '[') {
+      //Group: child layers are appended in order, before this object ends
+      _isGroup = true;
+      const char* _start;
+      if (depth >= _LAYER_TREE_MAX_DEPTH) {
+        rc = _skipValue(s, &_start);
+      }
+      else {
+        rc = _expect(s, '[');
+        _skipSpaces(s);
+        if (rc == 0 && s->p != s->end && *s->p == ']') {
+          s->p++;
+        }
+        else while (rc == 0) {
+          rc = _scanLayer(s, layers, depth + 1);
+          if (rc == 0) {
+            _skipSpaces(s);
+            if (s->p != s->end && *s->p == ']') { s->p++; break; }
+            rc = _expect(s, ',');
+          }
+        }
+      }
+    }
+    else {
+      json11::Json _value;
+      rc = _scanValue(s, &_value);
+      if (_key == "layers" && false == _value.is_null()) _isGroup = true;
+      if (_key == "chunks") _freeChunks(&_layer.chunks);
+      if (_key != "layers") _layer.fields[_key] = _value;
+    }
+    if (rc != 0) {
+      _freeStreamLayer(&_layer);
+      return -1;
+    }
+    _skipSpaces(s);
+    if (s->p != s->end && *s->p == '}') {
+      s->p++;
+      break;
+    }
+    if (_expect(s, ',') != 0) {
+      _freeStreamLayer(&_layer);
+      return -1;
+    }
+  }
+
+  //Groups are not layers themselves
+  json11::Json::object::const_iterator _type = _layer.fields.find("type");
+  if (_isGroup || (_type != _layer.fields.end() && _type->second.string_value() == "group")) {
+    _freeStreamLayer(&_layer);
+    return 0;
+  }
+  layers->push_back(std::move(_layer));
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Scan the map object
+ * Map fields (including tilesets) go to *fields, layers to *layers
+ */
+static int _scanMap(_Scanner_t* s, json11::Json::object* fields, std::vector<_StreamLayer_t>* layers)
+{
+  if (_expect(s, '{') != 0)
+    return -1;
+  _skipSpaces(s);
+  if (s->p != s->end && *s->p == '}') {
+    s->p++;
+  }
+  else while (true) {
+    std::string _key;
+    if (_scanString(s, &_key) != 0 || _expect(s, ':') != 0)
+      return -1;
+    _skipSpaces(s);
+    if (_key == "layers" && s->p != s->end && *s->p == '[') {
+      //Layers are read here, the map schema only checks "layers" is there
+      (*fields)[_key] = json11::Json::array();
+      if (_expect(s, '[') != 0)
+        return -1;
+      _skipSpaces(s);
+      if (s->p != s->end && *s->p == ']') {
+        s->p++;
+      }
+      else while (true) {
+        if (_scanLayer(s, layers, 1) != 0)
+          return -1;
+        _skipSpaces(s);
+        if (s->p != s->end && *s->p == ']') { s->p++; break; }
+        if (_expect(s, ',') != 0)
+          return -1;
+      }
+    }
+    else {
+      json11::Json _value;
+      if (_scanValue(s, &_value) != 0)
+        return -1;
+      (*fields)[_key] = _value;
+    }
+    _skipSpaces(s);
+    if (s->p != s->end && *s->p == '}') {
+      s->p++;
+      break;
+    }
+    if (_expect(s, ',') != 0)
+      return -1;
+  }
+  _skipSpaces(s);
+  if (s->p != s->end)
+    return _fail(s, "unexpected trailing characters");
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Check scanned layers and move them into map->layers
+ * Layers are checked in order, then base64 and infinite ones are decoded in
+ * parallel (errors are the ones of the first layer that fails, as if loaded
+ * in order). Layer fields go to *jsonLayers, for objects and properties
+ *
+ * @return != 0 : error loading layers
+ */
+static int _storeLayers(std::vector<_StreamLayer_t>* layers, GameMap_t* map, std::vector<json11::Json>* jsonLayers)
+{
+  std::string _err;
+  std::vector<json11::Json>& _jsonLayers = *jsonLayers;
+
+  //allocate memory for layers
+  map->layersNum = layers->size();
+  map->layers = (GMapTilelayer_t*)calloc(layers->size(), sizeof(GMapTilelayer_t));
+  map->byteSize += (sizeof(GMapTilelayer_t) * layers->size());
+  _StoreJob_t _job;
+  _job.layers = layers;
+  _job.jsonLayers = &_jsonLayers;
+  _job.map = map;
+  _job.errs.resize(layers->size());
+  int _failed = (int)layers->size(); //First layer failing its checks
+  int rc = 0; //return code of its check
+  std::string _failedErr;
+  size_t _tilesNum = 0;
+  for (int i = 0; i < (int)layers->size(); i++) {
+    _StreamLayer_t* _src = &(*layers)[i];
+    GMapTilelayer_t* _layer = &map->layers[i];
+    json11::Json _fields(_src->fields);
+    _jsonLayers.push_back(_fields);
+
+    //Check for unsupported encodings
+    if (0 != _GameMap_checkLayerEncoding(_fields, _failedErr)) {
+      _failed = i;
+      rc = 1;
+      break;
+    }
+    //Infinite map layer
+    if (false == _fields["chunks"].is_null()) {
+      if (false == _GameMap_chunkedLayerSchema.validate(_fields, _err)) {
+        _failedErr = "Layer \"" + _fields["name"].string_value() + "\": " + _err + "\n";
+        _failed = i;
+        rc = -1;
+        break;
+      }
+      _job.decodes.push_back(i);
+      _tilesNum += _src->chunks.size() * _CHUNK_TILES;
+      continue;
+    }
+    //Check layer shape, layers without tile data (objectgroup, imagelayer) are loaded empty
+    bool _hasData = "tilelayer" == _fields["type"].string_value() || _src->tiles.hasDataKey;
+    bool _isBase64 = "base64" == _fields["encoding"].string_value();
+    if (_hasData) {
+      //Same checks as the json11 loader's tile layer schema, data was checked while scanned
+      size_t _expected = (size_t)_fields["width"].int_value() * _fields["height"].int_value();
+      if (_GameMap_tileLayerHeaderSchema.validate(_fields, _err) && false == _isBase64)
+        _takeData(&_src->tiles, _isBase64, _fields["compression"].string_value(), _expected, _err);
+      if (false == _err.empty()) {
+        _failedErr = "Layer \"" + _fields["name"].string_value() + "\": " + _err + "\n";
+        _failed = i;
+        rc = -1;
+        break;
+      }
+    }
+    _GameMap_setLayerFields(_fields, _hasData, _layer);
+    _tilesNum += (size_t)_layer->width * _layer->height;
+    _job.packs.push_back(i);
+    if (_hasData && _isBase64)
+      _job.decodes.push_back(i);
+  }
+
+  //Decode layers before the first failing one
+  if (_tilesNum < _DECODE_PARALLEL_MIN) {
+    for (int t = 0; t < (int)_job.decodes.size(); t++)
+      _decodeTask(&_job, t);
+  }
+  else
+    _GameMap_runTasks((int)_job.decodes.size(), _decodeTask, &_job);
+  for (int i = 0; i < _failed; i++) {
+    if (false == _job.errs[i].empty()) {
+      _GameMap_appendToErrStr("Layer \"" + _jsonLayers[i]["name"].string_value() + "\": " + _job.errs[i] + "\n");
+      return -1;
+    }
+  }
+  if (rc != 0) {
+    _GameMap_appendToErrStr(_failedErr);
+    return rc;
+  }
+  //layer data, already in place
+  for (int t = 0; t < (int)_job.packs.size(); t++) {
+    _StreamLayer_t* _src = &(*layers)[_job.packs[t]];
+    GMapTilelayer_t* _layer = &map->layers[_job.packs[t]];
+    size_t _dataLen = _layer->width * _layer->height;
+    if (_src->tiles.data == nullptr || _dataLen == 0) {
+      _layer->data = (unsigned int*)malloc(0);
+    }
+    else {
+      _layer->data = _src->tiles.data;
+      _src->tiles.data = nullptr;
+    }
+  }
+  if (_tilesNum < _DECODE_PARALLEL_MIN) {
+    for (int t = 0; t < (int)_job.packs.size(); t++)
+      _packTask(&_job, t);
+  }
+  else
+    _GameMap_runTasks((int)_job.packs.size(), _packTask, &_job);
+  for (int i = 0; i < map->layersNum; i++) {
+    if (map->layers[i].chunks != nullptr)
+      map->byteSize += _GameMap_chunksByteSize(map->layers[i].chunks);
+    else
+      map->byteSize += _GameMap_layerDataBytes(&map->layers[i]);
+  }
+  return _GameMap_loadObjects(map, _jsonLayers);
+}
+
+/*******************************************************************************/
+//Decode base64 data of a layer, or the chunks of an infinite layer
+static void _decodeTask(void* arg, int index)
+{
+  _StoreJob_t* job = (_StoreJob_t*)arg;
+  int i = job->decodes[index];
+  _StreamLayer_t* _src = &(*job->layers)[i];
+  const json11::Json& _fields = (*job->jsonLayers)[i];
+  if (false == _fields["chunks"].is_null()) {
+    _storeChunks(_src, _fields, &job->map->layers[i], job->errs[i]);
+    return;
+  }
+  size_t _expected = (size_t)_fields["width"].int_value() * _fields["height"].int_value();
+  _takeData(&_src->tiles, true, _fields["compression"].string_value(), _expected, job->errs[i]);
+}
+
+static void _packTask(void* arg, int index)
+{
+  _StoreJob_t* job = (_StoreJob_t*)arg;
+  _GameMap_packLayer(&job->map->layers[job->packs[index]]);
+}
+
+/*******************************************************************************/
+/**
+ * Check the chunks of an infinite map layer and copy them into its chunk table
+ * (same checks and messages as the json11 loader)
+ *
+ * @return != 0 : chunk error, described in err
+ */
+static int _storeChunks(_StreamLayer_t* src, const json11::Json& fields, GMapTilelayer_t* layer, std::string& err)
+{
+  _GameMap_setLayerFields(fields, true, layer);
+  //(an empty table, layers without chunks are still infinite)
+  if (0 != _GameMap_putChunk(layer, 0, 0, 0, 0, nullptr)) {
+    err = "out of memory";
+    return -1;
+  }
+  bool _isBase64 = "base64" == fields["encoding"].string_value();
+  for (size_t c = 0; c < src->chunks.size(); c++) {
+    _StreamChunk_t* _chunk = &src->chunks[c];
+    const json11::Json& _header = _chunk->fields;
+    int _w = _header["width"].int_value();
+    int _h = _header["height"].int_value();
+    if (_GameMap_chunkHeaderSchema.validate(_header, err))
+      _takeData(&_chunk->tiles, _isBase64, fields["compression"].string_value(), (size_t)_w * _h, err);
+    if (false == err.empty()) {
+      err = "chunk " + std::to_string(c) + ": " + err;
+      return -1;
+    }
+    int rc = _GameMap_putChunk(layer, _header["x"].int_value(), _header["y"].int_value(), _w, _h, _chunk->tiles.data);
+    free(_chunk->tiles.data);
+    _chunk->tiles.data = nullptr;
+    if (rc != 0) {
+      err = "chunk " + std::to_string(c) + ": out of memory";
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************/
+/**
+ * Check scanned "data" against the expected number of tiles,
+ * decoding base64 ones. On success tiles->data has them (nullptr if none)
+ * err is set on error
+ */
+static void _takeData(_StreamData_t* tiles, bool isBase64, const std::string& compression, size_t expected, std::string& err)
+{
+  if (false == tiles->hasDataKey)
+    err = "missing data";
+  else if (isBase64 && false == tiles->hasText)
+    err = (std::string)"bad type for data: expected string, got " + _typeName(tiles->type);
+  else if (isBase64 && tiles->text != nullptr)
+    tiles->data = _GameMap_decodeLayerData(tiles->text, tiles->textLen, compression, expected, err);
+  else if (isBase64)
+    tiles->data = _GameMap_decodeLayerData(tiles->unescaped.data(), tiles->unescaped.size(), compression, expected, err);
+  else if (tiles->data == nullptr)
+    err = (std::string)"bad type for data: expected array, got " + _typeName(tiles->type);
+  else if (tiles->dataLen != expected)
+    err = "size of data is " + std::to_string(tiles->dataLen)
+        + ", expected width * height = " + std::to_string(expected);
+}
+
+/*******************************************************************************/
+//Same names as json11 schema errors use
+static const char* _typeName(json11::Json::Type type)
+{
+  switch (type) {
+  case json11::Json::NUL:    return "null";
+  case json11::Json::NUMBER: return "number";
+  case json11::Json::BOOL:   return "bool";
+  case json11::Json::STRING: return "string";
+  case json11::Json::ARRAY:  return "array";
+  case json11::Json::OBJECT: return "object";
+  }
+  return "unknown";
+}
+
+/*******************************************************************************/
+static void _freeChunks(std::vector<_StreamChunk_t>* chunks)
+{
+  for (size_t i = 0; i < chunks->size(); i++)
+    free((*chunks)[i].tiles.data);
+  chunks->clear();
+}
+
+static void _freeStreamLayer(_StreamLayer_t* layer)
+{
+  free(layer->tiles.data);
+  layer->tiles.data = nullptr;
+  _freeChunks(&layer->chunks);
+}
+
+static void _freeStreamLayers(std::vector<_StreamLayer_t>* layers)
+{
+  for (int i = 0; i < (int)layers->size(); i++)
+    _freeStreamLayer(&(*layers)[i]);
+}
@@ -0,0 +1,11 @@
+/******************************************************************************
+* DxLib stubs for the console programs (bench_GameMap, convert_GameMap...)
+* They are built without DxLib and video_GameMap.cpp: maps are loaded without
+* graphics, these stand in for the video functions the loaders call.
+******************************************************************************/
+
+#include "GameMap.h"
+#include "_GameMap.h"
+
+int ReloadGameMapGraphs(GameMap_t*) { return 0; }
+void DeleteGameMapGraphs(GameMap_t*) {}
@@ -0,0 +1,113 @@
+/******************************************************************************
+* GameMap tests: main
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "test_GameMap.h"
+
+typedef struct {
+  const char* name;
+  void (*run)();
+} _Test_t;
+
+static const _Test_t _tests[] = {
+  { "codec", Test_codec },
+  { "collision", Test_collision },
+  { "nav", Test_nav },
+  { "flow", Test_flow },
+  { "storage", Test_storage },
+  { "save", Test_save },
+  { "properties", Test_properties },
+};
+
+static int _failures = 0;
+
+/*******************************************************************************/
+void Test_fail(const char* file, int line, const char* cond)
+{
+  printf("%s:%d: check failed: %s\n", file, line, cond);
+  _failures++;
+}
+
+/*******************************************************************************/
+uint32_t Test_random(uint32_t* state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+/*******************************************************************************/
+std::string Test_tempPath(const char* name)
+{
+  const char* _dir = getenv("TEMP");
+  if (_dir == nullptr)
+    _dir = getenv("TMPDIR");
+  return std::string(_dir != nullptr ? _dir : ".") + "/test_GameMap_" + name;
+}
+
+/*******************************************************************************/
+GameMap_t* Test_gridMap(int width, int height, const std::string& tiles)
+{
+  TEST_CHECK(tiles.size() == (size_t)width * height);
+  std::string _json = "{\"width\":" + std::to_string(width) + ",\"height\":" + std::to_string(height)
+                    + ",\"tilewidth\":16,\"tileheight\":16,\"layers\":[{\"name\":\"ground\",\"type\":\"tilelayer\""
+                    + ",\"width\":" + std::to_string(width) + ",\"height\":" + std::to_string(height) + ",\"data\":[";
+  for (size_t i = 0; i < tiles.size(); i++) {
+    int _gid = tiles[i] == '#' ? 1 : (tiles[i] >= '2' && tiles[i] <= '9') ? tiles[i] - '0' : 0;
+    _json += (i > 0 ? "," : "") + std::to_string(_gid);
+  }
+  _json += "]}]}";
+
+  GameMap_t* map = Test_loadJson(_json);
+  if (map == nullptr)
+    printf("%s", GameMap_getErrStr());
+  TEST_CHECK(map != nullptr);
+  return map;
+}
+
+/*******************************************************************************/
+GameMap_t* Test_loadJson(const std::string& json)
+{
+  std::string _path = Test_tempPath("load.json");
+  FILE* fp = fopen(_path.c_str(), "wb");
+  TEST_CHECK(fp != nullptr);
+  if (fp == nullptr)
+    return nullptr;
+  fwrite(json.data(), 1, json.size(), fp);
+  fclose(fp);
+  GameMap_t* map = GameMap_loadFromTiledJSON(_path.c_str());
+  remove(_path.c_str());
+  return map;
+}
+
+/*******************************************************************************/
+int main(int argc, char** argv)
+{
+  int _testsNum = (int)(sizeof(_tests) / sizeof(_tests[0]));
+  int _failed = 0;
+  for (int i = 0; i < _testsNum; i++) {
+    bool _selected = (argc < 2);
+    for (int a = 1; a < argc; a++) {
+      if (strcmp(argv[a], _tests[i].name) == 0)
+        _selected = true;
+    }
+    if (false == _selected)
+      continue;
+    int _before = _failures;
+    _tests[i].run();
+    printf("%-12s %s\n", _tests[i].name, _failures == _before ? "ok" : "FAILED");
+    if (_failures != _before)
+      _failed++;
+  }
+  if (_failed != 0)
+    printf("%d test(s) failed\n", _failed);
+  return _failed == 0 ? 0 : 1;
+}
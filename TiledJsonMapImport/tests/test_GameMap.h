@@ -0,0 +1,47 @@
+/******************************************************************************
+* GameMap tests
+* Checks of the GameMap modules without DxLib, run by test_GameMap (console
+* program, test_GameMap.vcxproj in pandd_testing.sln). Each tests/test_*.cpp
+* file has one test function, run by main() in test_GameMap.cpp.
+*
+* Usage:
+*   test_GameMap [test names...]   without names all tests are run
+*   the exit code is 0 when all checks passed
+******************************************************************************/
+
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+#include "GameMap.h"
+#include "_GameMap.h"
+
+//Check cond, on failure print file, line and cond, and count the failure
+#define TEST_CHECK(cond) ((cond) ? (void)0 : Test_fail(__FILE__, __LINE__, #cond))
+
+void Test_fail(const char* file, int line, const char* cond);
+
+//Next number of a xorshift32 generator: the same test data on every platform
+uint32_t Test_random(uint32_t* state);
+
+//Path of file name in the temp directory
+std::string Test_tempPath(const char* name);
+
+//Load a map from Tiled JSON text (written to a temp file)
+//@return nullptr : load error (see GameMap_getErrStr())
+GameMap_t* Test_loadJson(const std::string& json);
+
+//Load a map of one layer "ground", width x height tiles, tiles has one char
+//per tile, rows top to bottom: '.' is GID 0, '#' GID 1, '2' ~ '9' that GID
+//@return nullptr : load error (reported as a failed check)
+GameMap_t* Test_gridMap(int width, int height, const std::string& tiles);
+
+//Tests
+void Test_codec();
+void Test_collision();
+void Test_nav();
+void Test_flow();
+void Test_storage();
+void Test_save();
+void Test_properties();
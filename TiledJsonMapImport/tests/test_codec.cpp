@@ -0,0 +1,166 @@
+/******************************************************************************
+* Layer data decoding tests (codec_GameMap.cpp)
+* base64 with and without padding, zlib streams with stored, fixed Huffman
+* and dynamic Huffman blocks, gzip headers, truncated and corrupt data.
+* The compressed data was made with Python's zlib and gzip modules, from the
+* tiles of _tile() below.
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string>
+
+#include "test_GameMap.h"
+
+//16 tiles, zlib level 0: one stored block
+static const char* _ZLIB_STORED =
+  "eAEBQAC//wAAAIAHAAAAAQAAAAgAAAACAAAACQAAgAMAAAAKAAAABAAAAAsAAAAFAACADAAAAAYAAAAAAAAABwAAAAEAAIBJQAJX";
+//16 tiles, Z_FIXED: one fixed Huffman block
+static const char* _ZLIB_FIXED =
+  "eAFjYGBoYGdgYGAEYg4gZgJiTqAYM5DmAmIWIOYGYlagGA+QZmOAAKieBgBJQAJX";
+//512 tiles (k = 3), level 9: one dynamic Huffman block
+static const char* _ZLIB_DYNAMIC =
+  "eNrtkAkKgEAMA6PrrY/O002xhdIv2IVhoTAkZAC8ACziFqt4dNvwvV1M4tBt1n+KIdxhcuAOkwN3mJzIYXIih8mJHJZu5rB0M4elmzks3cxh6WZOb9Ab9Aa9QW/QG/xqgxdySj+E";
+//512 tiles (k = 3), Z_FULL_FLUSH after 1000 bytes: dynamic, empty stored, dynamic blocks
+static const char* _ZLIB_MULTI =
+  "eNrskAsKgDAMQ6Pzs6mHztFNsYXSI8gGj0HhkZAG8AKwiVvs4tHtwPdOsYiu26p/iCbcYXLgDpMDd5icyGFyIofJiRyWbuawdDOHpZs5LN3MYelmztxgbvDrDV4AAAD//+2QCQrAQAgD03Pbbh+dpzdSBfENCoMgDIZMgAeAV5z4Z+i2aF9iFbfYdHu0dzGFO0wO3GFy4A6TE3+YnPjD5MQflmzmsGQzhyWbOSzZzGHJZk530B10B6mDD3JKP4Q=";
+//512 tiles (k = 3), gzip header without flags
+static const char* _GZIP =
+  "H4sIAAAAAAACA+2QCQqAQAwDo+utj87TTbGF0i/YhWGhMCRkALwALOIWq3h02/C9XUzi0G3Wf4oh3GFy4A6TA3eYnMhhciKHyYkclm7msHQzh6WbOSzdzGHpZk5v0Bv0Br1Bb9Ab/GqDF0F64ecACAAA";
+//512 tiles (k = 3), gzip header with FNAME "map.json" and FHCRC
+static const char* _GZIP_NAME_HCRC =
+  "H4sICgAAAAAA/21hcC5qc29uAPML7ZAJCoBADAOj662PztNNsYXSL9iFYaEwJGQAvAAs4hareHTb8L1dTOLQbdZ/iiHcYXLgDpMDd5icyGFyIofJiRyWbuawdDOHpZs5LN3MYelmTm/QG/QGvUFv0Bv8aoMXQXrh5wAIAAA=";
+//gzip header with FNAME and FHCRC, cut after the name: no room for the header crc
+static const char* _GZIP_CUT_HCRC = "H4sICgAAAAAA/2xvbmduYW1lAA==";
+
+/*
+Private functions
+*/
+static unsigned int _tile(int i, int k);
+static std::string _base64Encode(const unsigned char* data, size_t len);
+static bool _decodes(const std::string& text, const std::string& compression, int tilesNum, int k);
+static bool _fails(const std::string& text, const std::string& compression, int tilesNum);
+
+/*******************************************************************************/
+void Test_codec()
+{
+  TEST_CHECK(_GameMap_isCompressionSupported(""));
+  TEST_CHECK(_GameMap_isCompressionSupported("zlib"));
+  TEST_CHECK(_GameMap_isCompressionSupported("gzip"));
+  TEST_CHECK(false == _GameMap_isCompressionSupported("lz4"));
+
+  //base64: padding "==", "=", none
+  TEST_CHECK(_decodes("AAAAgA==", "", 1, 0));
+  TEST_CHECK(_decodes("AAAAgAcAAAA=", "", 2, 0));
+  TEST_CHECK(_decodes("AAAAgAcAAAABAAAA", "", 3, 0));
+  //long enough for the SSSE3 loop, with a scalar tail
+  for (int _tilesNum = 1; _tilesNum <= 40; _tilesNum++) {
+    unsigned int _tiles[40];
+    for (int i = 0; i < _tilesNum; i++)
+      _tiles[i] = _tile(i, 0);
+    std::string _text = _base64Encode((const unsigned char*)_tiles, _tilesNum * sizeof(unsigned int));
+    TEST_CHECK(_decodes(_text, "", _tilesNum, 0));
+    //bad char in each quad
+    for (size_t c = 1; c < _text.size(); c += 4) {
+      std::string _bad = _text;
+      _bad[c] = '*';
+      TEST_CHECK(_fails(_bad, "", _tilesNum));
+    }
+  }
+  //base64: bad length, bad padding, wrong size
+  TEST_CHECK(_fails("AAAAgA", "", 1));
+  TEST_CHECK(_fails("AAAAg===", "", 1));
+  TEST_CHECK(_fails("AAAAgA=A", "", 1));
+  TEST_CHECK(_fails("AAAAgAcA=AAA", "", 2));
+  TEST_CHECK(_fails("AAAAgA==", "", 2));
+  TEST_CHECK(_fails("AAAAgAcAAAABAAAA", "", 2));
+
+  //zlib and gzip
+  TEST_CHECK(_decodes(_ZLIB_STORED, "zlib", 16, 0));
+  TEST_CHECK(_decodes(_ZLIB_FIXED, "zlib", 16, 0));
+  TEST_CHECK(_decodes(_ZLIB_DYNAMIC, "zlib", 512, 3));
+  TEST_CHECK(_decodes(_ZLIB_MULTI, "zlib", 512, 3));
+  TEST_CHECK(_decodes(_GZIP, "gzip", 512, 3));
+  TEST_CHECK(_decodes(_GZIP_NAME_HCRC, "gzip", 512, 3));
+  TEST_CHECK(_fails(_GZIP_CUT_HCRC, "gzip", 512));
+  //wrong format, wrong tiles number
+  TEST_CHECK(_fails(_ZLIB_DYNAMIC, "gzip", 512));
+  TEST_CHECK(_fails(_GZIP, "zlib", 512));
+  TEST_CHECK(_fails(_ZLIB_STORED, "zlib", 15));
+  TEST_CHECK(_fails(_ZLIB_STORED, "zlib", 17));
+  TEST_CHECK(_fails(_ZLIB_DYNAMIC, "zlib", 511));
+  TEST_CHECK(_fails(_GZIP, "gzip", 513));
+
+  const char* _streams[] = { _ZLIB_STORED, _ZLIB_FIXED, _ZLIB_DYNAMIC, _ZLIB_MULTI, _GZIP, _GZIP_NAME_HCRC };
+  const char* _formats[] = { "zlib", "zlib", "zlib", "zlib", "gzip", "gzip" };
+  const int _tilesNums[] = { 16, 16, 512, 512, 512, 512 };
+  for (int s = 0; s < 6; s++) {
+    std::string _text = _streams[s];
+    //truncated: whole quads removed, from the checksum to the header
+    for (size_t _len = _text.size() - 4; _len > 0; _len -= 4)
+      TEST_CHECK(_fails(_text.substr(0, _len), _formats[s], _tilesNums[s]));
+    //corrupt: one base64 char changed, in the header, the blocks and the checksum
+    for (size_t c = 0; c < _text.size(); c++) {
+      if (_text[c] == '=')
+        continue;
+      std::string _bad = _text;
+      _bad[c] = (_bad[c] == 'A') ? 'B' : 'A';
+      if (_decodes(_bad, _formats[s], _tilesNums[s], _tilesNums[s] == 16 ? 0 : 3))
+        continue; //only unused bits changed
+      TEST_CHECK(_fails(_bad, _formats[s], _tilesNums[s]));
+    }
+  }
+}
+
+/*******************************************************************************/
+//Tile i of the test layers: small GIDs, every 5th flipped horizontally
+static unsigned int _tile(int i, int k)
+{
+  unsigned int _gid = (unsigned int)(i * 7 + k) % 13;
+  if (i % 5 == 0)
+    _gid |= 0x80000000u;
+  return _gid;
+}
+
+static std::string _base64Encode(const unsigned char* data, size_t len)
+{
+  static const char _chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string _text;
+  for (size_t i = 0; i < len; i += 3) {
+    unsigned int _v = data[i] << 16;
+    if (i + 1 < len) _v |= data[i + 1] << 8;
+    if (i + 2 < len) _v |= data[i + 2];
+    _text += _chars[(_v >> 18) & 63];
+    _text += _chars[(_v >> 12) & 63];
+    _text += (i + 1 < len) ? _chars[(_v >> 6) & 63] : '=';
+    _text += (i + 2 < len) ? _chars[_v & 63] : '=';
+  }
+  return _text;
+}
+
+//Decoded tiles are _tile(0, k) ... _tile(tilesNum - 1, k)
+static bool _decodes(const std::string& text, const std::string& compression, int tilesNum, int k)
+{
+  std::string _err;
+  unsigned int* _data = _GameMap_decodeLayerData(text.c_str(), text.size(), compression, tilesNum, _err);
+  if (_data == nullptr)
+    return false;
+  bool _same = true;
+  for (int i = 0; i < tilesNum; i++) {
+    if (_data[i] != _tile(i, k))
+      _same = false;
+  }
+  free(_data);
+  return _same;
+}
+
+//Decoding fails with an error message
+static bool _fails(const std::string& text, const std::string& compression, int tilesNum)
+{
+  std::string _err;
+  unsigned int* _data = _GameMap_decodeLayerData(text.c_str(), text.size(), compression, tilesNum, _err);
+  if (_data != nullptr) {
+    free(_data);
+    return false;
+  }
+  return _err.size() > 0;
+}
@@ -0,0 +1,157 @@
+/******************************************************************************
+* Collision tests (collision_GameMap.cpp)
+* Overlaps and sweeps against a small map, checked against contacts worked
+* out by hand: tile borders crossed, corners, boxes touching or inside tiles,
+* thin walls at high speed, the 64 bit word boundary of the bitset rows.
+******************************************************************************/
+
+#include <math.h>
+#include <string>
+
+#include "test_GameMap.h"
+
+#define _MAP_W 80
+#define _MAP_H 8
+
+//Expected sweep of one box
+typedef struct {
+  float x, y, w, h, vx, vy;
+  float toi, nx, ny;
+} _Sweep_t;
+
+static const _Sweep_t _sweeps[] = {
+  //Right edge 9 reaches tile (10,2) after 1 of 3 tiles
+  { 8, 2, 1, 1, 3, 0, 1.0f / 3, -1, 0 },
+  //Box over rows 2 and 3, edge 9.5 reaches column 10 after 0.5 of 4
+  { 8.5f, 2.5f, 1, 1, 4, 0, 0.125f, -1, 0 },
+  //Bottom edge on row 2: touching, no hit
+  { 8, 1, 1, 1, 4, 0, 1, 0, 0 },
+  //Falling: bottom edge 4 reaches the floor (row 6) after 2 of 5 tiles
+  { 3.25f, 2, 1.5f, 2, 0, 5, 0.4f, 0, -1 },
+  //Thin wall at 50 tiles per step: edge 0.5 reaches column 10 at 9.5 / 50
+  { 0, 2, 0.5f, 0.5f, 50, 0, 0.19f, -1, 0 },
+  //Second word of the bitset rows: edge 61 reaches column 70 at 9 / 20
+  { 60, 2, 1, 1, 20, 0, 0.45f, -1, 0 },
+  //Left: edge 12 reaches column 10 (border 11) after 1 of 4 tiles
+  { 12, 2, 1, 1, -4, 0, 0.25f, 1, 0 },
+  //Inside the floor, moving up out of it: no hit
+  { 5, 6.25f, 0.5f, 0.5f, 0, -3, 1, 0, 0 },
+  //Up from below the map into the floor: top edge 9 reaches border 7 after 2 of 4
+  { 5, 9, 1, 1, 0, -4, 0.5f, 0, 1 },
+  //Diagonal into corner tile (30,3): both borders crossed at 0.5,
+  //(30,2) and (29,3) are empty
+  { 28, 1, 1, 1, 2, 2, 0.5f, -1, -1 },
+  //Inside tile (10,2), moving out of it: no hit
+  { 10.2f, 2.2f, 0.5f, 0.5f, 2, 0, 1, 0, 0 },
+  //Sliding on the floor (bottom edge on row 6): no hit
+  { 2, 5, 1, 1, 5, 0, 1, 0, 0 },
+  //From left of the bitset: edge -9 reaches column 10 at 19 / 20
+  { -10, 2, 1, 1, 20, 0, 0.95f, -1, 0 },
+  //Not moving
+  { 9.5f, 2, 1, 1, 0, 0, 1, 0, 0 },
+  //Tile (40,1) has GID 2
+  { 38, 1, 1, 1, 3, 0, 1.0f / 3, -1, 0 },
+};
+
+/*
+Private functions
+*/
+static std::string _tiles();
+static bool _near(float a, float b);
+
+/*******************************************************************************/
+void Test_collision()
+{
+  GameMap_t* map = Test_gridMap(_MAP_W, _MAP_H, _tiles());
+  if (map == nullptr)
+    return;
+  GameMap_Collision_t* col = GameMap_newCollision(map, "ground");
+  TEST_CHECK(col != nullptr);
+  TEST_CHECK(GameMap_newCollision(map, "nothing") == nullptr);
+  if (col == nullptr) {
+    GameMap_free(map);
+    return;
+  }
+
+  //Overlaps: touching is not overlapping
+  const float x[] = { 9, 9.5f, 10.999f, 11, 69.5f, 0, 5 };
+  const float y[] = { 2, 2, 1, 2, 1.5f, 5, 6.5f };
+  const float w[] = { 1, 1, 1, 1, 1, 80, 0.5f };
+  const float h[] = { 1, 1, 1, 1, 1, 1, 0.25f };
+  const unsigned char _hits[] = { 0, 1, 0, 0, 1, 0, 1 };
+  unsigned char _hit[7];
+  TEST_CHECK(GameMap_overlapBoxes(col, 7, x, y, w, h, _hit) == 3);
+  for (int i = 0; i < 7; i++)
+    TEST_CHECK(_hit[i] == _hits[i]);
+
+  //Sweeps, one call for all of them
+  const int _sweepsNum = (int)(sizeof(_sweeps) / sizeof(_sweeps[0]));
+  float sx[_sweepsNum], sy[_sweepsNum], sw[_sweepsNum], sh[_sweepsNum], vx[_sweepsNum], vy[_sweepsNum];
+  float toi[_sweepsNum], nx[_sweepsNum], ny[_sweepsNum];
+  int _hitsNum = 0;
+  for (int i = 0; i < _sweepsNum; i++) {
+    sx[i] = _sweeps[i].x;
+    sy[i] = _sweeps[i].y;
+    sw[i] = _sweeps[i].w;
+    sh[i] = _sweeps[i].h;
+    vx[i] = _sweeps[i].vx;
+    vy[i] = _sweeps[i].vy;
+    if (_sweeps[i].nx != 0 || _sweeps[i].ny != 0)
+      _hitsNum++;
+  }
+  TEST_CHECK(GameMap_sweepBoxes(col, _sweepsNum, sx, sy, sw, sh, vx, vy, toi, nx, ny) == _hitsNum);
+  for (int i = 0; i < _sweepsNum; i++) {
+    if (_near(toi[i], _sweeps[i].toi) && nx[i] == _sweeps[i].nx && ny[i] == _sweeps[i].ny)
+      continue;
+    printf("sweep %d: toi %g n (%g,%g), expected %g (%g,%g)\n", i, toi[i], nx[i], ny[i],
+           _sweeps[i].toi, _sweeps[i].nx, _sweeps[i].ny);
+    TEST_CHECK(false);
+  }
+  //Moving back by toi: the box touches the tile, it does not overlap it
+  for (int i = 0; i < _sweepsNum; i++) {
+    if (nx[i] == 0 && ny[i] == 0)
+      continue;
+    float _x = sx[i] + vx[i] * toi[i], _y = sy[i] + vy[i] * toi[i];
+    unsigned char _overlap;
+    GameMap_overlapBoxes(col, 1, &_x, &_y, &sw[i], &sh[i], &_overlap);
+    TEST_CHECK(_overlap == 0);
+  }
+  //NaN and wrong arguments
+  float _nan = NAN, _one = 1;
+  TEST_CHECK(GameMap_sweepBoxes(col, 1, &_nan, &_one, &_one, &_one, &_one, &_one, toi, nx, ny) == 0);
+  TEST_CHECK(toi[0] == 1 && nx[0] == 0 && ny[0] == 0);
+  TEST_CHECK(GameMap_sweepBoxes(nullptr, 1, sx, sy, sw, sh, vx, vy, toi, nx, ny) == -1);
+  GameMap_freeCollision(col);
+
+  //Only GID 1 solid: tile (40,1) is not hit
+  const unsigned int _solidGids[] = { 1 };
+  col = GameMap_newCollision(map, "ground", _solidGids, 1);
+  TEST_CHECK(col != nullptr);
+  if (col != nullptr) {
+    const _Sweep_t* s = &_sweeps[_sweepsNum - 1];
+    TEST_CHECK(GameMap_sweepBoxes(col, 1, &s->x, &s->y, &s->w, &s->h, &s->vx, &s->vy, toi, nx, ny) == 0);
+    TEST_CHECK(toi[0] == 1);
+    GameMap_freeCollision(col);
+  }
+  GameMap_free(map);
+}
+
+/*******************************************************************************/
+//Solid tiles (10,2), (70,2), (30,3), (31,3), (40,1) with GID 2, floor row 6
+static std::string _tiles()
+{
+  std::string _tiles(_MAP_W * _MAP_H, '.');
+  _tiles[2 * _MAP_W + 10] = '#';
+  _tiles[2 * _MAP_W + 70] = '#';
+  _tiles[3 * _MAP_W + 30] = '#';
+  _tiles[3 * _MAP_W + 31] = '#';
+  _tiles[1 * _MAP_W + 40] = '2';
+  for (int x = 0; x < _MAP_W; x++)
+    _tiles[6 * _MAP_W + x] = '#';
+  return _tiles;
+}
+
+static bool _near(float a, float b)
+{
+  return fabsf(a - b) < 1e-5f;
+}
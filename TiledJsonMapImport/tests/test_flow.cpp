@@ -0,0 +1,188 @@
+/******************************************************************************
+* Flow field tests (flow_GameMap.cpp)
+* Fields solved in blocks on the worker threads against one serial Dijkstra
+* over the whole grid (same moves and costs): the costs must be the same,
+* each direction must step to the neighbour its cost came from, and
+* following the directions must reach a goal.
+******************************************************************************/
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <utility>
+
+#include "test_GameMap.h"
+
+#define _GRID_W 100     //Partial blocks on the right and bottom
+#define _GRID_H 70
+#define _UNREACHED -1
+
+//Cost of entering a tile by GID: '.' 1, '#' blocked, '2' ~ '5' that cost
+static const unsigned char _gidCosts[] = { 1, 0, 2, 3, 4, 5 };
+
+/*
+Private functions
+*/
+static std::vector<long long> _dijkstra(const std::string& tiles, const std::vector<int>& goals);
+static int _tileCost(const std::string& tiles, int x, int y);
+
+/*******************************************************************************/
+void Test_flow()
+{
+  for (uint32_t _seed = 1; _seed <= 3; _seed++) {
+    uint32_t _state = _seed * 2246822519u;
+    //Walls, and patches of costly tiles
+    std::string _tiles(_GRID_W * _GRID_H, '.');
+    for (size_t i = 0; i < _tiles.size(); i++) {
+      uint32_t r = Test_random(&_state) % 16;
+      _tiles[i] = r < 4 ? '#' : r < 8 ? (char)('2' + r - 4) : '.';
+    }
+    GameMap_t* map = Test_gridMap(_GRID_W, _GRID_H, _tiles);
+    if (map == nullptr)
+      return;
+    GameMap_Flows_t* flows = GameMap_newFlows(map, "ground", _gidCosts, (int)sizeof(_gidCosts), 4);
+    TEST_CHECK(flows != nullptr);
+    if (flows == nullptr) {
+      GameMap_free(map);
+      return;
+    }
+
+    for (int f = 0; f < 6; f++) {
+      //1 to 4 goals, some on walls (left out)
+      std::vector<int> _goals, _walkableGoals;
+      int _goalsNum = 1 + Test_random(&_state) % 4;
+      for (int g = 0; g < _goalsNum; g++) {
+        int x = Test_random(&_state) % _GRID_W, y = Test_random(&_state) % _GRID_H;
+        _goals.push_back(x);
+        _goals.push_back(y);
+        if (_tileCost(_tiles, x, y) != 0)
+          _walkableGoals.push_back(y * _GRID_W + x);
+      }
+      int _field = GameMap_getFlowField(flows, _goals.data(), _goalsNum);
+      TEST_CHECK(_field >= 0);
+      if (_field < 0)
+        continue;
+      //Kept field for the same goals in another order
+      if (_goalsNum > 1) {
+        std::vector<int> _reversed;
+        for (int g = _goalsNum - 1; g >= 0; g--) {
+          _reversed.push_back(_goals[2 * g]);
+          _reversed.push_back(_goals[2 * g + 1]);
+        }
+        TEST_CHECK(GameMap_getFlowField(flows, _reversed.data(), _goalsNum) == _field);
+      }
+
+      std::vector<long long> _costs = _dijkstra(_tiles, _walkableGoals);
+      int _wrongCosts = 0, _wrongDirs = 0, _lost = 0;
+      for (int y = 0; y < _GRID_H; y++) {
+        for (int x = 0; x < _GRID_W; x++) {
+          long long _cost = _costs[y * _GRID_W + x];
+          float _flowCost = GameMap_getFlowCost(flows, _field, x, y);
+          if (_cost == _UNREACHED ? _flowCost >= 0 : _flowCost != (float)(unsigned int)_cost / 10)
+            _wrongCosts++;
+          int dx, dy;
+          int rc = GameMap_getFlowDir(flows, _field, x, y, &dx, &dy);
+          if (_cost == _UNREACHED) {
+            if (rc == 0) _wrongDirs++;
+            continue;
+          }
+          if (rc != 0 || (_cost == 0) != (dx == 0 && dy == 0)) {
+            _wrongDirs++;
+            continue;
+          }
+          //Step to the neighbour the cost came from, without cutting corners
+          if (_cost > 0) {
+            int nx = x + dx, ny = y + dy;
+            bool _diagonal = dx != 0 && dy != 0;
+            if (nx < 0 || nx >= _GRID_W || ny < 0 || ny >= _GRID_H || _costs[ny * _GRID_W + nx] == _UNREACHED
+                || (_diagonal && (_tileCost(_tiles, nx, y) == 0 || _tileCost(_tiles, x, ny) == 0))
+                || _cost != _costs[ny * _GRID_W + nx] + _tileCost(_tiles, nx, ny) * (_diagonal ? 14 : 10))
+              _wrongDirs++;
+          }
+          //Following the directions reaches a goal
+          if ((x + y) % 7 == 0) {
+            int px = x, py = y, _steps = 0;
+            while (_steps <= _GRID_W * _GRID_H && 0 == GameMap_getFlowDir(flows, _field, px, py, &dx, &dy)
+                   && (dx != 0 || dy != 0)) {
+              px += dx;
+              py += dy;
+              _steps++;
+            }
+            if (_costs[py * _GRID_W + px] != 0)
+              _lost++;
+          }
+        }
+      }
+      if (_wrongCosts + _wrongDirs + _lost > 0)
+        printf("flow: seed %u field %d: %d wrong costs, %d wrong directions, %d lost\n",
+               _seed, f, _wrongCosts, _wrongDirs, _lost);
+      TEST_CHECK(_wrongCosts == 0);
+      TEST_CHECK(_wrongDirs == 0);
+      TEST_CHECK(_lost == 0);
+
+      //Units sample the same directions
+      float ux[3] = { 0.5f, _GRID_W / 2 + 0.25f, _GRID_W - 0.5f }, uy[3] = { 0.5f, _GRID_H / 2 + 0.75f, _GRID_H - 0.5f };
+      float udx[3], udy[3];
+      int _moving = GameMap_sampleFlow(flows, _field, 3, ux, uy, udx, udy);
+      int _expected = 0;
+      for (int u = 0; u < 3; u++) {
+        int dx, dy;
+        if (0 == GameMap_getFlowDir(flows, _field, (int)ux[u], (int)uy[u], &dx, &dy) && (dx != 0 || dy != 0)) {
+          _expected++;
+          TEST_CHECK(udx[u] * dx > 0 || (udx[u] == 0 && dx == 0));
+          TEST_CHECK(udy[u] * dy > 0 || (udy[u] == 0 && dy == 0));
+        }
+      }
+      TEST_CHECK(_moving == _expected);
+    }
+    TEST_CHECK(GameMap_getFlowField(nullptr, nullptr, 0) == -1);
+    GameMap_freeFlows(flows);
+    GameMap_free(map);
+  }
+}
+
+/*******************************************************************************/
+//Serial Dijkstra from the goals, a step costs the cost of the tile it goes to
+//(toward the goals) times 10 or 14
+static std::vector<long long> _dijkstra(const std::string& tiles, const std::vector<int>& goals)
+{
+  std::vector<long long> _costs(tiles.size(), _UNREACHED);
+  typedef std::pair<long long, int> _Item_t; //cost, tile
+  std::priority_queue<_Item_t, std::vector<_Item_t>, std::greater<_Item_t>> _open;
+  for (size_t g = 0; g < goals.size(); g++) {
+    _costs[goals[g]] = 0;
+    _open.push(_Item_t(0, goals[g]));
+  }
+  while (false == _open.empty()) {
+    _Item_t _item = _open.top();
+    _open.pop();
+    if (_item.first != _costs[_item.second])
+      continue;
+    int x = _item.second % _GRID_W, y = _item.second / _GRID_W;
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        int nx = x + dx, ny = y + dy;
+        if ((dx == 0 && dy == 0) || nx < 0 || nx >= _GRID_W || ny < 0 || ny >= _GRID_H
+            || _tileCost(tiles, nx, ny) == 0)
+          continue;
+        bool _diagonal = dx != 0 && dy != 0;
+        if (_diagonal && (_tileCost(tiles, nx, y) == 0 || _tileCost(tiles, x, ny) == 0))
+          continue;
+        long long _cost = _item.first + _tileCost(tiles, x, y) * (_diagonal ? 14 : 10);
+        if (_costs[ny * _GRID_W + nx] == _UNREACHED || _cost < _costs[ny * _GRID_W + nx]) {
+          _costs[ny * _GRID_W + nx] = _cost;
+          _open.push(_Item_t(_cost, ny * _GRID_W + nx));
+        }
+      }
+    }
+  }
+  return _costs;
+}
+
+static int _tileCost(const std::string& tiles, int x, int y)
+{
+  char c = tiles[y * _GRID_W + x];
+  return c == '#' ? 0 : c == '.' ? 1 : _gidCosts[c - '0'];
+}
@@ -0,0 +1,162 @@
+/******************************************************************************
+* Navigation tests (nav_GameMap.cpp)
+* Paths on random grids against a plain Dijkstra search of the whole grid
+* (same 8 way moves without corner cutting, same 10 / 14 costs): a path is
+* found when the goal is reachable, its steps are legal, and its cost is
+* close to the shortest one: HPA* goes through the cluster entrances, which
+* adds a detour of a few tiles at most (the most to short paths, like two
+* tiles side by side across a cluster border), a few percent on average.
+* The same after tiles are changed with GameMap_setNavTile().
+******************************************************************************/
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <utility>
+
+#include "test_GameMap.h"
+
+#define _GRID_W 70      //Partial clusters on the right and bottom
+#define _GRID_H 50
+#define _QUERIES 200
+#define _MAX_DETOUR 120       //Path cost - shortest cost, 12 straight steps
+#define _MAX_MEAN_RATIO 1.05  //Path cost / shortest cost, all paths
+
+/*
+Private functions
+*/
+static std::vector<int> _shortestCosts(const std::string& tiles, int from);
+static void _checkQueries(GameMap_Nav_t* nav, const std::string& tiles, uint32_t* state, double* ratios, int* pathsNum);
+
+/*******************************************************************************/
+void Test_nav()
+{
+  double _ratios = 0;
+  int _pathsNum = 0;
+  for (uint32_t _seed = 1; _seed <= 4; _seed++) {
+    uint32_t _state = _seed * 2654435761u;
+    //Walls: about one tile in four, and a few long ones
+    std::string _tiles(_GRID_W * _GRID_H, '.');
+    for (size_t i = 0; i < _tiles.size(); i++)
+      if (Test_random(&_state) % 4 == 0) _tiles[i] = '#';
+    for (int w = 0; w < 6; w++) {
+      int x = Test_random(&_state) % _GRID_W, y = Test_random(&_state) % _GRID_H;
+      bool _vertical = Test_random(&_state) % 2 == 0;
+      for (int i = 0; i < 20; i++, _vertical ? y++ : x++)
+        if (x < _GRID_W && y < _GRID_H) _tiles[y * _GRID_W + x] = '#';
+    }
+    GameMap_t* map = Test_gridMap(_GRID_W, _GRID_H, _tiles);
+    if (map == nullptr)
+      return;
+    GameMap_Nav_t* nav = GameMap_newNav(map, "ground");
+    TEST_CHECK(nav != nullptr);
+    if (nav == nullptr) {
+      GameMap_free(map);
+      return;
+    }
+    _checkQueries(nav, _tiles, &_state, &_ratios, &_pathsNum);
+
+    //Change tiles, clusters are built again on the next query
+    for (int c = 0; c < 3; c++) {
+      for (int i = 0; i < 40; i++) {
+        int x = Test_random(&_state) % _GRID_W, y = Test_random(&_state) % _GRID_H;
+        bool _walkable = Test_random(&_state) % 3 != 0;
+        TEST_CHECK(GameMap_setNavTile(nav, x, y, _walkable) == 0);
+        _tiles[y * _GRID_W + x] = _walkable ? '.' : '#';
+      }
+      _checkQueries(nav, _tiles, &_state, &_ratios, &_pathsNum);
+    }
+    TEST_CHECK(GameMap_setNavTile(nav, _GRID_W, 0, true) != 0);
+    GameMap_freeNav(nav);
+    GameMap_free(map);
+  }
+  TEST_CHECK(_pathsNum > _QUERIES);
+  TEST_CHECK(_ratios / _pathsNum <= _MAX_MEAN_RATIO);
+}
+
+/*******************************************************************************/
+//Random queries from a few starts, checked against the shortest costs
+static void _checkQueries(GameMap_Nav_t* nav, const std::string& tiles, uint32_t* state, double* ratios, int* pathsNum)
+{
+  static int _path[2 * _GRID_W * _GRID_H];
+  for (int s = 0; s < _QUERIES / 20; s++) {
+    int _start = Test_random(state) % (_GRID_W * _GRID_H);
+    std::vector<int> _costs = _shortestCosts(tiles, _start);
+    for (int q = 0; q < 20; q++) {
+      //Goals near the start (same or next clusters) and anywhere
+      int _goal;
+      if (q < 8) {
+        int x = _start % _GRID_W + (int)(Test_random(state) % 21) - 10;
+        int y = _start / _GRID_W + (int)(Test_random(state) % 21) - 10;
+        if (x < 0 || x >= _GRID_W || y < 0 || y >= _GRID_H)
+          continue;
+        _goal = y * _GRID_W + x;
+      }
+      else
+        _goal = Test_random(state) % (_GRID_W * _GRID_H);
+      int sx = _start % _GRID_W, sy = _start / _GRID_W, gx = _goal % _GRID_W, gy = _goal / _GRID_W;
+      int _pathNum = GameMap_findPath(nav, sx, sy, gx, gy, _path, _GRID_W * _GRID_H);
+      bool _reachable = tiles[_start] == '.' && _costs[_goal] >= 0;
+      if (_reachable != (_pathNum > 0)) {
+        printf("nav: (%d,%d) -> (%d,%d) %s, path %d\n", sx, sy, gx, gy, _reachable ? "reachable" : "unreachable", _pathNum);
+        TEST_CHECK(false);
+        continue;
+      }
+      if (_pathNum <= 0)
+        continue;
+      TEST_CHECK(_pathNum <= _GRID_W * _GRID_H);
+      TEST_CHECK(_path[0] == sx && _path[1] == sy);
+      TEST_CHECK(_path[2 * _pathNum - 2] == gx && _path[2 * _pathNum - 1] == gy);
+      TEST_CHECK(GameMap_checkPath(nav, _path, _pathNum) == -1);
+      int _cost = 0;
+      for (int i = 1; i < _pathNum; i++)
+        _cost += (_path[2 * i] != _path[2 * i - 2] && _path[2 * i + 1] != _path[2 * i - 1]) ? 14 : 10;
+      TEST_CHECK(_cost >= _costs[_goal]);
+      TEST_CHECK(_cost - _costs[_goal] <= _MAX_DETOUR);
+      if (_costs[_goal] > 0) {
+        *ratios += (double)_cost / _costs[_goal];
+        (*pathsNum)++;
+      }
+    }
+  }
+}
+
+/*******************************************************************************/
+//Dijkstra from tile from over the whole grid, -1: not reachable
+static std::vector<int> _shortestCosts(const std::string& tiles, int from)
+{
+  std::vector<int> _costs(tiles.size(), -1);
+  if (tiles[from] != '.')
+    return _costs;
+  typedef std::pair<int, int> _Item_t; //cost, tile
+  std::priority_queue<_Item_t, std::vector<_Item_t>, std::greater<_Item_t>> _open;
+  _costs[from] = 0;
+  _open.push(_Item_t(0, from));
+  while (false == _open.empty()) {
+    _Item_t _item = _open.top();
+    _open.pop();
+    if (_item.first != _costs[_item.second])
+      continue;
+    int x = _item.second % _GRID_W, y = _item.second / _GRID_W;
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        int nx = x + dx, ny = y + dy;
+        if ((dx == 0 && dy == 0) || nx < 0 || nx >= _GRID_W || ny < 0 || ny >= _GRID_H
+            || tiles[ny * _GRID_W + nx] != '.')
+          continue;
+        //No corner cutting
+        if (dx != 0 && dy != 0 && (tiles[y * _GRID_W + nx] != '.' || tiles[ny * _GRID_W + x] != '.'))
+          continue;
+        int _cost = _item.first + (dx != 0 && dy != 0 ? 14 : 10);
+        int _next = ny * _GRID_W + nx;
+        if (_costs[_next] < 0 || _cost < _costs[_next]) {
+          _costs[_next] = _cost;
+          _open.push(_Item_t(_cost, _next));
+        }
+      }
+    }
+  }
+  return _costs;
+}
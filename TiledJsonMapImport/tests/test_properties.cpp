@@ -0,0 +1,72 @@
+/******************************************************************************
+* Property tests (properties_GameMap.cpp)
+* Map properties of each type read back, colors "#AARRGGBB" or "#RRGGBB"
+* (opaque) in hex digits only: anything else fails the load.
+******************************************************************************/
+
+#include <string.h>
+#include <string>
+
+#include "test_GameMap.h"
+
+//Colors that fail the load
+static const char* const _badColors[] = {
+  "#0x12345", "#0x123456", "# 12345", "#-FFFFF", "#+FFFFF", "#-FFFFFFF", "#12345", "#1234567",
+  "102030A", "#GGGGGG", "#12345 ", "#\\t12345",
+};
+
+/*
+Private functions
+*/
+static std::string _mapJson(const std::string& properties);
+
+/*******************************************************************************/
+void Test_properties()
+{
+  GameMap_t* map = Test_loadJson(_mapJson(
+    "{\"name\":\"argb\",\"type\":\"color\",\"value\":\"#80aBcDeF\"},"
+    "{\"name\":\"rgb\",\"type\":\"color\",\"value\":\"#102030\"},"
+    "{\"name\":\"none\",\"type\":\"color\",\"value\":\"\"},"
+    "{\"name\":\"int\",\"type\":\"int\",\"value\":-42},"
+    "{\"name\":\"float\",\"type\":\"float\",\"value\":1.5},"
+    "{\"name\":\"bool\",\"type\":\"bool\",\"value\":true},"
+    "{\"name\":\"text\",\"type\":\"string\",\"value\":\"hello\"}"));
+  if (map == nullptr)
+    printf("%s", GameMap_getErrStr());
+  TEST_CHECK(map != nullptr);
+  if (map != nullptr) {
+    const GameMap_Property_t* p = GameMap_getMapProperty(map, GameMap_getPropertyId("argb"));
+    TEST_CHECK(p->type == GAMEMAP_PROPERTY_COLOR && p->color == 0x80ABCDEFu);
+    p = GameMap_getMapProperty(map, GameMap_getPropertyId("rgb"));
+    TEST_CHECK(p->type == GAMEMAP_PROPERTY_COLOR && p->color == 0xFF102030u);
+    p = GameMap_getMapProperty(map, GameMap_getPropertyId("none"));
+    TEST_CHECK(p->type == GAMEMAP_PROPERTY_COLOR && p->color == 0);
+    p = GameMap_getMapProperty(map, GameMap_getPropertyId("int"));
+    TEST_CHECK(p->type == GAMEMAP_PROPERTY_INT && p->i == -42);
+    p = GameMap_getMapProperty(map, GameMap_getPropertyId("float"));
+    TEST_CHECK(p->type == GAMEMAP_PROPERTY_FLOAT && p->f == 1.5f && p->i == 1);
+    p = GameMap_getMapProperty(map, GameMap_getPropertyId("bool"));
+    TEST_CHECK(p->type == GAMEMAP_PROPERTY_BOOL && p->i == 1);
+    p = GameMap_getMapProperty(map, GameMap_getPropertyId("text"));
+    TEST_CHECK(p->type == GAMEMAP_PROPERTY_STRING && 0 == strcmp(p->s, "hello"));
+    p = GameMap_getMapProperty(map, GameMap_getPropertyId("not set"));
+    TEST_CHECK(p->type == GAMEMAP_PROPERTY_NONE && p->i == 0);
+    GameMap_free(map);
+  }
+
+  for (size_t i = 0; i < sizeof(_badColors) / sizeof(_badColors[0]); i++) {
+    map = Test_loadJson(_mapJson("{\"name\":\"c\",\"type\":\"color\",\"value\":\"" + (std::string)_badColors[i] + "\"}"));
+    if (map != nullptr)
+      printf("properties: color \"%s\" accepted\n", _badColors[i]);
+    TEST_CHECK(map == nullptr);
+    GameMap_free(map);
+  }
+}
+
+/*******************************************************************************/
+//Map of one empty layer, properties: JSON property objects
+static std::string _mapJson(const std::string& properties)
+{
+  return "{\"width\":2,\"height\":2,\"tilewidth\":16,\"tileheight\":16,\"properties\":[" + properties + "],"
+         "\"layers\":[{\"name\":\"ground\",\"type\":\"tilelayer\",\"width\":2,\"height\":2,\"data\":[0,0,0,0]}]}";
+}
@@ -0,0 +1,230 @@
+/******************************************************************************
+* Save tests (save_GameMap.cpp)
+* A map with a layer of each storage (uint32, uint8 and uint16 cells with
+* flip flags, blocks, runs, chunks, and one without tiles) saved as CSV and
+* as base64, loaded back: same layers, same storage, same tiles.
+* A map with an embedded and an external tileset saved in other directories
+* than the one it was loaded from, loaded back: same tileset files.
+******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#define rmdir _rmdir
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "test_GameMap.h"
+
+#define _MAP_W 40
+#define _MAP_H 30
+#define _FLIP_H 0x80000000u
+#define _FLIP_V 0x40000000u
+
+/*
+Private functions
+*/
+static std::string _mapJson();
+static std::string _layerJson(const char* name, int width, int height, const std::vector<unsigned int>& tiles);
+static std::string _chunkedLayerJson(const char* name);
+static void _checkSame(const GameMap_t* map, const GameMap_t* saved, bool base64);
+static void _checkTilesetPaths();
+static bool _writeFile(const std::string& path, const std::string& text);
+
+/*******************************************************************************/
+void Test_save()
+{
+  GameMap_t* map = Test_loadJson(_mapJson());
+  if (map == nullptr)
+    printf("%s", GameMap_getErrStr());
+  TEST_CHECK(map != nullptr);
+  if (map == nullptr)
+    return;
+  //Each storage is saved
+  const int _storages[] = { _STORE_U32, _STORE_U8, _STORE_U16, _STORE_BLOCKS, _STORE_RUNS };
+  TEST_CHECK(map->layersNum == 7);
+  for (int l = 0; l < 5 && l < map->layersNum; l++)
+    TEST_CHECK(map->layers[l].storage == _storages[l]);
+  TEST_CHECK(map->layersNum < 7 || map->layers[5].chunks != nullptr);
+  TEST_CHECK(map->layersNum < 7 || map->layers[6].width == 0);
+
+  std::string _path = Test_tempPath("save.json");
+  for (int b = 0; b < 2; b++) {
+    TEST_CHECK(GameMap_saveToTiledJSON(map, _path.c_str(), b == 1) == 0);
+    GameMap_t* _saved = GameMap_loadFromTiledJSON(_path.c_str());
+    if (_saved == nullptr)
+      printf("%s", GameMap_getErrStr());
+    TEST_CHECK(_saved != nullptr);
+    if (_saved != nullptr) {
+      _checkSame(map, _saved, b == 1);
+      GameMap_free(_saved);
+    }
+  }
+  remove(_path.c_str());
+  GameMap_free(map);
+
+  //Paths from the directory of the saved file
+  TEST_CHECK(_GameMap_relativePath("maps/tiles.png", "out/") == "../maps/tiles.png");
+  TEST_CHECK(_GameMap_relativePath("maps/ts/../img/t.png", "maps/") == "img/t.png");
+  TEST_CHECK(_GameMap_relativePath("maps/t.png", "maps/a/b/") == "../../t.png");
+  TEST_CHECK(_GameMap_relativePath("../shared/t.png", "out/") == "../../shared/t.png");
+  TEST_CHECK(_GameMap_relativePath("t.png", "") == "t.png");
+  TEST_CHECK(_GameMap_relativePath("/a/b/t.png", "/a/c/") == "../b/t.png");
+  TEST_CHECK(_GameMap_relativePath("C:/a/t.png", "D:/a/") == "C:/a/t.png");
+  _checkTilesetPaths();
+}
+
+/*******************************************************************************/
+//maps/a.json with tileset images maps/tiles.png and maps/img/ext.png (from
+//maps/ts/ext.tsj), saved in a directory next to maps and in one inside it
+static void _checkTilesetPaths()
+{
+  std::string _root = Test_tempPath("paths");
+  std::string _dirs[] = { _root, _root + "/maps", _root + "/maps/ts", _root + "/out", _root + "/maps/out" };
+  for (int d = 0; d < 5; d++)
+    mkdir(_dirs[d].c_str(), 0755);
+  std::string _mapPath = _root + "/maps/a.json", _tsjPath = _root + "/maps/ts/ext.tsj";
+  bool _written = _writeFile(_tsjPath, "{\"name\":\"ext\",\"image\":\"../img/ext.png\",\"tilewidth\":16,"
+                                       "\"tileheight\":16,\"imagewidth\":64,\"imageheight\":64,\"tilecount\":16}")
+               && _writeFile(_mapPath, "{\"width\":2,\"height\":2,\"tilewidth\":16,\"tileheight\":16,"
+                                       "\"layers\":[{\"name\":\"ground\",\"type\":\"tilelayer\",\"width\":2,\"height\":2,"
+                                       "\"data\":[1,2,17,18]}],\"tilesets\":[{\"firstgid\":1,\"name\":\"emb\","
+                                       "\"image\":\"tiles.png\",\"tilewidth\":16,\"tileheight\":16,\"imagewidth\":64,"
+                                       "\"imageheight\":64,\"tilecount\":16},{\"firstgid\":17,\"source\":\"ts/ext.tsj\"}]}");
+  TEST_CHECK(_written);
+  GameMap_t* map = _written ? GameMap_loadFromTiledJSON(_mapPath.c_str()) : nullptr;
+  if (_written && map == nullptr)
+    printf("%s", GameMap_getErrStr());
+  TEST_CHECK(map != nullptr);
+  const char* _outPaths[] = { "/out/a.json", "/maps/out/a.json" };
+  for (int o = 0; map != nullptr && o < 2; o++) {
+    std::string _outPath = _root + _outPaths[o];
+    TEST_CHECK(GameMap_saveToTiledJSON(map, _outPath.c_str()) == 0);
+    GameMap_t* _saved = GameMap_loadFromTiledJSON(_outPath.c_str());
+    if (_saved == nullptr)
+      printf("save: %s: %s", _outPaths[o], GameMap_getErrStr());
+    TEST_CHECK(_saved != nullptr);
+    if (_saved != nullptr) {
+      TEST_CHECK(_saved->tilesetsNum == 2);
+      for (int t = 0; t < 2 && t < _saved->tilesetsNum; t++) {
+        TEST_CHECK(_GameMap_normPath(_saved->tilesets[t].imgPath) == _GameMap_normPath(map->tilesets[t].imgPath));
+        TEST_CHECK(_GameMap_normPath(_saved->tilesets[t].source) == _GameMap_normPath(map->tilesets[t].source));
+      }
+      GameMap_free(_saved);
+    }
+    remove(_outPath.c_str());
+  }
+  GameMap_free(map);
+  remove(_mapPath.c_str());
+  remove(_tsjPath.c_str());
+  for (int d = 4; d >= 0; d--)
+    rmdir(_dirs[d].c_str());
+}
+
+/*******************************************************************************/
+//Layers and tiles of saved as in map
+static void _checkSame(const GameMap_t* map, const GameMap_t* saved, bool base64)
+{
+  TEST_CHECK(saved->layersNum == map->layersNum);
+  for (int l = 0; l < map->layersNum && l < saved->layersNum; l++) {
+    const GMapTilelayer_t* _layer = &map->layers[l];
+    const GMapTilelayer_t* _saved = &saved->layers[l];
+    TEST_CHECK(0 == strcmp(_saved->name, _layer->name));
+    TEST_CHECK(_saved->storage == _layer->storage);
+    TEST_CHECK((_saved->chunks != nullptr) == (_layer->chunks != nullptr));
+    //Layers without tiles are saved as empty object layers
+    if (_layer->chunks == nullptr && (size_t)_layer->width * _layer->height == 0) {
+      TEST_CHECK((size_t)_saved->width * _saved->height == 0);
+      continue;
+    }
+    TEST_CHECK(_saved->width == _layer->width && _saved->height == _layer->height);
+    if ((_saved->chunks != nullptr) != (_layer->chunks != nullptr) || _saved->width != _layer->width
+        || _saved->height != _layer->height)
+      continue;
+    //Chunked layers: around and between the chunks
+    int x0 = 0, y0 = 0, x1 = _layer->width, y1 = _layer->height;
+    if (_layer->chunks != nullptr) {
+      x0 = y0 = -2 * _CHUNK_SIZE;
+      x1 = y1 = 3 * _CHUNK_SIZE;
+    }
+    int _wrongTiles = 0;
+    for (int y = y0; y < y1; y++)
+      for (int x = x0; x < x1; x++)
+        if (_GameMap_layerTile(_saved, x, y) != _GameMap_layerTile(_layer, x, y))
+          _wrongTiles++;
+    if (_wrongTiles > 0)
+      printf("save: %s layer \"%s\": %d wrong tiles\n", base64 ? "base64" : "CSV", _layer->name, _wrongTiles);
+    TEST_CHECK(_wrongTiles == 0);
+  }
+}
+
+/*******************************************************************************/
+//Tiles picked for the storage each layer gets when loaded
+static std::string _mapJson()
+{
+  uint32_t _state = 2463534242u;
+  size_t _tilesNum = _MAP_W * _MAP_H;
+  std::vector<unsigned int> _u32(_tilesNum), _u8(_tilesNum), _u16(_tilesNum), _blocks(_tilesNum, 0), _runs(_tilesNum, 0);
+  for (size_t i = 0; i < _tilesNum; i++) {
+    uint32_t r = Test_random(&_state);
+    _u32[i] = (1 + r % 100000) | (r & _FLIP_H);
+    _u8[i] = (r % 200) | (r % 7 == 0 ? _FLIP_V : 0);
+    _u16[i] = (r % 3000) | (r & _FLIP_H);
+  }
+  //Blocks: one 8 x 8 block of tiles all different from their neighbours
+  for (int y = 8; y < 16; y++)
+    for (int x = 16; x < 24; x++)
+      _blocks[y * _MAP_W + x] = 2 + (x + y) % 2;
+  //Runs: every 4th row full of the same tile
+  for (int y = 0; y < _MAP_H; y += 4)
+    for (int x = 0; x < _MAP_W; x++)
+      _runs[y * _MAP_W + x] = 5 | _FLIP_H;
+
+  return "{\"width\":" + std::to_string(_MAP_W) + ",\"height\":" + std::to_string(_MAP_H)
+         + ",\"tilewidth\":16,\"tileheight\":16,\"layers\":["
+         + _layerJson("u32", _MAP_W, _MAP_H, _u32) + "," + _layerJson("u8", _MAP_W, _MAP_H, _u8) + ","
+         + _layerJson("u16", _MAP_W, _MAP_H, _u16) + "," + _layerJson("blocks", _MAP_W, _MAP_H, _blocks) + ","
+         + _layerJson("runs", _MAP_W, _MAP_H, _runs) + "," + _chunkedLayerJson("chunks") + ","
+         + _layerJson("empty", 0, 5, std::vector<unsigned int>()) + "]}";
+}
+
+static std::string _layerJson(const char* name, int width, int height, const std::vector<unsigned int>& tiles)
+{
+  std::string _json = "{\"name\":\"" + (std::string)name + "\",\"type\":\"tilelayer\",\"width\":"
+                    + std::to_string(width) + ",\"height\":" + std::to_string(height) + ",\"data\":[";
+  for (size_t i = 0; i < tiles.size(); i++)
+    _json += (i > 0 ? "," : "") + std::to_string(tiles[i]);
+  return _json + "]}";
+}
+
+//Chunks of 16 x 16 tiles at negative and positive coordinates, apart
+static std::string _chunkedLayerJson(const char* name)
+{
+  const int _chunks[] = { -16, -16, 0, -16, 16, 32 };
+  std::string _json = "{\"name\":\"" + (std::string)name + "\",\"type\":\"tilelayer\",\"startx\":-16,\"starty\":-16"
+                    + ",\"width\":48,\"height\":64,\"chunks\":[";
+  for (int c = 0; c < 3; c++) {
+    _json += (c > 0 ? "," : "") + (std::string)"{\"x\":" + std::to_string(_chunks[2 * c]) + ",\"y\":"
+           + std::to_string(_chunks[2 * c + 1]) + ",\"width\":16,\"height\":16,\"data\":[";
+    for (int i = 0; i < 16 * 16; i++)
+      _json += (i > 0 ? "," : "") + std::to_string(i % 5 == 0 ? 0 : (c + 1) * 100 + i);
+    _json += "]}";
+  }
+  return _json + "]}";
+}
+
+static bool _writeFile(const std::string& path, const std::string& text)
+{
+  FILE* fp = fopen(path.c_str(), "wb");
+  if (fp == nullptr)
+    return false;
+  bool _written = 1 == fwrite(text.data(), text.size(), 1, fp);
+  return 0 == fclose(fp) && _written;
+}
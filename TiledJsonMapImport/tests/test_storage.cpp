@@ -0,0 +1,56 @@
+/******************************************************************************
+* Layer storage tests (storage_GameMap.cpp)
+* Layers packed at the widest rows runs can hold (GMapRun_t x and n are
+* uint16_t): UINT16_MAX tiles wide layers are stored as runs, wider ones
+* another way, the tiles read back the same.
+******************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_GameMap.h"
+
+/*
+Private functions
+*/
+static void _checkPacked(int width, bool runs);
+
+/*******************************************************************************/
+void Test_storage()
+{
+  _checkPacked(UINT16_MAX, true);
+  _checkPacked(UINT16_MAX + 1, false);
+}
+
+/*******************************************************************************/
+//Layer of 2 rows: one run of the whole first row, one tile at the end of
+//the second: runs take a few bytes
+static void _checkPacked(int width, bool runs)
+{
+  GMapTilelayer_t _layer;
+  memset(&_layer, 0, sizeof(_layer));
+  _layer.width = width;
+  _layer.height = 2;
+  _layer.storage = _STORE_U32;
+  _layer.data = (unsigned int*)calloc((size_t)width * 2, sizeof(unsigned int));
+  TEST_CHECK(_layer.data != nullptr);
+  if (_layer.data == nullptr)
+    return;
+  for (int x = 0; x < width; x++)
+    _layer.data[x] = 7;
+  _layer.data[2 * (size_t)width - 1] = 3;
+
+  _GameMap_packLayer(&_layer);
+  TEST_CHECK((_layer.storage == _STORE_RUNS) == runs);
+  TEST_CHECK(_layer.storage != _STORE_U32 && _layer.data == nullptr);
+  int _wrongTiles = 0;
+  for (int x = 0; x < width; x++) {
+    if (_GameMap_layerTile(&_layer, x, 0) != 7) _wrongTiles++;
+    if (_GameMap_layerTile(&_layer, x, 1) != (x == width - 1 ? 3u : 0u)) _wrongTiles++;
+  }
+  if (_wrongTiles > 0)
+    printf("storage: width %d storage %d: %d wrong tiles\n", width, _layer.storage, _wrongTiles);
+  TEST_CHECK(_wrongTiles == 0);
+  _GameMap_freeLayerData(&_layer);
+}
@@ -0,0 +1,387 @@
+/*******************************************************************************
+ * GameMap external tilesets
+ * Tiled tilesets saved in their own file (.tsj JSON, .tsx XML) and referenced
+ * by maps with "source". Each file is parsed once into the JSON fields of an
+ * embedded tileset (without firstgid) and kept, by path, while its size and
+ * modification time stay the same: maps sharing a tileset share the parsed
+ * json11::Json. Loaders may run on several threads, the cache is locked.
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <unordered_map>
+#ifdef _WIN32
+#include <direct.h>
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#endif
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+#include "json11.hpp"
+
+//Parsed tileset file, as it was when parsed
+typedef struct {
+  uint64_t size;
+  int64_t mtime;
+  json11::Json tileset;
+} _TilesetFile_t;
+
+static struct {
+  std::mutex mutex;
+  std::unordered_map<std::string, _TilesetFile_t> files; //by _GameMap_normPath()
+} _GameMap_tilesetFiles;
+
+/*
+Private functions
+*/
+static json11::Json _parseTsx(const std::string& text, std::string& err);
+static json11::Json::array _tsxProperties(const std::string& text, size_t from, size_t to, std::string& err);
+static size_t _xmlFind(const std::string& text, const char* name, size_t from);
+static bool _xmlTag(const std::string& text, const char* name, size_t from, size_t* end,
+                    std::unordered_map<std::string, std::string>* attrs);
+static std::string _xmlDecode(const std::string& text, size_t from, size_t to);
+static json11::Json _xmlValue(const std::string& value);
+static bool _isAbsolute(const std::string& path);
+static std::string _absolutePath(const std::string& path);
+static std::vector<std::string> _splitPath(const std::string& path);
+static bool _samePart(const std::string& a, const std::string& b);
+
+/*******************************************************************************/
+/**
+ * Tileset fields of an external tileset file, parsed only when the file is
+ * new or changed (.tsx files as XML, others as JSON)
+ *
+ * @return != 0 : can not read or parse the file, err says why
+ */
+int _GameMap_loadTilesetFile(const std::string& path, json11::Json* tileset, std::string& err)
+{
+  uint64_t _size = 0;
+  int64_t _mtime = 0;
+  if (0 != _GameMap_fileStat(path.c_str(), &_size, &_mtime)) {
+    err = "Can not open file: \"" + path + "\"";
+    return 1;
+  }
+  std::string _key = _GameMap_normPath(path);
+  {
+    std::lock_guard<std::mutex> _lock(_GameMap_tilesetFiles.mutex);
+    std::unordered_map<std::string, _TilesetFile_t>::const_iterator _found = _GameMap_tilesetFiles.files.find(_key);
+    if (_found != _GameMap_tilesetFiles.files.end() && _found->second.size == _size && _found->second.mtime == _mtime) {
+      *tileset = _found->second.tileset;
+      return 0;
+    }
+  }
+
+  //New or changed: parse it unlocked, other files may be loading
+  std::ifstream fin(path, std::ios::binary);
+  std::stringstream ss;
+  ss << fin.rdbuf();
+  fin.close();
+  if (ss.str() == "") {
+    err = "Can not open file: \"" + path + "\"";
+    return 1;
+  }
+  std::string _ext = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+  for (size_t i = 0; i < _ext.size(); i++) _ext[i] = (char)tolower((unsigned char)_ext[i]);
+  json11::Json _tileset = _ext == ".tsx" ? _parseTsx(ss.str(), err) : json11::Json::parse(ss.str(), err);
+  if (err.size() != 0 || false == _tileset.is_object()) {
+    err = "Tileset file \"" + path + "\": " + (err.size() != 0 ? err : "not a tileset");
+    return 1;
+  }
+  std::lock_guard<std::mutex> _lock(_GameMap_tilesetFiles.mutex);
+  _TilesetFile_t& _file = _GameMap_tilesetFiles.files[_key];
+  _file.size = _size;
+  _file.mtime = _mtime;
+  _file.tileset = _tileset;
+  *tileset = _tileset;
+  return 0;
+}
+
+/*******************************************************************************/
+//Same path for the same file reached from maps in other directories:
+//'\' as '/', without "." and "dir/.." parts
+std::string _GameMap_normPath(const std::string& path)
+{
+  std::vector<std::string> _parts;
+  std::string _norm;
+  size_t _start = 0;
+  if (path.size() > 0 && (path[0] == '/' || path[0] == '\\')) {
+    _norm = "/";
+    _start = 1;
+  }
+  while (_start <= path.size()) {
+    size_t _end = path.find_first_of("/\\", _start);
+    if (_end == std::string::npos) _end = path.size();
+    std::string _part = path.substr(_start, _end - _start);
+    if (_part == ".." && _parts.size() > 0 && _parts.back() != "..")
+      _parts.pop_back();
+    else if (_part != "" && _part != ".")
+      _parts.push_back(_part);
+    _start = _end + 1;
+  }
+  for (size_t i = 0; i < _parts.size(); i++)
+    _norm += (i > 0 ? "/" : "") + _parts[i];
+  return _norm;
+}
+
+/*******************************************************************************/
+//Path of the file at path (relative to the working directory, or absolute)
+//from directory dir, "../" for each part of dir not shared with it: paths in
+//a map file saved in dir. Absolute when they share nothing (other drives).
+std::string _GameMap_relativePath(const std::string& path, const std::string& dir)
+{
+  std::string _path = _GameMap_normPath(path), _dir = _GameMap_normPath(dir);
+  //Going up from dir needs the names of its parents: from the working directory
+  if (_isAbsolute(_path) != _isAbsolute(_dir) || _dir == ".." || 0 == _dir.compare(0, 3, "../")) {
+    _path = _absolutePath(_path);
+    _dir = _absolutePath(_dir);
+  }
+  std::vector<std::string> _pathParts = _splitPath(_path), _dirParts = _splitPath(_dir);
+  size_t _shared = 0;
+  while (_shared + 1 < _pathParts.size() && _shared < _dirParts.size() && _samePart(_pathParts[_shared], _dirParts[_shared]))
+    _shared++;
+  if (_isAbsolute(_path) != _isAbsolute(_dir) || (_isAbsolute(_path) && _shared == 0))
+    return _path;
+  std::string _relative;
+  for (size_t i = _shared; i < _dirParts.size(); i++)
+    _relative += "../";
+  for (size_t i = _shared; i < _pathParts.size(); i++)
+    _relative += _pathParts[i] + (i + 1 < _pathParts.size() ? "/" : "");
+  return _relative;
+}
+
+//"/..." "\\..." or "C:..."
+static bool _isAbsolute(const std::string& path)
+{
+  return (path.size() > 0 && (path[0] == '/' || path[0] == '\\')) || (path.size() > 1 && path[1] == ':');
+}
+
+static std::string _absolutePath(const std::string& path)
+{
+  char _cwd[4096];
+  if (_isAbsolute(path) || nullptr == getcwd(_cwd, sizeof(_cwd)))
+    return _GameMap_normPath(path);
+  return _GameMap_normPath((std::string)_cwd + "/" + path);
+}
+
+//Parts of a normalized path, the root "/" left out
+static std::vector<std::string> _splitPath(const std::string& path)
+{
+  std::vector<std::string> _parts;
+  size_t _start = path.size() > 0 && path[0] == '/' ? 1 : 0;
+  while (_start < path.size()) {
+    size_t _end = path.find('/', _start);
+    if (_end == std::string::npos) _end = path.size();
+    _parts.push_back(path.substr(_start, _end - _start));
+    _start = _end + 1;
+  }
+  return _parts;
+}
+
+//File names are not case sensitive on Windows
+static bool _samePart(const std::string& a, const std::string& b)
+{
+#ifdef _WIN32
+  return 0 == _stricmp(a.c_str(), b.c_str());
+#else
+  return a == b;
+#endif
+}
+
+/*******************************************************************************/
+/**
+ * Tileset fields of a .tsx file: attributes of <tileset> and of its <image>,
+ * properties of the tileset and of its tiles (the rest of the file, tile
+ * collision shapes and animations, wang sets, is not read)
+ */
+static json11::Json _parseTsx(const std::string& text, std::string& err)
+{
+  std::unordered_map<std::string, std::string> _tilesetAttrs, _imageAttrs;
+  size_t _end = 0;
+  if (false == _xmlTag(text, "tileset", 0, &_end, &_tilesetAttrs)) {
+    err = "no <tileset> element";
+    return json11::Json();
+  }
+  size_t _tilesetEnd = _end;
+  if (false == _xmlTag(text, "image", _tilesetEnd, &_end, &_imageAttrs)
+      || text.find("<tile ", _tilesetEnd) < _end) {
+    err = "no tileset <image> element (image collections are not supported)";
+    return json11::Json();
+  }
+  static const char* _tilesetFields[] = { "tilewidth", "tileheight", "tilecount" };
+  json11::Json::object _tileset;
+  for (const char* _field : _tilesetFields)
+    if (_tilesetAttrs.count(_field) > 0)
+      _tileset[_field] = _xmlValue(_tilesetAttrs[_field]);
+  if (_tilesetAttrs.count("name") > 0)
+    _tileset["name"] = _tilesetAttrs["name"];
+  if (_imageAttrs.count("source") > 0)
+    _tileset["image"] = _imageAttrs["source"];
+  if (_imageAttrs.count("width") > 0)
+    _tileset["imagewidth"] = _xmlValue(_imageAttrs["width"]);
+  if (_imageAttrs.count("height") > 0)
+    _tileset["imageheight"] = _xmlValue(_imageAttrs["height"]);
+
+  //Tileset properties come before its <image>, tile ones first in each <tile>
+  json11::Json::array _properties = _tsxProperties(text, _tilesetEnd, _xmlFind(text, "image", _tilesetEnd), err);
+  if (err.size() != 0)
+    return json11::Json();
+  if (_properties.size() > 0)
+    _tileset["properties"] = _properties;
+  json11::Json::array _tiles;
+  std::unordered_map<std::string, std::string> _tileAttrs;
+  size_t _tileEnd = _end;
+  while (_xmlTag(text, "tile", _tileEnd, &_tileEnd, &_tileAttrs)) {
+    std::unordered_map<std::string, std::string> _attrs;
+    std::swap(_attrs, _tileAttrs);
+    if (text[_tileEnd - 1] == '/')
+      continue;  //<tile id="..."/>
+    size_t _close = text.find("</tile>", _tileEnd);
+    size_t _shapes = _xmlFind(text, "objectgroup", _tileEnd);
+    _properties = _tsxProperties(text, _tileEnd, _shapes < _close ? _shapes : _close, err);
+    if (err.size() != 0)
+      return json11::Json();
+    if (_properties.size() > 0)
+      _tiles.push_back(json11::Json::object { { "id", _xmlValue(_attrs["id"]) }, { "properties", _properties } });
+    if (_close == std::string::npos)
+      break;
+    _tileEnd = _close;
+  }
+  if (_tiles.size() > 0)
+    _tileset["tiles"] = _tiles;
+  return json11::Json(_tileset);
+}
+
+/**
+ * <property> elements in text[from .. to), as the "properties" array of a
+ * .tsj file. Members of class properties are skipped with them.
+ */
+static json11::Json::array _tsxProperties(const std::string& text, size_t from, size_t to, std::string& err)
+{
+  json11::Json::array _properties;
+  std::unordered_map<std::string, std::string> _attrs;
+  size_t _end = 0;
+  while (_xmlFind(text, "property", from) < to && _xmlTag(text, "property", from, &_end, &_attrs)) {
+    from = _end;
+    std::string _type = _attrs.count("type") > 0 ? _attrs["type"] : "string";
+    bool _hasValue = _attrs.count("value") > 0;
+    std::string _value = _hasValue ? _attrs["value"] : "";
+    if (text[_end - 1] != '/') {
+      //Value as element text (multi-line strings), or class members up to its </property>
+      int _depth = 1;
+      size_t _close = _end;
+      while (_depth > 0) {
+        size_t _open = _xmlFind(text, "property", from);
+        _close = text.find("</property>", from);
+        if (_close == std::string::npos) {
+          err = "no </property>";
+          return _properties;
+        }
+        if (_open < _close) {
+          from = text.find('>', _open);
+          if (from == std::string::npos) {
+            err = "unclosed <property>";
+            return _properties;
+          }
+          if (text[from - 1] != '/') _depth++;
+          from++;
+          continue;
+        }
+        _depth--;
+        from = _close + strlen("</property>");
+      }
+      if (false == _hasValue && _type != "class")
+        _value = _xmlDecode(text, _end, _close);
+    }
+    json11::Json _jsonValue = _value;
+    if (_type == "bool")
+      _jsonValue = _value == "true";
+    else if (_type == "int" || _type == "float" || _type == "object")
+      _jsonValue = _xmlValue(_value);
+    _properties.push_back(json11::Json::object { { "name", _attrs["name"] }, { "type", _type }, { "value", _jsonValue } });
+    _attrs.clear();
+  }
+  return _properties;
+}
+
+//Position of the first <name ...> element from text[from], npos: none
+static size_t _xmlFind(const std::string& text, const char* name, size_t from)
+{
+  std::string _open = (std::string)"<" + name;
+  size_t _pos = text.find(_open, from);
+  while (_pos != std::string::npos && _pos + _open.size() < text.size()
+         && false == isspace((unsigned char)text[_pos + _open.size()])
+         && text[_pos + _open.size()] != '>' && text[_pos + _open.size()] != '/')
+    _pos = text.find(_open, _pos + 1);  //<tilesetx>, other element
+  return _pos;
+}
+
+//Attributes of the first <name ...> element from text[from], *end past it
+static bool _xmlTag(const std::string& text, const char* name, size_t from, size_t* end,
+                    std::unordered_map<std::string, std::string>* attrs)
+{
+  size_t _pos = _xmlFind(text, name, from);
+  if (_pos == std::string::npos)
+    return false;
+  _pos += strlen(name) + 1;
+  for (;;) {
+    while (_pos < text.size() && isspace((unsigned char)text[_pos])) _pos++;
+    if (_pos >= text.size())
+      return false;
+    if (text[_pos] == '>' || text[_pos] == '/') {
+      *end = _pos + 1;
+      return true;
+    }
+    size_t _eq = text.find('=', _pos);
+    if (_eq == std::string::npos || _eq + 1 >= text.size())
+      return false;
+    std::string _attr = text.substr(_pos, _eq - _pos);
+    while (_attr.size() > 0 && isspace((unsigned char)_attr.back())) _attr.pop_back();
+    _pos = _eq + 1;
+    while (_pos < text.size() && isspace((unsigned char)text[_pos])) _pos++;
+    if (_pos >= text.size() || (text[_pos] != '"' && text[_pos] != '\''))
+      return false;
+    size_t _close = text.find(text[_pos], _pos + 1);
+    if (_close == std::string::npos)
+      return false;
+    (*attrs)[_attr] = _xmlDecode(text, _pos + 1, _close);
+    _pos = _close + 1;
+  }
+}
+
+//text[from .. to) with the XML predefined entities replaced
+static std::string _xmlDecode(const std::string& text, size_t from, size_t to)
+{
+  std::string _value;
+  static const char* _entities[][2] = { { "&amp;", "&" }, { "&lt;", "<" }, { "&gt;", ">" },
+                                        { "&quot;", "\"" }, { "&apos;", "'" } };
+  for (size_t i = from; i < to; i++) {
+    size_t e = 0;
+    while (e < 5 && 0 != text.compare(i, strlen(_entities[e][0]), _entities[e][0])) e++;
+    if (e < 5) {
+      _value += _entities[e][1];
+      i += strlen(_entities[e][0]) - 1;
+    }
+    else
+      _value += text[i];
+  }
+  return _value;
+}
+
+//Number attributes as numbers, for the tileset schema to check them
+static json11::Json _xmlValue(const std::string& value)
+{
+  char* _end = nullptr;
+  double _number = strtod(value.c_str(), &_end);
+  if (value.size() == 0 || _end != value.c_str() + value.size())
+    return json11::Json(value);
+  return json11::Json(_number);
+}
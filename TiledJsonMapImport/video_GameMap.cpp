@@ -6,26 +6,145 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
 #include <vector>
+#include <unordered_map>
+#include <mutex>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <limits.h>
 #include "DxLib.h"
 #include "GameMap.h"
 #include "_GameMap.h"
 
+#define _TILESETS_IDLE_MAX 16 //Tilesets kept loaded without maps using them
+
+//Tile graphics of a tileset image, shared by the maps using it
+struct GMapTileGraphs_t {
+  std::string key;            //Image path and tile geometry, "": replaced by a newer load of the image
+  std::vector<int> handles;   //One per tile
+  int refs;                   //Tilesets using it
+  unsigned long long idleSince;
+};
+
+//Tileset registry, found by key
+static struct {
+  std::mutex mutex;
+  std::unordered_map<std::string, GMapTileGraphs_t*> graphs;
+  unsigned long long clock;   //Releases count
+  unsigned int generation;    //Video mode changes (GameMap_invalidateGraphs())
+} _GameMap_tilesets;
+
+/*
+Private functions
+*/
+static int _tileHandlesNum(const GameMap_t* map);
+static int _loadTilesetGraphs(GameMap_t* map, GMapTileset_t* tileset, bool reload);
+static GMapTileGraphs_t* _acquireGraphs(const GMapTileset_t* tileset, bool reload);
+static void _releaseGraphs(GMapTileGraphs_t* graphs);
+static void _deleteGraphs(GMapTileGraphs_t* graphs);
+static void _trimIdleGraphs(int idleMax);
 
 /*******************************************************************************
 *******************************************************************************/
 /**
  * Load maps graphic data
  * Depends on a graphic library (DxLib)
+ * Tilesets already loaded for other maps are shared, not loaded again
  */
 int ReloadGameMapGraphs(GameMap_t* map)
 {
   int rc = 0; //return code
-  map->tileHandlesNum = 0;
 
-  //Compute number of tile handles required
+  //Allocate and load all graphs
+  map->tileHandlesNum = _tileHandlesNum(map);
+  map->tileHandles = (int *)calloc(map->tileHandlesNum, sizeof(int));
+  for (int i = 0; i < map->tilesetsNum; i++) {
+    if (0 != _loadTilesetGraphs(map, &map->tilesets[i], false))
+      rc = 1;
+  }
+  return rc;
+}
+
+/*******************************************************************************/
+/**
+ * Graphics of a map loaded without them (GameMap_loadWithContext() on a
+ * worker thread), nothing to do when it has them
+ */
+int GameMap_loadGraphs(GameMap_t* map)
+{
+  _GameMap_clearErrStr();
+  if (map == nullptr)
+    return 1;
+  if (map->tileHandles != nullptr)
+    return 0;
+  return ReloadGameMapGraphs(map);
+}
+
+/*******************************************************************************
+*******************************************************************************/
+/**
+ * Load graphics of map tilesets, loading again only the images that changed
+ * (imageChanged[i] != 0 for old->tilesets[i] with the same image). The others
+ * are shared with old, that still has its graphics until freed.
+ * Used by hot reload to load only graphics of tilesets that changed
+ */
+int _GameMap_reuseGraphs(GameMap_t* map, GameMap_t* old, const unsigned char* imageChanged)
+{
+  int rc = 0; //return code
+
+  map->tileHandlesNum = _tileHandlesNum(map);
+  map->tileHandles = (int *)calloc(map->tileHandlesNum, sizeof(int));
+  for (int i = 0; i < map->tilesetsNum; i++) {
+    GMapTileset_t *tileset = &map->tilesets[i];
+    bool _changed = false;
+    for (int o = 0; o < old->tilesetsNum; o++)
+      if (imageChanged[o] != 0 && 0 == strcmp(old->tilesets[o].imgPath, tileset->imgPath))
+        _changed = true;
+    if (0 != _loadTilesetGraphs(map, tileset, _changed))
+      rc = 1;
+  }
+  return rc;
+}
+
+/*******************************************************************************/
+/**
+ * Delete graphics of the tilesets no map uses anymore
+ * (the last ones are kept for the maps loaded next)
+ */
+void GameMap_freeUnusedTilesets()
+{
+  std::lock_guard<std::mutex> _lock(_GameMap_tilesets.mutex);
+  _trimIdleGraphs(0);
+}
+
+/*******************************************************************************/
+/**
+ * Forget the graphics of all tilesets: a video mode change (ChangeWindowMode(),
+ * SetGraphMode()...) deleted them. Tilesets are loaded again by the next map
+ * loads, maps loaded before keep handles that draw nothing until reloaded
+ */
+void GameMap_invalidateGraphs()
+{
+  std::lock_guard<std::mutex> _lock(_GameMap_tilesets.mutex);
+  _GameMap_tilesets.generation++;
+  for (std::unordered_map<std::string, GMapTileGraphs_t*>::iterator it = _GameMap_tilesets.graphs.begin();
+       it != _GameMap_tilesets.graphs.end(); ++it) {
+    GMapTileGraphs_t* _graphs = it->second;
+    //Deleted already, their numbers may be given to new graphics
+    _graphs->handles.assign(_graphs->handles.size(), 0);
+    _graphs->key.clear();
+    if (_graphs->refs == 0)
+      _deleteGraphs(_graphs);
+  }
+  _GameMap_tilesets.graphs.clear();
+}
+
+/*******************************************************************************/
+//Tile handles array size: one per GID up to the last tileset end
+static int _tileHandlesNum(const GameMap_t* map)
+{
   int maxgid = -1;
   int maxgidTileset = -1;
   for (int i = 0; i < map->tilesetsNum; i++){
@@ -34,38 +153,137 @@ int ReloadGameMapGraphs(GameMap_t* map)
       maxgidTileset = i;
     }
   }
-  map->tileHandlesNum =   map->tilesets[maxgidTileset].firstgid
-                        + map->tilesets[maxgidTileset].tilecount;
+  if (maxgidTileset < 0)
+    return 0;
+  return map->tilesets[maxgidTileset].firstgid + map->tilesets[maxgidTileset].tilecount;
+}
 
-  //Allocate and load all graphs
-  map->tileHandles = (int *)calloc(map->tileHandlesNum, sizeof(int));
-  for (int i = 0; i < map->tilesetsNum; i++) {
-    GMapTileset_t *tileset = &map->tilesets[i];
-    int res = 0;
+//Get tileset graphs from the registry into map->tileHandles
+static int _loadTilesetGraphs(GameMap_t* map, GMapTileset_t* tileset, bool reload)
+{
+  tileset->graphs = _acquireGraphs(tileset, reload);
+  if (tileset->graphs == nullptr) {
+    printf("ERROR %s::line %d: can not load \"%s\"\n",
+            __func__, __LINE__, tileset->imgPath);
+    return 1;
+  }
+  int _count = tileset->tilecount;
+  if (_count > map->tileHandlesNum - tileset->firstgid)
+    _count = map->tileHandlesNum - tileset->firstgid;
+  if (_count > 0)
+    memcpy(map->tileHandles + tileset->firstgid, tileset->graphs->handles.data(), _count * sizeof(int));
+  return 0;
+}
+
+//Graphs of the tileset image, loaded unless already loaded with the same
+//geometry (reload: the image file changed, load it again)
+//The image is loaded with the registry unlocked, other threads keep acquiring
+//and releasing graphs meanwhile
+static GMapTileGraphs_t* _acquireGraphs(const GMapTileset_t* tileset, bool reload)
+{
+  std::string _key = _GameMap_normPath(tileset->imgPath) + "|" + std::to_string(tileset->tilewidth)
+                   + "x" + std::to_string(tileset->tileheight) + "|" + std::to_string(tileset->tilecount)
+                   + "|" + std::to_string(tileset->imagewidth) + "x" + std::to_string(tileset->imageheight);
+  for (;;) {
+    unsigned int _generation;
+    {
+      std::lock_guard<std::mutex> _lock(_GameMap_tilesets.mutex);
+      std::unordered_map<std::string, GMapTileGraphs_t*>::iterator _found = _GameMap_tilesets.graphs.find(_key);
+      if (_found != _GameMap_tilesets.graphs.end() && false == reload) {
+        _found->second->refs++;
+        return _found->second;
+      }
+      _generation = _GameMap_tilesets.generation;
+    }
+
+    GMapTileGraphs_t* _graphs = new GMapTileGraphs_t();
+    _graphs->key = _key;
+    _graphs->handles.assign(tileset->tilecount + 1, 0);
+    _graphs->refs = 1;
     int Ynum = tileset->imageheight / tileset->tileheight;
     int Xnum = tileset->imagewidth / tileset->tilewidth;
-    //
-    int* handles = map->tileHandles + tileset->firstgid;
-    res = LoadDivGraph(tileset->imgPath, tileset->tilecount, Xnum, Ynum,  
-                      tileset->tilewidth, tileset->tileheight, handles);
-    if (res == -1){
-      printf("ERROR %s::line %d: can not load \"%s\"\n",
-              __func__, __LINE__, tileset->imgPath);
-      rc = 1;
+    if (-1 == LoadDivGraph(tileset->imgPath, tileset->tilecount, Xnum, Ynum,
+                           tileset->tilewidth, tileset->tileheight, _graphs->handles.data())) {
+      delete _graphs;
+      return nullptr;
+    }
+
+    std::lock_guard<std::mutex> _lock(_GameMap_tilesets.mutex);
+    //Video mode changed while loading: the handles are deleted, load again
+    if (_generation != _GameMap_tilesets.generation) {
+      delete _graphs;
+      continue;
+    }
+    std::unordered_map<std::string, GMapTileGraphs_t*>::iterator _found = _GameMap_tilesets.graphs.find(_key);
+    //Loaded by another thread meanwhile
+    if (_found != _GameMap_tilesets.graphs.end() && false == reload) {
+      _found->second->refs++;
+      _deleteGraphs(_graphs);
+      return _found->second;
+    }
+    //Maps using the old image keep it until they are freed
+    if (_found != _GameMap_tilesets.graphs.end()) {
+      GMapTileGraphs_t* _old = _found->second;
+      _GameMap_tilesets.graphs.erase(_found);
+      _old->key.clear();
+      if (_old->refs == 0)
+        _deleteGraphs(_old);
     }
+    _GameMap_tilesets.graphs[_key] = _graphs;
+    return _graphs;
+  }
+}
+
+static void _releaseGraphs(GMapTileGraphs_t* graphs)
+{
+  std::lock_guard<std::mutex> _lock(_GameMap_tilesets.mutex);
+  if (--graphs->refs > 0)
+    return;
+  if (graphs->key.empty()) {
+    _deleteGraphs(graphs);
+    return;
+  }
+  graphs->idleSince = ++_GameMap_tilesets.clock;
+  _trimIdleGraphs(_TILESETS_IDLE_MAX);
+}
+
+static void _deleteGraphs(GMapTileGraphs_t* graphs)
+{
+  for (size_t i = 0; i < graphs->handles.size(); i++)
+    if (graphs->handles[i] > 0)
+      DeleteGraph(graphs->handles[i]);
+  delete graphs;
+}
+
+//Called with the registry locked, oldest idle tilesets deleted first
+static void _trimIdleGraphs(int idleMax)
+{
+  for (;;) {
+    int _idleNum = 0;
+    std::unordered_map<std::string, GMapTileGraphs_t*>::iterator _oldest = _GameMap_tilesets.graphs.end();
+    for (std::unordered_map<std::string, GMapTileGraphs_t*>::iterator it = _GameMap_tilesets.graphs.begin();
+         it != _GameMap_tilesets.graphs.end(); ++it) {
+      if (it->second->refs > 0)
+        continue;
+      _idleNum++;
+      if (_oldest == _GameMap_tilesets.graphs.end() || it->second->idleSince < _oldest->second->idleSince)
+        _oldest = it;
+    }
+    if (_idleNum <= idleMax)
+      return;
+    GMapTileGraphs_t* _graphs = _oldest->second;
+    _GameMap_tilesets.graphs.erase(_oldest);
+    _deleteGraphs(_graphs);
   }
-  return rc;
 }
 /*******************************************************************************
 *******************************************************************************/
 void DeleteGameMapGraphs(GameMap_t* map)
 {
-  if (map->tileHandlesNum <= 0 || map->tileHandles == nullptr)
-    return;
-
-  for (int i = 0; i < map->tileHandlesNum; i++){
-    if(map->tileHandles[i] > 0)
-      DeleteGraph(map->tileHandles[i]);
+  for (int i = 0; i < map->tilesetsNum; i++) {
+    if (map->tilesets[i].graphs != nullptr)
+      _releaseGraphs(map->tilesets[i].graphs);
+    map->tilesets[i].graphs = nullptr;
   }
   free(map->tileHandles);
   map->tileHandles = nullptr;
@@ -73,37 +291,68 @@ void DeleteGameMapGraphs(GameMap_t* map)
 /*******************************************************************************
 *******************************************************************************/
 /**
-* Draw GameMap with camera position at pixel (x,y)
-*/
-
-/*
-  TODO: REWRITE AND OPTIMIZE
+* Draw GameMap with camera position at tile (x,y)
+* Only tiles on screen are visited: the loops run over the tiles the screen
+* covers, clipped to the tiles layers have (dense layers and chunk bounds)
 */
 static const int _MAP_SCREEN_SIZE_W = 640;
 static const int _MAP_SCREEN_SIZE_H = 480;
 
+//Division rounding to -infinity, camera and chunks can be at negative tiles
+static inline long long _floorDiv(long long a, long long b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
 
 void DrawGameMap(const GameMap_t* map, double x, double y)
 {
   int tw = map->tilewidth, th = map->tileheight;
   int tw2 = tw / 2, th2 = th / 2;
-  int px = -x * map->tilewidth;
-  int py = -y * map->tileheight;
-  for (int i = 0; i != map->height; i++ , py += th)
+  //Camera in pixels, tile (tx,ty) is drawn at (tx * tw - camx, ty * th - camy)
+  long long camx = (long long)floor(x * tw);
+  long long camy = (long long)floor(y * th);
+
+  //Tiles of all visible layers, [bx0,bx1) x [by0,by1)
+  long long bx0 = LLONG_MAX, by0 = LLONG_MAX, bx1 = LLONG_MIN, by1 = LLONG_MIN;
+  for (int l = 0; l != map->layersNum; l++)
   {
-    if (py < -th || py > _MAP_SCREEN_SIZE_H) continue;
-    px = -x * map->tilewidth;
-    for (int j = 0; j != map->width; j++, px += tw)
+    const GMapTilelayer_t* _layer = &map->layers[l];
+    long long x0 = 0, y0 = 0, x1 = _layer->width, y1 = _layer->height;
+    if (_layer->visible == 0) continue;
+    if (_layer->chunks != nullptr) {
+      if (_layer->chunks->blocksNum == 0) continue;
+      x0 = (long long)_layer->chunks->minx * _CHUNK_SIZE;
+      y0 = (long long)_layer->chunks->miny * _CHUNK_SIZE;
+      x1 = (long long)_layer->chunks->maxx * _CHUNK_SIZE;
+      y1 = (long long)_layer->chunks->maxy * _CHUNK_SIZE;
+    }
+    if (x0 < bx0) bx0 = x0;
+    if (y0 < by0) by0 = y0;
+    if (x1 > bx1) bx1 = x1;
+    if (y1 > by1) by1 = y1;
+  }
+  //Tiles on screen, clipped to them
+  long long tx0 = _floorDiv(camx, tw), tx1 = _floorDiv(camx + _MAP_SCREEN_SIZE_W, tw) + 1;
+  long long ty0 = _floorDiv(camy, th), ty1 = _floorDiv(camy + _MAP_SCREEN_SIZE_H, th) + 1;
+  if (tx0 < bx0) tx0 = bx0;
+  if (ty0 < by0) ty0 = by0;
+  if (tx1 > bx1) tx1 = bx1;
+  if (ty1 > by1) ty1 = by1;
+
+  for (int i = (int)ty0; i < ty1; i++)
+  {
+    int py = (int)(i * (long long)th - camy);
+    for (int j = (int)tx0; j < tx1; j++)
     {
-      if (px < -tw || px > _MAP_SCREEN_SIZE_W) continue;
+      int px = (int)(j * (long long)tw - camx);
       for (int l = 0; l != map->layersNum; l++)
       {
         if (map->layers[l].visible == 0) continue;
-        if (i >= map->layers[l].height) continue;
-        if (j >= map->layers[l].width) continue;
 
-        unsigned int ti = map->layers[l].data[i * map->width + j];
-        int _handle = map->tileHandles[ti & _GID_MASK];
+        unsigned int ti = _GameMap_layerTile(&map->layers[l], j, i);
+        unsigned int gid = ti & _GID_MASK;
+        if (gid == 0 || gid >= (unsigned int)map->tileHandlesNum) continue;
+        int _handle = map->tileHandles[gid];
         if (_handle == 0) continue;
 
         double flipY = 1;
@@ -147,3 +396,17 @@ void DrawGameMap(const GameMap_t* map, double x, double y)
   }/*for i*/
   return;
 }
+
+/*******************************************************************************/
+void DrawGameWorld(const GameMap_World_t* world, double x, double y)
+{
+  for (int i = 0; i < GameMap_getWorldMapsNum(world); i++) {
+    int mx, my, mw, mh;
+    const GameMap_t* map = GameMap_getWorldMap(world, i, &mx, &my, &mw, &mh);
+    if (map == nullptr) continue;
+    //Maps off screen
+    if (mx >= x + _MAP_SCREEN_SIZE_W || my >= y + _MAP_SCREEN_SIZE_H || mx + (double)mw <= x || my + (double)mh <= y)
+      continue;
+    DrawGameMap(map, (x - mx) / map->tilewidth, (y - my) / map->tileheight);
+  }
+}
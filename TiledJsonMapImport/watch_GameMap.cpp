@@ -0,0 +1,321 @@
+/*******************************************************************************
+ * GameMap hot reload
+ * Watches a map JSON file, its tileset images and external tileset files, and
+ * updates a loaded map in place when they change: layers that are different
+ * are replaced, tilesets keep their graphics unless they (or their image
+ * file) changed.
+ * Files are checked by size and modification time, every _WATCH_INTERVAL_MS
+ * at most (a few stat calls, no OS notification API needed)
+ * The changed map is loaded in the background (_GameMap_loadAsync(), without
+ * graphics), the frame thread only swaps the changes in and loads the changed
+ * tileset graphics.
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+
+#define _WATCH_INTERVAL_MS 250
+
+//Size and time of a watched file, when last checked
+typedef struct {
+  std::string path;
+  uint64_t size;
+  int64_t mtime;    //-1: no file
+} _WatchedFile_t;
+
+//Map reloading, until GameMap_pollAsync() calls _mapLoaded()
+typedef struct {
+  GameMap_Watch_t* watch;     //nullptr: unwatched meanwhile
+} _WatchLoad_t;
+
+struct GameMap_Watch_t {
+  std::string jsonPath;
+  std::vector<_WatchedFile_t> files;  //files[0]: JSON file, then tileset images and files
+  std::chrono::steady_clock::time_point nextCheck;
+  std::vector<std::string> changedImages; //Since the last map update
+  _WatchLoad_t* load;         //nullptr: no reload running
+  bool loaded;                //newMap and err are set
+  bool changedAgain;          //Files changed while loading, load again
+  GameMap_t* newMap;          //Without graphics, nullptr: load error
+  std::string err;
+};
+
+/*
+Private functions
+*/
+static _WatchedFile_t _statFile(const std::string& path);
+static void _addFile(GameMap_Watch_t* watch, const char* path);
+static bool _sameLayer(const GMapTilelayer_t* a, const GMapTilelayer_t* b);
+static bool _sameTilesets(const GameMap_t* a, const GameMap_t* b);
+static int _startLoad(GameMap_Watch_t* watch);
+static void _mapLoaded(GameMap_t* map, const char* path, void* userData);
+static int _applyChanges(GameMap_t* map, GameMap_t* newMap, const unsigned char* imageChanged);
+
+/*******************************************************************************/
+/**
+ * Start watching a map JSON file
+ */
+GameMap_Watch_t* GameMap_watch(const char* jsonPath)
+{
+  if (jsonPath == nullptr)
+    return nullptr;
+  GameMap_Watch_t* watch = new GameMap_Watch_t();
+  watch->jsonPath = jsonPath;
+  watch->files.push_back(_statFile(watch->jsonPath));
+  watch->nextCheck = std::chrono::steady_clock::now();
+  watch->load = nullptr;
+  watch->loaded = false;
+  watch->changedAgain = false;
+  watch->newMap = nullptr;
+  return watch;
+}
+
+/*******************************************************************************/
+/**
+ * Stop watching (a map still reloading is freed when loaded)
+ */
+void GameMap_unwatch(GameMap_Watch_t* watch)
+{
+  if (watch == nullptr)
+    return;
+  if (watch->load != nullptr)
+    watch->load->watch = nullptr;
+  GameMap_free(watch->newMap);
+  delete watch;
+}
+
+/*******************************************************************************/
+/**
+ * Update map when watched files changed: they are loaded in the background,
+ * a later call swaps the changes into map (GameMap_pollAsync() runs the load)
+ *
+ * @return 1 : map updated (map == nullptr: files changed)
+ * @return 0 : no change, or changes still loading
+ * @return -1 : files changed but the map did not load, map is unchanged
+ */
+int GameMap_pollWatch(GameMap_Watch_t* watch, GameMap_t* map)
+{
+  if (watch == nullptr)
+    return 0;
+
+  //Reload done: swap the changes in, graphics of changed images loaded again
+  if (watch->loaded) {
+    GameMap_t* _newMap = watch->newMap;
+    watch->loaded = false;
+    watch->newMap = nullptr;
+    int rc = 0; //return code
+    if (_newMap == nullptr) {
+      _GameMap_clearErrStr();
+      _GameMap_appendToErrStr(watch->err);
+      rc = -1;
+    }
+    else if (map != nullptr) {
+      std::vector<unsigned char> _imageChanged(map->tilesetsNum + 1, 0);
+      for (int i = 0; i < map->tilesetsNum; i++) {
+        if (std::find(watch->changedImages.begin(), watch->changedImages.end(), map->tilesets[i].imgPath)
+            != watch->changedImages.end())
+          _imageChanged[i] = 1;
+      }
+      rc = _applyChanges(map, _newMap, _imageChanged.data()) == 0 ? 0 : -1;
+    }
+    GameMap_free(_newMap); //frees what map had before
+    //Files changed while loading: load again (their images too)
+    if (watch->changedAgain) {
+      watch->changedAgain = false;
+      _startLoad(watch);
+    }
+    else
+      watch->changedImages.clear();
+    return rc == 0 ? 1 : -1;
+  }
+
+  std::chrono::steady_clock::time_point _now = std::chrono::steady_clock::now();
+  if (_now < watch->nextCheck)
+    return 0;
+  watch->nextCheck = _now + std::chrono::milliseconds(_WATCH_INTERVAL_MS);
+
+  //Images and external files of the tilesets the map has now are watched too
+  for (int i = 0; map != nullptr && i < map->tilesetsNum; i++) {
+    _addFile(watch, map->tilesets[i].imgPath);
+    if (map->tilesets[i].source[0] != '\0')
+      _addFile(watch, map->tilesets[i].source);
+  }
+  bool _changed = false;
+  for (size_t f = 0; f < watch->files.size(); f++) {
+    _WatchedFile_t _file = _statFile(watch->files[f].path);
+    if (_file.size == watch->files[f].size && _file.mtime == watch->files[f].mtime)
+      continue;
+    watch->files[f] = _file;
+    _changed = true;
+    if (f > 0)
+      watch->changedImages.push_back(_file.path);
+  }
+  if (false == _changed)
+    return 0;
+  if (map == nullptr) {
+    if (watch->load == nullptr)
+      watch->changedImages.clear();
+    return 1;
+  }
+
+  //Load changed map without graphics, the next calls move the differences into map
+  if (watch->load != nullptr) {
+    watch->changedAgain = true;
+    return 0;
+  }
+  return _startLoad(watch) == 0 ? 0 : -1;
+}
+
+/*******************************************************************************/
+//@return != 0 : load not started
+static int _startLoad(GameMap_Watch_t* watch)
+{
+  _WatchLoad_t* _load = new _WatchLoad_t();
+  _load->watch = watch;
+  if (0 != _GameMap_loadAsync(watch->jsonPath.c_str(), _mapLoaded, _load, false)) {
+    delete _load;
+    return -1;
+  }
+  watch->load = _load;
+  return 0;
+}
+
+//_GameMap_loadAsync() callback, the map is swapped in by the next GameMap_pollWatch()
+static void _mapLoaded(GameMap_t* map, const char*, void* userData)
+{
+  _WatchLoad_t* _load = (_WatchLoad_t*)userData;
+  GameMap_Watch_t* watch = _load->watch;
+  delete _load;
+  if (watch == nullptr) {
+    GameMap_free(map);
+    return;
+  }
+  watch->load = nullptr;
+  watch->loaded = true;
+  watch->newMap = map;
+  watch->err = map == nullptr ? GameMap_getErrStr() : "";
+}
+
+/*******************************************************************************/
+/**
+ * Swap changed parts of newMap into map, newMap is left with the old ones
+ * (newMap has no graphics, it gets the handles map does not keep)
+ *
+ * @return != 0 : error loading tileset graphics
+ */
+static int _applyChanges(GameMap_t* map, GameMap_t* newMap, const unsigned char* imageChanged)
+{
+  //Layers, one by one when both own their data, all at once when one
+  //has them in a .gmapbin mapping
+  if (map->mapping == nullptr && newMap->mapping == nullptr && map->layersNum == newMap->layersNum) {
+    for (int i = 0; i < map->layersNum; i++)
+      if (false == _sameLayer(&map->layers[i], &newMap->layers[i]))
+        std::swap(map->layers[i], newMap->layers[i]);
+  }
+  else {
+    std::swap(map->layers, newMap->layers);
+    std::swap(map->layersNum, newMap->layersNum);
+    std::swap(map->mapping, newMap->mapping);
+  }
+  std::swap(map->objects, newMap->objects);
+  std::swap(map->objectsNum, newMap->objectsNum);
+  std::swap(map->properties, newMap->properties);
+  std::swap(map->byteSize, newMap->byteSize);
+  map->width = newMap->width;
+  map->height = newMap->height;
+  map->tilewidth = newMap->tilewidth;
+  map->tileheight = newMap->tileheight;
+
+  //Tilesets, graphics only loaded for new or changed images
+  bool _imagesChanged = false;
+  for (int i = 0; i < map->tilesetsNum; i++)
+    if (imageChanged[i] != 0) _imagesChanged = true;
+  if (false == _imagesChanged && _sameTilesets(map, newMap))
+    return 0;
+  std::swap(map->tilesets, newMap->tilesets);
+  std::swap(map->tilesetsNum, newMap->tilesetsNum);
+  std::swap(map->tileHandles, newMap->tileHandles);
+  std::swap(map->tileHandlesNum, newMap->tileHandlesNum);
+  return _GameMap_reuseGraphs(map, newMap, imageChanged);
+}
+
+/*******************************************************************************/
+static bool _sameLayer(const GMapTilelayer_t* a, const GMapTilelayer_t* b)
+{
+  if (0 != strcmp(a->name, b->name) || a->id != b->id
+      || a->width != b->width || a->height != b->height
+      || a->offsetx != b->offsetx || a->offsety != b->offsety
+      || a->opacity != b->opacity || a->visible != b->visible
+      || a->startx != b->startx || a->starty != b->starty
+      || (a->chunks == nullptr) != (b->chunks == nullptr))
+    return false;
+  if (a->chunks == nullptr) {
+    //Same tiles are stored the same way
+    size_t _tilesNum = (size_t)a->width * a->height;
+    if (a->storage != b->storage || (a->flags == nullptr) != (b->flags == nullptr))
+      return false;
+    if (a->storage == _STORE_U32)
+      return _tilesNum == 0 || 0 == memcmp(a->data, b->data, _tilesNum * sizeof(unsigned int));
+    if (a->storage == _STORE_BLOCKS || a->storage == _STORE_RUNS)
+      return _GameMap_layerDataBytes(a) == _GameMap_layerDataBytes(b)
+          && 0 == memcmp(a->cells, b->cells, _GameMap_layerDataBytes(a));
+    return 0 == memcmp(a->cells, b->cells, _tilesNum * (a->storage == _STORE_U8 ? 1 : 2))
+        && (a->flags == nullptr || 0 == memcmp(a->flags, b->flags, (_tilesNum + 1) / 2));
+  }
+  //Same blocks, in any order
+  if (a->chunks->blocksNum != b->chunks->blocksNum)
+    return false;
+  for (int i = 0; i < b->chunks->blocksNum; i++) {
+    const unsigned int* _tiles = _GameMap_findChunk(a->chunks, b->chunks->coords[2 * i], b->chunks->coords[2 * i + 1]);
+    if (_tiles == nullptr
+        || 0 != memcmp(_tiles, b->chunks->tiles + (size_t)i * _CHUNK_TILES, _CHUNK_TILES * sizeof(unsigned int)))
+      return false;
+  }
+  return true;
+}
+
+/*******************************************************************************/
+static bool _sameTilesets(const GameMap_t* a, const GameMap_t* b)
+{
+  if (a->tilesetsNum != b->tilesetsNum)
+    return false;
+  for (int i = 0; i < a->tilesetsNum; i++) {
+    const GMapTileset_t* x = &a->tilesets[i];
+    const GMapTileset_t* y = &b->tilesets[i];
+    if (0 != strcmp(x->name, y->name) || 0 != strcmp(x->imgPath, y->imgPath) || 0 != strcmp(x->source, y->source)
+        || x->firstgid != y->firstgid || x->tilecount != y->tilecount
+        || x->tilewidth != y->tilewidth || x->tileheight != y->tileheight
+        || x->imagewidth != y->imagewidth || x->imageheight != y->imageheight)
+      return false;
+  }
+  return true;
+}
+
+/*******************************************************************************/
+static void _addFile(GameMap_Watch_t* watch, const char* path)
+{
+  size_t f = 1;
+  while (f < watch->files.size() && watch->files[f].path != path) f++;
+  if (f == watch->files.size())
+    watch->files.push_back(_statFile(path));
+}
+
+/*******************************************************************************/
+static _WatchedFile_t _statFile(const std::string& path)
+{
+  _WatchedFile_t _file = { path, 0, -1 };
+  if (0 != _GameMap_fileStat(path.c_str(), &_file.size, &_file.mtime)) {
+    _file.size = 0;
+    _file.mtime = -1;
+  }
+  return _file;
+}
@@ -0,0 +1,412 @@
+/*******************************************************************************
+ * GameMap worlds
+ * A Tiled .world file places maps side by side in world pixels. Only maps
+ * near the camera are loaded, in the background with GameMap_loadAsync(), and
+ * loaded maps are kept while the world fits in its byte budget (map byteSize):
+ * over it, maps away from the camera are dropped, least recently near first.
+ * Everything runs on the DxLib thread, loaded maps are handed to the world by
+ * GameMap_pollAsync().
+*******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <regex>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+//
+#include "GameMap.h"
+#include "_GameMap.h"
+#include "json11.hpp"
+
+#define _WORLD_LOADS_MAX 2          //Maps loading at once
+#define _WORLD_COORD_MAX (1 << 30)  //Max world coordinate in pixels (either sign)
+
+enum {
+  _WORLD_MAP_UNLOADED,
+  _WORLD_MAP_LOADING,
+  _WORLD_MAP_LOADED,
+  _WORLD_MAP_FAILED     //Not loaded again, see err
+};
+
+typedef struct {
+  std::string path;
+  int x, y, width, height;    //World pixels
+  int state;
+  GameMap_t* map;
+  std::string err;            //Load error
+  unsigned long long lastUse; //Last update the camera was near
+  double distance;            //From the camera, last update
+} _WorldMap_t;
+
+//Map loading, until GameMap_pollAsync() calls _mapLoaded()
+typedef struct {
+  GameMap_World_t* world;     //nullptr: world freed meanwhile
+  int index;
+} _WorldLoad_t;
+
+struct GameMap_World_t {
+  std::vector<_WorldMap_t> maps;
+  std::vector<_WorldLoad_t*> loads;
+  size_t byteBudget;
+  size_t bytes;               //byteSize of the loaded maps
+  int prefetchDistance;
+  unsigned long long clock;   //Updates count
+};
+
+/*
+JSON shape checks, compiled once
+*/
+static const json11::JsonSchema _worldSchema = json11::JsonSchema()
+  .field("maps", json11::Json::ARRAY, false)
+  .field("patterns", json11::Json::ARRAY, false);
+static const json11::JsonSchema _worldMapSchema = json11::JsonSchema()
+  .field("fileName", json11::Json::STRING)
+  .field("x", json11::Json::NUMBER).range(-_WORLD_COORD_MAX, _WORLD_COORD_MAX)
+  .field("y", json11::Json::NUMBER).range(-_WORLD_COORD_MAX, _WORLD_COORD_MAX)
+  .field("width", json11::Json::NUMBER).range(0, _WORLD_COORD_MAX)
+  .field("height", json11::Json::NUMBER).range(0, _WORLD_COORD_MAX);
+static const json11::JsonSchema _worldPatternSchema = json11::JsonSchema()
+  .field("regexp", json11::Json::STRING)
+  .field("multiplierX", json11::Json::NUMBER).range(0, _WORLD_COORD_MAX)
+  .field("multiplierY", json11::Json::NUMBER).range(0, _WORLD_COORD_MAX)
+  .field("offsetX", json11::Json::NUMBER, false).range(-_WORLD_COORD_MAX, _WORLD_COORD_MAX)
+  .field("offsetY", json11::Json::NUMBER, false).range(-_WORLD_COORD_MAX, _WORLD_COORD_MAX)
+  .field("mapWidth", json11::Json::NUMBER, false).range(0, _WORLD_COORD_MAX)
+  .field("mapHeight", json11::Json::NUMBER, false).range(0, _WORLD_COORD_MAX);
+
+/*
+Private functions
+*/
+static int _loadWorldMaps(const json11::Json& jsonWorld, GameMap_World_t* world, const std::string& worldDir);
+static int _loadWorldPatterns(const json11::Json& jsonWorld, GameMap_World_t* world, const std::string& worldDir);
+static std::vector<std::string> _listDir(const std::string& dir);
+static void _startLoads(GameMap_World_t* world);
+static void _dropMaps(GameMap_World_t* world);
+static void _unloadMap(GameMap_World_t* world, _WorldMap_t* map);
+static void _mapLoaded(GameMap_t* map, const char* path, void* userData);
+
+/*******************************************************************************/
+/**
+ * Load a Tiled .world file, its maps are loaded later by GameMap_updateWorld()
+ *
+ * @return nullptr : error loading file
+ */
+GameMap_World_t* GameMap_loadWorld(const char* worldPath, size_t byteBudget, int prefetchDistance)
+{
+  _GameMap_clearErrStr();
+  if (worldPath == nullptr)
+    return nullptr;
+
+  std::ifstream fin(worldPath);
+  std::stringstream ss;
+  ss << fin.rdbuf();
+  fin.close();
+  if (ss.str() == "") {
+    _GameMap_appendToErrStr("Can not open file: \"" + (std::string)worldPath + "\"\n");
+    return nullptr;
+  }
+  std::string errmsg;
+  json11::Json jsonWorld = json11::Json::parse(ss.str(), errmsg);
+  if (errmsg.size() != 0) {
+    _GameMap_appendToErrStr(worldPath + (std::string)"\nJSON Parse Error:" + errmsg + "\n");
+    return nullptr;
+  }
+  if (false == _worldSchema.validate(jsonWorld, errmsg)) {
+    _GameMap_appendToErrStr(worldPath + (std::string)"\nWorld Error:" + errmsg + "\n");
+    return nullptr;
+  }
+
+  GameMap_World_t* world = new GameMap_World_t();
+  world->byteBudget = byteBudget;
+  world->bytes = 0;
+  world->prefetchDistance = prefetchDistance < 0 ? 0 : prefetchDistance;
+  world->clock = 0;
+  std::string _worldDir = _GameMap_getDir(worldPath);
+  int rc = 0; //return code
+  if (rc == 0) rc = _loadWorldMaps(jsonWorld, world, _worldDir);
+  if (rc == 0) rc = _loadWorldPatterns(jsonWorld, world, _worldDir);
+  if (rc != 0) {
+    _GameMap_appendToErrStr(worldPath + (std::string)"\n");
+    delete world;
+    return nullptr;
+  }
+  return world;
+}
+
+//Maps placed one by one
+static int _loadWorldMaps(const json11::Json& jsonWorld, GameMap_World_t* world, const std::string& worldDir)
+{
+  const json11::Json::array& _maps = jsonWorld["maps"].array_items();
+  for (size_t i = 0; i < _maps.size(); i++) {
+    std::string _err;
+    if (false == _worldMapSchema.validate(_maps[i], _err)) {
+      _GameMap_appendToErrStr("World map " + std::to_string(i) + ": " + _err + "\n");
+      return -1;
+    }
+    _WorldMap_t _map = _WorldMap_t();
+    _map.path = worldDir + _maps[i]["fileName"].string_value();
+    _map.x = _maps[i]["x"].int_value();
+    _map.y = _maps[i]["y"].int_value();
+    _map.width = _maps[i]["width"].int_value();
+    _map.height = _maps[i]["height"].int_value();
+    world->maps.push_back(_map);
+  }
+  return 0;
+}
+
+//Maps of the world directory whose file name matches a pattern, placed by
+//the 2 numbers it captures: x = multiplierX * number 1 + offsetX, same for y
+static int _loadWorldPatterns(const json11::Json& jsonWorld, GameMap_World_t* world, const std::string& worldDir)
+{
+  const json11::Json::array& _patterns = jsonWorld["patterns"].array_items();
+  if (_patterns.empty())
+    return 0;
+  std::vector<std::string> _files = _listDir(worldDir);
+  for (size_t i = 0; i < _patterns.size(); i++) {
+    const json11::Json& _pattern = _patterns[i];
+    std::string _err;
+    if (false == _worldPatternSchema.validate(_pattern, _err)) {
+      _GameMap_appendToErrStr("World pattern " + std::to_string(i) + ": " + _err + "\n");
+      return -1;
+    }
+    std::regex _regexp;
+    try {
+      _regexp.assign(_pattern["regexp"].string_value(), std::regex::ECMAScript);
+    }
+    catch (const std::regex_error& e) {
+      _GameMap_appendToErrStr("World pattern " + std::to_string(i) + ": bad regexp: " + e.what() + "\n");
+      return -1;
+    }
+    long long _multiplierX = _pattern["multiplierX"].int_value(), _multiplierY = _pattern["multiplierY"].int_value();
+    long long _offsetX = _pattern["offsetX"].int_value(), _offsetY = _pattern["offsetY"].int_value();
+    int _width = _pattern["mapWidth"].is_number() ? _pattern["mapWidth"].int_value() : (int)_multiplierX;
+    int _height = _pattern["mapHeight"].is_number() ? _pattern["mapHeight"].int_value() : (int)_multiplierY;
+    for (size_t f = 0; f < _files.size(); f++) {
+      std::smatch _match;
+      if (false == std::regex_search(_files[f], _match, _regexp) || _match.size() < 3)
+        continue;
+      long long _x = _multiplierX * atoll(_match[1].str().c_str()) + _offsetX;
+      long long _y = _multiplierY * atoll(_match[2].str().c_str()) + _offsetY;
+      if (_x < -_WORLD_COORD_MAX || _x > _WORLD_COORD_MAX || _y < -_WORLD_COORD_MAX || _y > _WORLD_COORD_MAX) {
+        _GameMap_appendToErrStr("World pattern " + std::to_string(i) + ": \"" + _files[f] + "\" out of the world\n");
+        return -1;
+      }
+      _WorldMap_t _map = _WorldMap_t();
+      _map.path = worldDir + _files[f];
+      _map.x = (int)_x;
+      _map.y = (int)_y;
+      _map.width = _width;
+      _map.height = _height;
+      world->maps.push_back(_map);
+    }
+  }
+  return 0;
+}
+
+//File names of a directory, sorted
+static std::vector<std::string> _listDir(const std::string& dir)
+{
+  std::vector<std::string> _files;
+#ifdef _WIN32
+  WIN32_FIND_DATAA _found;
+  HANDLE _find = FindFirstFileA((dir + "*").c_str(), &_found);
+  if (_find != INVALID_HANDLE_VALUE) {
+    do {
+      if ((_found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        _files.push_back(_found.cFileName);
+    } while (FindNextFileA(_find, &_found));
+    FindClose(_find);
+  }
+#else
+  DIR* _dir = opendir(dir.empty() ? "." : dir.c_str());
+  if (_dir != nullptr) {
+    for (struct dirent* _entry = readdir(_dir); _entry != nullptr; _entry = readdir(_dir))
+      if (_entry->d_name[0] != '.')
+        _files.push_back(_entry->d_name);
+    closedir(_dir);
+  }
+#endif
+  std::sort(_files.begin(), _files.end());
+  return _files;
+}
+
+/*******************************************************************************/
+/**
+ * Free world and its loaded maps (maps still loading are freed when loaded)
+ */
+void GameMap_freeWorld(GameMap_World_t* world)
+{
+  if (world == nullptr)
+    return;
+  for (size_t i = 0; i < world->loads.size(); i++)
+    world->loads[i]->world = nullptr;
+  for (size_t i = 0; i < world->maps.size(); i++)
+    GameMap_free(world->maps[i].map);
+  delete world;
+}
+
+/*******************************************************************************/
+/**
+ * Move the camera to world pixel (x,y): start loading the maps near it,
+ * drop maps away from it while over the byte budget
+ *
+ * @return number of maps loading
+ */
+int GameMap_updateWorld(GameMap_World_t* world, double x, double y)
+{
+  if (world == nullptr)
+    return 0;
+  world->clock++;
+  for (size_t i = 0; i < world->maps.size(); i++) {
+    _WorldMap_t* _map = &world->maps[i];
+    double _dx = std::max(std::max(_map->x - x, 0.0), x - ((double)_map->x + _map->width));
+    double _dy = std::max(std::max(_map->y - y, 0.0), y - ((double)_map->y + _map->height));
+    _map->distance = sqrt(_dx * _dx + _dy * _dy);
+    if (_map->distance <= world->prefetchDistance)
+      _map->lastUse = world->clock;
+  }
+  _startLoads(world);
+  _dropMaps(world);
+  return (int)world->loads.size();
+}
+
+//Nearest maps first
+static void _startLoads(GameMap_World_t* world)
+{
+  while (world->loads.size() < _WORLD_LOADS_MAX) {
+    int _nearest = -1;
+    for (size_t i = 0; i < world->maps.size(); i++) {
+      const _WorldMap_t* _map = &world->maps[i];
+      if (_map->state != _WORLD_MAP_UNLOADED || _map->lastUse != world->clock)
+        continue;
+      if (_nearest < 0 || _map->distance < world->maps[_nearest].distance)
+        _nearest = (int)i;
+    }
+    if (_nearest < 0)
+      return;
+    _WorldMap_t* _map = &world->maps[_nearest];
+    _WorldLoad_t* _load = new _WorldLoad_t();
+    _load->world = world;
+    _load->index = _nearest;
+    if (0 != GameMap_loadAsync(_map->path.c_str(), _mapLoaded, _load)) {
+      delete _load;
+      _map->state = _WORLD_MAP_FAILED;
+      _map->err = GameMap_getErrStr();
+      continue;
+    }
+    _map->state = _WORLD_MAP_LOADING;
+    world->loads.push_back(_load);
+  }
+}
+
+//Least recently near maps first, then the farthest, maps near the camera are kept
+static void _dropMaps(GameMap_World_t* world)
+{
+  while (world->bytes > world->byteBudget) {
+    _WorldMap_t* _drop = nullptr;
+    for (size_t i = 0; i < world->maps.size(); i++) {
+      _WorldMap_t* _map = &world->maps[i];
+      if (_map->state != _WORLD_MAP_LOADED || _map->lastUse == world->clock)
+        continue;
+      if (_drop == nullptr || _map->lastUse < _drop->lastUse
+          || (_map->lastUse == _drop->lastUse && _map->distance > _drop->distance))
+        _drop = _map;
+    }
+    if (_drop == nullptr)
+      return;
+    _unloadMap(world, _drop);
+  }
+}
+
+static void _unloadMap(GameMap_World_t* world, _WorldMap_t* map)
+{
+  world->bytes -= map->map->byteSize;
+  GameMap_free(map->map);
+  map->map = nullptr;
+  map->state = _WORLD_MAP_UNLOADED;
+}
+
+//GameMap_loadAsync() callback
+static void _mapLoaded(GameMap_t* map, const char*, void* userData)
+{
+  _WorldLoad_t* _load = (_WorldLoad_t*)userData;
+  GameMap_World_t* world = _load->world;
+  if (world == nullptr) {
+    GameMap_free(map);
+    delete _load;
+    return;
+  }
+  world->loads.erase(std::find(world->loads.begin(), world->loads.end(), _load));
+  _WorldMap_t* _map = &world->maps[_load->index];
+  delete _load;
+  if (map == nullptr) {
+    _map->state = _WORLD_MAP_FAILED;
+    _map->err = GameMap_getErrStr();
+    return;
+  }
+  _map->map = map;
+  _map->state = _WORLD_MAP_LOADED;
+  world->bytes += map->byteSize;
+}
+
+/*******************************************************************************/
+int GameMap_getWorldMapsNum(const GameMap_World_t* world)
+{
+  return world == nullptr ? 0 : (int)world->maps.size();
+}
+
+/*******************************************************************************/
+/**
+ * Map index of world, nullptr while not loaded
+ * (x,y,w,h): its place in world pixels (pointers may be nullptr)
+ */
+GameMap_t* GameMap_getWorldMap(const GameMap_World_t* world, int index, int* x, int* y, int* w, int* h)
+{
+  if (world == nullptr || index < 0 || index >= (int)world->maps.size())
+    return nullptr;
+  const _WorldMap_t* _map = &world->maps[index];
+  if (x != nullptr) *x = _map->x;
+  if (y != nullptr) *y = _map->y;
+  if (w != nullptr) *w = _map->width;
+  if (h != nullptr) *h = _map->height;
+  return _map->map;
+}
+
+/*******************************************************************************/
+/**
+ * Index of the map at world pixel (x,y), the last one in file order when
+ * maps overlap
+ *
+ * @return -1 : no map there
+ */
+int GameMap_findWorldMap(const GameMap_World_t* world, double x, double y)
+{
+  if (world == nullptr)
+    return -1;
+  for (int i = (int)world->maps.size() - 1; i >= 0; i--) {
+    const _WorldMap_t* _map = &world->maps[i];
+    if (x >= _map->x && y >= _map->y && x < (double)_map->x + _map->width && y < (double)_map->y + _map->height)
+      return i;
+  }
+  return -1;
+}
+
+/*******************************************************************************/
+/**
+ * Load error of map index, "" when it did not fail
+ */
+const char* GameMap_getWorldMapErr(const GameMap_World_t* world, int index)
+{
+  if (world == nullptr || index < 0 || index >= (int)world->maps.size())
+    return "";
+  return world->maps[index].err.c_str();
+}
@@ -0,0 +1,344 @@
+/*
+ * json11 benchmark on Tiled-style map documents.
+ *
+ * Generates synthetic Tiled JSON maps (square maps from 16x16 up to 4096x4096, 1 to 32 tile
+ * layers, with and without flip flags in the GIDs, pretty-printed and minified) and reports,
+ * for Json::parse (also with JsonParse::RAW_NUMBERS), Json::parse_multi and Json::dump:
+ *   - throughput in MB/s of JSON text,
+ *   - heap allocations per document,
+ *   - peak resident set size while running the case.
+ * Any map files given on the command line are measured too; by default the demo map
+ * ../../TiledJsonMapImport/map.json is used when it can be found.
+ *
+ * Build (from this directory):
+ *     g++ -std=c++11 -O2 json11.cpp bench.cpp -o bench
+ *     cl /EHsc /O2 json11.cpp bench.cpp
+ *
+ * Usage:
+ *     bench [--max-tiles N] [--min-time SECONDS] [map.json ...]
+ *
+ * Documents with more than --max-tiles tiles in total (default 16M) are skipped, so the
+ * 4096x4096x32 case only runs when asked for explicitly.
+ */
+
+#include "json11.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace json11;
+using std::string;
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Allocation counting
+ */
+
+static size_t alloc_count = 0;
+
+void * operator new(size_t size) {
+    alloc_count++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void * operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Peak RSS
+ */
+
+// Reset the peak RSS high-water mark where the OS allows it (Linux), so every case reports
+// its own peak. Elsewhere the peak only grows over the run.
+static void reset_peak_rss() {
+#if defined(__linux__)
+    if (FILE *f = std::fopen("/proc/self/clear_refs", "w")) {
+        std::fputs("5", f);
+        std::fclose(f);
+    }
+#endif
+}
+
+static double peak_rss_mb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc))
+        return pmc.PeakWorkingSetSize / (1024.0 * 1024.0);
+    return 0;
+#else
+#if defined(__linux__)
+    if (FILE *f = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        long kb = -1;
+        while (std::fgets(line, sizeof line, f))
+            if (std::sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+                break;
+        std::fclose(f);
+        if (kb >= 0)
+            return kb / 1024.0;
+    }
+#endif
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Synthetic Tiled maps
+ */
+
+struct MapSpec {
+    int size;       // width == height
+    int layers;
+    bool flags;     // set Tiled's flip bits on some GIDs (values above INT_MAX)
+    bool pretty;    // Tiled's pretty layout, otherwise minified
+};
+
+static uint32_t xorshift(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static string generate_map(const MapSpec &spec) {
+    const char *nl = spec.pretty ? "\n" : "";
+    const char *in1 = spec.pretty ? " " : "";
+    const char *in2 = spec.pretty ? "        " : "";
+    const char *in3 = spec.pretty ? "         " : "";
+    const char *sep = spec.pretty ? ", " : ",";
+    const size_t tiles = static_cast<size_t>(spec.size) * spec.size;
+    uint32_t rng = 2463534242u;
+
+    string out;
+    out.reserve(tiles * spec.layers * (spec.flags ? 6 : 4) + 4096);
+    char buf[64];
+    out += "{";
+    out += spec.pretty ? " " : "";
+    out += "\"compressionlevel\":-1,"; out += nl;
+    std::snprintf(buf, sizeof buf, "%s\"height\":%d,%s", in1, spec.size, nl); out += buf;
+    out += in1; out += "\"infinite\":false,"; out += nl;
+    out += in1; out += "\"layers\":["; out += nl;
+    for (int l = 0; l < spec.layers; l++) {
+        out += in2; out += "{"; out += nl;
+        out += in3; out += "\"data\":[";
+        for (size_t t = 0; t < tiles; t++) {
+            const uint32_t r = xorshift(rng);
+            // Mostly zeros on upper layers, like real decoration layers.
+            uint32_t gid = (l == 0 || (r & 3) == 0) ? 1 + (r >> 8) % 20 : 0;
+            if (spec.flags && gid != 0 && (r & 0x70) == 0)
+                gid |= (r & 0x80000000u) | ((r << 1) & 0x40000000u) | 0x20000000u;
+            if (t != 0)
+                out += sep;
+            std::snprintf(buf, sizeof buf, "%u", gid);
+            out += buf;
+        }
+        out += "],"; out += nl;
+        std::snprintf(buf, sizeof buf, "%s\"height\":%d,%s", in3, spec.size, nl); out += buf;
+        std::snprintf(buf, sizeof buf, "%s\"id\":%d,%s", in3, l + 1, nl); out += buf;
+        std::snprintf(buf, sizeof buf, "%s\"name\":\"Tile Layer %d\",%s", in3, l + 1, nl); out += buf;
+        out += in3; out += "\"opacity\":1,"; out += nl;
+        out += in3; out += "\"type\":\"tilelayer\","; out += nl;
+        out += in3; out += "\"visible\":true,"; out += nl;
+        std::snprintf(buf, sizeof buf, "%s\"width\":%d,%s", in3, spec.size, nl); out += buf;
+        out += in3; out += "\"x\":0,"; out += nl;
+        out += in3; out += "\"y\":0"; out += nl;
+        out += in2; out += (l + 1 == spec.layers) ? "}" : "}, "; out += nl;
+    }
+    out += in1; out += "],"; out += nl;
+    std::snprintf(buf, sizeof buf, "%s\"nextlayerid\":%d,%s", in1, spec.layers + 1, nl); out += buf;
+    out += in1; out += "\"nextobjectid\":1,"; out += nl;
+    out += in1; out += "\"orientation\":\"orthogonal\","; out += nl;
+    out += in1; out += "\"renderorder\":\"right-down\","; out += nl;
+    out += in1; out += "\"tiledversion\":\"1.8.2\","; out += nl;
+    out += in1; out += "\"tileheight\":80,"; out += nl;
+    out += in1; out += "\"tilesets\":["; out += nl;
+    out += in2; out += "{"; out += nl;
+    out += in3; out += "\"columns\":5,"; out += nl;
+    out += in3; out += "\"firstgid\":1,"; out += nl;
+    out += in3; out += "\"image\":\"tileset.png\","; out += nl;
+    out += in3; out += "\"imageheight\":320,"; out += nl;
+    out += in3; out += "\"imagewidth\":400,"; out += nl;
+    out += in3; out += "\"margin\":0,"; out += nl;
+    out += in3; out += "\"name\":\"tileset\","; out += nl;
+    out += in3; out += "\"spacing\":0,"; out += nl;
+    out += in3; out += "\"tilecount\":20,"; out += nl;
+    out += in3; out += "\"tileheight\":80,"; out += nl;
+    out += in3; out += "\"tilewidth\":80"; out += nl;
+    out += in2; out += "}]"; out += ","; out += nl;
+    out += in1; out += "\"tilewidth\":80,"; out += nl;
+    out += in1; out += "\"type\":\"map\","; out += nl;
+    out += in1; out += "\"version\":\"1.8\","; out += nl;
+    std::snprintf(buf, sizeof buf, "%s\"width\":%d%s", in1, spec.size, nl); out += buf;
+    out += "}";
+    return out;
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Measurement
+ */
+
+struct Result {
+    double mb_per_s;
+    double allocs_per_doc;
+    double peak_rss_mb;
+};
+
+static double min_time = 0.5;
+
+// Run op() until min_time has passed (at least once). op returns the number of bytes of JSON
+// text it processed and the number of documents in it.
+template <typename Op>
+static Result measure(Op op) {
+    typedef std::chrono::steady_clock clock;
+    reset_peak_rss();
+    size_t bytes = 0, docs = 0, allocs = 0;
+    const auto start = clock::now();
+    double elapsed = 0;
+    do {
+        size_t op_docs = 0;
+        const size_t allocs_before = alloc_count;
+        bytes += op(op_docs);
+        allocs += alloc_count - allocs_before;
+        docs += op_docs;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < min_time);
+    Result res;
+    res.mb_per_s = bytes / (1024.0 * 1024.0) / elapsed;
+    res.allocs_per_doc = docs ? static_cast<double>(allocs) / docs : 0;
+    res.peak_rss_mb = peak_rss_mb();
+    return res;
+}
+
+static void print_result(const string &name, const char *op, size_t bytes, const Result &res) {
+    std::printf("%-34s %-11s %10.2f MB %10.1f MB/s %12.0f allocs/doc %9.1f MB peak RSS\n",
+                name.c_str(), op, bytes / (1024.0 * 1024.0),
+                res.mb_per_s, res.allocs_per_doc, res.peak_rss_mb);
+    std::fflush(stdout);
+}
+
+static void bench_document(const string &name, const string &text) {
+    string err;
+    const Json doc = Json::parse(text, err);
+    if (!err.empty()) {
+        std::printf("%-34s parse error: %s\n", name.c_str(), err.c_str());
+        return;
+    }
+
+    print_result(name, "parse", text.size(), measure([&](size_t &docs) {
+        string err;
+        Json json = Json::parse(text, err);
+        docs = 1;
+        return text.size();
+    }));
+
+    print_result(name, "parse raw", text.size(), measure([&](size_t &docs) {
+        string err;
+        Json json = Json::parse(text, err, JsonParse::RAW_NUMBERS);
+        docs = 1;
+        return text.size();
+    }));
+
+    // parse_multi over the same document concatenated a few times, as in a stream of maps.
+    static const int multi_count = 4;
+    string multi;
+    multi.reserve((text.size() + 1) * multi_count);
+    for (int i = 0; i < multi_count; i++) {
+        multi += text;
+        multi += '\n';
+    }
+    print_result(name, "parse_multi", multi.size(), measure([&](size_t &docs) {
+        string err;
+        std::vector<Json> jsons = Json::parse_multi(multi, err);
+        docs = jsons.size();
+        return multi.size();
+    }));
+
+    size_t dump_size = doc.dump().size();
+    print_result(name, "dump", dump_size, measure([&](size_t &docs) {
+        string out;
+        doc.dump(out);
+        docs = 1;
+        return out.size();
+    }));
+}
+
+static bool read_file(const string &path, string &out) {
+    std::ifstream fin(path.c_str(), std::ios::binary);
+    if (!fin)
+        return false;
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    out = ss.str();
+    return true;
+}
+
+int main(int argc, char **argv) {
+    size_t max_tiles = 16 * 1024 * 1024;
+    std::vector<string> files;
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if (arg == "--max-tiles" && i + 1 < argc) {
+            max_tiles = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            min_time = std::atof(argv[++i]);
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty())
+        files.push_back("../../TiledJsonMapImport/map.json");
+
+    for (const auto &path : files) {
+        string text;
+        if (!read_file(path, text)) {
+            std::printf("%-34s can not open file\n", path.c_str());
+            continue;
+        }
+        bench_document(path, text);
+    }
+
+    static const int sizes[] = { 16, 256, 1024, 4096 };
+    static const int layer_counts[] = { 1, 8, 32 };
+    for (int size : sizes) {
+        for (int layers : layer_counts) {
+            if (static_cast<size_t>(size) * size * layers > max_tiles)
+                continue;
+            for (int flags = 0; flags < 2; flags++) {
+                for (int pretty = 0; pretty < 2; pretty++) {
+                    const MapSpec spec { size, layers, flags != 0, pretty != 0 };
+                    char name[64];
+                    std::snprintf(name, sizeof name, "%dx%d x%d%s%s", size, size, layers,
+                                  flags ? " flags" : "", pretty ? " pretty" : " min");
+                    bench_document(name, generate_map(spec));
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -20,10 +20,13 @@
  */
 
 #include "json11.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <limits>
 
 namespace json11 {
@@ -70,6 +73,12 @@ static void dump(int value, string &out) {
     out += buf;
 }
 
+static void dump(int64_t value, string &out) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%lld", static_cast<long long>(value));
+    out += buf;
+}
+
 static void dump(bool value, string &out) {
     out += value ? "true" : "false";
 }
@@ -111,19 +120,9 @@ static void dump(const string &value, string &out) {
     out += '"';
 }
 
-static void dump(const Json::array &values, string &out) {
-    bool first = true;
-    out += "[";
-    for (const auto &value : values) {
-        if (!first)
-            out += ", ";
-        value.dump(out);
-        first = false;
-    }
-    out += "]";
-}
+static void dump(const Json::array &values, string &out, size_t row_length);
 
-static void dump(const Json::object &values, string &out) {
+static void dump(const Json::object &values, string &out, size_t row_length) {
     bool first = true;
     out += "{";
     for (const auto &kv : values) {
@@ -131,14 +130,120 @@ static void dump(const Json::object &values, string &out) {
             out += ", ";
         dump(kv.first, out);
         out += ": ";
-        kv.second.dump(out);
+        kv.second.dump(out, row_length);
         first = false;
     }
     out += "}";
 }
 
+// Scalars have no rows to break.
+template <typename T>
+static void dump(const T &value, string &out, size_t) {
+    dump(value, out);
+}
+
 void Json::dump(string &out) const {
-    m_ptr->dump(out);
+    m_ptr->dump(out, 0);
+}
+
+void Json::dump(string &out, size_t row_length) const {
+    m_ptr->dump(out, row_length);
+}
+
+/* IntArrayWriter
+ *
+ * Writes a JSON array whose items are mostly integers. Integers are formatted two digits at a
+ * time from a table into a local chunk, which is appended to the output whenever it fills up,
+ * so a large tile layer costs one append per few thousand items instead of a snprintf each.
+ */
+static const char digit_pairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+class IntArrayWriter final {
+public:
+    IntArrayWriter(string &out, size_t row_length, size_t size_hint, bool brackets = true)
+        : m_out(out), m_row_length(row_length), m_brackets(brackets) {
+        m_out.reserve(m_out.size() + size_hint * 4 + 2);
+        if (m_brackets)
+            m_buf[m_used++] = '[';
+    }
+
+    void put(int64_t value) {
+        separator();
+        char digits[24];
+        char *end = digits + sizeof digits;
+        uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        char *p = end;
+        while (magnitude >= 100) {
+            p -= 2;
+            std::memcpy(p, digit_pairs + 2 * (magnitude % 100), 2);
+            magnitude /= 100;
+        }
+        if (magnitude >= 10) {
+            p -= 2;
+            std::memcpy(p, digit_pairs + 2 * magnitude, 2);
+        } else {
+            *--p = static_cast<char>('0' + magnitude);
+        }
+        if (value < 0)
+            *--p = '-';
+        room(static_cast<size_t>(end - p));
+        std::memcpy(m_buf + m_used, p, static_cast<size_t>(end - p));
+        m_used += static_cast<size_t>(end - p);
+    }
+
+    void put(const Json &value, size_t row_length) {
+        separator();
+        flush();
+        value.dump(m_out, row_length);
+    }
+
+    void finish() {
+        room(1);
+        if (m_brackets)
+            m_buf[m_used++] = ']';
+        flush();
+    }
+
+private:
+    void separator() {
+        if (m_count++ == 0)
+            return;
+        room(2);
+        m_buf[m_used++] = ',';
+        if (m_row_length != 0 && ++m_column == m_row_length) {
+            m_column = 0;
+            m_buf[m_used++] = '\n';
+        } else {
+            m_buf[m_used++] = ' ';
+        }
+    }
+
+    void room(size_t n) {
+        if (m_used + n > sizeof m_buf)
+            flush();
+    }
+
+    void flush() {
+        m_out.append(m_buf, m_used);
+        m_used = 0;
+    }
+
+    string &m_out;
+    const size_t m_row_length;
+    const bool m_brackets;
+    size_t m_count = 0;
+    size_t m_column = 0;
+    size_t m_used = 0;
+    char m_buf[4096];
+};
+
+void Json::dump_array(const uint32_t *values, size_t count, string &out, size_t row_length, bool brackets) {
+    IntArrayWriter writer(out, count > row_length ? row_length : 0, count, brackets);
+    for (size_t i = 0; i < count; i++)
+        writer.put(static_cast<int64_t>(values[i]));
+    writer.finish();
 }
 
 /* * * * * * * * * * * * * * * * * * * *
@@ -167,12 +272,32 @@ protected:
     }
 
     const T m_value;
-    void dump(string &out) const override { json11::dump(m_value, out); }
+    void dump(string &out, size_t row_length) const override { json11::dump(m_value, out, row_length); }
 };
 
+// double to int64_t, clamped to its range (NaN gives 0): a plain cast is undefined out of range.
+static int64_t clamp_int64(double value) {
+    if (!(value == value))
+        return 0;
+    if (value >= 9223372036854775807.0)
+        return std::numeric_limits<int64_t>::max();
+    if (value <= -9223372036854775808.0)
+        return std::numeric_limits<int64_t>::min();
+    return static_cast<int64_t>(value);
+}
+
 class JsonDouble final : public Value<Json::NUMBER, double> {
+    // "%.17g" writes integral values below 1e17 as plain digits.
+    bool integer(int64_t &value) const override {
+        if (!(std::fabs(m_value) < 1e17) || m_value != std::floor(m_value) || std::signbit(m_value))
+            return false;
+        value = static_cast<int64_t>(m_value);
+        return true;
+    }
     double number_value() const override { return m_value; }
     int int_value() const override { return static_cast<int>(m_value); }
+    int64_t int64_value() const override { return clamp_int64(m_value); }
+    uint32_t uint32_value() const override { return static_cast<uint32_t>(clamp_int64(m_value)); }
     bool equals(const JsonValue * other) const override { return m_value == other->number_value(); }
     bool less(const JsonValue * other)   const override { return m_value <  other->number_value(); }
 public:
@@ -180,14 +305,62 @@ public:
 };
 
 class JsonInt final : public Value<Json::NUMBER, int> {
+    bool integer(int64_t &value) const override { value = m_value; return true; }
     double number_value() const override { return m_value; }
     int int_value() const override { return m_value; }
+    int64_t int64_value() const override { return m_value; }
+    uint32_t uint32_value() const override { return static_cast<uint32_t>(m_value); }
     bool equals(const JsonValue * other) const override { return m_value == other->number_value(); }
     bool less(const JsonValue * other)   const override { return m_value <  other->number_value(); }
 public:
     explicit JsonInt(int value) : Value(value) {}
 };
 
+// Integers parsed with JsonParse::RAW_NUMBERS that do not fit an int.
+class JsonInt64 final : public Value<Json::NUMBER, int64_t> {
+    bool integer(int64_t &value) const override { value = m_value; return true; }
+    double number_value() const override { return static_cast<double>(m_value); }
+    int int_value() const override { return static_cast<int>(m_value); }
+    int64_t int64_value() const override { return m_value; }
+    uint32_t uint32_value() const override { return static_cast<uint32_t>(m_value); }
+    bool equals(const JsonValue * other) const override { return number_value() == other->number_value(); }
+    bool less(const JsonValue * other)   const override { return number_value() <  other->number_value(); }
+public:
+    explicit JsonInt64(int64_t value) : Value(value) {}
+
+    static Json make(int64_t value) {
+        return Json(std::make_shared<JsonInt64>(value));
+    }
+};
+
+/* JsonRawNumber
+ *
+ * A number parsed with JsonParse::RAW_NUMBERS that is not a plain integer: its own copy of its
+ * text, converted each time it is read. Not caching the conversion keeps the value immutable,
+ * so parsed trees can still be shared between threads.
+ */
+class JsonRawNumber final : public JsonValue {
+public:
+    JsonRawNumber(const char *text, size_t len) : m_text(text, len) {}
+
+    static Json make(const char *text, size_t len) {
+        return Json(std::make_shared<JsonRawNumber>(text, len));
+    }
+
+private:
+    Json::Type type() const override { return Json::NUMBER; }
+    bool equals(const JsonValue * other) const override { return number_value() == other->number_value(); }
+    bool less(const JsonValue * other)   const override { return number_value() <  other->number_value(); }
+    void dump(string &out, size_t) const override { out += m_text; }
+
+    double number_value() const override { return std::strtod(m_text.c_str(), nullptr); }
+    int int_value() const override { return static_cast<int>(int64_value()); }
+    uint32_t uint32_value() const override { return static_cast<uint32_t>(int64_value()); }
+    int64_t int64_value() const override { return clamp_int64(number_value()); }
+
+    const string m_text;
+};
+
 class JsonBoolean final : public Value<Json::BOOL, bool> {
     bool bool_value() const override { return m_value; }
 public:
@@ -205,6 +378,7 @@ class JsonArray final : public Value<Json::ARRAY, Json::array> {
     const Json::array &array_items() const override { return m_value; }
     const Json & operator[](size_t i) const override;
 public:
+    static void dump_items(const Json::array &values, string &out, size_t row_length);
     explicit JsonArray(const Json::array &value) : Value(value) {}
     explicit JsonArray(Json::array &&value)      : Value(move(value)) {}
 };
@@ -212,9 +386,32 @@ public:
 class JsonObject final : public Value<Json::OBJECT, Json::object> {
     const Json::object &object_items() const override { return m_value; }
     const Json & operator[](const string &key) const override;
+    const Json & operator[](const Json::Key &key) const override;
+
+    /* Index
+     *
+     * Open-addressing (linear probing) hash table over the items of m_value, which never
+     * changes after construction. Built on the first lookup of an object with at least
+     * index_min_size items; smaller objects are faster to search with m_value.find().
+     */
+    struct Index {
+        struct Slot {
+            size_t hash;
+            const Json::object::value_type *item;   // nullptr: empty slot
+        };
+        vector<Slot> slots;
+        size_t mask;
+    };
+    static const size_t index_min_size = 8;
+
+    const Index & index() const;
+    const Json & find(const string &key, size_t hash) const;
+
+    mutable std::atomic<const Index *> m_index { nullptr };
 public:
     explicit JsonObject(const Json::object &value) : Value(value) {}
     explicit JsonObject(Json::object &&value)      : Value(move(value)) {}
+    ~JsonObject() { delete m_index.load(std::memory_order_relaxed); }
 };
 
 class JsonNull final : public Value<Json::NUL, NullStruct> {
@@ -222,6 +419,27 @@ public:
     JsonNull() : Value({}) {}
 };
 
+void JsonArray::dump_items(const Json::array &values, string &out, size_t row_length) {
+    int64_t value;
+    // Only arrays made of integers alone are broken into rows.
+    bool wrap = row_length != 0 && values.size() > row_length;
+    for (size_t i = 0; wrap && i < values.size(); i++)
+        wrap = values[i].m_ptr->integer(value);
+
+    IntArrayWriter writer(out, wrap ? row_length : 0, values.size());
+    for (const auto &item : values) {
+        if (item.m_ptr->integer(value))
+            writer.put(value);
+        else
+            writer.put(item, row_length);
+    }
+    writer.finish();
+}
+
+static void dump(const Json::array &values, string &out, size_t row_length) {
+    JsonArray::dump_items(values, out, row_length);
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Static globals - static-init-safe
  */
@@ -270,26 +488,78 @@ Json::Json(Json::object &&values)      : m_ptr(make_shared<JsonObject>(move(valu
 Json::Type Json::type()                           const { return m_ptr->type();         }
 double Json::number_value()                       const { return m_ptr->number_value(); }
 int Json::int_value()                             const { return m_ptr->int_value();    }
+int64_t Json::int64_value()                       const { return m_ptr->int64_value();  }
+uint32_t Json::uint32_value()                     const { return m_ptr->uint32_value(); }
 bool Json::bool_value()                           const { return m_ptr->bool_value();   }
 const string & Json::string_value()               const { return m_ptr->string_value(); }
 const vector<Json> & Json::array_items()          const { return m_ptr->array_items();  }
 const map<string, Json> & Json::object_items()    const { return m_ptr->object_items(); }
 const Json & Json::operator[] (size_t i)          const { return (*m_ptr)[i];           }
 const Json & Json::operator[] (const string &key) const { return (*m_ptr)[key];         }
+const Json & Json::operator[] (const Key &key)    const { return (*m_ptr)[key];         }
 
 double                    JsonValue::number_value()              const { return 0; }
 int                       JsonValue::int_value()                 const { return 0; }
+int64_t                   JsonValue::int64_value()               const { return 0; }
+bool                      JsonValue::integer(int64_t &)          const { return false; }
+uint32_t                  JsonValue::uint32_value()              const { return 0; }
 bool                      JsonValue::bool_value()                const { return false; }
 const string &            JsonValue::string_value()              const { return statics().empty_string; }
 const vector<Json> &      JsonValue::array_items()               const { return statics().empty_vector; }
 const map<string, Json> & JsonValue::object_items()              const { return statics().empty_map; }
 const Json &              JsonValue::operator[] (size_t)         const { return static_null(); }
 const Json &              JsonValue::operator[] (const string &) const { return static_null(); }
+const Json &              JsonValue::operator[] (const Json::Key &) const { return static_null(); }
 
 const Json & JsonObject::operator[] (const string &key) const {
+    if (m_value.size() >= index_min_size)
+        return find(key, std::hash<string>()(key));
     auto iter = m_value.find(key);
     return (iter == m_value.end()) ? static_null() : iter->second;
 }
+
+const Json & JsonObject::operator[] (const Json::Key &key) const {
+    if (m_value.size() >= index_min_size)
+        return find(key.str(), key.hash());
+    auto iter = m_value.find(key.str());
+    return (iter == m_value.end()) ? static_null() : iter->second;
+}
+
+const Json & JsonObject::find(const string &key, size_t hash) const {
+    const Index &idx = index();
+    for (size_t i = hash & idx.mask; idx.slots[i].item != nullptr; i = (i + 1) & idx.mask) {
+        const Index::Slot &slot = idx.slots[i];
+        if (slot.hash == hash && slot.item->first == key)
+            return slot.item->second;
+    }
+    return static_null();
+}
+
+// Lock-free lazy construction: threads racing to build the index all build one, the first to
+// publish it wins and the others throw theirs away.
+const JsonObject::Index & JsonObject::index() const {
+    const Index *idx = m_index.load(std::memory_order_acquire);
+    if (idx != nullptr)
+        return *idx;
+
+    size_t capacity = 16;
+    while (capacity < m_value.size() * 2)
+        capacity *= 2;
+    Index *built = new Index { vector<Index::Slot>(capacity, Index::Slot { 0, nullptr }), capacity - 1 };
+    const std::hash<string> hasher;
+    for (const auto &item : m_value) {
+        const size_t hash = hasher(item.first);
+        size_t i = hash & built->mask;
+        while (built->slots[i].item != nullptr)
+            i = (i + 1) & built->mask;
+        built->slots[i] = Index::Slot { hash, &item };
+    }
+
+    if (m_index.compare_exchange_strong(idx, built, std::memory_order_acq_rel))
+        return *built;
+    delete built;
+    return *idx;
+}
 const Json & JsonArray::operator[] (size_t i) const {
     if (i >= m_value.size()) return static_null();
     else return m_value[i];
@@ -339,6 +609,29 @@ static inline bool in_range(long x, long lower, long upper) {
     return (x >= lower && x <= upper);
 }
 
+/* parse_int64(p, end, value)
+ *
+ * Convert the already validated integer text [p, end) to value. Return false if it does not
+ * fit an int64_t, or is "-0", which would not dump back the same.
+ */
+static bool parse_int64(const char *p, const char *end, int64_t &value) {
+    const bool negative = (*p == '-');
+    if (negative)
+        p++;
+    const uint64_t limit = negative ? uint64_t(1) << 63 : (uint64_t(1) << 63) - 1;
+    uint64_t magnitude = 0;
+    for (; p != end; p++) {
+        const uint64_t digit = static_cast<uint64_t>(*p - '0');
+        if (magnitude > (limit - digit) / 10)
+            return false;
+        magnitude = magnitude * 10 + digit;
+    }
+    if (negative && magnitude == 0)
+        return false;
+    value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    return true;
+}
+
 namespace {
 /* JsonParser
  *
@@ -423,7 +716,7 @@ struct JsonParser final {
      */
     void consume_garbage() {
       consume_whitespace();
-      if(strategy == JsonParse::COMMENTS) {
+      if(strategy & JsonParse::COMMENTS) {
         bool comment_found = false;
         do {
           comment_found = consume_comment();
@@ -568,7 +861,7 @@ struct JsonParser final {
 
     /* parse_number()
      *
-     * Parse a double.
+     * Parse a double. With RAW_NUMBERS, parse integers exactly and keep the text of others.
      */
     Json parse_number() {
         size_t start_pos = i;
@@ -589,9 +882,16 @@ struct JsonParser final {
             return fail("invalid " + esc(str[i]) + " in number");
         }
 
-        if (str[i] != '.' && str[i] != 'e' && str[i] != 'E'
-                && (i - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10)) {
-            return std::atoi(str.c_str() + start_pos);
+        const bool raw = (strategy & JsonParse::RAW_NUMBERS) != 0;
+        if (str[i] != '.' && str[i] != 'e' && str[i] != 'E') {
+            if (!raw && (i - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10))
+                return std::atoi(str.c_str() + start_pos);
+            int64_t value;
+            if (raw && parse_int64(str.c_str() + start_pos, str.c_str() + i, value)) {
+                if (value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max())
+                    return static_cast<int>(value);
+                return JsonInt64::make(value);
+            }
         }
 
         // Decimal part
@@ -618,6 +918,8 @@ struct JsonParser final {
                 i++;
         }
 
+        if (raw)
+            return JsonRawNumber::make(str.c_str() + start_pos, i - start_pos);
         return std::strtod(str.c_str() + start_pos, nullptr);
     }
 
@@ -769,17 +1071,36 @@ vector<Json> Json::parse_multi(const string &in,
  * Shape-checking
  */
 
+static const char * type_name(Json::Type type) {
+    switch (type) {
+    case Json::NUL:    return "null";
+    case Json::NUMBER: return "number";
+    case Json::BOOL:   return "bool";
+    case Json::STRING: return "string";
+    case Json::ARRAY:  return "array";
+    case Json::OBJECT: return "object";
+    }
+    return "unknown";
+}
+
+// A direct lookup per key: building a JsonSchema here would cost more than the check itself.
+// Errors are worded like JsonSchema::validate() ones.
 bool Json::has_shape(const shape & types, string & err) const {
     if (!is_object()) {
-        err = "expected JSON object, got " + dump();
+        err = string("expected JSON object, got ") + type_name(type());
         return false;
     }
 
     const auto& obj_items = object_items();
     for (auto & item : types) {
         const auto it = obj_items.find(item.first);
-        if (it == obj_items.cend() || it->second.type() != item.second) {
-            err = "bad type for " + item.first + " in " + dump();
+        if (it == obj_items.cend()) {
+            err = "missing " + item.first;
+            return false;
+        }
+        if (it->second.type() != item.second) {
+            err = "bad type for " + item.first + ": expected " + type_name(item.second)
+                + ", got " + type_name(it->second.type());
             return false;
         }
     }
@@ -787,4 +1108,189 @@ bool Json::has_shape(const shape & types, string & err) const {
     return true;
 }
 
+static string number_string(double value) {
+    string out;
+    dump(value, out);
+    return out;
+}
+
+JsonSchema & JsonSchema::field(const string &key, Json::Type type, bool required) {
+    auto it = std::find_if(m_rules.begin(), m_rules.end(),
+                           [&](const Rule &rule) { return rule.key == key; });
+    if (it == m_rules.end())
+        it = m_rules.insert(m_rules.end(), Rule { key, type, required, false, 0, 0, -1 });
+    else
+        *it = Rule { key, type, required, false, 0, 0, -1 };
+    m_last_key = key;
+    compile();
+    return *this;
+}
+
+JsonSchema & JsonSchema::range(double min, double max) {
+    for (auto &rule : m_rules) {
+        if (rule.key == m_last_key) {
+            rule.ranged = true;
+            rule.min = min;
+            rule.max = max;
+        }
+    }
+    return *this;
+}
+
+JsonSchema & JsonSchema::size_product(const string &array_key,
+                                      const string &a_key,
+                                      const string &b_key) {
+    const string last_key = m_last_key;
+    const auto declare = [&](const string &key, Json::Type type) {
+        for (const auto &rule : m_rules)
+            if (rule.key == key) return;
+        field(key, type, false);
+    };
+    declare(array_key, Json::ARRAY);
+    declare(a_key, Json::NUMBER);
+    declare(b_key, Json::NUMBER);
+    m_last_key = last_key;
+    m_products.push_back(Product { array_key, a_key, b_key, -1, -1, -1 });
+    compile();
+    return *this;
+}
+
+int JsonSchema::slot_for(const string &key) {
+    for (auto &rule : m_rules) {
+        if (rule.key != key)
+            continue;
+        if (rule.slot < 0)
+            rule.slot = m_slots++;
+        return rule.slot;
+    }
+    return -1;
+}
+
+/* compile()
+ *
+ * Sort the rules in Json::object order and give every key used by a product constraint a
+ * slot in the value table, so validate() never has to look a key up.
+ */
+void JsonSchema::compile() {
+    std::sort(m_rules.begin(), m_rules.end(),
+              [](const Rule &a, const Rule &b) { return a.key < b.key; });
+    m_slots = 0;
+    for (auto &rule : m_rules)
+        rule.slot = -1;
+    for (auto &product : m_products) {
+        product.array_slot = slot_for(product.array_key);
+        product.a_slot = slot_for(product.a_key);
+        product.b_slot = slot_for(product.b_key);
+    }
+}
+
+bool JsonSchema::validate(const Json &json, string &err) const {
+    // What went wrong, kept until the end so the message is only built on failure.
+    enum { OK, NOT_OBJECT, MISSING, BAD_TYPE, OUT_OF_RANGE, BAD_PRODUCT } failure = OK;
+    const Rule *bad_rule = nullptr;
+    const Product *bad_product = nullptr;
+    double bad_value = 0;
+
+    static const int max_stack_slots = 16;
+    double stack_slots[max_stack_slots];
+    vector<double> heap_slots;
+    double *slots = stack_slots;
+    if (m_slots > max_stack_slots) {
+        heap_slots.resize(m_slots);
+        slots = heap_slots.data();
+    }
+    std::fill(slots, slots + m_slots, std::numeric_limits<double>::quiet_NaN());
+
+    if (!json.is_object()) {
+        failure = NOT_OBJECT;
+    } else {
+        // Both sides are sorted by key: walk them together once.
+        const auto &items = json.object_items();
+        auto item = items.begin();
+        for (const auto &rule : m_rules) {
+            int cmp = -1;
+            while (item != items.end() && (cmp = item->first.compare(rule.key)) < 0)
+                ++item;
+            if (item == items.end() || cmp != 0) {
+                if (rule.required) {
+                    failure = MISSING;
+                    bad_rule = &rule;
+                    break;
+                }
+                continue;
+            }
+
+            const Json &value = item->second;
+            ++item;
+            if (value.type() != rule.type) {
+                failure = BAD_TYPE;
+                bad_rule = &rule;
+                bad_value = value.type();
+                break;
+            }
+            if (!rule.ranged && rule.slot < 0)
+                continue;
+
+            double measure;
+            switch (rule.type) {
+            case Json::NUMBER: measure = value.number_value();                       break;
+            case Json::STRING: measure = static_cast<double>(value.string_value().size()); break;
+            case Json::ARRAY:  measure = static_cast<double>(value.array_items().size());  break;
+            case Json::OBJECT: measure = static_cast<double>(value.object_items().size()); break;
+            default:           measure = 0;                                          break;
+            }
+            if (rule.ranged && !(measure >= rule.min && measure <= rule.max)) {
+                failure = OUT_OF_RANGE;
+                bad_rule = &rule;
+                bad_value = measure;
+                break;
+            }
+            if (rule.slot >= 0)
+                slots[rule.slot] = measure;
+        }
+    }
+
+    if (failure == OK) {
+        for (const auto &product : m_products) {
+            const double size = slots[product.array_slot];
+            const double a = slots[product.a_slot];
+            const double b = slots[product.b_slot];
+            if (std::isnan(size) || std::isnan(a) || std::isnan(b))
+                continue;
+            if (size != a * b) {
+                failure = BAD_PRODUCT;
+                bad_product = &product;
+                bad_value = size;
+                break;
+            }
+        }
+    }
+
+    switch (failure) {
+    case OK:
+        return true;
+    case NOT_OBJECT:
+        err = string("expected JSON object, got ") + type_name(json.type());
+        break;
+    case MISSING:
+        err = "missing " + bad_rule->key;
+        break;
+    case BAD_TYPE:
+        err = "bad type for " + bad_rule->key + ": expected " + type_name(bad_rule->type)
+            + ", got " + type_name(static_cast<Json::Type>(static_cast<int>(bad_value)));
+        break;
+    case OUT_OF_RANGE:
+        err = (bad_rule->type == Json::NUMBER ? "" : "size of ") + bad_rule->key
+            + " is " + number_string(bad_value) + ", expected " + number_string(bad_rule->min)
+            + " to " + number_string(bad_rule->max);
+        break;
+    case BAD_PRODUCT:
+        err = "size of " + bad_product->array_key + " is " + number_string(bad_value)
+            + ", expected " + bad_product->a_key + " * " + bad_product->b_key + " = "
+            + number_string(slots[bad_product->a_slot] * slots[bad_product->b_slot]);
+        break;
+    }
+    return false;
+}
+
 } // namespace json11
@@ -50,10 +50,12 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
 #include <memory>
+#include <functional>
 #include <initializer_list>
 
 #ifdef _MSC_VER
@@ -70,10 +72,24 @@
 
 namespace json11 {
 
+/* JsonParse
+ *
+ * Parse options, combinable with |.
+ *
+ * RAW_NUMBERS parses plain integers straight to int64, without strtod, so they keep their full
+ * precision (int64_value(), uint32_value()). Other numbers keep a copy of their text, converted
+ * only when read, to whichever type is asked for. dump() writes numbers back as they were.
+ */
 enum JsonParse {
-    STANDARD, COMMENTS
+    STANDARD = 0,
+    COMMENTS = 1 << 0,
+    RAW_NUMBERS = 1 << 1
 };
 
+inline JsonParse operator|(JsonParse a, JsonParse b) {
+    return static_cast<JsonParse>(static_cast<int>(a) | static_cast<int>(b));
+}
+
 class JsonValue;
 
 class Json final {
@@ -87,6 +103,26 @@ public:
     typedef std::vector<Json> array;
     typedef std::map<std::string, Json> object;
 
+    /* Key
+     *
+     * An object key with its hash computed once, for lookups repeated in hot loops or every
+     * frame. Objects with many keys build a hash index the first time they are looked up
+     * (by Key or by string), after which a lookup is a probe of that index.
+     *
+     *     static const Json::Key width_key("width");
+     *     int width = layer[width_key].int_value();
+     */
+    class Key final {
+    public:
+        explicit Key(const std::string &str) : m_str(str), m_hash(std::hash<std::string>()(str)) {}
+        explicit Key(const char *str) : Key(std::string(str)) {}
+        const std::string &str() const { return m_str; }
+        size_t hash() const { return m_hash; }
+    private:
+        std::string m_str;
+        size_t m_hash;
+    };
+
     // Constructors for the various types of JSON value.
     Json() noexcept;                // NUL
     Json(std::nullptr_t) noexcept;  // NUL
@@ -137,6 +173,10 @@ public:
     // can both be applied to a NUMBER-typed object.
     double number_value() const;
     int int_value() const;
+    // Integer helpers that keep the full value of RAW_NUMBERS numbers (see JsonParse).
+    // uint32_value() wraps like a C cast, which suits Tiled GIDs with flip flags set.
+    int64_t int64_value() const;
+    uint32_t uint32_value() const;
 
     // Return the enclosed value if this is a boolean, false otherwise.
     bool bool_value() const;
@@ -151,6 +191,7 @@ public:
     const Json & operator[](size_t i) const;
     // Return a reference to obj[key] if this is an object, Json() otherwise.
     const Json & operator[](const std::string &key) const;
+    const Json & operator[](const Key &key) const;
 
     // Serialize.
     void dump(std::string &out) const;
@@ -159,6 +200,14 @@ public:
         dump(out);
         return out;
     }
+    // Serialize, breaking arrays of integers longer than row_length into lines of row_length
+    // items (the layout of Tiled's CSV tile data). row_length == 0 is the same as dump(out).
+    void dump(std::string &out, size_t row_length) const;
+    // Append count integers as a JSON array, exactly as dump(out, row_length) would write a
+    // Json::array of them. Writes tile layers without building a Json::array first.
+    // brackets == false leaves out '[' and ']': the items of an array written in parts.
+    static void dump_array(const uint32_t *values, size_t count,
+                           std::string &out, size_t row_length = 0, bool brackets = true);
 
     // Parse. If parse fails, return Json() and assign an error message to err.
     static Json parse(const std::string & in,
@@ -200,32 +249,101 @@ public:
      *
      * Return true if this is a JSON object and, for each item in types, has a field of
      * the given type. If not, return false and set err to a descriptive message.
+     * For checks run more than once, build a JsonSchema once and validate() with it.
      */
     typedef std::initializer_list<std::pair<std::string, Type>> shape;
     bool has_shape(const shape & types, std::string & err) const;
 
 private:
+    friend class JsonInt64;
+    friend class JsonRawNumber;
+    friend class JsonArray;
+    explicit Json(std::shared_ptr<JsonValue> ptr) noexcept : m_ptr(std::move(ptr)) {}
+
     std::shared_ptr<JsonValue> m_ptr;
 };
 
+/* JsonSchema
+ *
+ * A small subset of JSON Schema for objects: required/optional keys with a type, an inclusive
+ * range on numbers (or on the size of strings and arrays), and array sizes that must equal the
+ * product of two number fields (Tiled's data.size() == width * height).
+ *
+ * The rules are compiled once, when the schema is built, into a table sorted the same way as
+ * Json::object, so validate() checks an object in a single merge pass over its items with no
+ * per-key lookups. Error strings are only formatted when validation fails, and never contain a
+ * dump() of the object being checked.
+ *
+ *     static const JsonSchema layer = JsonSchema()
+ *         .field("width", Json::NUMBER).range(0, 65536)
+ *         .field("height", Json::NUMBER).range(0, 65536)
+ *         .field("data", Json::ARRAY)
+ *         .size_product("data", "width", "height");
+ */
+class JsonSchema final {
+public:
+    // Add a key that must (or may) be present with the given type.
+    JsonSchema & field(const std::string &key, Json::Type type, bool required = true);
+    // Restrict the last added field: number value, or string/array size, in [min, max].
+    JsonSchema & range(double min, double max);
+    // Require array_key.size() == a_key * b_key when all three are present.
+    JsonSchema & size_product(const std::string &array_key,
+                              const std::string &a_key,
+                              const std::string &b_key);
+
+    // Return true if json is an object matching this schema. If not, return false and set
+    // err to a descriptive message about the first rule that failed.
+    bool validate(const Json &json, std::string &err) const;
+
+private:
+    struct Rule {
+        std::string key;
+        Json::Type type;
+        bool required;
+        bool ranged;
+        double min, max;
+        int slot;       // index into the per-validation value table, -1 if unused
+    };
+    struct Product {
+        std::string array_key, a_key, b_key;
+        int array_slot, a_slot, b_slot;
+    };
+
+    void compile();
+    int slot_for(const std::string &key);
+
+    std::vector<Rule> m_rules;          // sorted by key, like Json::object
+    std::vector<Product> m_products;
+    std::string m_last_key;
+    int m_slots = 0;
+};
+
 // Internal class hierarchy - JsonValue objects are not exposed to users of this API.
 class JsonValue {
 protected:
     friend class Json;
     friend class JsonInt;
     friend class JsonDouble;
+    friend class JsonInt64;
+    friend class JsonRawNumber;
+    friend class JsonArray;
     virtual Json::Type type() const = 0;
     virtual bool equals(const JsonValue * other) const = 0;
     virtual bool less(const JsonValue * other) const = 0;
-    virtual void dump(std::string &out) const = 0;
+    virtual void dump(std::string &out, size_t row_length) const = 0;
+    // If this number dumps as plain integer digits, set value and return true.
+    virtual bool integer(int64_t &value) const;
     virtual double number_value() const;
     virtual int int_value() const;
+    virtual int64_t int64_value() const;
+    virtual uint32_t uint32_value() const;
     virtual bool bool_value() const;
     virtual const std::string &string_value() const;
     virtual const Json::array &array_items() const;
     virtual const Json &operator[](size_t i) const;
     virtual const Json::object &object_items() const;
     virtual const Json &operator[](const std::string &key) const;
+    virtual const Json &operator[](const Json::Key &key) const;
     virtual ~JsonValue() {}
 };
 
@@ -41,6 +41,7 @@
 #include <unordered_map>
 #include <algorithm>
 #include <type_traits>
+#include <limits>
 
 // Insert user-defined prefix code (includes, function declarations, etc)
 // to set up a custom test suite
@@ -224,6 +225,92 @@ JSON11_TEST_CASE(json11_test) {
         }
     }
 
+    {
+        const string raw_test = R"([12345678901234567, 1.50, -3, 3221225479, 2e3, 0])";
+        Json raw = Json::parse(raw_test, err, JsonParse::RAW_NUMBERS);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(raw.dump() == "[12345678901234567, 1.50, -3, 3221225479, 2e3, 0]");
+        JSON11_TEST_ASSERT(raw[0].int64_value() == 12345678901234567LL);
+        JSON11_TEST_ASSERT(raw[1].number_value() == 1.5);
+        JSON11_TEST_ASSERT(raw[1].int_value() == 1);
+        JSON11_TEST_ASSERT(raw[2].int_value() == -3);
+        JSON11_TEST_ASSERT(raw[2].int64_value() == -3);
+        JSON11_TEST_ASSERT(raw[3].uint32_value() == 3221225479u);
+        JSON11_TEST_ASSERT(raw[4].int_value() == 2000);
+        JSON11_TEST_ASSERT(raw[2] == Json(-3));
+        JSON11_TEST_ASSERT(raw[1] == Json(1.5));
+        JSON11_TEST_ASSERT(Json::parse(raw_test, err) == raw);
+        JSON11_TEST_ASSERT(Json::parse("3221225479", err).uint32_value() == 3221225479u);
+
+        Json raw_comment = Json::parse("[1, /* two */ 2.0]", err,
+                                       JsonParse::COMMENTS | JsonParse::RAW_NUMBERS);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(raw_comment.dump() == "[1, 2.0]");
+        JSON11_TEST_ASSERT(Json::parse("[01]", err, JsonParse::RAW_NUMBERS).is_null());
+
+        // Integers are converted while parsing, exactly; others keep their text.
+        err.clear();
+        const string edge_test = R"([-9223372036854775808, 9223372036854775807, 9223372036854775808, -0, 1e300, -1e300])";
+        Json edge = Json::parse(edge_test, err, JsonParse::RAW_NUMBERS);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(edge.dump() == edge_test);
+        JSON11_TEST_ASSERT(edge[0].int64_value() == std::numeric_limits<int64_t>::min());
+        JSON11_TEST_ASSERT(edge[1].int64_value() == std::numeric_limits<int64_t>::max());
+        JSON11_TEST_ASSERT(edge[2].int64_value() == std::numeric_limits<int64_t>::max());
+        JSON11_TEST_ASSERT(edge[3].int64_value() == 0);
+        JSON11_TEST_ASSERT(edge[4].int64_value() == std::numeric_limits<int64_t>::max());
+        JSON11_TEST_ASSERT(edge[5].int64_value() == std::numeric_limits<int64_t>::min());
+        JSON11_TEST_ASSERT(Json(1e300).int64_value() == std::numeric_limits<int64_t>::max());
+        JSON11_TEST_ASSERT(Json(-1e300).uint32_value() == 0);
+        JSON11_TEST_ASSERT(Json(std::numeric_limits<double>::quiet_NaN()).int64_value() == 0);
+    }
+
+    {
+        const Json::Key k2("k2"), missing("missing");
+        JSON11_TEST_ASSERT(json[k2] == Json(42));
+        JSON11_TEST_ASSERT(json[missing].is_null());
+        JSON11_TEST_ASSERT(Json(42)[k2].is_null());
+
+        Json::object items;
+        for (int i = 0; i < 100; i++)
+            items["key" + std::to_string(i)] = i;
+        const Json big = items;
+        for (int i = 0; i < 100; i++) {
+            const Json::Key key("key" + std::to_string(i));
+            JSON11_TEST_ASSERT(big[key].int_value() == i);
+            JSON11_TEST_ASSERT(big["key" + std::to_string(i)].int_value() == i);
+        }
+        JSON11_TEST_ASSERT(big[missing].is_null());
+        JSON11_TEST_ASSERT(big["key100"].is_null());
+    }
+
+    {
+        const Json ints = Json::array { 0, 7, -12, 345, 2147483647, -2147483647 - 1, 4294967295.0 };
+        JSON11_TEST_ASSERT(ints.dump() == "[0, 7, -12, 345, 2147483647, -2147483648, 4294967295]");
+        const Json doubles = Json::array { 1.5, -0.0, 1e17, 99.0 };
+        JSON11_TEST_ASSERT(doubles.dump() == "[1.5, -0, 1e+17, 99]");
+
+        const Json layer = Json::object {
+            { "data", Json::array { 1, 2, 3, 4, 5, 6 } },
+            { "mixed", Json::array { 1, "a", 3, 4 } },
+        };
+        string wrapped;
+        layer.dump(wrapped, 3);
+        JSON11_TEST_ASSERT(wrapped == "{\"data\": [1, 2, 3,\n4, 5, 6], \"mixed\": [1, \"a\", 3, 4]}");
+        JSON11_TEST_ASSERT(layer.dump() == "{\"data\": [1, 2, 3, 4, 5, 6], \"mixed\": [1, \"a\", 3, 4]}");
+
+        const uint32_t gids[] = { 1, 3221225479u, 0, 20 };
+        string gids_json;
+        Json::dump_array(gids, 4, gids_json, 2);
+        JSON11_TEST_ASSERT(gids_json == "[1, 3221225479,\n0, 20]");
+        gids_json.clear();
+        Json::dump_array(gids, 0, gids_json);
+        JSON11_TEST_ASSERT(gids_json == "[]");
+        gids_json.clear();
+        Json::dump_array(gids, 4, gids_json, 2, false);
+        JSON11_TEST_ASSERT(gids_json == "1, 3221225479,\n0, 20");
+    }
+
     Json my_json = Json::object {
         { "key1", "value1" },
         { "key2", false },
@@ -249,6 +336,38 @@ JSON11_TEST_CASE(json11_test) {
     JSON11_TEST_ASSERT(((Json)(Json::object { { "foo", nullptr } })).has_shape({ { "foo", Json::NUL } }, err) == true);
     JSON11_TEST_ASSERT(((Json)(Json::object { { "foo", 1234567 } })).has_shape({ { "foo", Json::NUL } }, err) == false);
     JSON11_TEST_ASSERT(((Json)(Json::object { { "bar", 1234567 } })).has_shape({ { "foo", Json::NUL } }, err) == false);
+    JSON11_TEST_ASSERT(err == "missing foo");
+    JSON11_TEST_ASSERT(((Json)(Json::object { { "foo", 1 } })).has_shape({ { "foo", Json::STRING } }, err) == false);
+    JSON11_TEST_ASSERT(err == "bad type for foo: expected string, got number");
+    JSON11_TEST_ASSERT(((Json)(Json::array { 1 })).has_shape({ { "foo", Json::NUL } }, err) == false);
+    JSON11_TEST_ASSERT(err == "expected JSON object, got array");
+
+    const JsonSchema layer_schema = JsonSchema()
+        .field("name", Json::STRING)
+        .field("width", Json::NUMBER).range(0, 1000)
+        .field("height", Json::NUMBER).range(0, 1000)
+        .field("data", Json::ARRAY)
+        .field("opacity", Json::NUMBER, false).range(0, 1)
+        .size_product("data", "width", "height");
+    const Json good_layer = Json::object {
+        { "name", "ground" }, { "width", 2 }, { "height", 2 },
+        { "data", Json::array { 1, 2, 3, 4 } }, { "visible", true },
+    };
+    JSON11_TEST_ASSERT(layer_schema.validate(good_layer, err));
+    JSON11_TEST_ASSERT(!layer_schema.validate(Json::array {}, err));
+    JSON11_TEST_ASSERT(err == "expected JSON object, got array");
+    JSON11_TEST_ASSERT(!layer_schema.validate(Json::object { { "name", "x" } }, err));
+    JSON11_TEST_ASSERT(err == "missing data");
+    JSON11_TEST_ASSERT(!layer_schema.validate(Json::object {
+        { "name", 1 }, { "width", 0 }, { "height", 0 }, { "data", Json::array {} } }, err));
+    JSON11_TEST_ASSERT(err == "bad type for name: expected string, got number");
+    JSON11_TEST_ASSERT(!layer_schema.validate(Json::object {
+        { "name", "x" }, { "width", 2 }, { "height", 2 }, { "opacity", 1.5 },
+        { "data", Json::array { 1, 2, 3, 4 } } }, err));
+    JSON11_TEST_ASSERT(err == "opacity is 1.5, expected 0 to 1");
+    JSON11_TEST_ASSERT(!layer_schema.validate(Json::object {
+        { "name", "x" }, { "width", 2 }, { "height", 3 }, { "data", Json::array { 1, 2, 3, 4 } } }, err));
+    JSON11_TEST_ASSERT(err == "size of data is 4, expected width * height = 6");
 
 }
 